@@ -32,9 +32,15 @@ project "MouseTracker"
         "opengl32",
         "shell32",
         "ole32",
-        "uuid"
+        "uuid",
+        "winmm"
     }
 
+    filter "system:linux"
+        defines "X11"
+        links { "X11", "Xi" }
+    filter {}
+
     -- gcc* clang* msc*
     filter "toolset:msc*"
         warnings "High"
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "TrackJournal.h"
+#include "TrackFile.h"
+#include "Autosave.h"
+#include "Log.h"
+
+Autosave::Autosave(const std::filesystem::path& path, std::chrono::seconds interval)
+    : m_Path(path), m_Journal(path.string() + ".journal"), m_Interval(interval), m_Last(std::chrono::steady_clock::now())
+{
+    Log << "{Autosave} Saving every " << interval.count() << " s to [" << m_Path << "]" << std::endl;
+}
+
+
+Autosave::~Autosave()
+{
+    // a running checkpoint is finished, not abandoned
+    if (m_Thread.joinable())
+        m_Thread.join();
+}
+
+
+void Autosave::Update(StrokeCanvas& canvas, bool now)
+{
+    if (!now && (Busy() || std::chrono::steady_clock::now() - m_Last < m_Interval))
+        return;
+    if (m_Thread.joinable())
+        m_Thread.join();
+
+    m_Last = std::chrono::steady_clock::now();
+    m_Checkpoint = canvas.TakeCheckpoint(m_Full);
+    if (!m_Checkpoint.has_value())
+        return;
+    m_Busy.store(true, std::memory_order_release);
+    m_Thread = std::thread(&Autosave::Run, this);
+}
+
+
+void Autosave::Run()
+{
+    const auto start = std::chrono::steady_clock::now();
+    const bool full = m_Checkpoint->full.has_value();
+    const bool ok = full ? WriteTrack(*m_Checkpoint->full) : AppendTiles(*m_Checkpoint);
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (ok && full)
+        Log << "{Autosave} Wrote " << m_TrackBytes << " bytes in " << ms << " ms [" << m_Path << "]" << std::endl;
+    else if (ok)
+        Log << "{Autosave} Appended " << m_Checkpoint->tiles.size() << " tile(s) in " << ms << " ms, the journal has " << m_JournalBytes << " bytes" << std::endl;
+    else
+        Err << "{Autosave} Failed to write the checkpoint, the next one writes everything [" << m_Path << "]" << std::endl;
+
+    // a failed append may have left a torn checkpoint behind, the journal starts over with the next track
+    m_Full = !ok || m_JournalBytes > std::max(m_TrackBytes, MinCompaction);
+    m_Checkpoint.reset();
+    m_Busy.store(false, std::memory_order_release);
+}
+
+
+// The new track is written next to the old one, which stays valid together
+// with its journal until the rename. A journal that doesn't belong to the
+// track is ignored, so a crash before the new journal exists loses nothing.
+bool Autosave::WriteTrack(const Canvas& canvas)
+{
+    const std::filesystem::path tmp = m_Path.string() + ".tmp";
+    if (!canvas.SaveTrack(tmp, 1) || !TrackJournal::Sync(tmp) || !TrackJournal::Replace(tmp, m_Path))
+        return false;
+
+    TrackFile track;
+    const std::optional<std::string> errorMsg = track.Open(m_Path);
+    if (errorMsg.has_value())
+    {
+        Err << "{Autosave} Failed to read back the track: " << errorMsg.value() << std::endl;
+        return false;
+    }
+    std::error_code ec;
+    m_TrackBytes = std::filesystem::file_size(m_Path, ec);
+    m_JournalBytes = TrackJournal::FileHeaderBytes;
+    return TrackJournal::Create(m_Journal, track.Id());
+}
+
+
+bool Autosave::AppendTiles(const StrokeCanvas::Checkpoint& checkpoint)
+{
+    std::vector<unsigned char> payload;
+    std::vector<unsigned char> planar;
+    std::vector<unsigned char> stored;
+    for (const Canvas::TileCopy& tile : checkpoint.tiles)
+    {
+        if (tile.data == nullptr)
+        {
+            TrackJournal::PutTile(payload, tile.index, nullptr, 0);
+            continue;
+        }
+        TrackFile::Pack(checkpoint.header, reinterpret_cast<const unsigned char*>(tile.data.get()), planar, stored);
+        TrackJournal::PutTile(payload, tile.index, stored.data(), stored.size());
+    }
+    if (!TrackJournal::Append(m_Journal, (uint32_t)checkpoint.tiles.size(), payload))
+        return false;
+    m_JournalBytes += TrackJournal::CheckpointHeaderBytes + payload.size();
+    return true;
+}
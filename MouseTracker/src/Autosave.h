@@ -0,0 +1,61 @@
+#pragma once
+#include <system_error>
+#include <filesystem>
+#include <optional>
+#include <cstdint>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#include "StrokeCanvas.h"
+
+// Periodically persists the image to a track and a journal next to it (see
+// TrackJournal). A checkpoint usually appends only the tiles changed since
+// the previous one to the journal, it is compacted into a new track once it
+// outgrows the track. The track is replaced by an atomic rename, so after a
+// crash the files always hold the state of the last finished checkpoint.
+// The tiles are copied on the render thread, compressing and writing them
+// happens on a worker thread.
+class Autosave
+{
+private:
+    static constexpr uint64_t MinCompaction = 4 * 1024 * 1024; // journal size that is always fine
+    std::thread m_Thread;
+    std::filesystem::path m_Path;
+    std::filesystem::path m_Journal;
+    std::chrono::seconds m_Interval;
+    std::chrono::steady_clock::time_point m_Last;
+    std::optional<StrokeCanvas::Checkpoint> m_Checkpoint;
+    std::atomic<bool> m_Busy{ false };
+    bool m_Full = true; // the next checkpoint writes a new track
+    uint64_t m_TrackBytes = 0;
+    uint64_t m_JournalBytes = 0;
+private:
+    void Run();
+    bool WriteTrack(const Canvas& canvas);
+    bool AppendTiles(const StrokeCanvas::Checkpoint& checkpoint);
+public:
+    Autosave(const std::filesystem::path& path, std::chrono::seconds interval);
+    ~Autosave();
+    Autosave(const Autosave&) = delete;
+    Autosave& operator=(const Autosave&) = delete;
+
+    // Loads the track and its journal into target (an Image or a StrokeCanvas) if
+    // there is one, nullopt if that worked or there is nothing to restore
+    template <class Target>
+    inline std::optional<std::string> Restore(Target& target) const
+    {
+        std::error_code ec;
+        if (!std::filesystem::exists(m_Path, ec))
+            return std::nullopt;
+        return target.LoadFromFile(m_Path.string(), m_Journal);
+    }
+
+    // Takes a checkpoint once the interval has passed, or right now, waiting for the
+    // previous one, if now is set. Cheap enough to be called every frame
+    void Update(StrokeCanvas& canvas, bool now = false);
+
+    inline bool Busy()                         const { return m_Busy.load(std::memory_order_acquire); }
+    inline const std::filesystem::path& Path() const { return m_Path;                                 }
+};
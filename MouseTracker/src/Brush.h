@@ -0,0 +1,167 @@
+#pragma once
+#include <type_traits>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+
+enum class BrushShape
+{
+    Square, Disc, Soft
+};
+
+
+// The pixels a stamp covers around the cursor, precomputed as row spans
+// whenever the shape or radius changes. A soft brush is a disc whose edge
+// thins out: the canvas formats only store whether (or how often) a pixel
+// was visited, so the falloff is ordered dithering. The dither pattern is
+// anchored to the canvas, not to the stamp, so overlapping stamps of a
+// stroke keep the edge soft instead of filling it up. It has one span list
+// per pattern phase for that reason.
+class Brush
+{
+public:
+    static constexpr int MaxRadius = 16;
+    struct Span
+    {
+        int dy;
+        int dx0; // [dx0, dx1) relative to the center
+        int dx1;
+    };
+private:
+    static constexpr int Phases = 4; // size of the dither pattern
+    BrushShape m_Shape = BrushShape::Square;
+    int m_Radius = 0;
+    std::vector<std::vector<Span>> m_Spans; // one list per phase (x & 3, y & 3) for Soft, a single one otherwise
+    bool m_Box = false;                     // the stamp covers the whole square of the radius
+private:
+    // Share of the pixel covered by the brush in [0, 1]
+    inline float Coverage(int dx, int dy) const
+    {
+        const float r = (float)m_Radius + 0.5f;
+        const float d = std::sqrt((float)(dx * dx + dy * dy));
+        switch (m_Shape)
+        {
+        case BrushShape::Square:
+            return 1.f;
+        case BrushShape::Disc:
+            return d <= r ? 1.f : 0.f;
+        case BrushShape::Soft:
+        default:
+        {
+            const float core = r * 0.5f; // solid up to here, falls off linearly to the edge
+            return std::clamp((r - d) / (r - core), 0.f, 1.f);
+        }
+        }
+    }
+
+
+    // Threshold of the 4x4 Bayer matrix in (0, 1)
+    static inline float DitherThreshold(int x, int y)
+    {
+        static constexpr uint8_t bayer[Phases][Phases] = { { 0, 8, 2, 10 }, { 12, 4, 14, 6 }, { 3, 11, 1, 9 }, { 15, 7, 13, 5 } };
+        return ((float)bayer[y & (Phases - 1)][x & (Phases - 1)] + 0.5f) / (float)(Phases * Phases);
+    }
+
+
+    inline void Build()
+    {
+        const size_t phases = m_Shape == BrushShape::Soft ? Phases * Phases : 1;
+        m_Spans.assign(phases, {});
+        for (size_t phase = 0; phase < phases; ++phase)
+        {
+            // pixel dx, dy of a stamp centered at a canvas position with (x & 3, y & 3) = phase
+            const int px = (int)(phase % Phases);
+            const int py = (int)(phase / Phases);
+            for (int dy = -m_Radius; dy <= m_Radius; ++dy)
+            {
+                for (int dx = -m_Radius; dx <= m_Radius;)
+                {
+                    const auto covered = [&](int x)
+                    {
+                        const float coverage = Coverage(x, dy);
+                        return phases == 1 ? coverage > 0.f : coverage > DitherThreshold(px + x, py + dy);
+                    };
+                    if (!covered(dx))
+                    {
+                        ++dx;
+                        continue;
+                    }
+                    const int dx0 = dx;
+                    while (dx <= m_Radius && covered(dx))
+                        ++dx;
+                    m_Spans[phase].push_back({ dy, dx0, dx });
+                }
+            }
+        }
+        m_Box = phases == 1 && m_Spans[0].size() == (size_t)(2 * m_Radius + 1)
+            && std::all_of(m_Spans[0].begin(), m_Spans[0].end(), [&](const Span& s) { return s.dx0 == -m_Radius && s.dx1 == m_Radius + 1; });
+    }
+
+
+    inline const std::vector<Span>& SpansAt(int x, int y) const
+    {
+        return m_Spans.size() == 1 ? m_Spans[0] : m_Spans[(size_t)((y & (Phases - 1)) * Phases + (x & (Phases - 1)))];
+    }
+public:
+    inline explicit Brush(BrushShape shape = BrushShape::Square, int radius = 0)
+        : m_Shape(shape), m_Radius(std::clamp(radius, 0, MaxRadius))
+    {
+        Build();
+    }
+
+
+    // Stamps the brush at x, y through plot.Span(y, x0, x1), clipped to width x height.
+    // plot(x, y) is used for single pixels and for squares smaller than the
+    // SpanRadius of the plot (see TileFormats).
+    template <class Plot>
+    inline void Stamp(Plot&& plot, int x, int y, int width, int height) const
+    {
+        if (m_Radius == 0)
+        {
+            plot(x, y);
+            return;
+        }
+        if (m_Box && m_Radius < std::decay_t<Plot>::SpanRadius)
+        {
+            // the bounds in locals, the pixel stores may alias the brush
+            const int x0 = std::max(x - m_Radius, 0);
+            const int x1 = std::min(x + m_Radius + 1, width);
+            const int y1 = std::min(y + m_Radius + 1, height);
+            for (int b = std::max(y - m_Radius, 0); b < y1; ++b)
+                for (int a = x0; a < x1; ++a)
+                    plot(a, b);
+            return;
+        }
+
+        const std::vector<Span>& spans = SpansAt(x, y);
+        if (x >= m_Radius && y >= m_Radius && x + m_Radius < width && y + m_Radius < height)
+        {
+            for (const Span& s : spans)
+                plot.Span(y + s.dy, x + s.dx0, x + s.dx1);
+            return;
+        }
+        for (const Span& s : spans)
+        {
+            const int sy = y + s.dy;
+            const int x0 = std::max(x + s.dx0, 0);
+            const int x1 = std::min(x + s.dx1, width);
+            if (sy >= 0 && sy < height && x0 < x1)
+                plot.Span(sy, x0, x1);
+        }
+    }
+
+
+    // Pixels covered by one stamp, over all phases for the soft brush
+    inline size_t Pixels() const
+    {
+        size_t pixels = 0;
+        for (const std::vector<Span>& spans : m_Spans)
+            for (const Span& s : spans)
+                pixels += (size_t)(s.dx1 - s.dx0);
+        return pixels / m_Spans.size();
+    }
+
+    inline BrushShape Shape() const { return m_Shape;  }
+    inline int Radius()       const { return m_Radius; }
+};
@@ -0,0 +1,920 @@
+#pragma once
+#include <filesystem>
+#include <algorithm>
+#include <optional>
+#include <cstring>
+#include <cstdint>
+#include <utility>
+#include <climits>
+#include <memory>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <array>
+#include <new>
+
+#include "stb/stb_image.h"
+
+#include "PngWriter.h"
+#include "PngReader.h"
+#include "TrackJournal.h"
+#include "TrackFile.h"
+#include "TileFormat.h"
+#include "TileArena.h"
+#include "OpaqueRects.h"
+#include "Colormap.h"
+#include "Parallel.h"
+#include "Pixels.h"
+#include "Rect.h"
+#include "Log.h"
+
+// CPU side storage of the tracking image, independent of OpenGL.
+// Pixels live in 64x64 tiles which are allocated on the first write, tiles
+// that were never written read as not visited. Tiles no monitor covers are
+// never allocated, so memory scales with the visited area and not with the
+// bounding box of all monitors.
+// How a tile stores its pixels is up to the format picked at runtime, the
+// work per pixel is done by its policy in TileFormat.h. All tiles live in
+// one TileArena, tiles of formats that are blank with all bits zero
+// (everything but RGBA8) only cost memory for the pages drawn to.
+class Canvas
+{
+public:
+    using Format = TileFormat;
+    static constexpr int TileSize = TileFormats::TileSize;
+    static constexpr int Channel = TileFormats::Channel;
+
+    struct TileCopy
+    {
+        uint32_t index = 0;
+        std::unique_ptr<uint64_t[]> data; // nullptr = blank
+    };
+private:
+    enum Coverage : unsigned char { Uncovered, Partial, Covered };
+    static constexpr int TileMask = TileSize - 1;
+    Format m_Format = Format::RGBA8;
+    int m_Width = 0;
+    int m_Height = 0;
+    int m_TilesX = 0;
+    int m_TilesY = 0;
+    TileArena m_Arena;                                // slot i holds tile i
+    std::vector<uint64_t*> m_Tiles;                   // nullptr = never written
+    std::vector<unsigned char> m_Coverage;            // Coverage of every tile by m_Monitors
+    std::vector<Rect> m_Monitors;                     // area covered by monitors, the rest is transparent, empty = everything
+    size_t m_AllocatedTiles = 0;
+    bool m_AllocationFailed = false;
+    uint16_t m_MaxCount = 0;
+    Colormap m_Colormap;
+private:
+    // The plot passed to the PaintFn of Paint()
+    template <int SpanRadiusOfFormat, class PixelFn, class SpanFn>
+    struct Plot
+    {
+        static constexpr int SpanRadius = SpanRadiusOfFormat;
+        PixelFn pixel;
+        SpanFn span;
+        inline void operator()(int x, int y)    { pixel(x, y);    }
+        inline void Span(int y, int x0, int x1) { span(y, x0, x1); }
+    };
+
+    template <int SpanRadius, class PixelFn, class SpanFn>
+    static inline Plot<SpanRadius, PixelFn, SpanFn> MakePlot(PixelFn pixel, SpanFn span)
+    {
+        return { std::move(pixel), std::move(span) };
+    }
+
+
+    static inline size_t TileBytes(Format format)
+    {
+        return VisitTileFormat(format, [](auto f) { return decltype(f)::TileBytes; });
+    }
+
+
+    // Every byte of a tile that was never written
+    static inline unsigned char Fill(Format format)
+    {
+        return VisitTileFormat(format, [](auto f) { return decltype(f)::Fill; });
+    }
+
+
+    inline size_t TileIndex(int x, int y) const
+    {
+        return (size_t)(y / TileSize) * (size_t)m_TilesX + (size_t)(x / TileSize);
+    }
+
+
+    // Tile bounds clipped to the canvas
+    inline Rect TileRect(size_t index) const
+    {
+        const int x = (int)(index % (size_t)m_TilesX) * TileSize;
+        const int y = (int)(index / (size_t)m_TilesX) * TileSize;
+        return { x, y, std::min(x + TileSize, m_Width), std::min(y + TileSize, m_Height) };
+    }
+
+
+    // Allocates the tile on first use, nullptr if no monitor covers it
+    inline uint64_t* Touch(size_t index)
+    {
+        uint64_t*& tile = m_Tiles[index];
+        if (tile != nullptr)
+            return tile;
+        if (m_Coverage[index] == Uncovered)
+            return nullptr;
+
+        tile = m_Arena.Commit(index);
+        if (tile == nullptr)
+        {
+            if (!m_AllocationFailed)
+                Err << "{Canvas} Failed to allocate tile " << index << std::endl;
+            m_AllocationFailed = true;
+            return nullptr;
+        }
+        const unsigned char fill = Fill(m_Format);
+        if (fill != 0) // the arena hands out zeroed tiles
+            std::memset(tile, fill, TileBytes(m_Format));
+        ++m_AllocatedTiles;
+        return tile;
+    }
+
+
+    // The tile reads as never written again
+    inline void ReleaseTile(size_t index)
+    {
+        if (m_Tiles[index] == nullptr)
+            return;
+        m_Arena.Release(index);
+        m_Tiles[index] = nullptr;
+        --m_AllocatedTiles;
+    }
+
+
+    // Calls fn(a, b, onMonitor) for consecutive runs of [x0, x1) in row y
+    template <class Fn>
+    inline void ForEachMonitorSpan(int y, int x0, int x1, Fn&& fn) const
+    {
+        if (m_Monitors.empty())
+        {
+            fn(x0, x1, true);
+            return;
+        }
+
+        int x = x0;
+        while (x < x1)
+        {
+            int coverEnd = x;
+            int nextStart = x1;
+            for (const Rect& r : m_Monitors)
+            {
+                if (y < r.y0 || y >= r.y1)
+                    continue;
+                if (r.x0 <= x && r.x1 > x)
+                    coverEnd = std::max(coverEnd, r.x1);
+                else if (r.x0 > x)
+                    nextStart = std::min(nextStart, r.x0);
+            }
+            const bool onMonitor = coverEnd > x;
+            const int end = std::min(onMonitor ? coverEnd : nextStart, x1);
+            fn(x, end, onMonitor);
+            x = end;
+        }
+    }
+
+
+    inline void UpdateCoverage()
+    {
+        m_Coverage.assign(m_Tiles.size(), Covered);
+        if (m_Monitors.empty())
+            return;
+
+        for (size_t i = 0; i < m_Tiles.size(); ++i)
+        {
+            const Rect t = TileRect(i);
+            size_t covered = 0;
+            for (int y = t.y0; y < t.y1; ++y)
+                ForEachMonitorSpan(y, t.x0, t.x1, [&](int a, int b, bool onMonitor) { covered += onMonitor ? (size_t)(b - a) : 0; });
+
+            if (covered == 0)
+                m_Coverage[i] = Uncovered;
+            else if (covered < (size_t)t.Width() * (size_t)t.Height())
+                m_Coverage[i] = Partial;
+
+            if (m_Coverage[i] == Uncovered)
+                ReleaseTile(i);
+        }
+    }
+
+
+    // Rows are filled on several threads while saving, each gets its own buffer
+    static inline unsigned char* RowScratch(size_t bytes)
+    {
+        thread_local std::vector<unsigned char> scratch;
+        scratch.resize(bytes);
+        return scratch.data();
+    }
+
+
+    // Averages the allocated tiles into gray tiles in the same pass that looks for
+    // transparency and stops at the first transparent pixel. slots[i] is the
+    // offset of tile i in gray, SIZE_MAX if it isn't allocated.
+    inline bool GrayTiles(std::vector<unsigned char>& gray, std::vector<size_t>& slots) const
+    {
+        static constexpr size_t TilePixels = TileSize * TileSize;
+        if (std::any_of(m_Coverage.begin(), m_Coverage.end(), [](unsigned char c) { return c != Covered; }))
+            return false;
+
+        gray.resize((size_t)std::count_if(m_Tiles.begin(), m_Tiles.end(), [](const uint64_t* t) { return t != nullptr; }) * TilePixels);
+        slots.assign(m_Tiles.size(), SIZE_MAX);
+        size_t offset = 0;
+        for (size_t i = 0; i < m_Tiles.size(); ++i)
+        {
+            if (m_Tiles[i] == nullptr)
+                continue;
+            if (!Pixels::GrayIfOpaque(reinterpret_cast<const unsigned char*>(m_Tiles[i]), TilePixels, &gray[offset]))
+                return false; // loaded images may carry their own alpha
+            slots[i] = offset;
+            offset += TilePixels;
+        }
+        return true;
+    }
+
+
+    inline bool SaveRGBA(const char* path, const PngOptions& options, std::atomic<int>* rowsDone) const
+    {
+        std::vector<unsigned char> gray;
+        std::vector<size_t> slots;
+        if (!GrayTiles(gray, slots))
+            return WritePng(path, m_Width, m_Height, { PngColor::RGBA, 8 }, [&](int y, unsigned char* row) { ExpandRow(y, 0, m_Width, row); }, options, rowsDone);
+
+        return WritePng(path, m_Width, m_Height, { PngColor::Gray, 8 }, [&](int y, unsigned char* row)
+        {
+            const size_t ly = (size_t)(y & TileMask);
+            for (int x = 0; x < m_Width; x += TileSize)
+            {
+                const size_t n = (size_t)std::min(TileSize, m_Width - x);
+                const size_t slot = slots[TileIndex(x, y)];
+                if (slot == SIZE_MAX)
+                    std::memset(row + x, 255, n);
+                else
+                    std::memcpy(row + x, &gray[slot + ly * TileSize], n);
+            }
+        }, options, rowsDone);
+    }
+
+
+    inline bool SaveBit1(const char* path, const PngOptions& options, std::atomic<int>* rowsDone) const
+    {
+        // 1 = white, pixels are stored msb first, our bits are lsb first and 1 = visited
+        static const auto reversed = []()
+        {
+            std::array<unsigned char, 256> t{};
+            for (int i = 0; i < 256; ++i)
+                for (int b = 0; b < 8; ++b)
+                    if (i & (1 << b))
+                        t[(size_t)i] |= (unsigned char)(0x80 >> b);
+            return t;
+        }();
+
+        if (!AlphaIsNeeded())
+        {
+            return WritePng(path, m_Width, m_Height, { PngColor::Gray, 1 }, [&](int y, unsigned char* row)
+            {
+                const size_t rowBytes = ((size_t)m_Width + 7) / 8;
+                for (int tx = 0; tx < m_TilesX; ++tx)
+                {
+                    const uint64_t* tile = m_Tiles[TileIndex(tx * TileSize, y)];
+                    const uint64_t bits = tile == nullptr ? 0 : tile[y & TileMask];
+                    for (size_t i = 0; i < 8 && (size_t)tx * 8 + i < rowBytes; ++i)
+                        row[(size_t)tx * 8 + i] = (unsigned char)~reversed[(bits >> (i * 8)) & 0xFF];
+                }
+            }, options, rowsDone);
+        }
+
+        // 2 bit gray: 0 visited, 3 not visited, 1 off monitor (transparent)
+        return WritePng(path, m_Width, m_Height, { PngColor::Gray, 2, 1 }, [&](int y, unsigned char* row)
+        {
+            unsigned char* rgba = RowScratch((size_t)m_Width * Channel);
+            ExpandRow(y, 0, m_Width, rgba);
+            std::memset(row, 0, ((size_t)m_Width + 3) / 4);
+            for (size_t x = 0; x < (size_t)m_Width; ++x)
+            {
+                const unsigned char* p = &rgba[x * Channel];
+                const int v = p[3] == 0 ? 1 : p[0] == 0 ? 0 : 3;
+                row[x >> 2] |= (unsigned char)(v << (6 - 2 * (x & 3)));
+            }
+        }, options, rowsDone);
+    }
+
+
+    // Writes the colormapped counts, the counts themselves can't be stored in a png
+    inline bool SaveHeatmap(const char* path, const PngOptions& options, std::atomic<int>* rowsDone) const
+    {
+        if (AlphaIsNeeded())
+            return WritePng(path, m_Width, m_Height, { PngColor::RGBA, 8 }, [&](int y, unsigned char* row) { ExpandRow(y, 0, m_Width, row); }, options, rowsDone);
+
+        return WritePng(path, m_Width, m_Height, { PngColor::RGB, 8 }, [&](int y, unsigned char* row)
+        {
+            unsigned char* rgba = RowScratch((size_t)m_Width * Channel);
+            ExpandRow(y, 0, m_Width, rgba);
+            for (size_t x = 0; x < (size_t)m_Width; ++x)
+                std::memcpy(row + x * 3, &rgba[x * Channel], 3);
+        }, options, rowsDone);
+    }
+
+
+    // The tiles hold the gray levels already, only off monitor pixels need another channel
+    inline bool SaveGray(const char* path, const PngOptions& options, std::atomic<int>* rowsDone) const
+    {
+        if (AlphaIsNeeded())
+        {
+            return WritePng(path, m_Width, m_Height, { PngColor::GrayAlpha, 8 }, [&](int y, unsigned char* row)
+            {
+                unsigned char* rgba = RowScratch((size_t)m_Width * Channel);
+                ExpandRow(y, 0, m_Width, rgba);
+                for (size_t x = 0; x < (size_t)m_Width; ++x)
+                {
+                    row[x * 2] = rgba[x * Channel];
+                    row[x * 2 + 1] = rgba[x * Channel + 3];
+                }
+            }, options, rowsDone);
+        }
+
+        return WritePng(path, m_Width, m_Height, { PngColor::Gray, 8 }, [&](int y, unsigned char* row)
+        {
+            for (int x = 0; x < m_Width; x += TileSize)
+            {
+                const size_t n = (size_t)std::min(TileSize, m_Width - x);
+                const uint64_t* tile = m_Tiles[TileIndex(x, y)];
+                if (tile == nullptr)
+                    std::memset(row + x, 255, n);
+                else
+                    TileFormats::Gray8::Gray(tile, 0, y & TileMask, n, row + x);
+            }
+        }, options, rowsDone);
+    }
+
+
+    // A tile that holds nothing but the value of a new one
+    inline bool Blank(const uint64_t* tile) const
+    {
+        const unsigned char fill = Fill(m_Format);
+        uint64_t blank;
+        std::memset(&blank, fill, sizeof(blank));
+        return std::all_of(tile, tile + TileBytes(m_Format) / sizeof(uint64_t), [blank](uint64_t v) { return v == blank; });
+    }
+
+
+    // Row y of the image with F::LoadChannels per pixel (RGBA for RGBA8, gray and
+    // alpha for Gray8), pixels that leave tiles that aren't allocated yet blank are skipped
+    template <class F>
+    inline void LoadRow(int y, const unsigned char* pixels)
+    {
+        constexpr size_t channels = F::LoadChannels;
+        const int ly = y & TileMask;
+        for (int x = 0; x < m_Width; x += TileSize)
+        {
+            const size_t index = TileIndex(x, y);
+            const size_t n = (size_t)std::min(TileSize, m_Width - x);
+            const unsigned char* src = pixels + (size_t)x * channels;
+            if (m_Tiles[index] == nullptr && F::LoadsBlank(src, n))
+                continue;
+            if (uint64_t* tile = Touch(index))
+                F::Load(tile, ly, src, n);
+        }
+    }
+
+
+    // The compact formats only need the brightness and the alpha, transparent pixels
+    // are never visited. Their alpha comes from the monitor layout, so a canvas without
+    // one takes the opaque area of an image with transparent pixels as its layout.
+    // A heatmap png only holds colors, visited pixels start with a count of one.
+    template <class ReadFn>
+    inline void LoadRows(ReadFn&& read)
+    {
+        if (m_Format == Format::RGBA8)
+        {
+            read(Channel, [&](int y, const unsigned char* rgba) { LoadRow<TileFormats::Rgba8>(y, rgba); });
+            return;
+        }
+
+        OpaqueRects opaque(m_Width);
+        if (m_Format == Format::Gray8)
+        {
+            read(2, [&](int y, const unsigned char* grayAlpha)
+            {
+                LoadRow<TileFormats::Gray8>(y, grayAlpha);
+                opaque.AddRow(y, grayAlpha);
+            });
+        }
+        else
+        {
+            Paint([&](auto&& plot)
+            {
+                read(2, [&](int y, const unsigned char* grayAlpha)
+                {
+                    for (int x = 0; x < m_Width; ++x)
+                        if (grayAlpha[x * 2] < 128 && grayAlpha[x * 2 + 1] >= 128)
+                            plot(x, y);
+                    opaque.AddRow(y, grayAlpha);
+                });
+            });
+        }
+
+        std::optional<std::vector<Rect>> layout = opaque.Layout();
+        if (m_Monitors.empty() && layout.has_value())
+            SetMonitors(std::move(layout.value()));
+    }
+
+
+    inline std::optional<std::string> LoadPng(PngReader& png)
+    {
+        Clear();
+        std::optional<std::string> errorMsg;
+        LoadRows([&](int channels, auto&& onRow) { errorMsg = png.ReadRows(channels, onRow); });
+        return errorMsg;
+    }
+
+
+    // Formats other than PNG are decoded in full first
+    inline std::optional<std::string> LoadDecoded(const std::string& path)
+    {
+        const int channels = m_Format == Format::RGBA8 ? Channel : 2;
+        int width, height, cmp;
+        unsigned char* data = stbi_load(path.data(), &width, &height, &cmp, channels);
+        if (data == NULL)
+            return std::string(stbi_failure_reason());
+        if (width != m_Width || height != m_Height)
+        {
+            stbi_image_free(data);
+            return std::string("size changed while loading");
+        }
+
+        Clear();
+        LoadRows([&](int, auto&& onRow)
+        {
+            for (int y = 0; y < m_Height; ++y)
+                onRow(y, data + (size_t)y * (size_t)m_Width * (size_t)channels);
+        });
+        stbi_image_free(data);
+        return std::nullopt;
+    }
+
+
+    // Decodes the stored tiles of an opened track. The tiles are allocated up
+    // front and decoded in parallel, each thread only writes its own tiles.
+    // Corrupted tiles are left blank, the rest of the image is still loaded.
+    // The checkpoints of journal (see TrackJournal) are applied afterwards.
+    inline std::optional<std::string> LoadTrack(const TrackFile& track, unsigned threads, const std::filesystem::path& journal)
+    {
+        const TrackFile::Header& h = track.GetHeader();
+        if (h.format > (uint32_t)Format::Gray8)
+            return std::string("unknown storage format");
+        const Format format = (Format)h.format;
+        if (h.tileSize != TileSize || h.tileBytes != TileBytes(format))
+            return std::string("unsupported tile layout");
+
+        Canvas loaded = EmptyCopy(format);
+        const std::vector<TrackFile::Entry>& entries = track.Entries();
+        std::vector<uint64_t*> tiles(entries.size());
+        for (size_t i = 0; i < entries.size(); ++i)
+            tiles[i] = loaded.Touch(entries[i].index); // nullptr if no monitor covers it anymore
+        if (loaded.m_AllocationFailed)
+            return std::string("not enough memory");
+
+        std::atomic<size_t> next{ 0 };
+        std::atomic<size_t> corrupted{ 0 };
+        threads = std::max(1u, std::min<unsigned>(threads != 0 ? threads : HardwareThreads(), (unsigned)(entries.size() / 64 + 1)));
+        RunParallel(threads, [&](unsigned)
+        {
+            for (size_t i = next++; i < entries.size(); i = next++)
+            {
+                unsigned char* dst = reinterpret_cast<unsigned char*>(tiles[i]);
+                if (dst != nullptr && !track.Decode(entries[i], dst))
+                {
+                    std::memset(dst, Fill(format), h.tileBytes);
+                    corrupted.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        });
+        if (corrupted != 0)
+            Err << "{Canvas} Skipped " << corrupted << " corrupted tile(s) of the track" << std::endl;
+        loaded.m_MaxCount = (uint16_t)std::min<uint32_t>(h.maxCount, 65535);
+
+        // the tiles changed after the track was written replace their stored version
+        if (!journal.empty())
+        {
+            const size_t checkpoints = TrackJournal::Replay(journal, track.Id(), [&](uint32_t index, const unsigned char* stored, size_t bytes)
+            {
+                if (index >= loaded.m_Tiles.size())
+                    return;
+                if (stored == nullptr)
+                {
+                    loaded.ReleaseTile(index);
+                    return;
+                }
+                uint64_t* tile = loaded.Touch(index);
+                if (tile == nullptr)
+                    return;
+                if (!TrackFile::Unpack(h, stored, bytes, reinterpret_cast<unsigned char*>(tile)))
+                    std::memset(tile, Fill(format), h.tileBytes);
+                else if (format == Format::Count16)
+                    loaded.m_MaxCount = std::max(loaded.m_MaxCount, TileFormats::Count16::MaxCount(tile));
+            });
+            if (loaded.m_AllocationFailed)
+                return std::string("not enough memory");
+            Log << "{Canvas} Replayed " << checkpoints << " checkpoint(s) of the journal [" << journal << "]" << std::endl;
+        }
+
+        if (!loaded.SetFormat(m_Format))
+            return std::string("not enough memory to convert it");
+        *this = std::move(loaded);
+        return std::nullopt;
+    }
+
+
+    // Paint() with the policy F of m_Format
+    template <class F, class PaintFn>
+    inline void PaintAs(PaintFn&& paint)
+    {
+        size_t cached = SIZE_MAX;
+        uint64_t* tile = nullptr;
+        const auto tileAt = [&](int x, int y)
+        {
+            const size_t i = TileIndex(x, y);
+            if (i != cached)
+            {
+                cached = i;
+                tile = Touch(i);
+            }
+            return tile;
+        };
+
+        uint16_t maxCount = m_MaxCount;
+        paint(MakePlot<F::SpanRadius>([&](int x, int y)
+        {
+            if (uint64_t* t = tileAt(x, y))
+                F::Plot(t, x & TileMask, y & TileMask, maxCount);
+        },
+        [&](int y, int x0, int x1)
+        {
+            // the part of the span within every tile, x >= 0
+            for (int x = x0; x < x1;)
+            {
+                const int tileEnd = std::min(x1, (x | TileMask) + 1);
+                if (uint64_t* t = tileAt(x, y))
+                    F::Span(t, x & TileMask, y & TileMask, tileEnd - x, maxCount);
+                x = tileEnd;
+            }
+        }));
+        m_MaxCount = maxCount;
+    }
+public:
+    inline explicit Canvas(Format format = Format::RGBA8) : m_Format(format) {}
+
+
+    // Drops the content and the monitor layout
+    inline void Resize(int width, int height)
+    {
+        m_Width = width;
+        m_Height = height;
+        m_TilesX = (width + TileSize - 1) / TileSize;
+        m_TilesY = (height + TileSize - 1) / TileSize;
+        m_Tiles.assign((size_t)m_TilesX * (size_t)m_TilesY, nullptr);
+        if (!m_Arena.Reserve(m_Tiles.size(), TileBytes(m_Format)))
+            Err << "{Canvas} Failed to reserve address space for " << m_Tiles.size() << " tiles" << std::endl; // every Touch() fails
+        m_Monitors.clear();
+        Clear();
+    }
+
+
+    // Frees all tiles, their memory goes back to the OS right away
+    inline void Clear()
+    {
+        m_Arena.Reset();
+        std::fill(m_Tiles.begin(), m_Tiles.end(), nullptr);
+        m_AllocatedTiles = 0;
+        m_AllocationFailed = false;
+        m_MaxCount = 0;
+        m_Colormap.Reset();
+        UpdateCoverage();
+    }
+
+
+    // Everything outside of the given rectangles is transparent and never allocated
+    inline void SetMonitors(std::vector<Rect> monitors)
+    {
+        m_Monitors = std::move(monitors);
+        UpdateCoverage();
+    }
+
+
+    // Same size, monitor layout and settings, nothing visited
+    inline Canvas EmptyCopy(Format format) const
+    {
+        Canvas copy(format);
+        copy.Resize(m_Width, m_Height);
+        copy.SetMonitors(m_Monitors);
+        copy.SetHeatmapScale(m_Colormap.Scale());
+        return copy;
+    }
+
+
+    inline Canvas EmptyCopy() const
+    {
+        return EmptyCopy(m_Format);
+    }
+
+
+    // Deep copy that can be read on another thread while this one is drawn to, nullopt if memory ran out
+    inline std::optional<Canvas> Snapshot() const
+    {
+        Canvas copy = EmptyCopy();
+        for (size_t i = 0; i < m_Tiles.size(); ++i)
+        {
+            if (m_Tiles[i] == nullptr)
+                continue;
+            copy.m_Tiles[i] = copy.m_Arena.Commit(i);
+            if (copy.m_Tiles[i] == nullptr)
+            {
+                Err << "{Canvas} Failed to allocate a snapshot of " << m_AllocatedTiles << " tiles" << std::endl;
+                return std::nullopt;
+            }
+            std::memcpy(copy.m_Tiles[i], m_Tiles[i], TileBytes(m_Format));
+        }
+        copy.m_AllocatedTiles = m_AllocatedTiles;
+        copy.m_MaxCount = m_MaxCount;
+        copy.m_Colormap = m_Colormap;
+        return copy;
+    }
+
+
+    // Combines tiles [begin, end) of other, an EmptyCopy() of this canvas, into
+    // this one: visited pixels are or'ed and hit counts summed. Tiles only other
+    // has are copied. Disjoint ranges may be merged concurrently, FinishMerge()
+    // has to be called after all of them.
+    inline void MergeTiles(Canvas& other, size_t begin, size_t end)
+    {
+        VisitTileFormat(m_Format, [&](auto f)
+        {
+            using F = decltype(f);
+            for (size_t i = begin; i < end; ++i)
+            {
+                const uint64_t* src = other.m_Tiles[i];
+                uint64_t*& dst = m_Tiles[i];
+                if (src == nullptr)
+                    continue;
+                if (dst != nullptr)
+                    F::Merge(dst, src);
+                else if ((dst = m_Arena.Commit(i)) != nullptr)
+                    std::memcpy(dst, src, F::TileBytes);
+                else
+                    Err << "{Canvas} Failed to allocate tile " << i << " while merging" << std::endl;
+            }
+        });
+    }
+
+
+    inline void FinishMerge()
+    {
+        m_AllocatedTiles = (size_t)std::count_if(m_Tiles.begin(), m_Tiles.end(), [](const uint64_t* tile) { return tile != nullptr; });
+        if (m_Format != Format::Count16)
+            return;
+        for (const uint64_t* tile : m_Tiles)
+            if (tile != nullptr)
+                m_MaxCount = std::max(m_MaxCount, TileFormats::Count16::MaxCount(tile));
+    }
+
+
+    // Converts the content to another format, returns false if memory ran out
+    inline bool SetFormat(Format format)
+    {
+        if (format == m_Format)
+            return true;
+
+        Canvas converted = EmptyCopy(format);
+        VisitTileFormat(m_Format, [&](auto f)
+        {
+            using F = decltype(f);
+            converted.Paint([&](auto&& plot)
+            {
+                for (size_t i = 0; i < m_Tiles.size(); ++i)
+                {
+                    if (m_Tiles[i] == nullptr)
+                        continue;
+                    const Rect t = TileRect(i);
+                    for (int y = t.y0; y < t.y1; ++y)
+                        for (int x = t.x0; x < t.x1; ++x)
+                            if (F::Visited(m_Tiles[i], x & TileMask, y & TileMask))
+                                plot(x, y);
+                }
+            });
+        });
+        *this = std::move(converted);
+        return !m_AllocationFailed;
+    }
+
+
+    // Calls paint(plot), plot(x, y) marks one pixel as visited in the current
+    // format and plot.Span(y, x0, x1) the pixels [x0, x1) of a row, both
+    // without bounds checks. The format is dispatched once per call and the
+    // current tile is cached so the per pixel work stays small.
+    template <class PaintFn>
+    inline void Paint(PaintFn&& paint)
+    {
+        VisitTileFormat(m_Format, [&](auto f) { PaintAs<decltype(f)>(paint); });
+    }
+
+
+    // Writes pixels [x0, x1) of row y as RGBA to out
+    inline void ExpandRow(int y, int x0, int x1, unsigned char* out) const
+    {
+        const int ly = y & TileMask;
+        VisitTileFormat(m_Format, [&](auto f)
+        {
+            using F = decltype(f);
+            for (int x = x0; x < x1;)
+            {
+                const int tileEnd = std::min(x1, (x / TileSize + 1) * TileSize);
+                const size_t index = TileIndex(x, y);
+                const size_t n = (size_t)(tileEnd - x);
+                unsigned char* p = out + (size_t)(x - x0) * Channel;
+                if (m_Coverage[index] == Uncovered)
+                    std::memset(p, 0, n * Channel);
+                else
+                {
+                    if (m_Tiles[index] == nullptr)
+                        std::memset(p, 255, n * Channel);
+                    else
+                        F::Expand(m_Tiles[index], x & TileMask, ly, n, p, m_Colormap);
+
+                    if (m_Coverage[index] == Partial)
+                    {
+                        ForEachMonitorSpan(y, x, tileEnd, [&](int a, int b, bool onMonitor)
+                        {
+                            if (!onMonitor)
+                                std::memset(out + (size_t)(a - x0) * Channel, 0, (size_t)(b - a) * Channel);
+                        });
+                    }
+                }
+                x = tileEnd;
+            }
+        });
+    }
+
+
+    inline bool AlphaIsNeeded() const
+    {
+        for (size_t i = 0; i < m_Tiles.size(); ++i)
+        {
+            if (m_Coverage[i] != Covered)
+                return true;
+            if (m_Format != Format::RGBA8 || m_Tiles[i] == nullptr)
+                continue;
+
+            // loaded images may carry their own alpha
+            if (Pixels::AnyTransparent(reinterpret_cast<const unsigned char*>(m_Tiles[i]), TileSize * TileSize))
+                return true;
+        }
+        return false;
+    }
+
+
+    // rowsDone (if any) counts the rows compressed so far, it may be read from another thread
+    inline bool SaveToFile(const char* path, const PngOptions& options = {}, std::atomic<int>* rowsDone = nullptr) const
+    {
+        switch (m_Format)
+        {
+        case Format::Bit1:    return SaveBit1(path, options, rowsDone);
+        case Format::Count16: return SaveHeatmap(path, options, rowsDone);
+        case Format::Gray8:   return SaveGray(path, options, rowsDone);
+        case Format::RGBA8:
+        default:              return SaveRGBA(path, options, rowsDone);
+        }
+    }
+
+
+    // Stores the allocated tiles with content as a track (see TrackFile), compressed
+    // on threads threads. tilesDone (if any) counts the tiles compressed so far.
+    inline bool SaveTrack(const std::filesystem::path& path, unsigned threads = 0, std::atomic<int>* tilesDone = nullptr) const
+    {
+        return TrackFile::Write(path, TrackHeader(), m_Tiles.size(), [&](size_t i) -> const unsigned char*
+        {
+            const uint64_t* tile = m_Tiles[i];
+            return tile == nullptr || Blank(tile) ? nullptr : reinterpret_cast<const unsigned char*>(tile);
+        }, threads, tilesDone);
+    }
+
+
+    // How the tiles are stored in a track
+    inline TrackFile::Header TrackHeader() const
+    {
+        const uint32_t planes = VisitTileFormat(m_Format, [](auto f) { return decltype(f)::Planes; });
+        return { (uint32_t)m_Format, m_Width, m_Height, TileSize, (uint32_t)TileBytes(m_Format), planes, m_MaxCount };
+    }
+
+
+    // Copies of the given tiles, blank or never written ones without data. nullopt if memory ran out
+    inline std::optional<std::vector<TileCopy>> CopyTiles(const std::vector<uint32_t>& indices) const
+    {
+        std::vector<TileCopy> copies(indices.size());
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            const uint64_t* tile = m_Tiles[indices[i]];
+            copies[i].index = indices[i];
+            if (tile == nullptr || Blank(tile))
+                continue;
+            copies[i].data.reset(new (std::nothrow) uint64_t[TileBytes(m_Format) / sizeof(uint64_t)]);
+            if (copies[i].data == nullptr)
+            {
+                Err << "{Canvas} Failed to copy " << indices.size() << " tiles" << std::endl;
+                return std::nullopt;
+            }
+            std::memcpy(copies[i].data.get(), tile, TileBytes(m_Format));
+        }
+        return copies;
+    }
+
+
+    // Validates the size from the file header before any pixels are decoded.
+    // Tracks are mapped and their tiles decoded on threads threads, with the
+    // checkpoints of journal (if any) applied on top. PNGs are decoded row by
+    // row straight into the tiles, everything else through stbi_load. An image
+    // that turns out to be corrupted leaves the canvas cleared.
+    inline std::optional<std::string> LoadFromFile(const std::string& path, unsigned threads = 0, const std::filesystem::path& journal = {})
+    {
+        int width, height, cmp;
+        TrackFile track;
+        if (TrackFile::IsTrack(path))
+        {
+            const std::optional<std::string> errorMsg = track.Open(path);
+            if (errorMsg.has_value())
+            {
+                const std::string msg = "Failed to load image [" + path + "] " + errorMsg.value();
+                Err << msg << std::endl;
+                return { msg };
+            }
+            width = track.GetHeader().width;
+            height = track.GetHeader().height;
+        }
+        else if (stbi_info(path.data(), &width, &height, &cmp) == 0)
+        {
+            const std::string errorMsg = "Failed to load image [" + path + "]";
+            Err << errorMsg << std::endl;
+            return { errorMsg };
+        }
+        if (width != m_Width || height != m_Height)
+        {
+            std::string msg = "Couldn't load image since it doesn't match the monitors resolution!\nMonitor: ";
+            msg += std::to_string(m_Width) + 'x' + std::to_string(m_Height) + "\nImage: ";
+            msg += std::to_string(width) + 'x' + std::to_string(height);
+
+            const std::string msgNl = msg;
+            std::replace(msg.begin(), msg.end(), '\n', ' ');
+            Err << msg << std::endl;
+            return { msgNl };
+        }
+
+        PngReader png;
+        std::optional<std::string> errorMsg;
+        if (track.IsOpen())
+            errorMsg = LoadTrack(track, threads, journal);
+        else
+            errorMsg = png.Open(path.data()) && !png.Interlaced() && png.Width() == m_Width && png.Height() == m_Height ? LoadPng(png) : LoadDecoded(path);
+        if (errorMsg.has_value())
+        {
+            Clear();
+            const std::string msg = "Failed to load image [" + path + "] " + errorMsg.value();
+            Err << msg << std::endl;
+            return { msg };
+        }
+        Log << "Successfully loaded image from file w: " << m_Width << " h: " << m_Height << " [" << path << "]" << std::endl;
+        return std::nullopt;
+    }
+
+
+    // Returns true if the colors of the heatmap changed and everything has to be redrawn
+    inline bool FitColormap()
+    {
+        return m_Format == Format::Count16 && m_Colormap.Fit(m_MaxCount);
+    }
+
+
+    inline void SetHeatmapScale(HeatmapScale scale)
+    {
+        m_Colormap.SetScale(scale);
+    }
+
+
+    inline size_t MemoryUsage() const
+    {
+        return m_AllocatedTiles * TileBytes(m_Format) + m_Tiles.capacity() * sizeof(m_Tiles[0]) + m_Coverage.capacity();
+    }
+
+
+    inline HeatmapScale GetHeatmapScale()      const { return m_Colormap.Scale(); }
+    inline Format GetFormat()                  const { return m_Format;           }
+    inline int Width()                         const { return m_Width;            }
+    inline int Height()                        const { return m_Height;           }
+    inline size_t AllocatedTiles()             const { return m_AllocatedTiles;   }
+    inline size_t TileCount()                  const { return m_Tiles.size();     }
+    inline const std::vector<Rect>& Monitors() const { return m_Monitors;         }
+};
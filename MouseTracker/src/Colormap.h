@@ -0,0 +1,77 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <array>
+#include <vector>
+
+enum class HeatmapScale { Linear, Logarithmic };
+
+// Maps hit counts to colors, index 0 (never visited) is white, the rest a
+// yellow -> red -> black gradient. The count -> color index table is rebuilt
+// whenever the maximum count outgrows the current scale, the scale doubles
+// each time so this only happens log2(65535) times.
+class Colormap
+{
+public:
+    using Color = std::array<unsigned char, 4>; // RGBA
+private:
+    std::array<Color, 256> m_Colors{};
+    std::vector<unsigned char> m_Index = std::vector<unsigned char>(65536, 0);
+    uint32_t m_ScaleMax = 0;
+    HeatmapScale m_Scale = HeatmapScale::Logarithmic;
+private:
+    inline void BuildIndex()
+    {
+        m_Index[0] = 0;
+        const double logMax = std::log1p((double)m_ScaleMax);
+        for (uint32_t c = 1; c < m_Index.size(); ++c)
+        {
+            const double t = m_Scale == HeatmapScale::Linear ? (double)c / m_ScaleMax : std::log1p((double)c) / logMax;
+            m_Index[c] = (unsigned char)std::clamp(1 + (int)std::lround(t * 254.0), 1, 255);
+        }
+    }
+public:
+    inline Colormap()
+    {
+        static constexpr Color stops[] = { { 255, 237, 160, 255 }, { 254, 178, 76, 255 }, { 240, 59, 32, 255 }, { 128, 0, 38, 255 }, { 0, 0, 0, 255 } };
+        static constexpr int segments = (int)(sizeof(stops) / sizeof(stops[0])) - 1;
+        m_Colors[0] = { 255, 255, 255, 255 };
+        for (int i = 1; i < 256; ++i)
+        {
+            const double t = (double)(i - 1) / 254.0 * segments;
+            const int s = std::min((int)t, segments - 1);
+            const double f = t - s;
+            for (size_t c = 0; c < 4; ++c)
+                m_Colors[(size_t)i][c] = (unsigned char)std::lround(stops[s][c] + (stops[s + 1][c] - stops[s][c]) * f);
+        }
+    }
+
+    // Returns true if the mapping changed and everything has to be redrawn
+    inline bool Fit(uint32_t maxCount)
+    {
+        if (maxCount <= m_ScaleMax)
+            return false;
+        m_ScaleMax = 16;
+        while (m_ScaleMax < maxCount)
+            m_ScaleMax *= 2;
+        BuildIndex();
+        return true;
+    }
+
+    // Forgets the fitted scale, the next Fit() rebuilds the table
+    inline void Reset()
+    {
+        m_ScaleMax = 0;
+    }
+
+    inline void SetScale(HeatmapScale scale)
+    {
+        m_Scale = scale;
+        if (m_ScaleMax != 0)
+            BuildIndex();
+    }
+
+    inline HeatmapScale Scale() const { return m_Scale; }
+    inline const Color& operator[](uint16_t count) const { return m_Colors[m_Index[count]]; }
+};
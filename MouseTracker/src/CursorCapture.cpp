@@ -0,0 +1,57 @@
+#include <algorithm>
+#include <utility>
+
+#include "CursorCapture.h"
+#include "Log.h"
+
+CursorCapture::CursorCapture(std::unique_ptr<CursorSource> source, size_t capacity, SessionLogWriter* log) : m_Ring(capacity), m_Source(std::move(source)), m_Log(log)
+{
+    if (m_Source->Rate() != 0)
+        SetRate(m_Source->Rate());
+    m_Thread = std::thread(&CursorCapture::Run, this);
+    Log << "Started cursor capture rate: " << Rate() << " Hz capacity: " << m_Ring.Capacity() << std::endl;
+}
+
+
+CursorCapture::~CursorCapture()
+{
+    Stop();
+    Log << "Stopped cursor capture captured: " << Captured() << " dropped: " << Dropped() << std::endl;
+}
+
+
+void CursorCapture::Stop()
+{
+    m_Running = false;
+    if (m_Thread.joinable())
+        m_Thread.join();
+}
+
+
+void CursorCapture::SetRate(int rateHz)
+{
+    m_Source->SetRate(std::clamp(rateHz, MinRate, MaxRate));
+}
+
+
+void CursorCapture::Run()
+{
+    const bool lossless = m_Source->Lossless();
+    Sample sample{ 0, 0, 0 };
+    while (m_Running.load(std::memory_order_relaxed) && !m_Source->Exhausted())
+    {
+        if (!m_Source->Next(sample))
+            continue;
+        if (m_Log != nullptr)
+            m_Log->Append(sample);
+
+        bool pushed = m_Ring.Push(sample);
+        while (!pushed && lossless && m_Running.load(std::memory_order_relaxed))
+        {
+            std::this_thread::yield(); // replayed samples wait for the consumer instead of being dropped
+            pushed = m_Ring.Push(sample);
+        }
+        (pushed ? m_Captured : m_Dropped).fetch_add(1, std::memory_order_relaxed);
+    }
+    m_Running = false;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <atomic>
+#include <thread>
+
+#include "SessionLogWriter.h"
+#include "CursorSource.h"
+#include "SpscRing.h"
+#include "Sample.h"
+
+// Pulls samples from a CursorSource on its own thread, independent of the
+// render loop, and hands them to the render thread through a ring and to the
+// session log (if any) through another one.
+class CursorCapture
+{
+private:
+    SpscRing<Sample> m_Ring;
+    std::unique_ptr<CursorSource> m_Source;
+    SessionLogWriter* const m_Log;
+    std::thread m_Thread;
+    std::atomic<bool> m_Running{ true };
+    std::atomic<uint64_t> m_Captured{ 0 };
+    std::atomic<uint64_t> m_Dropped{ 0 };
+private:
+    void Run();
+public:
+    static constexpr int MinRate = 60;
+    static constexpr int MaxRate = 8000;
+public:
+    explicit CursorCapture(std::unique_ptr<CursorSource> source, size_t capacity = 1 << 14, SessionLogWriter* log = nullptr);
+    ~CursorCapture();
+    CursorCapture(const CursorCapture&) = delete;
+    CursorCapture& operator=(const CursorCapture&) = delete;
+
+    // render thread
+    inline size_t Drain(Sample* out, size_t max) { return m_Ring.PopBatch(out, max); }
+
+    // Joins the capture thread, what it captured until then can still be drained
+    void Stop();
+
+    void SetRate(int rateHz);
+    inline int      Rate()      const { return m_Source->Rate();                           }
+    inline bool     Finished()  const { return !m_Running.load(std::memory_order_relaxed); }
+    inline uint64_t Captured()  const { return m_Captured.load(std::memory_order_relaxed); }
+    inline uint64_t Dropped()   const { return m_Dropped.load(std::memory_order_relaxed);  }
+    inline size_t   Occupancy() const { return m_Ring.Size();                              }
+    inline size_t   Capacity()  const { return m_Ring.Capacity();                          }
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include <filesystem>
+#include <climits>
+#include <fstream>
+#include <memory>
+#include <atomic>
+#include <chrono>
+
+#include "Sample.h"
+
+// Where cursor samples come from. Next() may block but has to return
+// regularly (~100 ms at most) so the capture thread can be stopped.
+class CursorSource
+{
+public:
+    virtual ~CursorSource() = default;
+    // Returns true and fills sample if the cursor moved
+    virtual bool Next(Sample& sample) = 0;
+    // Sources with a finite amount of samples (replay) return true once drained
+    virtual bool Exhausted() const { return false; }
+    // Samples of lossless sources are never dropped, the capture thread waits for the ring instead
+    virtual bool Lossless() const { return false; }
+    // Polling rate in Hz, 0 for event driven sources
+    virtual int Rate() const { return 0; }
+    virtual void SetRate(int) {}
+};
+
+
+#ifdef WINDOWS
+class Win32CursorSource : public CursorSource
+{
+private:
+    std::atomic<int> m_Rate;
+    std::chrono::steady_clock::time_point m_Next;
+    long m_PrevX = LONG_MIN;
+    long m_PrevY = LONG_MIN;
+    bool m_Failed = false;
+public:
+    explicit Win32CursorSource(int rateHz);
+    ~Win32CursorSource() override;
+    bool Next(Sample& sample) override;
+    inline int Rate() const override { return m_Rate.load(std::memory_order_relaxed); }
+    inline void SetRate(int rateHz) override { m_Rate = rateHz; }
+};
+#endif
+
+
+#ifdef X11
+struct _XDisplay;
+
+// Event driven via XInput2 motion events, works under Xvfb
+class X11CursorSource : public CursorSource
+{
+private:
+    _XDisplay* m_Display = nullptr;
+    int m_XiOpcode = 0;
+    int m_PrevX = -1;
+    int m_PrevY = -1;
+public:
+    X11CursorSource();
+    ~X11CursorSource() override;
+    bool Next(Sample& sample) override;
+};
+#endif
+
+
+// Feeds samples recorded as text lines "<time in us> <x> <y>" either with
+// the original timing or as fast as the consumer can take them
+class ReplayCursorSource : public CursorSource
+{
+private:
+    std::ifstream m_File;
+    const bool m_MaxSpeed;
+    bool m_Exhausted = false;
+    bool m_HasPending = false;
+    bool m_Started = false; // traces may start at time 0
+    Sample m_Pending{ 0, 0, 0 };
+    int64_t m_FirstTime = 0;
+    std::chrono::steady_clock::time_point m_Start;
+private:
+    bool ReadSample(Sample& sample);
+public:
+    ReplayCursorSource(const std::filesystem::path& path, bool maxSpeed);
+    bool Next(Sample& sample) override;
+    inline bool Exhausted() const override { return m_Exhausted; }
+    inline bool Lossless()  const override { return true;        }
+};
+
+
+// Win32 polling at rateHz on Windows, X11 (rateHz is ignored) elsewhere
+std::unique_ptr<CursorSource> CreateSystemCursorSource(int rateHz);
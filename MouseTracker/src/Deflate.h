@@ -0,0 +1,521 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <vector>
+#include <array>
+#include <queue>
+
+// Deflate (RFC 1951) encoder that compresses a buffer in independent pieces,
+// pigz style: every piece may reference the 32 KB before it, ends on a byte
+// boundary (empty stored block) and the pieces are concatenated into one
+// stream. zlib framing and Adler-32 (with Combine() for per piece checksums)
+// are left to the caller.
+namespace Deflate
+{
+    static constexpr int MaxLevel = 9;
+    static constexpr size_t Window = 32768;
+    static constexpr int MinMatch = 3;
+    static constexpr int MaxMatch = 258;
+    static constexpr size_t BlockTokens = 1 << 15; // a new dynamic block (fresh codes) after this many tokens
+
+    struct LevelParams
+    {
+        int chain;     // match candidates tried per position
+        int nice;      // stop searching once a match is this long
+        int maxInsert; // longer matches only insert their first position into the hash chains
+    };
+
+    // 0 = stored
+    static constexpr LevelParams Levels[MaxLevel + 1] = {
+        { 0, 0, 0 }, { 4, 8, 4 }, { 6, 16, 5 }, { 8, 32, 6 }, { 16, 32, 258 },
+        { 32, 64, 258 }, { 64, 128, 258 }, { 128, 128, 258 }, { 512, 258, 258 }, { 2048, 258, 258 }
+    };
+
+
+    inline uint32_t Adler32(const unsigned char* data, size_t size, uint32_t adler = 1)
+    {
+        static constexpr uint32_t Base = 65521;
+        static constexpr size_t MaxRun = 5552; // largest n that can't overflow the sums
+        uint32_t a = adler & 0xFFFF;
+        uint32_t b = adler >> 16;
+        while (size != 0)
+        {
+            const size_t n = std::min(size, MaxRun);
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16)
+            {
+                // 16 steps at once, b gains a 16 times plus every byte weighted by the steps left
+                uint32_t sum = 0, weighted = 0;
+                for (uint32_t k = 0; k < 16; ++k)
+                {
+                    sum += data[i + k];
+                    weighted += (16 - k) * data[i + k];
+                }
+                b += 16 * a + weighted;
+                a += sum;
+            }
+            for (; i < n; ++i)
+            {
+                a += data[i];
+                b += a;
+            }
+            a %= Base;
+            b %= Base;
+            data += n;
+            size -= n;
+        }
+        return (b << 16) | a;
+    }
+
+
+    // Adler-32 of the concatenation, second is the checksum of the size2 bytes after the first
+    inline uint32_t Adler32Combine(uint32_t first, uint32_t second, size_t size2)
+    {
+        static constexpr uint64_t Base = 65521;
+        const uint64_t rem = size2 % Base;
+        const uint64_t a1 = first & 0xFFFF;
+        const uint64_t b1 = first >> 16;
+        const uint64_t a = (a1 + (second & 0xFFFF) + Base - 1) % Base;
+        const uint64_t b = (b1 + (second >> 16) + rem * a1 + Base - rem) % Base;
+        return (uint32_t)((b << 16) | a);
+    }
+
+
+    class BitWriter
+    {
+    private:
+        std::vector<unsigned char>& m_Out;
+        uint64_t m_Bits = 0;
+        int m_Count = 0;
+    public:
+        inline explicit BitWriter(std::vector<unsigned char>& out) : m_Out(out) {}
+
+        // LSB first, n <= 32
+        inline void Put(uint32_t value, int n)
+        {
+            m_Bits |= (uint64_t)value << m_Count;
+            m_Count += n;
+            while (m_Count >= 8)
+            {
+                m_Out.push_back((unsigned char)m_Bits);
+                m_Bits >>= 8;
+                m_Count -= 8;
+            }
+        }
+
+        inline void Align()
+        {
+            if (m_Count > 0)
+                Put(0, 8 - m_Count);
+        }
+    };
+
+
+    class Encoder
+    {
+    private:
+        static constexpr int LitLenSymbols = 286;
+        static constexpr int DistSymbols = 30;
+        static constexpr int CodeLenSymbols = 19;
+        static constexpr int MaxBits = 15;
+        static constexpr int MaxCodeLenBits = 7;
+        static constexpr int HashBits = 15;
+        static constexpr uint32_t NoPos = UINT32_MAX;
+
+        struct Token
+        {
+            uint16_t length;   // 0 = literal
+            uint16_t distance; // literal value if length is 0
+        };
+
+        struct Code
+        {
+            std::vector<uint16_t> codes; // bit reversed, ready for BitWriter
+            std::vector<uint8_t> lengths;
+        };
+
+        const LevelParams m_Params;
+        std::vector<uint32_t> m_Head = std::vector<uint32_t>(1 << HashBits);
+        std::vector<uint32_t> m_Prev = std::vector<uint32_t>(Window);
+        std::vector<Token> m_Tokens;
+        size_t m_Base = 0; // position m_Prev is relative to
+    private:
+        struct Tables
+        {
+            std::array<uint8_t, MaxMatch + 1> lengthSymbol{}; // - 257
+            std::array<uint16_t, 29> lengthBase{};
+            std::array<uint8_t, 29> lengthExtra{};
+            std::array<uint8_t, 512> distSymbolLow{}; // distance - 1 < 256 and (distance - 1) >> 7 otherwise
+            std::array<uint16_t, 30> distBase{};
+            std::array<uint8_t, 30> distExtra{};
+        };
+
+
+        static inline const Tables& GetTables()
+        {
+            static const Tables t = []()
+            {
+                Tables r;
+                int base = 3;
+                for (uint8_t s = 0; s < 28; ++s)
+                {
+                    r.lengthExtra[s] = (uint8_t)(s < 8 ? 0 : (s - 4) / 4);
+                    r.lengthBase[s] = (uint16_t)base;
+                    for (int i = 0; i < (1 << r.lengthExtra[s]); ++i)
+                        r.lengthSymbol[(size_t)(base + i)] = s;
+                    base += 1 << r.lengthExtra[s];
+                }
+                r.lengthExtra[28] = 0;
+                r.lengthBase[28] = 258;
+                r.lengthSymbol[258] = 28;
+
+                base = 1;
+                for (uint8_t s = 0; s < 30; ++s)
+                {
+                    r.distExtra[s] = (uint8_t)(s < 4 ? 0 : (s - 2) / 2);
+                    r.distBase[s] = (uint16_t)base;
+                    for (int i = 0; i < (1 << r.distExtra[s]); ++i)
+                    {
+                        const int d = base + i - 1;
+                        if (d < 256)
+                            r.distSymbolLow[(size_t)d] = s;
+                        else
+                            r.distSymbolLow[256 + (size_t)(d >> 7)] = s;
+                    }
+                    base += 1 << r.distExtra[s];
+                }
+                return r;
+            }();
+            return t;
+        }
+
+
+        static inline int DistSymbol(const Tables& t, int distance)
+        {
+            const int d = distance - 1;
+            return d < 256 ? t.distSymbolLow[(size_t)d] : t.distSymbolLow[256 + (size_t)(d >> 7)];
+        }
+
+
+        static inline uint32_t Hash(const unsigned char* p)
+        {
+            const uint32_t v = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16;
+            return (v * 2654435761u) >> (32 - HashBits);
+        }
+
+
+        // Huffman code lengths limited to maxBits, at least two symbols get a code so the code is complete
+        static inline Code BuildCode(const std::vector<uint32_t>& freq, int maxBits)
+        {
+            const size_t n = freq.size();
+            Code code{ std::vector<uint16_t>(n, 0), std::vector<uint8_t>(n, 0) };
+            std::vector<size_t> used;
+            for (size_t i = 0; i < n; ++i)
+                if (freq[i] != 0)
+                    used.push_back(i);
+            for (size_t i = 0; used.size() < 2; ++i)
+                if (freq[i] == 0)
+                    used.push_back(i);
+
+            // tree depths, nodes [0, used) are leaves
+            std::vector<size_t> parent(2 * used.size(), 0);
+            using Node = std::pair<uint64_t, size_t>;
+            std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+            for (size_t i = 0; i < used.size(); ++i)
+                queue.push({ std::max<uint64_t>(freq[used[i]], 1), i });
+            size_t next = used.size();
+            while (queue.size() > 1)
+            {
+                const Node a = queue.top();
+                queue.pop();
+                const Node b = queue.top();
+                queue.pop();
+                parent[a.second] = parent[b.second] = next;
+                queue.push({ a.first + b.first, next++ });
+            }
+            std::vector<int> depth(next, 0);
+            for (size_t i = next - 1; i-- > 0;)
+                depth[i] = depth[parent[i]] + 1;
+
+            // limit the lengths (moving leaves down keeps the Kraft sum), longest codes go to the rarest symbols
+            std::vector<int> count((size_t)std::max(maxBits, *std::max_element(depth.begin(), depth.begin() + (std::ptrdiff_t)used.size())) + 1, 0);
+            for (size_t i = 0; i < used.size(); ++i)
+                ++count[(size_t)depth[i]];
+            for (size_t len = (size_t)maxBits + 1; len < count.size(); ++len)
+                count[(size_t)maxBits] += std::exchange(count[len], 0);
+            uint32_t kraft = 0;
+            for (int len = 1; len <= maxBits; ++len)
+                kraft += (uint32_t)count[(size_t)len] << (maxBits - len);
+            while (kraft > (1u << maxBits))
+            {
+                --count[(size_t)maxBits];
+                for (int len = maxBits - 1; len > 0; --len)
+                {
+                    if (count[(size_t)len] != 0)
+                    {
+                        --count[(size_t)len];
+                        count[(size_t)len + 1] += 2;
+                        break;
+                    }
+                }
+                --kraft;
+            }
+
+            std::sort(used.begin(), used.end(), [&](size_t a, size_t b) { return freq[a] != freq[b] ? freq[a] > freq[b] : a < b; });
+            size_t k = 0;
+            for (int len = 1; len <= maxBits; ++len)
+                for (int c = 0; c < count[(size_t)len]; ++c)
+                    code.lengths[used[k++]] = (uint8_t)len;
+
+            // canonical codes
+            std::vector<uint16_t> nextCode((size_t)maxBits + 2, 0);
+            std::vector<int> lengthCount((size_t)maxBits + 1, 0);
+            for (uint8_t len : code.lengths)
+                ++lengthCount[len];
+            lengthCount[0] = 0;
+            for (size_t len = 1; len <= (size_t)maxBits; ++len)
+                nextCode[len + 1] = (uint16_t)((nextCode[len] + lengthCount[len]) << 1);
+            for (size_t i = 0; i < n; ++i)
+            {
+                const int len = code.lengths[i];
+                if (len == 0)
+                    continue;
+                uint16_t c = nextCode[(size_t)len]++;
+                uint16_t reversed = 0;
+                for (int b = 0; b < len; ++b, c >>= 1)
+                    reversed = (uint16_t)((reversed << 1) | (c & 1));
+                code.codes[i] = reversed;
+            }
+            return code;
+        }
+
+
+        static inline void PutSymbol(BitWriter& out, const Code& code, size_t symbol)
+        {
+            out.Put(code.codes[symbol], code.lengths[symbol]);
+        }
+
+
+        inline void WriteBlock(BitWriter& out, bool final) const
+        {
+            const Tables& t = GetTables();
+            std::vector<uint32_t> litFreq(LitLenSymbols, 0);
+            std::vector<uint32_t> distFreq(DistSymbols, 0);
+            for (const Token& tok : m_Tokens)
+            {
+                if (tok.length == 0)
+                    ++litFreq[tok.distance];
+                else
+                {
+                    ++litFreq[257 + (size_t)t.lengthSymbol[tok.length]];
+                    ++distFreq[(size_t)DistSymbol(t, tok.distance)];
+                }
+            }
+            litFreq[256] = 1;
+            const Code lit = BuildCode(litFreq, MaxBits);
+            const Code dist = BuildCode(distFreq, MaxBits);
+
+            size_t hlit = LitLenSymbols;
+            while (hlit > 257 && lit.lengths[hlit - 1] == 0)
+                --hlit;
+            size_t hdist = DistSymbols;
+            while (hdist > 1 && dist.lengths[hdist - 1] == 0)
+                --hdist;
+
+            // run length encoded code lengths: 16 repeats the previous 3-6 times, 17/18 are runs of zeros
+            std::vector<uint8_t> lengths(lit.lengths.begin(), lit.lengths.begin() + (std::ptrdiff_t)hlit);
+            lengths.insert(lengths.end(), dist.lengths.begin(), dist.lengths.begin() + (std::ptrdiff_t)hdist);
+            std::vector<std::pair<uint8_t, uint8_t>> rle; // symbol, extra bits value
+            for (size_t i = 0; i < lengths.size();)
+            {
+                const uint8_t len = lengths[i];
+                size_t run = 1;
+                while (i + run < lengths.size() && lengths[i + run] == len)
+                    ++run;
+                i += run;
+                if (len == 0)
+                {
+                    for (; run >= 11; run -= std::min<size_t>(run, 138))
+                        rle.push_back({ 18, (uint8_t)(std::min<size_t>(run, 138) - 11) });
+                    if (run >= 3)
+                    {
+                        rle.push_back({ 17, (uint8_t)(run - 3) });
+                        run = 0;
+                    }
+                    for (; run > 0; --run)
+                        rle.push_back({ 0, 0 });
+                    continue;
+                }
+                rle.push_back({ len, 0 });
+                for (--run; run >= 3; run -= std::min<size_t>(run, 6))
+                    rle.push_back({ 16, (uint8_t)(std::min<size_t>(run, 6) - 3) });
+                for (; run > 0; --run)
+                    rle.push_back({ len, 0 });
+            }
+
+            std::vector<uint32_t> clFreq(CodeLenSymbols, 0);
+            for (const auto& [symbol, extra] : rle)
+                ++clFreq[symbol];
+            const Code cl = BuildCode(clFreq, MaxCodeLenBits);
+            static constexpr uint8_t order[CodeLenSymbols] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+            size_t hclen = CodeLenSymbols;
+            while (hclen > 4 && cl.lengths[order[hclen - 1]] == 0)
+                --hclen;
+
+            out.Put(final ? 1 : 0, 1);
+            out.Put(2, 2); // dynamic Huffman
+            out.Put((uint32_t)(hlit - 257), 5);
+            out.Put((uint32_t)(hdist - 1), 5);
+            out.Put((uint32_t)(hclen - 4), 4);
+            for (size_t i = 0; i < hclen; ++i)
+                out.Put(cl.lengths[order[i]], 3);
+            for (const auto& [symbol, extra] : rle)
+            {
+                PutSymbol(out, cl, symbol);
+                if (symbol >= 16)
+                    out.Put(extra, symbol == 16 ? 2 : symbol == 17 ? 3 : 7);
+            }
+
+            for (const Token& tok : m_Tokens)
+            {
+                if (tok.length == 0)
+                {
+                    PutSymbol(out, lit, tok.distance);
+                    continue;
+                }
+                const size_t ls = t.lengthSymbol[tok.length];
+                PutSymbol(out, lit, 257 + ls);
+                out.Put((uint32_t)(tok.length - t.lengthBase[ls]), t.lengthExtra[ls]);
+                const size_t ds = (size_t)DistSymbol(t, tok.distance);
+                PutSymbol(out, dist, ds);
+                out.Put((uint32_t)(tok.distance - t.distBase[ds]), t.distExtra[ds]);
+            }
+            PutSymbol(out, lit, 256);
+        }
+
+
+        inline void Insert(const unsigned char* data, size_t pos)
+        {
+            const uint32_t h = Hash(data + pos);
+            m_Prev[pos % Window] = m_Head[h];
+            m_Head[h] = (uint32_t)(pos - m_Base);
+        }
+
+
+        inline int LongestMatch(const unsigned char* data, size_t pos, size_t end, int& distance) const
+        {
+            const int maxLength = (int)std::min<size_t>(MaxMatch, end - pos);
+            int best = MinMatch - 1;
+            uint32_t candidate = m_Head[Hash(data + pos)];
+            for (int chain = m_Params.chain; chain > 0 && candidate != NoPos; --chain)
+            {
+                const size_t c = m_Base + candidate;
+                if (c >= pos || pos - c > Window - 1)
+                    break;
+                const unsigned char* a = data + c;
+                const unsigned char* b = data + pos;
+                if (a[best] == b[best] && a[0] == b[0])
+                {
+                    int len = 0;
+                    while (len < maxLength && a[len] == b[len])
+                        ++len;
+                    if (len > best)
+                    {
+                        best = len;
+                        distance = (int)(pos - c);
+                        if (len >= m_Params.nice || len == maxLength)
+                            break;
+                    }
+                }
+                const uint32_t prev = m_Prev[c % Window];
+                if (prev == NoPos || prev >= candidate)
+                    break;
+                candidate = prev;
+            }
+            return best >= MinMatch ? best : 0;
+        }
+
+
+        static inline void WriteStored(BitWriter& out, const unsigned char* data, size_t size, bool final)
+        {
+            do
+            {
+                const size_t n = std::min<size_t>(size, 65535);
+                size -= n;
+                out.Put(final && size == 0 ? 1 : 0, 1);
+                out.Put(0, 2);
+                out.Align();
+                out.Put((uint32_t)n, 16);
+                out.Put((uint32_t)~n & 0xFFFF, 16);
+                for (size_t i = 0; i < n; ++i)
+                    out.Put(data[i], 8);
+                data += n;
+            } while (size != 0);
+        }
+    public:
+        inline explicit Encoder(int level) : m_Params(Levels[std::clamp(level, 0, MaxLevel)]) {}
+
+
+        // Appends the deflate blocks of data[begin, end) to out, matches may
+        // reach back into data[begin - 32 KB, begin). Unless final the output
+        // ends on a byte boundary and the next piece can be appended directly.
+        inline void Compress(const unsigned char* data, size_t begin, size_t end, bool final, std::vector<unsigned char>& out)
+        {
+            BitWriter bits(out);
+            if (m_Params.chain == 0)
+            {
+                WriteStored(bits, data + begin, end - begin, final);
+                return;
+            }
+
+            std::fill(m_Head.begin(), m_Head.end(), NoPos);
+            std::fill(m_Prev.begin(), m_Prev.end(), NoPos);
+            const size_t prime = begin - std::min(begin, Window);
+            m_Base = prime;
+            for (size_t pos = prime; pos + MinMatch <= begin; ++pos)
+                Insert(data, pos);
+
+            m_Tokens.clear();
+            for (size_t pos = begin; pos < end;)
+            {
+                int distance = 0;
+                const int length = pos + MinMatch <= end ? LongestMatch(data, pos, end, distance) : 0;
+                if (length == 0)
+                {
+                    if (pos + MinMatch <= end)
+                        Insert(data, pos);
+                    m_Tokens.push_back({ 0, data[pos] });
+                    ++pos;
+                }
+                else
+                {
+                    m_Tokens.push_back({ (uint16_t)length, (uint16_t)distance });
+                    const size_t inserted = length <= m_Params.maxInsert ? (size_t)length : 1;
+                    for (size_t i = 0; i < inserted && pos + i + MinMatch <= end; ++i)
+                        Insert(data, pos + i);
+                    pos += (size_t)length;
+                }
+
+                if (m_Tokens.size() >= BlockTokens && pos < end)
+                {
+                    WriteBlock(bits, false);
+                    m_Tokens.clear();
+                }
+            }
+            WriteBlock(bits, final);
+            m_Tokens.clear();
+            if (!final)
+            {
+                // empty stored block, brings the stream to a byte boundary (sync flush)
+                bits.Put(0, 3);
+                bits.Align();
+                bits.Put(0, 16);
+                bits.Put(0xFFFF, 16);
+            }
+            bits.Align();
+        }
+    };
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <chrono>
+
+#include "FrameStats.h"
+
+// Decides when the main loop renders a frame. A frame is only built and
+// swapped if it was requested: by input, by the image changing or by
+// something animated in the UI. In between the loop blocks in
+// glfwWaitEventsTimeout(), waking up every IdleTimeout to drain the cursor
+// capture, which runs on its own thread and keeps seconds of samples.
+class FrameScheduler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    static constexpr int InputFrames = 3; // ImGui needs a few frames to settle after input (hover, popups)
+private:
+    static constexpr std::chrono::milliseconds IdleTimeout{ 100 };    // wakeup interval without any activity
+    static constexpr std::chrono::milliseconds ActiveTimeout{ 10 };   // while samples keep arriving
+    static constexpr std::chrono::milliseconds ActiveLinger{ 200 };   // activity counts as ongoing this long
+    static constexpr std::chrono::milliseconds RefreshInterval{ 100 }; // minimum distance of Refresh() frames
+    int m_Frames = InputFrames; // frames still to render, the first ones draw the whole UI
+    bool m_Refresh = false;
+    bool m_OnDemand = true;
+    bool m_Visible = true;
+    Clock::time_point m_LastActivity;
+    Clock::time_point m_LastFrame;
+    FrameStats m_FrameTime;
+    // per second, measured over the last StatsInterval
+    static constexpr std::chrono::seconds StatsInterval{ 1 };
+    Clock::time_point m_StatsStart = Clock::now();
+    uint32_t m_Wakeups = 0;
+    uint32_t m_Rendered = 0;
+    float m_WakeupsPerSecond = 0.f;
+    float m_FramesPerSecond = 0.f;
+private:
+    inline void CountStats(Clock::time_point now, bool rendered)
+    {
+        ++m_Wakeups;
+        m_Rendered += rendered ? 1 : 0;
+        const std::chrono::duration<float> elapsed = now - m_StatsStart;
+        if (elapsed < StatsInterval)
+            return;
+        m_WakeupsPerSecond = (float)m_Wakeups / elapsed.count();
+        m_FramesPerSecond = (float)m_Rendered / elapsed.count();
+        m_Wakeups = 0;
+        m_Rendered = 0;
+        m_StatsStart = now;
+    }
+public:
+    // Seconds the loop may block waiting for events, 0 = poll and render right away
+    inline double Timeout() const
+    {
+        if (m_Visible && (!m_OnDemand || m_Frames > 0))
+            return 0.0;
+        const bool active = Clock::now() - m_LastActivity < ActiveLinger;
+        return std::chrono::duration<double>(active && m_Visible ? ActiveTimeout : IdleTimeout).count();
+    }
+
+
+    // The next frames show something new
+    inline void Request(int frames = 1)
+    {
+        m_Frames = std::max(m_Frames, frames);
+    }
+
+
+    // Something in the UI changed that isn't worth more than a few frames per second
+    inline void Refresh()
+    {
+        m_Refresh = true;
+    }
+
+
+    // Samples arrived, more are likely to follow soon
+    inline void Activity()
+    {
+        m_LastActivity = Clock::now();
+    }
+
+
+    // Off renders every iteration, paced only by vsync
+    inline void SetOnDemand(bool onDemand)
+    {
+        m_OnDemand = onDemand;
+    }
+
+
+    // Called once per iteration, true if a frame is to be rendered. Nothing is
+    // rendered while the window is minimized, the requests are kept for later.
+    inline bool BeginFrame(bool visible)
+    {
+        const Clock::time_point now = Clock::now();
+        m_Visible = visible;
+        if (m_Refresh && now - m_LastFrame >= RefreshInterval)
+            Request();
+
+        const bool render = visible && (!m_OnDemand || m_Frames > 0);
+        if (render)
+        {
+            m_Frames = std::max(m_Frames - 1, 0);
+            m_Refresh = false;
+            m_LastFrame = now;
+        }
+        CountStats(now, render);
+        return render;
+    }
+
+
+    // After the frame was built and submitted, before the swap waits for vsync
+    inline void EndFrame()
+    {
+        m_FrameTime.Add(std::chrono::duration<float, std::milli>(Clock::now() - m_LastFrame).count());
+    }
+
+
+    // CPU time of the rendered frames in milliseconds
+    inline const FrameStats& FrameTime() const
+    {
+        return m_FrameTime;
+    }
+
+
+    inline float WakeupsPerSecond() const { return m_WakeupsPerSecond; }
+    inline float FramesPerSecond()  const { return m_FramesPerSecond;  }
+};
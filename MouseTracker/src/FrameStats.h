@@ -0,0 +1,33 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <array>
+
+// Keeps the last Window durations in milliseconds to report percentiles
+class FrameStats
+{
+private:
+    static constexpr size_t Window = 512;
+    std::array<float, Window> m_Ms{};
+    size_t m_Count = 0;
+    size_t m_Next = 0;
+public:
+    inline void Add(float ms)
+    {
+        m_Ms[m_Next] = ms;
+        m_Next = (m_Next + 1) % Window;
+        m_Count = std::min(m_Count + 1, Window);
+    }
+
+
+    // p in [0, 1], e.g. 0.99 for p99
+    inline float Percentile(float p) const
+    {
+        if (m_Count == 0)
+            return 0.f;
+        std::array<float, Window> sorted = m_Ms;
+        const size_t n = std::min((size_t)(p * (float)m_Count), m_Count - 1);
+        std::nth_element(sorted.begin(), sorted.begin() + (std::ptrdiff_t)n, sorted.begin() + (std::ptrdiff_t)m_Count);
+        return sorted[n];
+    }
+};
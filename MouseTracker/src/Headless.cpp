@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <optional>
+#include <cstdlib>
+#include <csignal>
+#include <utility>
+#include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#include "GLFW/glfw3.h"
+
+#include "SessionLogWriter.h"
+#include "CursorCapture.h"
+#include "CursorSource.h"
+#include "StrokeCanvas.h"
+#include "Headless.h"
+#include "Autosave.h"
+#include "Monitor.h"
+#include "Log.h"
+
+namespace
+{
+    // samples wait in the capture ring in between, it holds seconds of them
+    constexpr std::chrono::milliseconds DrainInterval(100);
+
+    volatile std::sig_atomic_t g_Stop = 0;
+
+    extern "C" void OnStopSignal(int)
+    {
+        g_Stop = 1;
+    }
+}
+
+
+int RunHeadless(const Options& opt)
+{
+    if (opt.autosavePath.empty() && opt.logPath.empty())
+    {
+        Err << "{Headless} Nothing would be kept, pass --autosave <file> and/or --log <file>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // glfw only reads the monitor layout, no window or context is created
+    if (!glfwInit())
+    {
+        Err << "{Headless} glfwInit() failed!" << std::endl;
+        return EXIT_FAILURE;
+    }
+    const std::vector<MonitorInfo> mInfo = GetMonitors(); // mInfo[0] primary monitor, the last one "All" if there are several
+    glfwTerminate();
+    if (mInfo.empty() || opt.monitor >= mInfo.size())
+    {
+        Err << "{Headless} Monitor " << opt.monitor << " doesn't exist, there are " << mInfo.size() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const MonitorInfo& sm = mInfo[opt.monitor];
+    const Canvas::Format format = TileFormatFromName(opt.format);
+    const Brush brush(opt.brushShape, opt.brushRadius);
+    StrokeCanvas canvas(format);
+    canvas.Resize(sm.w, sm.h);
+    if (mInfo.size() > 1 && opt.monitor == mInfo.size() - 1)
+    {
+        // the area between the monitors is transparent
+        std::vector<Rect> monitors;
+        for (size_t i = 0; i + 1 < mInfo.size(); ++i)
+            monitors.push_back(Rect::FromSize(mInfo[i].x - sm.x, mInfo[i].y - sm.y, mInfo[i].w, mInfo[i].h));
+        canvas.GetCanvas().SetMonitors(std::move(monitors));
+    }
+
+    std::unique_ptr<Autosave> autosave;
+    if (!opt.autosavePath.empty())
+    {
+        autosave = std::make_unique<Autosave>(TrackFile::HasExtension(opt.autosavePath) ? opt.autosavePath : opt.autosavePath + TrackFile::Extension, std::chrono::seconds(opt.autosaveInterval));
+        const std::optional<std::string> errorMsg = autosave->Restore(canvas);
+        if (errorMsg.has_value())
+        {
+            // nobody would see a warning, better not to track than to overwrite it
+            Err << "{Headless} " << errorMsg.value() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::unique_ptr<CursorSource> source;
+    if (opt.replayPath.empty())
+        source = CreateSystemCursorSource(opt.rate);
+    else
+        source = std::make_unique<ReplayCursorSource>(opt.replayPath, opt.replayMaxSpeed);
+
+    std::unique_ptr<SessionLogWriter> log;
+    if (!opt.logPath.empty())
+    {
+        log = std::make_unique<SessionLogWriter>(opt.logPath);
+        log->SetRecording(true);
+    }
+
+    std::signal(SIGINT, OnStopSignal);
+    std::signal(SIGTERM, OnStopSignal);
+#ifdef SIGBREAK
+    std::signal(SIGBREAK, OnStopSignal);
+#endif
+
+    Log << "{Headless} Tracking monitor " << opt.monitor << " w: " << sm.w << " h: " << sm.h << std::endl;
+    uint64_t drawn = 0;
+    {
+        CursorCapture capture(std::move(source), 1 << 14, log.get());
+        std::vector<Sample> samples(capture.Capacity());
+        bool finished = false;
+        while (!finished)
+        {
+            finished = g_Stop != 0 || capture.Finished();
+            if (finished)
+                capture.Stop(); // everything in the session log is drawn as well
+            size_t count;
+            while ((count = capture.Drain(samples.data(), samples.size())) != 0)
+            {
+                canvas.DrawStroke(samples.data(), count, sm.x, sm.y, brush);
+                drawn += count;
+            }
+            if (autosave != nullptr)
+                autosave->Update(canvas);
+            if (!finished)
+                std::this_thread::sleep_for(DrainInterval);
+        }
+    }
+    if (autosave != nullptr)
+        autosave->Update(canvas, true);
+    Log << "{Headless} Stopped after drawing " << drawn << " samples" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include "Options.h"
+
+// Tracks without a window, GL context or ImGui: the cursor is captured and
+// drawn onto the canvas of --monitor, which is persisted by --autosave and
+// the samples by --log. Runs until the replay ends or SIGINT/SIGTERM (Ctrl+C)
+// arrives, the last changes are saved before it returns.
+int RunHeadless(const Options& opt);
@@ -2,102 +2,130 @@
 #include <filesystem>
 #include <algorithm>
 #include <optional>
-#include <cstring>
+#include <cstdint>
+#include <utility>
 #include <string>
-#include <new>
+#include <vector>
+#include <cctype>
+#include <chrono>
 
-#define STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "GLFW/glfw3.h"
 #include "ImGui/imgui.h"
-#include "stb/stb_image.h"
-#include "stb/stb_image_write.h"
 
+#include "SessionReplay.h"
+#include "TextureStream.h"
+#include "TextureGrid.h"
+#include "Pyramid.h"
+#include "FrameStats.h"
+#include "StrokeCanvas.h"
+#include "Canvas.h"
+#include "Sample.h"
+#include "Rect.h"
 #include "Log.h"
 
 class Image
 {
+public:
+    using Format = Canvas::Format;
+    using GpuTile = TextureGrid::Cell;
 private:
-    static constexpr int Channel = 4;
+    static constexpr int Channel = Canvas::Channel;
+    static constexpr size_t BandBytes = 4 * 1024 * 1024; // upper bound of RGBA expanded per glTexSubImage2D
+    static constexpr GLint ClampToEdge = 0x812F; // GL_CLAMP_TO_EDGE, GL 1.2
     int m_Width  = 0;
     int m_Height = 0;
-    unsigned char* m_Data = nullptr;
-    GLuint m_GpuImage = 0;
+    StrokeCanvas m_Strokes;
+    TextureStream m_Stream;
+    FrameStats m_UploadTime;
+    TextureGrid m_Grid;              // textures each within GL_MAX_TEXTURE_SIZE
+    int m_TextureLimit = 0;          // 0 = GL_MAX_TEXTURE_SIZE
+    int m_Level = 0;                 // pyramid level shown by the textures
+    Pyramid m_Pyramid;
+    PngOptions m_PngOptions;
+    size_t m_UploadedBytes = 0; // bytes passed to the driver by the last Upload()
 private:
-    constexpr int GetIndex(int x, int y) const
-    {
-        if (x < 0 || y < 0 || x >= m_Width || y >= m_Height)
-            return -1;
-        return (m_Width * y + x) * Channel;
-    }
-
-
-    inline GLuint GenerateTexture() const
+    static inline GLuint GenerateTexture(int width, int height)
     {
         // Create a OpenGL texture identifier
         GLuint img;
         glGenTextures(1, &img);
         glBindTexture(GL_TEXTURE_2D, img);
 
-        // Setup filtering parameters for display
+        // Setup filtering parameters for display, clamp so neighbouring textures don't bleed into each other
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, ClampToEdge);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, ClampToEdge);
 
-        glTexImage2D(GL_TEXTURE_2D, 0, Channel, m_Width, m_Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, m_Data);
-        Log << "Generated opengl texture w: " << m_Width << " h: " << m_Height << " texture: " << img << std::endl;
+        // content is uploaded by the first Upload()
+        glTexImage2D(GL_TEXTURE_2D, 0, Channel, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        Log << "Generated opengl texture w: " << width << " h: " << height << " texture: " << img << std::endl;
         return img;
     }
 
 
-    inline bool SetPixel(int x, int y, bool bigPixelMode)
+    // Covers the current pyramid level
+    inline void GenerateTextures()
     {
-        auto SetDataAtIndex = [this](int a, int b)
-        {
-            const int index = GetIndex(a, b);
-            if (index != -1)
-            {
-                m_Data[index] = 0;   // R
-                m_Data[index+1] = 0; // G
-                m_Data[index+2] = 0; // B
-                return true;
-            }
-            return false;
-        };
+        const int width = Pyramid::LevelSize(m_Width, m_Level);
+        const int height = Pyramid::LevelSize(m_Height, m_Level);
+        GLint maxSize = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+        const int limit = TextureGrid::CellSize(m_TextureLimit, (int)maxSize, width, height);
+        m_Grid.Layout(width, height, m_Level, limit);
+        for (GpuTile& tile : m_Grid.Cells())
+            tile.texture = GenerateTexture(tile.area.Width(), tile.area.Height());
+        Log << "{Image} Using " << m_Grid.Cells().size() << " texture(s) of at most " << limit << 'x' << limit << " for level " << m_Level << std::endl;
+    }
+
 
-        const bool inRange = SetDataAtIndex(x, y);
-        if (bigPixelMode && inRange)
+    inline void Free()
+    {
+        for (const GpuTile& tile : m_Grid.Cells())
         {
-            SetDataAtIndex(x+1, y);
-            SetDataAtIndex(x-1, y);
-            SetDataAtIndex(x, y+1);
-            SetDataAtIndex(x, y-1);
-            SetDataAtIndex(x+1, y+1);
-            SetDataAtIndex(x+1, y-1);
-            SetDataAtIndex(x-1, y+1);
-            SetDataAtIndex(x-1, y-1);
+            glDeleteTextures(1, &tile.texture);
+            Log << "Deleted image texture: " << tile.texture << std::endl;
         }
-        return inRange;
+        m_Grid.Clear();
     }
 
 
-    inline void DeleteTexture() const
+    inline void MarkAllDirty()
     {
-        if (m_GpuImage == 0 || m_Data == nullptr)
-            return;
+        m_Grid.MarkAllDirty();
+    }
+
 
-        delete[] m_Data;
-        glDeleteTextures(1, &m_GpuImage);
-        Log << "Deleted image texture: " << m_GpuImage << std::endl;
+    // Everything changed, the canvas may even have another format or monitor layout
+    inline void ChangedAll()
+    {
+        MarkAllDirty();
+        m_Strokes.ChangedAll();
     }
 
 
-    inline void UpdateGpu() const
+    // Expands the dirty part of the tile into the stream and uploads it
+    inline void UploadTile(GpuTile& tile)
     {
-        glBindTexture(GL_TEXTURE_2D, m_GpuImage);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_Width, m_Height, GL_RGBA, GL_UNSIGNED_BYTE, m_Data);
+        // expand in bands so the buffers stay small even if everything is dirty
+        glBindTexture(GL_TEXTURE_2D, tile.texture);
+        const Rect dirty = std::exchange(tile.dirty, Rect());
+        const size_t rowBytes = (size_t)dirty.Width() * Channel;
+        const int bandRows = std::min(dirty.Height(), std::max(1, (int)(BandBytes / rowBytes)));
+        for (int y = dirty.y0; y < dirty.y1; y += bandRows)
+        {
+            const int rows = std::min(bandRows, dirty.y1 - y);
+            unsigned char* band = m_Stream.Map(rowBytes * (size_t)rows);
+            for (int row = 0; row < rows; ++row)
+                m_Pyramid.ExpandRow(m_Strokes.GetCanvas(), m_Level, y + row, dirty.x0, dirty.x1, band + (size_t)row * rowBytes);
+            if (m_Stream.Submit(dirty.x0 - tile.area.x0, y - tile.area.y0, dirty.Width(), rows))
+                m_UploadedBytes += rowBytes * (size_t)rows;
+            else
+                tile.dirty.Add(dirty.x0, y, dirty.Width(), rows); // retried next frame
+        }
     }
 public:
-    inline Image(int width, int height)
+    inline Image(int width, int height, Format format = Format::RGBA8) : m_Strokes(format)
     {
         Resize(width, height);
     }
@@ -105,96 +133,212 @@ public:
 
     inline ~Image()
     {
-        DeleteTexture();
+        Free();
     }
 
 
+    // Canvas tiles are allocated on first write, only the textures are created here
     inline std::optional<std::string> Resize(int width, int height)
     {
-        DeleteTexture();
-        const size_t pixel = (size_t)(width * height * Channel);
-        m_Data = new (std::nothrow) unsigned char[pixel];
-        if (m_Data == nullptr)
+        Free();
+        m_Width = width;
+        m_Height = height;
+        m_Strokes.Resize(width, height);
+        GenerateTextures();
+        MarkAllDirty();
+        Log << "{Image} Resized to w: " << m_Width << " h: " << m_Height << std::endl;
+        return std::nullopt;
+    }
+
+
+    // Converts the current content to the new storage format
+    inline std::optional<std::string> SetFormat(Format format)
+    {
+        if (format == m_Strokes.GetCanvas().GetFormat())
+            return std::nullopt;
+
+        const bool converted = m_Strokes.GetCanvas().SetFormat(format);
+        ChangedAll();
+        if (!converted)
         {
-            const std::string errorMsg = "Failed to allocate memory for the internal array!";
+            const std::string errorMsg = "Ran out of memory while converting the image, parts of it are lost!";
             Err << "{Image} " << errorMsg << std::endl;
             return { errorMsg };
         }
-        std::memset(m_Data, 255, pixel);
-        m_Width = width;
-        m_Height = height;
-        m_GpuImage = GenerateTexture();
+        Log << "{Image} Changed storage format, now using " << MemoryUsage() << " bytes" << std::endl;
         return std::nullopt;
     }
 
 
     inline ImVec2 Resolution() const
-    { 
-        return { static_cast<float>(m_Width), static_cast<float>(m_Height) }; 
+    {
+        return { static_cast<float>(m_Width), static_cast<float>(m_Height) };
     }
 
 
-    constexpr GLuint GetGpuImage() const
-    { 
-        return m_GpuImage; 
+    inline const std::vector<GpuTile>& GetGpuTiles() const
+    {
+        return m_Grid.Cells();
     }
 
 
-    inline void Update(int x, int y, bool bpm)
+    // Caps the size of the textures below GL_MAX_TEXTURE_SIZE, 0 removes the cap
+    inline void LimitTextureSize(int size)
     {
-        if (SetPixel(x, y, bpm))
-            UpdateGpu();
+        m_TextureLimit = size;
+        Free();
+        GenerateTextures();
+        MarkAllDirty();
     }
 
 
-    inline int AlphaIsNeeded() const
+    // Switches to the pyramid level matching the size the image is displayed with,
+    // scale = displayed / image size
+    inline void SetViewScale(float scale)
     {
-        for (size_t i = 3; i < (size_t)(m_Width * m_Height * Channel); i += 4)
-        {
-            if (m_Data[i] == 0)
-                return true;
-        }
-        return false;
+        const int level = Pyramid::LevelFor(scale);
+        if (level == m_Level)
+            return;
+
+        m_Level = level;
+        Free();
+        GenerateTextures();
+        MarkAllDirty();
+    }
+
+
+    // The textures show the image downsampled by this factor
+    constexpr int PreviewFactor() const
+    {
+        return 1 << m_Level;
+    }
+
+
+    inline Format GetFormat() const
+    {
+        return m_Strokes.GetCanvas().GetFormat();
+    }
+
+
+    inline void SetHeatmapScale(HeatmapScale scale)
+    {
+        m_Strokes.GetCanvas().SetHeatmapScale(scale);
+        if (m_Strokes.GetCanvas().GetFormat() == Format::Count16)
+            MarkAllDirty();
+    }
+
+
+    inline HeatmapScale GetHeatmapScale() const
+    {
+        return m_Strokes.GetCanvas().GetHeatmapScale();
+    }
+
+
+    constexpr size_t UploadedBytes() const
+    {
+        return m_UploadedBytes;
     }
 
 
-    inline void RemoveGBAFromData(unsigned char* data) const
+    // CPU side memory of the canvas
+    inline size_t MemoryUsage() const
     {
-        size_t mainDataIndex = 0;
-        for (size_t i = 0; i < (size_t)(m_Width * m_Height); ++i)
+        return m_Strokes.GetCanvas().MemoryUsage() + m_Stream.MemoryUsage() + m_Pyramid.MemoryUsage();
+    }
+
+
+    // Connects the samples (offset by -ox/-oy) with lines stamped with brush, continuing the previous stroke
+    inline void DrawStroke(const Sample* samples, size_t count, int ox, int oy, const Brush& brush)
+    {
+        m_Strokes.DrawStroke(samples, count, ox, oy, brush, [&](const Rect& area) { m_Grid.MarkDirty(area); });
+    }
+
+
+    // The next DrawStroke() call starts a new line instead of connecting to the last point
+    inline void EndStroke()
+    {
+        m_Strokes.EndStroke();
+    }
+
+
+    // Uploads only the regions written since the last call, should be called once per frame
+    inline void Upload()
+    {
+        const auto start = std::chrono::steady_clock::now();
+        m_UploadedBytes = 0;
+        if (m_Strokes.GetCanvas().FitColormap())
+            MarkAllDirty(); // the color of every count changed
+
+        for (GpuTile& tile : m_Grid.Cells())
         {
-            data[i] = static_cast<unsigned char>((m_Data[mainDataIndex] + m_Data[mainDataIndex + 1] + m_Data[mainDataIndex + 2]) / 3);
-            mainDataIndex += 4;
+            if (!tile.dirty.Empty())
+                UploadTile(tile);
         }
+        if (m_UploadedBytes != 0)
+            m_UploadTime.Add(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
     }
 
 
-    inline int SaveToFile(const char* path) const
+    // Something changed that the next Upload() has to show
+    inline bool Dirty() const
     {
-        const auto stbiWriteWAlphaFunc = [&](){ return stbi_write_png(path, m_Width, m_Height, Channel, m_Data, m_Width * Channel); };
-        if (AlphaIsNeeded())
-            return stbiWriteWAlphaFunc();
+        return m_Grid.Dirty();
+    }
 
-        unsigned char* data = new (std::nothrow) unsigned char[(size_t)m_Width * (size_t)m_Height];
-        if (data == nullptr)
-            return stbiWriteWAlphaFunc();
 
-        RemoveGBAFromData(data);
-        const int error = stbi_write_png(path, m_Width, m_Height, 1, data, m_Width);
-        delete[] data;
-        return error;
+    // Pixel buffer objects are used if the driver supports them
+    inline void StreamUploads(bool enable)
+    {
+        m_Stream.Enable(enable);
     }
 
 
-    inline bool WriteToFile(const std::filesystem::path& path) const
+    inline const TextureStream& GetTextureStream() const
+    {
+        return m_Stream;
+    }
+
+
+    // CPU time spent in Upload() for the frames that uploaded something
+    inline const FrameStats& UploadTime() const
+    {
+        return m_UploadTime;
+    }
+
+
+    // Appends extension (lower case, with the dot) unless path already has it
+    static inline std::filesystem::path WithExtension(const std::filesystem::path& path, const std::string& extension)
+    {
+        std::string current = path.extension().string();
+        std::transform(current.begin(), current.end(), current.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (current == extension)
+            return path;
+        return path.string() + extension;
+    }
+
+
+    inline void SetPngOptions(const PngOptions& options)
     {
-        std::string pathStr = path.string();
-        std::string extension = path.extension().string();
-        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
-        if (extension != ".png")
-            pathStr += ".png";
+        m_PngOptions = options;
+    }
+
+
+    inline const PngOptions& GetPngOptions() const
+    {
+        return m_PngOptions;
+    }
 
-        if(SaveToFile(pathStr.c_str()) == 0)
+
+    // Copy of the content to save on another thread (see ImageSaver)
+    inline std::optional<Canvas> Snapshot() const
+    {
+        return m_Strokes.GetCanvas().Snapshot();
+    }
+
+
+    inline bool WriteToFile(const std::filesystem::path& path) const
+    {
+        if (!m_Strokes.GetCanvas().SaveToFile(WithExtension(path, ".png").string().c_str(), m_PngOptions))
         {
             Err << "Failed to write image w: " << m_Width << " h: " << m_Height << " [" << path << "]" << std::endl;
             return false;
@@ -204,68 +348,46 @@ public:
     }
 
 
-    inline std::optional<std::string> LoadFromFile(const std::string& path)
+    // journal (if any) holds the changes made after path, a track, was written
+    inline std::optional<std::string> LoadFromFile(const std::string& path, const std::filesystem::path& journal = {})
     {
-        int width, height, cmp;
-        unsigned char* data = stbi_load(path.data(), &width, &height, &cmp, Channel);
-        if (data == NULL)
-        {
-            const std::string errorMsg = "Failed to load image [" + path + "]";
-            Err << errorMsg << std::endl;
-            return { errorMsg };
-        }
-        if (width != m_Width || height != m_Height)
-        {
-            stbi_image_free(data);
-            std::string msg = "Couldn't load image since it doesn't match the monitors resolution!\nMonitor: ";
-            msg += std::to_string(m_Width) + 'x' + std::to_string(m_Height) + "\nImage: ";
-            msg += std::to_string(width) + 'x' + std::to_string(height);
-
-            const std::string msgNl = msg;
-            std::replace(msg.begin(), msg.end(), '\n', ' ');
-            Err << msg << std::endl;
-            return { msgNl };
-        }
+        const std::optional<std::string> errorMsg = m_Strokes.LoadFromFile(path, journal, m_PngOptions.threads);
+        MarkAllDirty();
+        return errorMsg;
+    }
 
-        std::memcpy(m_Data, data, (size_t)(m_Width * m_Height * Channel));
-        stbi_image_free(data);
-        UpdateGpu();
-        Log << "Successfully loaded image from file w: " << m_Width << " h: " << m_Height << " [" << path << "]" << std::endl;
-        return std::nullopt;
+
+    // Replaces the content with the samples of a session log within range
+    inline std::optional<std::string> ReplayLog(const std::filesystem::path& path, int ox, int oy, ReplayRange range, const Brush& brush, unsigned threads)
+    {
+        m_Strokes.GetCanvas().Clear();
+        EndStroke();
+        const std::optional<std::string> errorMsg = SessionReplay::Render(path, m_Strokes.GetCanvas(), ox, oy, range, brush, threads);
+        ChangedAll();
+        return errorMsg;
     }
 
 
     inline void Reset()
     {
-        std::memset(m_Data, 255, (size_t)(m_Width * m_Height * Channel));
-        UpdateGpu();
+        m_Strokes.GetCanvas().Clear();
+        ChangedAll();
         Log << "{Image} Reset image w: " << m_Width << " h: " << m_Height << std::endl;
     }
 
 
-    inline void SetAllPixel(int c)
+    // Everything outside of the given rectangles becomes transparent (not covered by a monitor)
+    inline void SetMonitorMask(std::vector<Rect> monitors)
     {
-        std::memset(m_Data, c, (size_t)(m_Width * m_Height * Channel));
-        UpdateGpu();
+        m_Strokes.GetCanvas().SetMonitors(std::move(monitors));
+        ChangedAll();
     }
 
 
-    inline void SetPixelRange(int x, int y, int w, int h, unsigned char c)
+
+    // For checkpoints (see Autosave), what is drawn through it doesn't reach the textures
+    inline StrokeCanvas& Strokes()
     {
-        for (int i = x; i < x+w; ++i)
-        {
-            for (int k = y; k < y+h; ++k)
-            {
-                const int index = GetIndex(i, k);
-                if (index != -1)
-                {
-                    m_Data[index] = c;
-                    m_Data[index+1] = c;
-                    m_Data[index+2] = c;
-                    m_Data[index+3] = c;
-                }
-            }
-        }
-        UpdateGpu();
+        return m_Strokes;
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,56 @@
+#include <utility>
+
+#include "ImageSaver.h"
+#include "Log.h"
+
+ImageSaver::~ImageSaver()
+{
+    // a running save is finished, not abandoned
+    if (m_Thread.joinable())
+        m_Thread.join();
+}
+
+
+bool ImageSaver::Start(Canvas snapshot, const std::filesystem::path& path, const PngOptions& options)
+{
+    if (Busy())
+        return false;
+    if (m_Thread.joinable())
+        m_Thread.join();
+
+    m_Snapshot = std::move(snapshot);
+    m_Path = path;
+    m_Options = options;
+    m_Track = TrackFile::HasExtension(path);
+    m_Total = m_Track ? (int)m_Snapshot->TileCount() : m_Snapshot->Height();
+    m_Done = 0;
+    m_Start = std::chrono::steady_clock::now();
+    m_State.store(State::Saving, std::memory_order_release);
+    m_Thread = std::thread(&ImageSaver::Run, this);
+    return true;
+}
+
+
+std::optional<bool> ImageSaver::TakeResult()
+{
+    State done = State::Done;
+    if (!m_State.compare_exchange_strong(done, State::Idle, std::memory_order_acquire))
+        return std::nullopt;
+    return m_Result;
+}
+
+
+void ImageSaver::Run()
+{
+    if (m_Track)
+        m_Result = m_Snapshot->SaveTrack(m_Path, m_Options.threads, &m_Done);
+    else
+        m_Result = m_Snapshot->SaveToFile(m_Path.string().c_str(), m_Options, &m_Done);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_Start).count();
+    if (m_Result)
+        Log << "{ImageSaver} Wrote image w: " << m_Snapshot->Width() << " h: " << m_Snapshot->Height() << " in " << seconds << " s [" << m_Path << "]" << std::endl;
+    else
+        Err << "{ImageSaver} Failed to write image w: " << m_Snapshot->Width() << " h: " << m_Snapshot->Height() << " [" << m_Path << "]" << std::endl;
+    m_Snapshot.reset();
+    m_State.store(State::Done, std::memory_order_release);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <filesystem>
+#include <optional>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#include "Canvas.h"
+
+// Encodes and writes a snapshot of the canvas on a worker thread so tracking
+// and rendering go on while a large image is saved. The snapshot is taken on
+// the render thread before the save starts, later drawing doesn't affect it.
+class ImageSaver
+{
+private:
+    enum class State { Idle, Saving, Done };
+    std::thread m_Thread;
+    std::optional<Canvas> m_Snapshot;
+    std::filesystem::path m_Path;
+    bool m_Track = false;
+    PngOptions m_Options;
+    std::atomic<State> m_State{ State::Idle };
+    std::atomic<int> m_Done{ 0 }; // rows of a PNG, tiles of a track
+    int m_Total = 0;
+    bool m_Result = false;
+    std::chrono::steady_clock::time_point m_Start;
+private:
+    void Run();
+public:
+    inline ImageSaver() = default;
+    ~ImageSaver();
+    ImageSaver(const ImageSaver&) = delete;
+    ImageSaver& operator=(const ImageSaver&) = delete;
+
+    // Saves the snapshot to path, as a track if it has the track extension and as PNG
+    // otherwise. False if the previous save hasn't finished yet
+    bool Start(Canvas snapshot, const std::filesystem::path& path, const PngOptions& options = {});
+
+    // The result of a finished save, returned once
+    std::optional<bool> TakeResult();
+
+    // Share of the rows or tiles compressed so far, writing the file follows the last one
+    inline float Progress() const
+    {
+        return m_Total == 0 ? 0.f : (float)m_Done.load(std::memory_order_relaxed) / (float)m_Total;
+    }
+
+    inline bool Busy()                         const { return m_State.load(std::memory_order_acquire) == State::Saving; }
+    inline bool HasResult()                    const { return m_State.load(std::memory_order_acquire) == State::Done;   }
+    inline const std::filesystem::path& Path() const { return m_Path;                                                  }
+};
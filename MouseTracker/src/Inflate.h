@@ -0,0 +1,368 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <array>
+
+#include "Deflate.h"
+
+// Streaming zlib (RFC 1950/1951) decoder. The compressed stream is pulled in
+// pieces and the output pushed out in pieces, only the 32 KB window the back
+// references need is kept, so nothing is ever held in full.
+namespace Deflate
+{
+    class Inflater
+    {
+    private:
+        static constexpr int FastBits = 9;
+        static constexpr int MaxBits = 15;
+        static constexpr size_t InputBytes = 64 * 1024;
+        static constexpr size_t OutputBytes = 64 * 1024; // written in pieces of this size (plus the window)
+
+        // Canonical code, codes up to FastBits long are looked up at once
+        struct Huffman
+        {
+            std::array<uint16_t, 1 << FastBits> fast{}; // length << 9 | symbol, 0 = longer code
+            uint16_t counts[MaxBits + 1] = {};
+            uint16_t symbols[288] = {};
+
+            // False if the lengths are over-subscribed, incomplete codes are allowed
+            inline bool Build(const unsigned char* lengths, size_t n)
+            {
+                fast.fill(0);
+                std::fill(std::begin(counts), std::end(counts), (uint16_t)0);
+                for (size_t i = 0; i < n; ++i)
+                    ++counts[lengths[i]];
+                counts[0] = 0;
+
+                int left = 1;
+                uint16_t offsets[MaxBits + 2] = {};
+                for (int len = 1; len <= MaxBits; ++len)
+                {
+                    left = (left << 1) - counts[len];
+                    if (left < 0)
+                        return false;
+                    offsets[len + 1] = (uint16_t)(offsets[len] + counts[len]);
+                }
+                for (size_t i = 0; i < n; ++i)
+                    if (lengths[i] != 0)
+                        symbols[offsets[lengths[i]]++] = (uint16_t)i;
+
+                // canonical codes are assigned in symbol order, deflate sends them msb first
+                uint32_t code = 0;
+                size_t index = 0;
+                for (int len = 1; len <= FastBits; ++len)
+                {
+                    for (uint16_t k = 0; k < counts[len]; ++k, ++code, ++index)
+                    {
+                        uint32_t reversed = 0;
+                        for (int b = 0; b < len; ++b)
+                            reversed |= ((code >> b) & 1) << (len - 1 - b);
+                        for (uint32_t fill = reversed; fill < fast.size(); fill += 1u << len)
+                            fast[fill] = (uint16_t)(len << 9 | symbols[index]);
+                    }
+                    code <<= 1;
+                }
+                return true;
+            }
+        };
+
+        const unsigned char* m_In = nullptr;
+        size_t m_InSize = 0;
+        size_t m_InPos = 0;
+        uint64_t m_Bits = 0;
+        int m_BitCount = 0;
+        size_t m_Overrun = 0; // zero bytes fed past the end of the input
+        std::vector<unsigned char> m_Input;
+        std::vector<unsigned char> m_Out;
+        size_t m_OutPos = 0;
+        size_t m_Flushed = 0;
+        uint64_t m_Total = 0;
+        uint32_t m_Adler = 1;
+        Huffman m_LitLen;
+        Huffman m_Dist;
+    private:
+        template <class ReadFn>
+        inline void Refill(ReadFn& read)
+        {
+            while (m_BitCount <= 56)
+            {
+                if (m_InPos == m_InSize)
+                {
+                    m_InSize = read(m_Input.data(), m_Input.size());
+                    m_In = m_Input.data();
+                    m_InPos = 0;
+                    if (m_InSize == 0)
+                    {
+                        ++m_Overrun;
+                        m_BitCount += 8;
+                        continue;
+                    }
+                }
+                m_Bits |= (uint64_t)m_In[m_InPos++] << m_BitCount;
+                m_BitCount += 8;
+            }
+        }
+
+
+        template <class ReadFn>
+        inline uint32_t Get(ReadFn& read, int n)
+        {
+            if (m_BitCount < n)
+                Refill(read);
+            const uint32_t v = (uint32_t)(m_Bits & ((uint64_t(1) << n) - 1));
+            m_Bits >>= n;
+            m_BitCount -= n;
+            return v;
+        }
+
+
+        // -1 for an invalid code
+        template <class ReadFn>
+        inline int Decode(ReadFn& read, const Huffman& h)
+        {
+            if (m_BitCount < MaxBits)
+                Refill(read);
+            const uint16_t entry = h.fast[m_Bits & ((1u << FastBits) - 1)];
+            if (entry != 0)
+            {
+                m_Bits >>= entry >> 9;
+                m_BitCount -= entry >> 9;
+                return entry & 0x1FF;
+            }
+
+            int code = 0, first = 0, index = 0;
+            for (int len = 1; len <= MaxBits; ++len)
+            {
+                code |= (int)((m_Bits >> (len - 1)) & 1);
+                const int count = h.counts[len];
+                if (code - count < first)
+                {
+                    m_Bits >>= len;
+                    m_BitCount -= len;
+                    return h.symbols[index + code - first];
+                }
+                index += count;
+                first = (first + count) << 1;
+                code <<= 1;
+            }
+            return -1;
+        }
+
+
+        template <class WriteFn>
+        inline bool Flush(WriteFn& write)
+        {
+            const size_t n = m_OutPos - m_Flushed;
+            if (n == 0)
+                return true;
+            m_Adler = Adler32(&m_Out[m_Flushed], n, m_Adler);
+            if (!write(&m_Out[m_Flushed], n))
+                return false;
+
+            // keep the window at the front for the back references
+            const size_t keep = std::min(m_OutPos, Window);
+            std::memmove(m_Out.data(), &m_Out[m_OutPos - keep], keep);
+            m_OutPos = keep;
+            m_Flushed = keep;
+            return true;
+        }
+
+
+        template <class ReadFn>
+        inline bool ReadDynamic(ReadFn& read)
+        {
+            static constexpr uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+            const size_t lit = Get(read, 5) + 257u;
+            const size_t dist = Get(read, 5) + 1u;
+            const size_t codeLen = Get(read, 4) + 4u;
+            if (lit > 286 || dist > 30)
+                return false;
+
+            unsigned char lengths[286 + 30] = {};
+            for (size_t i = 0; i < codeLen; ++i)
+                lengths[order[i]] = (unsigned char)Get(read, 3);
+            Huffman lengthCode;
+            if (!lengthCode.Build(lengths, 19))
+                return false;
+
+            std::fill(std::begin(lengths), std::end(lengths), (unsigned char)0);
+            for (size_t i = 0; i < lit + dist;)
+            {
+                const int symbol = Decode(read, lengthCode);
+                if (symbol < 0)
+                    return false;
+                if (symbol < 16)
+                {
+                    lengths[i++] = (unsigned char)symbol;
+                    continue;
+                }
+
+                unsigned char value = 0;
+                size_t repeat;
+                if (symbol == 16)
+                {
+                    if (i == 0)
+                        return false;
+                    value = lengths[i - 1];
+                    repeat = 3 + Get(read, 2);
+                }
+                else if (symbol == 17)
+                    repeat = 3 + Get(read, 3);
+                else
+                    repeat = 11 + Get(read, 7);
+                if (i + repeat > lit + dist)
+                    return false;
+                std::memset(&lengths[i], value, repeat);
+                i += repeat;
+            }
+            return lengths[256] != 0 && m_LitLen.Build(lengths, lit) && m_Dist.Build(lengths + lit, dist);
+        }
+
+
+        inline void UseFixed()
+        {
+            static const auto tables = []()
+            {
+                std::pair<Huffman, Huffman> t;
+                unsigned char lengths[288];
+                std::fill(lengths, lengths + 144, (unsigned char)8);
+                std::fill(lengths + 144, lengths + 256, (unsigned char)9);
+                std::fill(lengths + 256, lengths + 280, (unsigned char)7);
+                std::fill(lengths + 280, lengths + 288, (unsigned char)8);
+                t.first.Build(lengths, 288);
+                std::fill(lengths, lengths + 30, (unsigned char)5);
+                t.second.Build(lengths, 30);
+                return t;
+            }();
+            m_LitLen = tables.first;
+            m_Dist = tables.second;
+        }
+
+
+        template <class ReadFn, class WriteFn>
+        inline bool Stored(ReadFn& read, WriteFn& write)
+        {
+            Get(read, m_BitCount & 7); // to the byte boundary
+            const uint32_t len = Get(read, 16);
+            if ((Get(read, 16) ^ 0xFFFF) != len)
+                return false;
+
+            // the bit buffer holds whole bytes now, drain it before the input
+            for (uint32_t i = 0; i < len; ++i)
+            {
+                if (m_BitCount == 0 && m_InPos < m_InSize)
+                {
+                    const size_t n = std::min<size_t>({ len - i, m_InSize - m_InPos, m_Out.size() - m_OutPos });
+                    std::memcpy(&m_Out[m_OutPos], m_In + m_InPos, n);
+                    m_InPos += n;
+                    m_OutPos += n;
+                    i += (uint32_t)n - 1;
+                }
+                else
+                    m_Out[m_OutPos++] = (unsigned char)Get(read, 8);
+                if (m_OutPos == m_Out.size() && !Flush(write))
+                    return false;
+            }
+            m_Total += len;
+            return true;
+        }
+
+
+        template <class ReadFn, class WriteFn>
+        inline bool Compressed(ReadFn& read, WriteFn& write)
+        {
+            static constexpr uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+            static constexpr uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+            static constexpr uint16_t distBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+            static constexpr uint8_t distExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+            for (;;)
+            {
+                const int symbol = Decode(read, m_LitLen);
+                if (symbol < 0 || m_Overrun > 8)
+                    return false;
+                if (symbol < 256)
+                {
+                    m_Out[m_OutPos++] = (unsigned char)symbol;
+                    ++m_Total;
+                    if (m_OutPos == m_Out.size() && !Flush(write))
+                        return false;
+                    continue;
+                }
+                if (symbol == 256)
+                    return true;
+                if (symbol > 285)
+                    return false;
+
+                size_t length = lengthBase[symbol - 257] + Get(read, lengthExtra[symbol - 257]);
+                const int d = Decode(read, m_Dist);
+                if (d < 0 || d > 29)
+                    return false;
+                const size_t distance = distBase[d] + Get(read, distExtra[d]);
+                if (distance > m_Total)
+                    return false;
+
+                m_Total += length;
+                while (length != 0)
+                {
+                    const size_t n = std::min(length, m_Out.size() - m_OutPos);
+                    unsigned char* dst = &m_Out[m_OutPos];
+                    // an overlapping copy repeats the last distance bytes, whole periods are
+                    // copied at once and each copy doubles the period that can be copied next
+                    for (size_t done = 0, step = distance; done < n; step *= 2)
+                    {
+                        const size_t c = std::min(n - done, step);
+                        std::memcpy(dst + done, dst + done - step, c);
+                        done += c;
+                    }
+                    m_OutPos += n;
+                    length -= n;
+                    if (m_OutPos == m_Out.size() && !Flush(write))
+                        return false;
+                }
+            }
+        }
+    public:
+        inline Inflater() : m_Input(InputBytes), m_Out(Window + OutputBytes) {}
+
+
+        // read(buffer, capacity) returns the number of bytes read, 0 at the end.
+        // write(data, size) gets the output in order and returns false to stop.
+        // False if the stream is malformed, truncated or fails its checksum.
+        template <class ReadFn, class WriteFn>
+        inline bool Run(ReadFn&& read, WriteFn&& write)
+        {
+            const uint32_t cmf = Get(read, 8);
+            const uint32_t flg = Get(read, 8);
+            if ((cmf & 15) != 8 || (cmf >> 4) > 7 || (cmf * 256 + flg) % 31 != 0 || (flg & 32) != 0)
+                return false;
+
+            bool final = false;
+            while (!final)
+            {
+                final = Get(read, 1) != 0;
+                bool ok = false;
+                switch (Get(read, 2))
+                {
+                case 0: ok = Stored(read, write); break;
+                case 1: UseFixed(); ok = Compressed(read, write); break;
+                case 2: ok = ReadDynamic(read) && Compressed(read, write); break;
+                default: break;
+                }
+                if (!ok || m_Overrun > 8)
+                    return false;
+            }
+            if (!Flush(write))
+                return false;
+
+            Get(read, m_BitCount & 7);
+            uint32_t adler = 0;
+            for (int i = 0; i < 4; ++i)
+                adler = adler << 8 | Get(read, 8);
+            return m_Overrun * 8 <= (size_t)m_BitCount && adler == m_Adler; // the padding wasn't consumed
+        }
+    };
+}
@@ -0,0 +1,159 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// Small LZ77 codec for blocks up to 64 KB (one tile), LZ4 style: a sequence
+// is a token (literal count << 4 | match length - MinMatch), extra count bytes
+// while a field is saturated (255 continues), the literals and a 16 bit
+// offset. The last sequence only carries literals. Runs of one color become
+// matches with a small offset, so blank areas cost a few bytes.
+namespace Lz
+{
+    static constexpr size_t MaxBlock = 65536;
+    static constexpr size_t MinMatch = 4;
+    static constexpr int HashBits = 12;
+
+
+    inline uint32_t Read32(const unsigned char* p)
+    {
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        return v;
+    }
+
+
+    inline void PutCount(std::vector<unsigned char>& out, size_t count)
+    {
+        for (; count >= 255; count -= 255)
+            out.push_back(255);
+        out.push_back((unsigned char)count);
+    }
+
+
+    inline void PutSequence(std::vector<unsigned char>& out, const unsigned char* literals, size_t literalCount, size_t offset, size_t matchLength)
+    {
+        const size_t extraMatch = matchLength == 0 ? 0 : matchLength - MinMatch;
+        out.push_back((unsigned char)(std::min<size_t>(literalCount, 15) << 4 | std::min<size_t>(extraMatch, 15)));
+        if (literalCount >= 15)
+            PutCount(out, literalCount - 15);
+        out.insert(out.end(), literals, literals + literalCount);
+        if (matchLength == 0)
+            return;
+        out.push_back((unsigned char)offset);
+        out.push_back((unsigned char)(offset >> 8));
+        if (extraMatch >= 15)
+            PutCount(out, extraMatch - 15);
+    }
+
+
+    // Length of the match of src[pos...] with the earlier src[from...]
+    inline size_t MatchLength(const unsigned char* src, size_t size, size_t from, size_t pos)
+    {
+        size_t length = 0;
+        while (pos + length < size && src[from + length] == src[pos + length])
+            ++length;
+        return length;
+    }
+
+
+    // Appends the compressed size bytes of src to out, size <= MaxBlock. Data
+    // that tends to repeat every stride bytes (the planes of a tile) gets that
+    // distance tried next to the hash candidate, 0 = no such distance.
+    inline void Compress(const unsigned char* src, size_t size, std::vector<unsigned char>& out, size_t stride = 0)
+    {
+        uint16_t table[1 << HashBits] = {};
+        const auto hash = [](uint32_t v) { return (v * 2654435761u) >> (32 - HashBits); };
+
+        size_t anchor = 0;
+        size_t pos = 1; // position 0 is what the zeroed table entries point to
+        while (pos + MinMatch <= size)
+        {
+            const uint32_t v = Read32(src + pos);
+            uint16_t& slot = table[hash(v)];
+            size_t from = slot;
+            slot = (uint16_t)pos;
+            size_t length = Read32(src + from) == v ? MatchLength(src, size, from, pos) : 0;
+            if (stride != 0 && pos >= stride && Read32(src + pos - stride) == v)
+            {
+                const size_t strided = MatchLength(src, size, pos - stride, pos);
+                if (strided > length)
+                {
+                    from = pos - stride;
+                    length = strided;
+                }
+            }
+            if (length < MinMatch)
+            {
+                ++pos;
+                continue;
+            }
+
+            PutSequence(out, src + anchor, pos - anchor, pos - from, length);
+            pos += length;
+            anchor = pos;
+        }
+        PutSequence(out, src + anchor, size - anchor, 0, 0);
+    }
+
+
+    // Reads a count continued by 255 bytes, false if it runs past end
+    inline bool GetCount(const unsigned char*& p, const unsigned char* end, size_t& count)
+    {
+        for (;;)
+        {
+            if (p == end)
+                return false;
+            const unsigned char b = *p++;
+            count += b;
+            if (b != 255)
+                return true;
+        }
+    }
+
+
+    // Decompresses exactly size bytes into dst, false if src is malformed
+    inline bool Decompress(const unsigned char* src, size_t srcSize, unsigned char* dst, size_t size)
+    {
+        const unsigned char* p = src;
+        const unsigned char* const end = src + srcSize;
+        size_t pos = 0;
+        while (p < end)
+        {
+            const unsigned char token = *p++;
+            size_t literals = token >> 4;
+            if (literals == 15 && !GetCount(p, end, literals))
+                return false;
+            if (literals > (size_t)(end - p) || literals > size - pos)
+                return false;
+            std::memcpy(dst + pos, p, literals);
+            p += literals;
+            pos += literals;
+            if (p == end)
+                break; // the last sequence
+
+            if (end - p < 2)
+                return false;
+            const size_t offset = (size_t)p[0] | (size_t)p[1] << 8;
+            p += 2;
+            size_t length = token & 15;
+            if (length == 15 && !GetCount(p, end, length))
+                return false;
+            length += MinMatch;
+            if (offset == 0 || offset > pos || length > size - pos)
+                return false;
+
+            // overlapping copies repeat the last offset bytes, the period doubles with every copy
+            for (size_t done = 0, step = offset; done < length; step *= 2)
+            {
+                const size_t n = std::min(length - done, step);
+                std::memcpy(dst + pos + done, dst + pos + done - step, n);
+                done += n;
+            }
+            pos += length;
+        }
+        return pos == size;
+    }
+}
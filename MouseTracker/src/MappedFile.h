@@ -0,0 +1,100 @@
+#pragma once
+#include <filesystem>
+#include <cstdint>
+#include <cstddef>
+
+#ifdef WINDOWS
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Read only view of a whole file, pages are read by the OS when they are
+// first accessed, so only the parts that are used cost I/O
+class MappedFile
+{
+private:
+    const unsigned char* m_Data = nullptr;
+    size_t m_Size = 0;
+#ifdef WINDOWS
+    HANDLE m_File = INVALID_HANDLE_VALUE;
+    HANDLE m_Mapping = NULL;
+#endif
+public:
+    inline MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+
+    inline ~MappedFile()
+    {
+        Close();
+    }
+
+
+    // False if the file can't be opened or is empty
+    inline bool Open(const std::filesystem::path& path)
+    {
+        Close();
+#ifdef WINDOWS
+        m_File = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        LARGE_INTEGER size;
+        if (m_File == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_File, &size) || size.QuadPart <= 0 || (uint64_t)size.QuadPart > SIZE_MAX)
+        {
+            Close();
+            return false;
+        }
+        m_Mapping = CreateFileMappingW(m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (m_Mapping != NULL)
+            m_Data = static_cast<const unsigned char*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+        if (m_Data == nullptr)
+        {
+            Close();
+            return false;
+        }
+        m_Size = (size_t)size.QuadPart;
+#else
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        void* data = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && info.st_size > 0 && (uint64_t)info.st_size <= SIZE_MAX)
+            data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd); // the mapping keeps the file open
+        if (data == MAP_FAILED)
+            return false;
+        m_Data = static_cast<const unsigned char*>(data);
+        m_Size = (size_t)info.st_size;
+#endif
+        return true;
+    }
+
+
+    inline void Close()
+    {
+#ifdef WINDOWS
+        if (m_Data != nullptr)
+            UnmapViewOfFile(m_Data);
+        if (m_Mapping != NULL)
+            CloseHandle(m_Mapping);
+        if (m_File != INVALID_HANDLE_VALUE)
+            CloseHandle(m_File);
+        m_Mapping = NULL;
+        m_File = INVALID_HANDLE_VALUE;
+#else
+        if (m_Data != nullptr)
+            munmap(const_cast<unsigned char*>(m_Data), m_Size);
+#endif
+        m_Data = nullptr;
+        m_Size = 0;
+    }
+
+
+    inline const unsigned char* Data() const { return m_Data;           }
+    inline size_t Size()               const { return m_Size;           }
+    inline bool IsOpen()               const { return m_Data != nullptr; }
+};
@@ -0,0 +1,75 @@
+#pragma once
+#include <optional>
+#include <cstddef>
+#include <vector>
+
+#include "Rect.h"
+
+// Collects the opaque pixels of an image row by row as rectangles. A row with
+// the same opaque spans as the one above extends their rectangles, so a PNG
+// saved with a monitor layout gives back one rectangle per monitor.
+class OpaqueRects
+{
+private:
+    static constexpr size_t MaxRects = 64; // anything more ragged isn't a monitor layout
+    std::vector<Rect> m_Rects;
+    int m_Width = 0;
+    bool m_Transparent = false;
+    bool m_TooMany = false;
+private:
+    inline void AddSpan(int y, int x0, int x1)
+    {
+        for (Rect& r : m_Rects)
+        {
+            if (r.y1 == y && r.x0 == x0 && r.x1 == x1)
+            {
+                r.y1 = y + 1;
+                return;
+            }
+        }
+        if (m_Rects.size() == MaxRects)
+        {
+            m_TooMany = true;
+            m_Rects.clear();
+            return;
+        }
+        m_Rects.push_back({ x0, y, x1, y + 1 });
+    }
+public:
+    inline explicit OpaqueRects(int width) : m_Width(width) {}
+
+
+    // Rows have to be added in order, grayAlpha holds 2 bytes per pixel
+    inline void AddRow(int y, const unsigned char* grayAlpha)
+    {
+        if (m_TooMany)
+            return;
+        int x = 0;
+        while (x < m_Width)
+        {
+            const int x0 = x;
+            while (x < m_Width && grayAlpha[x * 2 + 1] < 128)
+                ++x;
+            m_Transparent |= x != x0;
+            if (x == m_Width)
+                break;
+
+            const int start = x;
+            while (x < m_Width && grayAlpha[x * 2 + 1] >= 128)
+                ++x;
+            AddSpan(y, start, x);
+            if (m_TooMany)
+                return;
+        }
+    }
+
+
+    // The opaque area as monitor layout, nullopt if the image is opaque (or
+    // completely transparent) or the area is too ragged
+    inline std::optional<std::vector<Rect>> Layout() const
+    {
+        if (!m_Transparent || m_TooMany || m_Rects.empty())
+            return std::nullopt;
+        return m_Rects;
+    }
+};
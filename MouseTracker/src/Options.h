@@ -0,0 +1,196 @@
+#pragma once
+#include <algorithm>
+#include <optional>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <ctime>
+
+#include "Brush.h"
+#include "Log.h"
+
+struct Options
+{
+    std::string replayPath;       // --replay <trace>
+    bool replayMaxSpeed = false;  // --replay-speed max|original
+    std::string format = "rgba";  // --format rgba|bit1|heatmap|gray
+    bool streamUploads = true;    // --no-pbo
+    int maxTextureSize = 0;       // --max-texture-size <pixels>, 0 = GL_MAX_TEXTURE_SIZE
+    std::string logPath;          // --log <session log>
+    std::string replayLogPath;    // --replay-log <session log>, rebuilds the image at startup
+    int64_t replayFrom = INT64_MIN; // --from <time>
+    int64_t replayTo = INT64_MAX;   // --to <time>
+    unsigned threads = 0;         // --threads <n> for replaying logs and saving images, 0 = all hardware threads
+    int pngLevel = 6;             // --png-level <0-9>
+    std::string autosavePath;     // --autosave <track>, restored at startup and saved periodically
+    int autosaveInterval = 60;    // --autosave-interval <seconds>
+    bool headless = false;        // --headless, only capture, drawing and saving, no window
+    size_t monitor = 0;           // --monitor <index> tracked without a window, the one after the last is "All"
+    int rate = 1000;              // --rate <Hz> of the cursor capture
+    BrushShape brushShape = BrushShape::Square; // --brush square|disc|soft
+    int brushRadius = 0;          // --brush-radius <0-16>, 0 = single pixels
+};
+
+
+// Arguments followed by the ones in --config files: one option per line, the
+// leading dashes may be left out, empty lines and lines starting with # are skipped
+inline std::vector<std::string> ExpandConfigFiles(int argc, char** argv)
+{
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--config") != 0 || i + 1 >= argc)
+        {
+            args.emplace_back(argv[i]);
+            continue;
+        }
+
+        std::ifstream config(argv[++i]);
+        if (!config)
+            Err << "Failed to open config file [" << argv[i] << "]" << std::endl;
+        for (std::string line; std::getline(config, line);)
+        {
+            std::istringstream words(line);
+            std::string name, value;
+            if (!(words >> name) || name[0] == '#')
+                continue;
+            args.push_back(name[0] == '-' ? name : "--" + name);
+            std::getline(words >> std::ws, value);
+            if (!value.empty() && value.back() == '\r')
+                value.pop_back();
+            if (!value.empty())
+                args.push_back(value);
+        }
+    }
+    return args;
+}
+
+
+// "YYYY-MM-DD HH:MM[:SS]" in local time or microseconds since epoch
+inline std::optional<int64_t> ParseTime(const char* value)
+{
+    char* end = nullptr;
+    const long long micros = std::strtoll(value, &end, 10);
+    if (*end == '\0' && end != value)
+        return micros;
+
+    std::tm tm{};
+    std::istringstream stream(value);
+    stream >> std::get_time(&tm, "%Y-%m-%d %H:%M");
+    if (stream.fail())
+        return std::nullopt;
+    if (stream.peek() == ':')
+    {
+        stream.get();
+        stream >> tm.tm_sec;
+    }
+    tm.tm_isdst = -1;
+    const std::time_t time = std::mktime(&tm);
+    if (time == -1)
+        return std::nullopt;
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::from_time_t(time).time_since_epoch()).count();
+}
+
+
+inline Options ParseOptions(int argc, char** argv)
+{
+    Options opt;
+    const std::vector<std::string> args = ExpandConfigFiles(argc, argv);
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        const char* const arg = args[i].c_str();
+        const char* const value = i + 1 < args.size() ? args[i + 1].c_str() : nullptr;
+        if (std::strcmp(arg, "--replay") == 0 && value != nullptr)
+        {
+            opt.replayPath = value;
+            ++i;
+        }
+        else if (std::strcmp(arg, "--replay-speed") == 0 && value != nullptr)
+        {
+            opt.replayMaxSpeed = std::strcmp(value, "max") == 0;
+            ++i;
+        }
+        else if (std::strcmp(arg, "--format") == 0 && value != nullptr)
+        {
+            opt.format = value;
+            ++i;
+        }
+        else if (std::strcmp(arg, "--log") == 0 && value != nullptr)
+        {
+            opt.logPath = value;
+            ++i;
+        }
+        else if (std::strcmp(arg, "--replay-log") == 0 && value != nullptr)
+        {
+            opt.replayLogPath = value;
+            ++i;
+        }
+        else if ((std::strcmp(arg, "--from") == 0 || std::strcmp(arg, "--to") == 0) && value != nullptr)
+        {
+            const std::optional<int64_t> time = ParseTime(value);
+            if (!time.has_value())
+                Err << "Invalid time for " << arg << ": " << value << std::endl;
+            else
+                (arg[2] == 'f' ? opt.replayFrom : opt.replayTo) = *time;
+            ++i;
+        }
+        else if (std::strcmp(arg, "--threads") == 0 && value != nullptr)
+        {
+            opt.threads = (unsigned)std::max(0, std::atoi(value));
+            ++i;
+        }
+        else if (std::strcmp(arg, "--png-level") == 0 && value != nullptr)
+        {
+            opt.pngLevel = std::clamp(std::atoi(value), 0, 9);
+            ++i;
+        }
+        else if (std::strcmp(arg, "--autosave") == 0 && value != nullptr)
+        {
+            opt.autosavePath = value;
+            ++i;
+        }
+        else if (std::strcmp(arg, "--autosave-interval") == 0 && value != nullptr)
+        {
+            opt.autosaveInterval = std::max(1, std::atoi(value));
+            ++i;
+        }
+        else if (std::strcmp(arg, "--max-texture-size") == 0 && value != nullptr)
+        {
+            opt.maxTextureSize = std::max(0, std::atoi(value));
+            ++i;
+        }
+        else if (std::strcmp(arg, "--monitor") == 0 && value != nullptr)
+        {
+            opt.monitor = (size_t)std::max(0, std::atoi(value));
+            ++i;
+        }
+        else if (std::strcmp(arg, "--rate") == 0 && value != nullptr)
+        {
+            opt.rate = std::max(1, std::atoi(value)); // clamped by CursorCapture
+            ++i;
+        }
+        else if (std::strcmp(arg, "--brush") == 0 && value != nullptr)
+        {
+            opt.brushShape = std::strcmp(value, "disc") == 0 ? BrushShape::Disc : std::strcmp(value, "soft") == 0 ? BrushShape::Soft : BrushShape::Square;
+            ++i;
+        }
+        else if (std::strcmp(arg, "--brush-radius") == 0 && value != nullptr)
+        {
+            opt.brushRadius = std::clamp(std::atoi(value), 0, Brush::MaxRadius);
+            ++i;
+        }
+        else if (std::strcmp(arg, "--headless") == 0)
+            opt.headless = true;
+        else if (std::strcmp(arg, "--no-pbo") == 0)
+            opt.streamUploads = false;
+        else
+            Err << "Ignoring unknown or incomplete argument: " << arg << std::endl;
+    }
+    return opt;
+}
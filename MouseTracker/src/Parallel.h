@@ -0,0 +1,22 @@
+#pragma once
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+inline unsigned HardwareThreads()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+
+// Runs fn(worker) for worker in [0, threads), worker 0 on the calling thread
+template <class Fn>
+inline void RunParallel(unsigned threads, Fn&& fn)
+{
+    std::vector<std::thread> pool;
+    for (unsigned worker = 1; worker < threads; ++worker)
+        pool.emplace_back([&fn, worker]() { fn(worker); });
+    fn(0u);
+    for (std::thread& t : pool)
+        t.join();
+}
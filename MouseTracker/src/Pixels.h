@@ -0,0 +1,315 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PIXELS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PIXELS_AVX2
+#else
+#define PIXELS_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define PIXELS_X86 0
+#endif
+
+// Kernels over packed RGBA8 pixels. The x86 versions are picked at runtime,
+// SSE2 is part of every x64 cpu, AVX2 is used if the cpu has it.
+namespace Pixels
+{
+    // (s * DivideBy3) >> 16 == s / 3 for every s <= 765 = 3 * 255
+    static constexpr uint32_t DivideBy3 = 21846;
+
+    namespace Scalar
+    {
+        inline bool AnyTransparent(const unsigned char* rgba, size_t pixels)
+        {
+            for (size_t i = 0; i < pixels; ++i)
+            {
+                if (rgba[i * 4 + 3] == 0)
+                    return true;
+            }
+            return false;
+        }
+
+
+        // Writes the average of r, g and b of every pixel to gray, stops and
+        // returns false at the first pixel with zero alpha
+        inline bool GrayIfOpaque(const unsigned char* rgba, size_t pixels, unsigned char* gray)
+        {
+            for (size_t i = 0; i < pixels; ++i, rgba += 4)
+            {
+                if (rgba[3] == 0)
+                    return false;
+                gray[i] = (unsigned char)(((uint32_t)(rgba[0] + rgba[1] + rgba[2]) * DivideBy3) >> 16);
+            }
+            return true;
+        }
+
+
+        inline void SplitChannels(const unsigned char* rgba, size_t pixels, unsigned char* planes)
+        {
+            for (size_t i = 0; i < pixels; ++i)
+                for (size_t c = 0; c < 4; ++c)
+                    planes[c * pixels + i] = rgba[i * 4 + c];
+        }
+
+
+        inline void JoinChannels(const unsigned char* planes, size_t pixels, unsigned char* rgba)
+        {
+            for (size_t i = 0; i < pixels; ++i)
+                for (size_t c = 0; c < 4; ++c)
+                    rgba[i * 4 + c] = planes[c * pixels + i];
+        }
+    }
+
+#if PIXELS_X86
+    namespace Sse2
+    {
+        // r + g + b of the 4 pixels as 32 bit lanes
+        inline __m128i Sum(__m128i v)
+        {
+            const __m128i low = _mm_set1_epi32(0xFF);
+            return _mm_add_epi32(_mm_add_epi32(_mm_and_si128(v, low), _mm_and_si128(_mm_srli_epi32(v, 8), low)), _mm_and_si128(_mm_srli_epi32(v, 16), low));
+        }
+
+
+        // Non zero if the alpha of one of the 4 pixels is zero
+        inline int Transparent(__m128i v)
+        {
+            const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+            return _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(v, alpha), _mm_setzero_si128()));
+        }
+
+
+        inline bool AnyTransparent(const unsigned char* rgba, size_t pixels)
+        {
+            size_t i = 0;
+            for (; i + 16 <= pixels; i += 16)
+            {
+                const __m128i* p = reinterpret_cast<const __m128i*>(rgba + i * 4);
+                const __m128i a = _mm_min_epu8(_mm_min_epu8(_mm_loadu_si128(p), _mm_loadu_si128(p + 1)), _mm_min_epu8(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3)));
+                if (Transparent(a) != 0)
+                    return true;
+            }
+            return Scalar::AnyTransparent(rgba + i * 4, pixels - i);
+        }
+
+
+        inline bool GrayIfOpaque(const unsigned char* rgba, size_t pixels, unsigned char* gray)
+        {
+            const __m128i divide = _mm_set1_epi16((short)DivideBy3);
+            size_t i = 0;
+            for (; i + 16 <= pixels; i += 16)
+            {
+                const __m128i* p = reinterpret_cast<const __m128i*>(rgba + i * 4);
+                const __m128i a = _mm_loadu_si128(p);
+                const __m128i b = _mm_loadu_si128(p + 1);
+                const __m128i c = _mm_loadu_si128(p + 2);
+                const __m128i d = _mm_loadu_si128(p + 3);
+                if (Transparent(_mm_min_epu8(_mm_min_epu8(a, b), _mm_min_epu8(c, d))) != 0)
+                    return false;
+
+                const __m128i ab = _mm_mulhi_epu16(_mm_packs_epi32(Sum(a), Sum(b)), divide);
+                const __m128i cd = _mm_mulhi_epu16(_mm_packs_epi32(Sum(c), Sum(d)), divide);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(gray + i), _mm_packus_epi16(ab, cd));
+            }
+            return Scalar::GrayIfOpaque(rgba + i * 4, pixels - i, gray + i);
+        }
+
+
+        // Channel c of the 16 pixels a, b, c, d
+        inline __m128i Channel(__m128i a, __m128i b, __m128i c, __m128i d, int shift)
+        {
+            const __m128i low = _mm_set1_epi32(0xFF);
+            const __m128i shiftBy = _mm_cvtsi32_si128(shift);
+            const __m128i ab = _mm_packs_epi32(_mm_and_si128(_mm_srl_epi32(a, shiftBy), low), _mm_and_si128(_mm_srl_epi32(b, shiftBy), low));
+            const __m128i cd = _mm_packs_epi32(_mm_and_si128(_mm_srl_epi32(c, shiftBy), low), _mm_and_si128(_mm_srl_epi32(d, shiftBy), low));
+            return _mm_packus_epi16(ab, cd);
+        }
+
+
+        inline void SplitChannels(const unsigned char* rgba, size_t pixels, unsigned char* planes)
+        {
+            size_t i = 0;
+            for (; i + 16 <= pixels; i += 16)
+            {
+                const __m128i* p = reinterpret_cast<const __m128i*>(rgba + i * 4);
+                const __m128i a = _mm_loadu_si128(p);
+                const __m128i b = _mm_loadu_si128(p + 1);
+                const __m128i c = _mm_loadu_si128(p + 2);
+                const __m128i d = _mm_loadu_si128(p + 3);
+                for (size_t k = 0; k < 4; ++k)
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(planes + k * pixels + i), Channel(a, b, c, d, (int)k * 8));
+            }
+            for (; i < pixels; ++i)
+                for (size_t k = 0; k < 4; ++k)
+                    planes[k * pixels + i] = rgba[i * 4 + k];
+        }
+
+
+        inline void JoinChannels(const unsigned char* planes, size_t pixels, unsigned char* rgba)
+        {
+            size_t i = 0;
+            for (; i + 16 <= pixels; i += 16)
+            {
+                const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes + i));
+                const __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes + pixels + i));
+                const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes + 2 * pixels + i));
+                const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes + 3 * pixels + i));
+                const __m128i rgLow = _mm_unpacklo_epi8(r, g);
+                const __m128i rgHigh = _mm_unpackhi_epi8(r, g);
+                const __m128i baLow = _mm_unpacklo_epi8(b, a);
+                const __m128i baHigh = _mm_unpackhi_epi8(b, a);
+                __m128i* out = reinterpret_cast<__m128i*>(rgba + i * 4);
+                _mm_storeu_si128(out, _mm_unpacklo_epi16(rgLow, baLow));
+                _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rgLow, baLow));
+                _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rgHigh, baHigh));
+                _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rgHigh, baHigh));
+            }
+            for (; i < pixels; ++i)
+                for (size_t k = 0; k < 4; ++k)
+                    rgba[i * 4 + k] = planes[k * pixels + i];
+        }
+    }
+
+
+    namespace Avx2
+    {
+        PIXELS_AVX2 inline __m256i Sum(__m256i v)
+        {
+            const __m256i low = _mm256_set1_epi32(0xFF);
+            return _mm256_add_epi32(_mm256_add_epi32(_mm256_and_si256(v, low), _mm256_and_si256(_mm256_srli_epi32(v, 8), low)), _mm256_and_si256(_mm256_srli_epi32(v, 16), low));
+        }
+
+
+        PIXELS_AVX2 inline int Transparent(__m256i v)
+        {
+            const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+            return _mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_and_si256(v, alpha), _mm256_setzero_si256()));
+        }
+
+
+        PIXELS_AVX2 inline bool AnyTransparent(const unsigned char* rgba, size_t pixels)
+        {
+            size_t i = 0;
+            for (; i + 32 <= pixels; i += 32)
+            {
+                const __m256i* p = reinterpret_cast<const __m256i*>(rgba + i * 4);
+                const __m256i a = _mm256_min_epu8(_mm256_min_epu8(_mm256_loadu_si256(p), _mm256_loadu_si256(p + 1)), _mm256_min_epu8(_mm256_loadu_si256(p + 2), _mm256_loadu_si256(p + 3)));
+                if (Transparent(a) != 0)
+                    return true;
+            }
+            return Sse2::AnyTransparent(rgba + i * 4, pixels - i);
+        }
+
+
+        PIXELS_AVX2 inline bool GrayIfOpaque(const unsigned char* rgba, size_t pixels, unsigned char* gray)
+        {
+            const __m256i divide = _mm256_set1_epi16((short)DivideBy3);
+            const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7); // undoes the per lane packing
+            size_t i = 0;
+            for (; i + 32 <= pixels; i += 32)
+            {
+                const __m256i* p = reinterpret_cast<const __m256i*>(rgba + i * 4);
+                const __m256i a = _mm256_loadu_si256(p);
+                const __m256i b = _mm256_loadu_si256(p + 1);
+                const __m256i c = _mm256_loadu_si256(p + 2);
+                const __m256i d = _mm256_loadu_si256(p + 3);
+                if (Transparent(_mm256_min_epu8(_mm256_min_epu8(a, b), _mm256_min_epu8(c, d))) != 0)
+                    return false;
+
+                const __m256i ab = _mm256_mulhi_epu16(_mm256_packs_epi32(Sum(a), Sum(b)), divide);
+                const __m256i cd = _mm256_mulhi_epu16(_mm256_packs_epi32(Sum(c), Sum(d)), divide);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(gray + i), _mm256_permutevar8x32_epi32(_mm256_packus_epi16(ab, cd), order));
+            }
+            return Sse2::GrayIfOpaque(rgba + i * 4, pixels - i, gray + i);
+        }
+    }
+
+
+    inline bool HasAvx2()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuid(info, 1);
+        const bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6; // OSXSAVE, xmm and ymm state
+        __cpuidex(info, 7, 0);
+        return osSavesYmm && (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+
+
+    enum class Isa { Scalar, Sse2, Avx2 };
+
+    inline Isa Detect()
+    {
+#if PIXELS_X86
+        static const Isa isa = HasAvx2() ? Isa::Avx2 : Isa::Sse2;
+        return isa;
+#else
+        return Isa::Scalar;
+#endif
+    }
+
+
+    // True if one of the pixels has zero alpha
+    inline bool AnyTransparent(const unsigned char* rgba, size_t pixels)
+    {
+        switch (Detect())
+        {
+#if PIXELS_X86
+        case Isa::Avx2: return Avx2::AnyTransparent(rgba, pixels);
+        case Isa::Sse2: return Sse2::AnyTransparent(rgba, pixels);
+#endif
+        case Isa::Scalar:
+        default:        return Scalar::AnyTransparent(rgba, pixels);
+        }
+    }
+
+
+    // Averages r, g and b of every pixel into gray in the same pass that looks
+    // for transparency, false as soon as a pixel with zero alpha turns up (gray
+    // is incomplete then)
+    inline bool GrayIfOpaque(const unsigned char* rgba, size_t pixels, unsigned char* gray)
+    {
+        switch (Detect())
+        {
+#if PIXELS_X86
+        case Isa::Avx2: return Avx2::GrayIfOpaque(rgba, pixels, gray);
+        case Isa::Sse2: return Sse2::GrayIfOpaque(rgba, pixels, gray);
+#endif
+        case Isa::Scalar:
+        default:        return Scalar::GrayIfOpaque(rgba, pixels, gray);
+        }
+    }
+
+
+    // Stores channel c of every pixel in plane c, planes holds 4 planes of pixels bytes
+    inline void SplitChannels(const unsigned char* rgba, size_t pixels, unsigned char* planes)
+    {
+#if PIXELS_X86
+        Sse2::SplitChannels(rgba, pixels, planes);
+#else
+        Scalar::SplitChannels(rgba, pixels, planes);
+#endif
+    }
+
+
+    inline void JoinChannels(const unsigned char* planes, size_t pixels, unsigned char* rgba)
+    {
+#if PIXELS_X86
+        Sse2::JoinChannels(planes, pixels, rgba);
+#else
+        Scalar::JoinChannels(planes, pixels, rgba);
+#endif
+    }
+}
@@ -0,0 +1,450 @@
+#pragma once
+#include <algorithm>
+#include <optional>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "PngWriter.h"
+#include "Inflate.h"
+#include "Crc32.h"
+
+// Decodes a non interlaced PNG row by row without holding the image. Open()
+// only reads the chunks up to the first IDAT, so the size is known before
+// any pixel memory is allocated. Rows are converted to 1 (gray), 2 (gray and
+// alpha) or 4 (RGBA) channels the same way stbi_load does it. The crc of
+// every chunk it reads is checked, chunks it skips aren't read.
+class PngReader
+{
+private:
+    std::FILE* m_File = nullptr;
+    int m_Width = 0;
+    int m_Height = 0;
+    PngFormat m_Format;
+    bool m_Interlaced = false;
+    int m_Key[3] = { -1, -1, -1 };            // tRNS of gray and rgb images, raw sample values
+    std::vector<unsigned char> m_Palette;     // RGBA per entry
+    uint32_t m_ChunkLeft = 0;                 // data left in the current IDAT
+    uint32_t m_Crc = 0;                       // of the current IDAT so far
+    bool m_DataEnd = false;
+    bool m_BadCrc = false;
+private:
+    static inline uint32_t GetU32(const unsigned char* p)
+    {
+        return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+    }
+
+
+    // Reads the next chunk header, false at the end of the file
+    inline bool NextChunk(uint32_t& length, char type[4])
+    {
+        unsigned char head[8];
+        if (std::fread(head, 1, sizeof(head), m_File) != sizeof(head))
+            return false;
+        length = GetU32(head);
+        std::memcpy(type, head + 4, 4);
+        return length <= INT32_MAX;
+    }
+
+
+    // Reads the crc at the end of a chunk, false if it isn't crc
+    inline bool CrcMatches(uint32_t crc)
+    {
+        unsigned char stored[4];
+        return std::fread(stored, 1, sizeof(stored), m_File) == sizeof(stored) && GetU32(stored) == crc;
+    }
+
+
+    inline bool ValidHeader() const
+    {
+        const int d = m_Format.bitDepth;
+        switch (m_Format.color)
+        {
+        case PngColor::Gray:      return d == 1 || d == 2 || d == 4 || d == 8 || d == 16;
+        case PngColor::Palette:   return d == 1 || d == 2 || d == 4 || d == 8;
+        case PngColor::RGB:
+        case PngColor::GrayAlpha:
+        case PngColor::RGBA:      return d == 8 || d == 16;
+        default:                  return false;
+        }
+    }
+
+
+    // IDAT data for the inflater, chunks in between are skipped
+    inline size_t ReadData(unsigned char* buffer, size_t capacity)
+    {
+        while (m_ChunkLeft == 0 && !m_DataEnd)
+        {
+            uint32_t length;
+            char type[4];
+            m_BadCrc = !CrcMatches(m_Crc);
+            if (m_BadCrc || !NextChunk(length, type) || std::memcmp(type, "IDAT", 4) != 0)
+                m_DataEnd = true;
+            else
+            {
+                m_ChunkLeft = length;
+                m_Crc = Crc32(type, 4);
+            }
+        }
+        if (m_DataEnd)
+            return 0;
+
+        const size_t n = std::fread(buffer, 1, std::min<size_t>(capacity, m_ChunkLeft), m_File);
+        m_ChunkLeft -= (uint32_t)n;
+        m_Crc = Crc32(buffer, n, m_Crc);
+        if (n == 0)
+            m_DataEnd = true;
+        return n;
+    }
+
+
+    // Sample i of the row in its own bit depth
+    template <int Depth>
+    static inline uint32_t Sample(const unsigned char* row, size_t i)
+    {
+        if constexpr (Depth == 16)
+            return (uint32_t)row[i * 2] << 8 | row[i * 2 + 1];
+        else if constexpr (Depth == 8)
+            return row[i];
+        else
+            return (uint32_t)(row[i * Depth / 8] >> (8 - Depth - (int)(i * Depth % 8))) & ((1u << Depth) - 1);
+    }
+
+
+    // The sample scaled to 8 bits
+    template <int Depth>
+    static inline unsigned char Sample8(const unsigned char* row, size_t i)
+    {
+        if constexpr (Depth == 16)
+            return row[i * 2];
+        else
+            return (unsigned char)(Sample<Depth>(row, i) * (255 / ((1u << Depth) - 1)));
+    }
+
+
+    // The weights add up to 256, so gray stays as it is
+    static inline unsigned char Luma(uint32_t r, uint32_t g, uint32_t b)
+    {
+        return (unsigned char)((r * 77 + g * 150 + b * 29) >> 8);
+    }
+
+
+    template <int Channels>
+    static inline void Put(unsigned char* out, size_t x, unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+    {
+        if constexpr (Channels == 1)
+            out[x] = Luma(r, g, b);
+        else if constexpr (Channels == 2)
+        {
+            out[x * 2] = Luma(r, g, b);
+            out[x * 2 + 1] = a;
+        }
+        else
+        {
+            unsigned char* p = out + x * 4;
+            p[0] = r;
+            p[1] = g;
+            p[2] = b;
+            p[3] = a;
+        }
+    }
+
+
+    // Gray of a 16 bit RGB(A) pixel, stbi_load takes the weighted sum before dropping the low byte
+    static inline unsigned char Luma16(const unsigned char* row, size_t i)
+    {
+        return (unsigned char)((Sample<16>(row, i) * 77 + Sample<16>(row, i + 1) * 150 + Sample<16>(row, i + 2) * 29) >> 16);
+    }
+
+
+    template <int Channels, int Depth>
+    inline void ConvertAs(const unsigned char* row, unsigned char* out) const
+    {
+        const size_t w = (size_t)m_Width;
+        const int key[3] = { m_Key[0], m_Key[1], m_Key[2] }; // out may alias the members as far as the compiler knows
+        const unsigned char* palette = m_Palette.data();
+        switch (m_Format.color)
+        {
+        case PngColor::Gray:
+            if (Channels == 1 && Depth == 8)
+            {
+                std::memcpy(out, row, w);
+                break;
+            }
+            if (Channels == 4 && Depth == 8 && key[0] < 0)
+            {
+                for (size_t x = 0; x < w; ++x)
+                {
+                    const uint32_t pixel = row[x] * 0x010101u | 0xFF000000u; // little endian RGBA
+                    std::memcpy(out + x * 4, &pixel, 4);
+                }
+                break;
+            }
+            for (size_t x = 0; x < w; ++x)
+            {
+                const unsigned char v = Sample8<Depth>(row, x);
+                Put<Channels>(out, x, v, v, v, (int)Sample<Depth>(row, x) == key[0] ? 0 : 255);
+            }
+            break;
+        case PngColor::GrayAlpha:
+            for (size_t x = 0; x < w; ++x)
+            {
+                const unsigned char v = Sample8<Depth>(row, x * 2);
+                Put<Channels>(out, x, v, v, v, Sample8<Depth>(row, x * 2 + 1));
+            }
+            break;
+        case PngColor::RGB:
+            if (Channels == 4 && Depth == 8 && key[0] < 0)
+            {
+                for (size_t x = 0; x < w; ++x)
+                    Put<4>(out, x, row[x * 3], row[x * 3 + 1], row[x * 3 + 2], 255);
+                break;
+            }
+            for (size_t x = 0; x < w; ++x)
+            {
+                if (Channels == 1 && Depth == 16)
+                {
+                    out[x] = Luma16(row, x * 3);
+                    continue;
+                }
+                const bool transparent = (int)Sample<Depth>(row, x * 3) == key[0] && (int)Sample<Depth>(row, x * 3 + 1) == key[1] && (int)Sample<Depth>(row, x * 3 + 2) == key[2];
+                if (Channels == 2 && Depth == 16)
+                {
+                    out[x * 2] = Luma16(row, x * 3);
+                    out[x * 2 + 1] = transparent ? 0 : 255;
+                    continue;
+                }
+                Put<Channels>(out, x, Sample8<Depth>(row, x * 3), Sample8<Depth>(row, x * 3 + 1), Sample8<Depth>(row, x * 3 + 2), transparent ? 0 : 255);
+            }
+            break;
+        case PngColor::Palette:
+            for (size_t x = 0; x < w; ++x)
+            {
+                const unsigned char* p = palette + Sample<Depth>(row, x) * 4;
+                Put<Channels>(out, x, p[0], p[1], p[2], p[3]);
+            }
+            break;
+        case PngColor::RGBA:
+        default:
+            if (Channels == 4 && Depth == 8)
+            {
+                std::memcpy(out, row, w * 4);
+                break;
+            }
+            for (size_t x = 0; x < w; ++x)
+            {
+                if (Channels == 1 && Depth == 16)
+                    out[x] = Luma16(row, x * 4);
+                else if (Channels == 2 && Depth == 16)
+                {
+                    out[x * 2] = Luma16(row, x * 4);
+                    out[x * 2 + 1] = Sample8<Depth>(row, x * 4 + 3);
+                }
+                else
+                    Put<Channels>(out, x, Sample8<Depth>(row, x * 4), Sample8<Depth>(row, x * 4 + 1), Sample8<Depth>(row, x * 4 + 2), Sample8<Depth>(row, x * 4 + 3));
+            }
+            break;
+        }
+    }
+
+
+    // Converts an unfiltered row to channels (1, 2 or 4) per pixel
+    template <int Channels>
+    inline void Convert(const unsigned char* row, unsigned char* out) const
+    {
+        switch (m_Format.bitDepth)
+        {
+        case 1:  ConvertAs<Channels, 1>(row, out);  break;
+        case 2:  ConvertAs<Channels, 2>(row, out);  break;
+        case 4:  ConvertAs<Channels, 4>(row, out);  break;
+        case 16: ConvertAs<Channels, 16>(row, out); break;
+        case 8:
+        default: ConvertAs<Channels, 8>(row, out);  break;
+        }
+    }
+
+
+    // Reverses filter type ft in place, false for an unknown filter
+    static inline bool Unfilter(int ft, unsigned char* row, const unsigned char* prev, size_t size, size_t bpp)
+    {
+        switch (ft)
+        {
+        case 0:
+            break;
+        case 1:
+            for (size_t i = bpp; i < size; ++i)
+                row[i] = (unsigned char)(row[i] + row[i - bpp]);
+            break;
+        case 2:
+            for (size_t i = 0; i < size; ++i)
+                row[i] = (unsigned char)(row[i] + prev[i]);
+            break;
+        case 3:
+            for (size_t i = 0; i < size; ++i)
+                row[i] = (unsigned char)(row[i] + (((i >= bpp ? row[i - bpp] : 0) + prev[i]) >> 1));
+            break;
+        case 4:
+            for (size_t i = 0; i < size; ++i)
+                row[i] = (unsigned char)(row[i] + Png::Paeth(i >= bpp ? row[i - bpp] : 0, prev[i], i >= bpp ? prev[i - bpp] : 0));
+            break;
+        default:
+            return false;
+        }
+        return true;
+    }
+public:
+    inline PngReader() = default;
+
+
+    inline ~PngReader()
+    {
+        if (m_File != nullptr)
+            std::fclose(m_File);
+    }
+
+
+    PngReader(const PngReader&) = delete;
+    PngReader& operator=(const PngReader&) = delete;
+
+
+    // Reads the header and the chunks before the pixel data, false if path
+    // isn't a PNG this reader understands
+    inline bool Open(const char* path)
+    {
+        static constexpr unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+        unsigned char head[8];
+        m_File = std::fopen(path, "rb");
+        if (m_File == nullptr || std::fread(head, 1, sizeof(head), m_File) != sizeof(head) || std::memcmp(head, signature, sizeof(signature)) != 0)
+            return false;
+
+        uint32_t length;
+        char type[4];
+        unsigned char ihdr[13];
+        if (!NextChunk(length, type) || std::memcmp(type, "IHDR", 4) != 0 || length != sizeof(ihdr) || std::fread(ihdr, 1, sizeof(ihdr), m_File) != sizeof(ihdr) || !CrcMatches(Crc32(ihdr, sizeof(ihdr), Crc32(type, 4))))
+            return false;
+        m_Width = (int)std::min<uint32_t>(GetU32(ihdr), INT32_MAX);
+        m_Height = (int)std::min<uint32_t>(GetU32(ihdr + 4), INT32_MAX);
+        m_Format.bitDepth = ihdr[8];
+        m_Format.color = (PngColor)ihdr[9];
+        m_Interlaced = ihdr[12] != 0;
+        if (m_Width == 0 || m_Height == 0 || !ValidHeader() || ihdr[10] != 0 || ihdr[11] != 0 || ihdr[12] > 1)
+            return false;
+
+        m_Palette.assign(256 * 4, 0);
+        for (size_t i = 0; i < 256; ++i)
+            m_Palette[i * 4 + 3] = 255;
+        while (NextChunk(length, type))
+        {
+            if (std::memcmp(type, "IDAT", 4) == 0)
+            {
+                m_ChunkLeft = length;
+                m_Crc = Crc32(type, 4);
+                return true;
+            }
+
+            const bool needed = std::memcmp(type, "PLTE", 4) == 0 || std::memcmp(type, "tRNS", 4) == 0;
+            if (std::memcmp(type, "IEND", 4) == 0 || (needed && length > 768))
+                return false;
+            if (!needed)
+            {
+                if (std::fseek(m_File, (long)length + 4, SEEK_CUR) != 0)
+                    return false;
+                continue;
+            }
+
+            std::vector<unsigned char> data(length);
+            if (std::fread(data.data(), 1, data.size(), m_File) != data.size() || !CrcMatches(Crc32(data.data(), data.size(), Crc32(type, 4))))
+                return false;
+            if (std::memcmp(type, "PLTE", 4) == 0)
+            {
+                for (size_t i = 0; i < std::min<size_t>(256, length / 3); ++i)
+                    std::memcpy(&m_Palette[i * 4], &data[i * 3], 3);
+            }
+            else if (std::memcmp(type, "tRNS", 4) == 0)
+            {
+                if (m_Format.color == PngColor::Palette)
+                {
+                    for (size_t i = 0; i < std::min<size_t>(256, length); ++i)
+                        m_Palette[i * 4 + 3] = data[i];
+                }
+                else if (m_Format.color == PngColor::Gray || m_Format.color == PngColor::RGB)
+                {
+                    for (size_t i = 0; i < (size_t)m_Format.Channels() && i * 2 + 1 < length; ++i)
+                        m_Key[i] = data[i * 2] << 8 | data[i * 2 + 1];
+                }
+            }
+        }
+        return false;
+    }
+
+
+    // Calls onRow(y, row) for every row in order, row holds Width() * channels
+    // bytes and channels is 1 (gray), 2 (gray and alpha) or 4 (RGBA)
+    template <class RowFunc>
+    inline std::optional<std::string> ReadRows(int channels, RowFunc&& onRow)
+    {
+        if (m_Interlaced)
+            return "Interlaced images can't be streamed";
+
+        const size_t rowBytes = m_Format.RowBytes(m_Width);
+        const size_t bpp = m_Format.PixelBytes();
+        std::vector<unsigned char> prev(rowBytes, 0);
+        std::vector<unsigned char> cur(rowBytes + 1); // filter type and row
+        std::vector<unsigned char> out((size_t)m_Width * (size_t)channels);
+        size_t filled = 0;
+        int y = 0;
+        bool badFilter = false;
+
+        Deflate::Inflater inflater;
+        const bool ok = inflater.Run([&](unsigned char* buffer, size_t capacity) { return ReadData(buffer, capacity); }, [&](const unsigned char* data, size_t size)
+        {
+            while (size != 0 && y < m_Height)
+            {
+                const size_t n = std::min(size, cur.size() - filled);
+                std::memcpy(&cur[filled], data, n);
+                filled += n;
+                data += n;
+                size -= n;
+                if (filled < cur.size())
+                    break;
+
+                if (!Unfilter(cur[0], cur.data() + 1, prev.data(), rowBytes, bpp))
+                {
+                    badFilter = true;
+                    return false;
+                }
+                if (channels == 1)
+                    Convert<1>(cur.data() + 1, out.data());
+                else if (channels == 2)
+                    Convert<2>(cur.data() + 1, out.data());
+                else
+                    Convert<4>(cur.data() + 1, out.data());
+                onRow(y++, out.data());
+                std::memcpy(prev.data(), cur.data() + 1, rowBytes);
+                filled = 0;
+            }
+            return true;
+        });
+
+        // the inflater stops at the end of the stream, the crc of the last IDAT is checked here
+        unsigned char rest[4096];
+        while (ok && ReadData(rest, sizeof(rest)) != 0)
+            continue;
+        if (m_BadCrc)
+            return std::string("Image data fails its crc");
+        if (badFilter)
+            return "Invalid filter in row " + std::to_string(y);
+        if (y < m_Height)
+            return "Image data ends after " + std::to_string(y) + " of " + std::to_string(m_Height) + " rows";
+        if (!ok)
+            return std::string("Corrupted image data");
+        return std::nullopt;
+    }
+
+
+    inline int Width()        const { return m_Width;      }
+    inline int Height()       const { return m_Height;     }
+    inline bool Interlaced()  const { return m_Interlaced; }
+};
@@ -0,0 +1,231 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <vector>
+#include <atomic>
+
+#include "Parallel.h"
+#include "Deflate.h"
+#include "Crc32.h"
+
+enum class PngColor : uint8_t { Gray = 0, RGB = 2, Palette = 3, GrayAlpha = 4, RGBA = 6 };
+
+struct PngFormat
+{
+    PngColor color = PngColor::RGBA;
+    int bitDepth = 8;          // 1, 2, 4 or 8 for Gray, 8 otherwise
+    int transparentGray = -1;  // Gray only, this gray level is written as fully transparent (tRNS)
+
+    constexpr int Channels() const
+    {
+        switch (color)
+        {
+        case PngColor::Gray:      return 1;
+        case PngColor::Palette:   return 1;
+        case PngColor::GrayAlpha: return 2;
+        case PngColor::RGB:       return 3;
+        case PngColor::RGBA:      return 4;
+        default:                  return 4;
+        }
+    }
+
+    constexpr size_t RowBytes(int width) const { return ((size_t)width * (size_t)(Channels() * bitDepth) + 7) / 8; }
+    constexpr size_t PixelBytes()        const { return (size_t)std::max(1, Channels() * bitDepth / 8);          }
+};
+
+
+struct PngOptions
+{
+    int level = 6;        // deflate level, 0 stores uncompressed, 1 is the fastest, 9 the smallest
+    unsigned threads = 0; // 0 = all hardware threads
+};
+
+
+namespace Png
+{
+    static constexpr size_t StripBytes = 256 * 1024; // filtered bytes per strip, the unit of parallel work
+
+
+    inline void PutZlibHeader(std::vector<unsigned char>& out, int level)
+    {
+        const unsigned cmf = 0x78; // deflate, 32 KB window
+        const unsigned flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+        const unsigned flg = flevel << 6;
+        out.push_back((unsigned char)cmf);
+        out.push_back((unsigned char)(flg + 31 - (cmf * 256 + flg) % 31));
+    }
+
+
+    inline void PutU32(std::vector<unsigned char>& out, uint32_t v)
+    {
+        out.push_back((unsigned char)(v >> 24));
+        out.push_back((unsigned char)(v >> 16));
+        out.push_back((unsigned char)(v >> 8));
+        out.push_back((unsigned char)v);
+    }
+
+
+    inline bool WriteChunk(std::FILE* f, const char* type, const unsigned char* data, size_t size)
+    {
+        std::vector<unsigned char> head;
+        PutU32(head, (uint32_t)size);
+        head.insert(head.end(), type, type + 4);
+        uint32_t crc = Crc32(type, 4);
+        crc = Crc32(data, size, crc);
+        std::vector<unsigned char> tail;
+        PutU32(tail, crc);
+        return std::fwrite(head.data(), 1, head.size(), f) == head.size()
+            && (size == 0 || std::fwrite(data, 1, size, f) == size)
+            && std::fwrite(tail.data(), 1, tail.size(), f) == tail.size();
+    }
+
+
+    inline unsigned char Paeth(int a, int b, int c)
+    {
+        const int p = a + b - c;
+        const int pa = std::abs(p - a);
+        const int pb = std::abs(p - b);
+        const int pc = std::abs(p - c);
+        if (pa <= pb && pa <= pc)
+            return (unsigned char)a;
+        return (unsigned char)(pb <= pc ? b : c);
+    }
+
+
+    // Applies filter type ft to row (prev is the unfiltered row above or zeros)
+    inline void Filter(int ft, const unsigned char* row, const unsigned char* prev, size_t size, size_t bpp, unsigned char* out)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            const int a = i >= bpp ? row[i - bpp] : 0;
+            const int b = prev[i];
+            const int c = i >= bpp ? prev[i - bpp] : 0;
+            int v = row[i];
+            switch (ft)
+            {
+            case 1: v -= a;              break;
+            case 2: v -= b;              break;
+            case 3: v -= (a + b) >> 1;   break;
+            case 4: v -= Paeth(a, b, c); break;
+            default:                     break;
+            }
+            out[i] = (unsigned char)v;
+        }
+    }
+
+
+    // Filters one row choosing the filter with the smallest sum of absolute values,
+    // sub byte formats always use filter 0 as recommended by the spec
+    inline void FilterRow(const PngFormat& fmt, const unsigned char* row, const unsigned char* prev, size_t size, unsigned char* out)
+    {
+        if (fmt.bitDepth < 8)
+        {
+            out[0] = 0;
+            std::memcpy(out + 1, row, size);
+            return;
+        }
+
+        int bestSum = -1;
+        for (int ft = 0; ft < 5; ++ft)
+        {
+            Filter(ft, row, prev, size, fmt.PixelBytes(), out + 1);
+            int sum = 0;
+            for (size_t i = 0; i < size; ++i)
+                sum += std::abs((int)(signed char)out[1 + i]);
+            if (bestSum == -1 || sum < bestSum)
+            {
+                bestSum = sum;
+                out[0] = (unsigned char)ft;
+            }
+        }
+        if (out[0] != 4)
+            Filter(out[0], row, prev, size, fmt.PixelBytes(), out + 1);
+    }
+}
+
+
+// Streams a PNG to path. fillRow(y, row) has to write fmt.RowBytes(w) bytes of the
+// packed row y, it is called concurrently for different rows. The rows are
+// filtered and deflated in strips on options.threads threads and the strips
+// stitched into one zlib stream. rowsDone (if any) counts the rows compressed so far.
+template <class RowFunc>
+inline bool WritePng(const char* path, int w, int h, const PngFormat& fmt, RowFunc&& fillRow, const PngOptions& options = {}, std::atomic<int>* rowsDone = nullptr)
+{
+    const size_t rowBytes = fmt.RowBytes(w);
+    const size_t stride = rowBytes + 1; // filter type and row
+    const int stripRows = (int)std::max<size_t>(1, Png::StripBytes / stride);
+    const size_t strips = std::max<size_t>(1, ((size_t)h + (size_t)stripRows - 1) / (size_t)stripRows);
+    const unsigned threads = std::min<unsigned>(options.threads != 0 ? options.threads : HardwareThreads(), (unsigned)strips);
+    const auto stripBegin = [&](size_t s) { return std::min(h, (int)s * stripRows); };
+    std::vector<unsigned char> filtered(stride * (size_t)h);
+
+    // the first row of a strip is filtered against the last one of the previous strip, which is filled again
+    std::atomic<size_t> next{ 0 };
+    RunParallel(threads, [&](unsigned)
+    {
+        std::vector<unsigned char> rows[2] = { std::vector<unsigned char>(rowBytes, 0), std::vector<unsigned char>(rowBytes, 0) };
+        for (size_t s = next++; s < strips; s = next++)
+        {
+            const int y0 = stripBegin(s);
+            std::fill(rows[(y0 + 1) & 1].begin(), rows[(y0 + 1) & 1].end(), (unsigned char)0);
+            if (y0 > 0)
+                fillRow(y0 - 1, rows[(y0 + 1) & 1].data());
+            for (int y = y0; y < stripBegin(s + 1); ++y)
+            {
+                std::vector<unsigned char>& row = rows[y & 1];
+                fillRow(y, row.data());
+                Png::FilterRow(fmt, row.data(), rows[(y + 1) & 1].data(), rowBytes, &filtered[(size_t)y * stride]);
+            }
+        }
+    });
+
+    std::vector<std::vector<unsigned char>> compressed(strips);
+    std::vector<uint32_t> adler(strips);
+    Png::PutZlibHeader(compressed[0], options.level);
+    next = 0;
+    RunParallel(threads, [&](unsigned)
+    {
+        Deflate::Encoder encoder(options.level);
+        for (size_t s = next++; s < strips; s = next++)
+        {
+            const size_t begin = (size_t)stripBegin(s) * stride;
+            const size_t end = (size_t)stripBegin(s + 1) * stride;
+            encoder.Compress(filtered.data(), begin, end, s + 1 == strips, compressed[s]);
+            adler[s] = Deflate::Adler32(filtered.data() + begin, end - begin);
+            if (rowsDone != nullptr)
+                rowsDone->fetch_add(stripBegin(s + 1) - stripBegin(s), std::memory_order_relaxed);
+        }
+    });
+
+    uint32_t checksum = adler[0];
+    for (size_t s = 1; s < strips; ++s)
+        checksum = Deflate::Adler32Combine(checksum, adler[s], (size_t)(stripBegin(s + 1) - stripBegin(s)) * stride);
+    Png::PutU32(compressed.back(), checksum);
+
+    std::vector<unsigned char> ihdr;
+    Png::PutU32(ihdr, (uint32_t)w);
+    Png::PutU32(ihdr, (uint32_t)h);
+    ihdr.push_back((unsigned char)fmt.bitDepth);
+    ihdr.push_back((unsigned char)fmt.color);
+    ihdr.insert(ihdr.end(), { 0, 0, 0 }); // compression, filter, interlace
+
+    std::FILE* f = std::fopen(path, "wb");
+    if (f == nullptr)
+        return false;
+    static constexpr unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    bool ok = std::fwrite(signature, 1, sizeof(signature), f) == sizeof(signature) && Png::WriteChunk(f, "IHDR", ihdr.data(), ihdr.size());
+    if (ok && fmt.color == PngColor::Gray && fmt.transparentGray >= 0)
+    {
+        const unsigned char trns[2] = { 0, (unsigned char)fmt.transparentGray };
+        ok = Png::WriteChunk(f, "tRNS", trns, sizeof(trns));
+    }
+
+    // one IDAT per strip, the zlib stream continues across them
+    for (size_t s = 0; s < strips && ok; ++s)
+        ok = Png::WriteChunk(f, "IDAT", compressed[s].data(), compressed[s].size());
+    ok = ok && Png::WriteChunk(f, "IEND", nullptr, 0);
+    return std::fclose(f) == 0 && ok;
+}
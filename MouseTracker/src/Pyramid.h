@@ -0,0 +1,140 @@
+#pragma once
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define PYRAMID_SSE2
+    #include <emmintrin.h>
+#endif
+
+#include "Canvas.h"
+
+// Downsampled preview of a Canvas. Level n halves the resolution n times,
+// every level pixel is the 2x2 reduction of the level below, computed on the
+// fly from the canvas rows of the requested region. The reduction keeps the
+// darkest color and the most opaque alpha so single pixel trails survive any
+// level instead of being averaged or filtered away.
+class Pyramid
+{
+public:
+    static constexpr int MaxLevel = 6;
+private:
+    static constexpr int Channel = Canvas::Channel;
+    static constexpr uint32_t RgbMask = 0x00FFFFFF;
+    static constexpr uint32_t AlphaMask = 0xFF000000;
+    static constexpr uint32_t Neutral = RgbMask; // transparent white, doesn't change any reduction
+    std::vector<uint32_t> m_Row;
+    std::vector<uint32_t> m_Acc;
+private:
+    static inline uint32_t Reduce(uint32_t a, uint32_t b)
+    {
+        // transparent pixels count as white so they don't darken their visible neighbours
+        const uint32_t ta = (a & AlphaMask) == 0 ? a | RgbMask : a;
+        const uint32_t tb = (b & AlphaMask) == 0 ? b | RgbMask : b;
+        uint32_t r = 0;
+        for (uint32_t shift = 0; shift < 24; shift += 8)
+            r |= std::min((ta >> shift) & 0xFF, (tb >> shift) & 0xFF) << shift;
+        return r | std::max(a & AlphaMask, b & AlphaMask);
+    }
+
+
+#ifdef PYRAMID_SSE2
+    static inline __m128i Reduce(__m128i a, __m128i b)
+    {
+        const __m128i rgb = _mm_set1_epi32((int)RgbMask);
+        const __m128i alpha = _mm_set1_epi32((int)AlphaMask);
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i ta = _mm_or_si128(a, _mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(a, alpha), zero), rgb));
+        const __m128i tb = _mm_or_si128(b, _mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(b, alpha), zero), rgb));
+        return _mm_or_si128(_mm_and_si128(_mm_min_epu8(ta, tb), rgb), _mm_and_si128(_mm_max_epu8(a, b), alpha));
+    }
+#endif
+
+
+    // acc[i] = Reduce(acc[i], row[i])
+    static inline void ReduceRows(uint32_t* acc, const uint32_t* row, size_t n)
+    {
+        size_t i = 0;
+#ifdef PYRAMID_SSE2
+        for (; i + 4 <= n; i += 4)
+        {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + i), Reduce(a, b));
+        }
+#endif
+        for (; i < n; ++i)
+            acc[i] = Reduce(acc[i], row[i]);
+    }
+
+
+    // row[i] = Reduce(row[2i], row[2i + 1]) in place, n has to be even
+    static inline void ReduceColumns(uint32_t* row, size_t n)
+    {
+        size_t i = 0;
+#ifdef PYRAMID_SSE2
+        for (; i + 8 <= n; i += 8)
+        {
+            const __m128 a = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)));
+            const __m128 b = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i + 4)));
+            const __m128i even = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            const __m128i odd = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(row + i / 2), Reduce(even, odd));
+        }
+#endif
+        for (; i < n; i += 2)
+            row[i / 2] = Reduce(row[i], row[i + 1]);
+    }
+public:
+    // Coarsest level that still has at least as many pixels as the image is displayed with
+    static inline int LevelFor(float scale)
+    {
+        if (!(scale > 0.f) || scale >= 1.f)
+            return 0;
+        return std::min((int)std::floor(std::log2(1.f / scale)), MaxLevel);
+    }
+
+
+    static constexpr int LevelSize(int size, int level)
+    {
+        return (size + (1 << level) - 1) >> level;
+    }
+
+
+    // Writes pixels [x0, x1) of row y of the level as RGBA to out
+    inline void ExpandRow(const Canvas& canvas, int level, int y, int x0, int x1, unsigned char* out)
+    {
+        if (level == 0)
+        {
+            canvas.ExpandRow(y, x0, x1, out);
+            return;
+        }
+
+        const int factor = 1 << level;
+        const int sx0 = x0 * factor;
+        const int sx1 = std::min(x1 * factor, canvas.Width());
+        const size_t n = (size_t)(x1 - x0) * (size_t)factor;
+        m_Row.resize(n);
+        m_Acc.assign(n, Neutral);
+        for (int sy = y * factor; sy < std::min((y + 1) * factor, canvas.Height()); ++sy)
+        {
+            // the last column of blocks may reach past the canvas, it stays neutral
+            std::fill(m_Row.begin() + (sx1 - sx0), m_Row.end(), Neutral);
+            canvas.ExpandRow(sy, sx0, sx1, reinterpret_cast<unsigned char*>(m_Row.data()));
+            ReduceRows(m_Acc.data(), m_Row.data(), n);
+        }
+        for (size_t width = n; width > (size_t)(x1 - x0); width /= 2)
+            ReduceColumns(m_Acc.data(), width);
+        std::memcpy(out, m_Acc.data(), (size_t)(x1 - x0) * Channel);
+    }
+
+
+    inline size_t MemoryUsage() const
+    {
+        return (m_Row.capacity() + m_Acc.capacity()) * sizeof(uint32_t);
+    }
+};
@@ -0,0 +1,75 @@
+#pragma once
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+
+// Clips the segment against [0, w) x [0, h) (Liang-Barsky).
+// Returns false if nothing of it is visible, the endpoints are updated otherwise.
+inline bool ClipLine(int w, int h, int& x0, int& y0, int& x1, int& y1)
+{
+    const bool inside0 = x0 >= 0 && y0 >= 0 && x0 < w && y0 < h;
+    const bool inside1 = x1 >= 0 && y1 >= 0 && x1 < w && y1 < h;
+    if (inside0 && inside1)
+        return true;
+
+    const double dx = x1 - x0;
+    const double dy = y1 - y0;
+    const double p[4] = { -dx, dx, -dy, dy };
+    const double q[4] = { (double)x0, (double)(w - 1 - x0), (double)y0, (double)(h - 1 - y0) };
+    double t0 = 0.0;
+    double t1 = 1.0;
+    for (int i = 0; i < 4; ++i)
+    {
+        if (p[i] == 0.0)
+        {
+            if (q[i] < 0.0)
+                return false;
+            continue;
+        }
+        const double t = q[i] / p[i];
+        if (p[i] < 0.0)
+            t0 = std::max(t0, t);
+        else
+            t1 = std::min(t1, t);
+    }
+    if (t0 > t1)
+        return false;
+
+    const int ox = x0;
+    const int oy = y0;
+    x0 = std::clamp((int)std::lround(ox + t0 * dx), 0, w - 1);
+    y0 = std::clamp((int)std::lround(oy + t0 * dy), 0, h - 1);
+    x1 = std::clamp((int)std::lround(ox + t1 * dx), 0, w - 1);
+    y1 = std::clamp((int)std::lround(oy + t1 * dy), 0, h - 1);
+    return true;
+}
+
+
+// Bresenham, calls plot(x, y) for every pixel from (x0, y0) to (x1, y1) inclusive.
+// No bounds checks, clip the segment first.
+template <class Plot>
+inline void RasterizeLine(int x0, int y0, int x1, int y1, Plot&& plot)
+{
+    const int dx = std::abs(x1 - x0);
+    const int dy = -std::abs(y1 - y0);
+    const int sx = x0 < x1 ? 1 : -1;
+    const int sy = y0 < y1 ? 1 : -1;
+    int err = dx + dy;
+    while (true)
+    {
+        plot(x0, y0);
+        if (x0 == x1 && y0 == y1)
+            return;
+        const int e2 = 2 * err;
+        if (e2 >= dy)
+        {
+            err += dy;
+            x0 += sx;
+        }
+        if (e2 <= dx)
+        {
+            err += dx;
+            y0 += sy;
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <algorithm>
+#include <climits>
+
+struct Rect
+{
+    int x0 = INT_MAX;
+    int y0 = INT_MAX;
+    int x1 = INT_MIN; // exclusive
+    int y1 = INT_MIN; // exclusive
+
+    constexpr bool Empty()  const { return x0 >= x1 || y0 >= y1; }
+    constexpr int  Width()  const { return x1 - x0; }
+    constexpr int  Height() const { return y1 - y0; }
+
+    constexpr void Add(int x, int y, int w, int h)
+    {
+        x0 = std::min(x0, x);
+        y0 = std::min(y0, y);
+        x1 = std::max(x1, x + w);
+        y1 = std::max(y1, y + h);
+    }
+
+    constexpr Rect Intersect(const Rect& r) const
+    {
+        return { std::max(x0, r.x0), std::max(y0, r.y0), std::min(x1, r.x1), std::min(y1, r.y1) };
+    }
+
+    constexpr bool operator==(const Rect& r) const
+    {
+        return x0 == r.x0 && y0 == r.y0 && x1 == r.x1 && y1 == r.y1;
+    }
+
+    static constexpr Rect FromSize(int x, int y, int w, int h)
+    {
+        return { x, y, x + w, y + h };
+    }
+};
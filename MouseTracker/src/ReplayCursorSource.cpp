@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <string>
+
+#include "CursorSource.h"
+#include "Log.h"
+
+ReplayCursorSource::ReplayCursorSource(const std::filesystem::path& path, bool maxSpeed) : m_File(path), m_MaxSpeed(maxSpeed)
+{
+    if (!m_File.is_open())
+    {
+        Err << "{ReplayCursorSource} Failed to open trace [" << path << "]" << std::endl;
+        m_Exhausted = true;
+        return;
+    }
+    Log << "Replaying trace [" << path << "] " << (m_MaxSpeed ? "at maximum speed" : "with original timing") << std::endl;
+}
+
+
+bool ReplayCursorSource::ReadSample(Sample& sample)
+{
+    std::string line;
+    while (std::getline(m_File, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        long long t;
+        int x, y;
+        if (std::sscanf(line.c_str(), "%lld %d %d", &t, &x, &y) != 3)
+        {
+            Err << "{ReplayCursorSource} Malformed line: " << line << std::endl;
+            continue;
+        }
+        sample = { (int64_t)t, x, y };
+        return true;
+    }
+    return false;
+}
+
+
+bool ReplayCursorSource::Next(Sample& sample)
+{
+    if (m_Exhausted)
+        return false;
+
+    if (!m_HasPending)
+    {
+        if (!ReadSample(m_Pending))
+        {
+            m_Exhausted = true;
+            Log << "{ReplayCursorSource} Reached end of trace" << std::endl;
+            return false;
+        }
+        if (!m_Started)
+        {
+            m_Started = true;
+            m_FirstTime = m_Pending.time;
+            m_Start = std::chrono::steady_clock::now();
+        }
+        m_HasPending = true;
+    }
+
+    if (!m_MaxSpeed)
+    {
+        const auto due = m_Start + std::chrono::microseconds(m_Pending.time - m_FirstTime);
+        const auto now = std::chrono::steady_clock::now();
+        if (due > now)
+        {
+            std::this_thread::sleep_until(std::min(due, now + std::chrono::milliseconds(100)));
+            if (std::chrono::steady_clock::now() < due)
+                return false;
+        }
+    }
+    sample = m_Pending;
+    m_HasPending = false;
+    return true;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <cstdint>
+#include <chrono>
+
+struct Sample
+{
+    int64_t time; // microseconds since epoch
+    int x, y;     // virtual desktop coordinates
+};
+
+
+inline int64_t SampleTimeNow()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
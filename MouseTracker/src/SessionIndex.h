@@ -0,0 +1,348 @@
+#pragma once
+#include <system_error>
+#include <filesystem>
+#include <algorithm>
+#include <optional>
+#include <climits>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "SessionLog.h"
+#include "Sample.h"
+#include "Crc32.h"
+#include "Rect.h"
+#include "Log.h"
+
+// Sidecar index of a session log ("<log>.idx"), one fixed size entry per chunk.
+//
+// file  := "MTSIDX\r\n" u32 version entry*
+// entry := u64 offset u32 flags u32 count u32 payloadBytes i64 firstTime i32 firstX i32 firstY
+//          i64 lastTime i32 lastX i32 lastY i32 x0 i32 y0 i32 x1 i32 y1 u32 crc
+//
+// Entries are in log order and samples are appended in time order, so a time
+// range is found with a binary search over the file without reading the log.
+// The bounding box answers region and monitor queries (a monitor is a region
+// of the virtual desktop, its index isn't stable across layout changes).
+// The index is derived data: a missing, stale or damaged index is brought up
+// to date from the log when it is opened.
+class SessionIndex
+{
+public:
+    struct Entry
+    {
+        uint64_t offset = 0; // of the chunk in the log
+        SessionLog::ChunkHeader header;
+        Sample last{ 0, 0, 0 };
+        Rect bounds;         // of the samples
+
+        constexpr uint64_t End() const { return offset + SessionLog::ChunkHeaderBytes + header.payloadBytes; }
+
+        inline void Add(const Sample& s)
+        {
+            last = s;
+            bounds.Add(s.x, s.y, 1, 1);
+        }
+    };
+
+    static constexpr char Magic[8] = { 'M', 'T', 'S', 'I', 'D', 'X', '\r', '\n' };
+    static constexpr uint32_t Version = 1;
+    static constexpr size_t FileHeaderBytes = sizeof(Magic) + 4;
+    static constexpr size_t EntryBytes = 72;
+    static constexpr Rect Everywhere{ INT_MIN, INT_MIN, INT_MAX, INT_MAX };
+private:
+    static constexpr size_t ReadBatch = 4096; // entries per read while scanning a range
+    std::filesystem::path m_LogPath;
+    std::filesystem::path m_Path;
+    std::FILE* m_File = nullptr;
+    std::vector<Entry> m_Entries; // used instead of the file if it can't be written
+    bool m_Open = false;
+    uint64_t m_Count = 0;
+private:
+    inline void CloseFile()
+    {
+        if (m_File != nullptr)
+            std::fclose(m_File);
+        m_File = nullptr;
+    }
+
+
+    // Entries are trusted if the last one describes the chunk that is in the log at its offset
+    inline bool MatchesLog(const Entry& e, uint64_t logSize) const
+    {
+        if (e.End() > logSize)
+            return false;
+        std::FILE* log = std::fopen(m_LogPath.string().c_str(), "rb");
+        unsigned char h[SessionLog::HeaderBytes];
+        const bool read = log != nullptr && SessionLog::Seek(log, e.offset) == 0 && std::fread(h, 1, sizeof(h), log) == sizeof(h);
+        if (log != nullptr)
+            std::fclose(log);
+        if (!read)
+            return false;
+        const SessionLog::ChunkHeader c = SessionLog::GetHeader(h);
+        return SessionLog::GetU32(h) == SessionLog::ChunkMagic && c.flags == e.header.flags && c.count == e.header.count && c.payloadBytes == e.header.payloadBytes
+            && c.first.time == e.header.first.time && c.first.x == e.header.first.x && c.first.y == e.header.first.y;
+    }
+
+
+    // Opens the sidecar, false if it doesn't belong to the log and has to be recreated
+    inline bool OpenExisting(uint64_t logSize)
+    {
+        std::error_code ec;
+        const uintmax_t size = std::filesystem::file_size(m_Path, ec);
+        if (ec || size < FileHeaderBytes || (m_File = std::fopen(m_Path.string().c_str(), "r+b")) == nullptr)
+            return false;
+
+        unsigned char header[FileHeaderBytes];
+        if (std::fread(header, 1, sizeof(header), m_File) != sizeof(header) || std::memcmp(header, Magic, sizeof(Magic)) != 0
+            || SessionLog::GetU32(header + sizeof(Magic)) != Version)
+        {
+            CloseFile();
+            return false;
+        }
+
+        // a torn last entry is left out and overwritten by the next one
+        m_Count = (size - FileHeaderBytes) / EntryBytes;
+        Entry last;
+        if (m_Count != 0 && !(Read(m_Count - 1, last) && MatchesLog(last, logSize)))
+        {
+            CloseFile();
+            return false;
+        }
+        return true;
+    }
+
+
+    inline bool Create()
+    {
+        m_Count = 0;
+        m_File = std::fopen(m_Path.string().c_str(), "w+b");
+        if (m_File == nullptr)
+            return false;
+        unsigned char header[FileHeaderBytes];
+        std::memcpy(header, Magic, sizeof(Magic));
+        SessionLog::PutU32(header + sizeof(Magic), Version);
+        if (std::fwrite(header, 1, sizeof(header), m_File) == sizeof(header))
+            return true;
+        CloseFile();
+        return false;
+    }
+
+
+    // Indexes the chunks after the last indexed one
+    inline bool CatchUp()
+    {
+        Entry last;
+        uint64_t from = SessionLog::FileHeaderBytes;
+        if (m_Count != 0 && Read(m_Count - 1, last))
+            from = last.End();
+
+        SessionLogReader reader(m_LogPath);
+        if (!reader.IsOpen())
+            return false;
+        reader.SetOffset(from);
+        SessionLog::ChunkHeader header;
+        std::vector<Sample> samples;
+        uint64_t added = 0;
+        while (reader.Next(header, samples))
+        {
+            if (!Append(FromChunk(reader.Offset() - SessionLog::ChunkHeaderBytes - header.payloadBytes, header, samples)))
+            {
+                Err << "{SessionIndex} Failed to write [" << m_Path << "]" << std::endl;
+                return false;
+            }
+            samples.clear();
+            ++added;
+        }
+        if (added != 0)
+            Log << "{SessionIndex} Indexed " << added << " new chunk(s) of [" << m_LogPath << "]" << std::endl;
+        return Flush();
+    }
+
+
+    inline std::optional<std::vector<Entry>> QueryOnce(int64_t from, int64_t to, const Rect& area) const
+    {
+        // first chunk that ends at or after from
+        uint64_t lo = 0;
+        uint64_t hi = m_Count;
+        Entry e;
+        while (lo < hi)
+        {
+            const uint64_t mid = lo + (hi - lo) / 2;
+            if (!Read(mid, e))
+                return std::nullopt;
+            if (e.last.time < from)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        std::vector<Entry> result;
+        std::vector<unsigned char> batch;
+        for (uint64_t i = lo; i < m_Count; ++i)
+        {
+            if (m_File == nullptr)
+                e = m_Entries[i];
+            else
+            {
+                // sequential from here on, read in batches
+                const uint64_t k = (i - lo) % ReadBatch;
+                if (k == 0)
+                {
+                    batch.resize(std::min<uint64_t>(ReadBatch, m_Count - i) * EntryBytes);
+                    if (SessionLog::Seek(m_File, FileHeaderBytes + i * EntryBytes) != 0 || std::fread(batch.data(), 1, batch.size(), m_File) != batch.size())
+                        return std::nullopt;
+                }
+                if (!Get(batch.data() + k * EntryBytes, e))
+                    return std::nullopt;
+            }
+            if (e.header.first.time >= to)
+                break;
+            if (!e.bounds.Intersect(area).Empty())
+                result.push_back(e);
+        }
+        return result;
+    }
+
+
+    inline bool Rebuild()
+    {
+        CloseFile();
+        m_Entries.clear();
+        if (!Create())
+            Err << "{SessionIndex} Failed to create [" << m_Path << "], indexing in memory" << std::endl;
+        return CatchUp();
+    }
+public:
+    inline explicit SessionIndex(const std::filesystem::path& logPath) : m_LogPath(logPath), m_Path(PathFor(logPath))
+    {
+        std::error_code ec;
+        const uintmax_t logSize = std::filesystem::file_size(m_LogPath, ec);
+        if (ec)
+        {
+            Err << "{SessionIndex} Failed to open session log [" << m_LogPath << "]" << std::endl;
+            return;
+        }
+        m_Open = OpenExisting(logSize) ? CatchUp() : Rebuild();
+    }
+
+
+    inline ~SessionIndex()
+    {
+        CloseFile();
+    }
+
+
+    SessionIndex(const SessionIndex&) = delete;
+    SessionIndex& operator=(const SessionIndex&) = delete;
+
+
+    static inline std::filesystem::path PathFor(const std::filesystem::path& logPath)
+    {
+        std::filesystem::path path = logPath;
+        path += ".idx";
+        return path;
+    }
+
+
+    static inline Entry FromChunk(uint64_t offset, const SessionLog::ChunkHeader& header, const std::vector<Sample>& samples)
+    {
+        Entry e;
+        e.offset = offset;
+        e.header = header;
+        for (const Sample& s : samples)
+            e.Add(s);
+        return e;
+    }
+
+
+    static inline void Put(unsigned char* p, const Entry& e)
+    {
+        SessionLog::PutU64(p, e.offset);
+        SessionLog::PutU32(p + 8, e.header.flags);
+        SessionLog::PutU32(p + 12, e.header.count);
+        SessionLog::PutU32(p + 16, e.header.payloadBytes);
+        SessionLog::PutU64(p + 20, (uint64_t)e.header.first.time);
+        SessionLog::PutU32(p + 28, (uint32_t)e.header.first.x);
+        SessionLog::PutU32(p + 32, (uint32_t)e.header.first.y);
+        SessionLog::PutU64(p + 36, (uint64_t)e.last.time);
+        SessionLog::PutU32(p + 44, (uint32_t)e.last.x);
+        SessionLog::PutU32(p + 48, (uint32_t)e.last.y);
+        SessionLog::PutU32(p + 52, (uint32_t)e.bounds.x0);
+        SessionLog::PutU32(p + 56, (uint32_t)e.bounds.y0);
+        SessionLog::PutU32(p + 60, (uint32_t)e.bounds.x1);
+        SessionLog::PutU32(p + 64, (uint32_t)e.bounds.y1);
+        SessionLog::PutU32(p + 68, Crc32(p, EntryBytes - 4));
+    }
+
+
+    // False if the crc doesn't match
+    static inline bool Get(const unsigned char* p, Entry& e)
+    {
+        if (Crc32(p, EntryBytes - 4) != SessionLog::GetU32(p + 68))
+            return false;
+        e.offset = SessionLog::GetU64(p);
+        e.header.flags = SessionLog::GetU32(p + 8);
+        e.header.count = SessionLog::GetU32(p + 12);
+        e.header.payloadBytes = SessionLog::GetU32(p + 16);
+        e.header.first = { (int64_t)SessionLog::GetU64(p + 20), (int)SessionLog::GetU32(p + 28), (int)SessionLog::GetU32(p + 32) };
+        e.last = { (int64_t)SessionLog::GetU64(p + 36), (int)SessionLog::GetU32(p + 44), (int)SessionLog::GetU32(p + 48) };
+        e.bounds = { (int)SessionLog::GetU32(p + 52), (int)SessionLog::GetU32(p + 56), (int)SessionLog::GetU32(p + 60), (int)SessionLog::GetU32(p + 64) };
+        return true;
+    }
+
+
+    inline bool Read(uint64_t i, Entry& e) const
+    {
+        if (m_File == nullptr)
+        {
+            e = m_Entries[i];
+            return true;
+        }
+        unsigned char p[EntryBytes];
+        return SessionLog::Seek(m_File, FileHeaderBytes + i * EntryBytes) == 0 && std::fread(p, 1, sizeof(p), m_File) == sizeof(p) && Get(p, e);
+    }
+
+
+    // Adds the entry of the chunk after the last indexed one
+    inline bool Append(const Entry& e)
+    {
+        if (m_File == nullptr)
+        {
+            m_Entries.push_back(e);
+            ++m_Count;
+            return true;
+        }
+        unsigned char p[EntryBytes];
+        Put(p, e);
+        if (SessionLog::Seek(m_File, FileHeaderBytes + m_Count * EntryBytes) != 0 || std::fwrite(p, 1, sizeof(p), m_File) != sizeof(p))
+            return false;
+        ++m_Count;
+        return true;
+    }
+
+
+    inline bool Flush()
+    {
+        return m_File == nullptr || std::fflush(m_File) == 0;
+    }
+
+
+    // Chunks with samples in [from, to) whose bounding box intersects area, in log order
+    inline std::optional<std::vector<Entry>> Query(int64_t from, int64_t to, const Rect& area = Everywhere)
+    {
+        std::optional<std::vector<Entry>> result = QueryOnce(from, to, area);
+        if (result.has_value() || !m_Open)
+            return result;
+
+        Err << "{SessionIndex} Index is damaged, rebuilding it [" << m_Path << "]" << std::endl;
+        m_Open = Rebuild();
+        return m_Open ? QueryOnce(from, to, area) : std::nullopt;
+    }
+
+
+    inline bool IsOpen()        const { return m_Open;              }
+    inline bool Persistent()    const { return m_File != nullptr;   } // false if the index only lives in memory
+    inline uint64_t Size()      const { return m_Count;             }
+};
@@ -0,0 +1,318 @@
+#pragma once
+#include <filesystem>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "Sample.h"
+#include "Crc32.h"
+#include "Log.h"
+
+// Append-only binary log of every tracked sample.
+//
+// file   := "MTSLOG\r\n" u32 version chunk*
+// chunk  := header u32 crc payload
+// header := u32 'MTCK' u32 flags u32 count u32 payloadBytes i64 time i32 x i32 y
+//
+// All integers are little endian. The header holds the first sample of the
+// chunk in absolute terms, the payload the remaining count - 1 samples as
+// zigzag varint deltas (time, x, y) to their predecessor. The crc covers
+// header and payload. Every chunk decodes on its own so a torn write at the
+// end or a corrupted chunk only loses that chunk.
+namespace SessionLog
+{
+    static constexpr char Magic[8] = { 'M', 'T', 'S', 'L', 'O', 'G', '\r', '\n' };
+    static constexpr uint32_t Version = 1;
+    static constexpr uint32_t ChunkMagic = 0x4B43544D; // "MTCK"
+    static constexpr size_t FileHeaderBytes = sizeof(Magic) + 4;
+    static constexpr size_t HeaderBytes = 32;
+    static constexpr size_t ChunkHeaderBytes = HeaderBytes + 4; // header and crc
+    static constexpr size_t ChunkPayload = 16 * 1024; // chunks are closed once their payload reaches this
+    static constexpr size_t MaxSampleBytes = 3 * 10;  // three 64 bit varints
+
+    // chunk flags
+    static constexpr uint32_t StrokeStart = 1; // the first sample doesn't connect to the last one of the previous chunk
+
+    struct ChunkHeader
+    {
+        uint32_t flags = 0;
+        uint32_t count = 0;
+        uint32_t payloadBytes = 0;
+        Sample first{ 0, 0, 0 };
+    };
+
+    enum class ChunkStatus { Ok, End, Corrupted };
+
+
+    // Logs grow past 2 GB, long is 32 bit on Windows
+    inline int Seek(std::FILE* file, uint64_t offset)
+    {
+#ifdef WINDOWS
+        return _fseeki64(file, (long long)offset, SEEK_SET);
+#else
+        return fseeko(file, (off_t)offset, SEEK_SET);
+#endif
+    }
+
+
+    inline void PutU32(unsigned char* p, uint32_t v)
+    {
+        for (int i = 0; i < 4; ++i)
+            p[i] = (unsigned char)(v >> (8 * i));
+    }
+
+
+    inline void PutU64(unsigned char* p, uint64_t v)
+    {
+        for (int i = 0; i < 8; ++i)
+            p[i] = (unsigned char)(v >> (8 * i));
+    }
+
+
+    inline uint32_t GetU32(const unsigned char* p)
+    {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i)
+            v |= (uint32_t)p[i] << (8 * i);
+        return v;
+    }
+
+
+    inline uint64_t GetU64(const unsigned char* p)
+    {
+        uint64_t v = 0;
+        for (int i = 0; i < 8; ++i)
+            v |= (uint64_t)p[i] << (8 * i);
+        return v;
+    }
+
+
+    constexpr uint64_t ZigZag(int64_t v)
+    {
+        return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+    }
+
+
+    constexpr int64_t UnZigZag(uint64_t v)
+    {
+        return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+    }
+
+
+    // Returns the number of bytes written, at most 10
+    inline size_t PutVarint(unsigned char* p, uint64_t v)
+    {
+        size_t n = 0;
+        while (v >= 0x80)
+        {
+            p[n++] = (unsigned char)(v | 0x80);
+            v >>= 7;
+        }
+        p[n++] = (unsigned char)v;
+        return n;
+    }
+
+
+    // Returns false if the varint runs past end or is longer than 64 bits
+    inline bool GetVarint(const unsigned char*& p, const unsigned char* end, uint64_t& v)
+    {
+        v = 0;
+        for (int shift = 0; shift < 64 && p < end; shift += 7)
+        {
+            const unsigned char b = *p++;
+            v |= (uint64_t)(b & 0x7F) << shift;
+            if ((b & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+
+    inline size_t PutDelta(unsigned char* p, const Sample& prev, const Sample& s)
+    {
+        size_t n = PutVarint(p, ZigZag(s.time - prev.time));
+        n += PutVarint(p + n, ZigZag((int64_t)s.x - prev.x));
+        n += PutVarint(p + n, ZigZag((int64_t)s.y - prev.y));
+        return n;
+    }
+
+
+    inline void PutHeader(unsigned char* p, const ChunkHeader& h)
+    {
+        PutU32(p, ChunkMagic);
+        PutU32(p + 4, h.flags);
+        PutU32(p + 8, h.count);
+        PutU32(p + 12, h.payloadBytes);
+        PutU64(p + 16, (uint64_t)h.first.time);
+        PutU32(p + 24, (uint32_t)h.first.x);
+        PutU32(p + 28, (uint32_t)h.first.y);
+    }
+
+
+    inline ChunkHeader GetHeader(const unsigned char* p)
+    {
+        ChunkHeader h;
+        h.flags = GetU32(p + 4);
+        h.count = GetU32(p + 8);
+        h.payloadBytes = GetU32(p + 12);
+        h.first = { (int64_t)GetU64(p + 16), (int)GetU32(p + 24), (int)GetU32(p + 28) };
+        return h;
+    }
+
+
+    // Appends the samples of the payload after the first one, false if it is malformed
+    inline bool DecodePayload(const ChunkHeader& h, const unsigned char* payload, std::vector<Sample>& out)
+    {
+        const unsigned char* p = payload;
+        const unsigned char* const end = payload + h.payloadBytes;
+        Sample s = h.first;
+        out.push_back(s);
+        for (uint32_t i = 1; i < h.count; ++i)
+        {
+            uint64_t dt, dx, dy;
+            if (!GetVarint(p, end, dt) || !GetVarint(p, end, dx) || !GetVarint(p, end, dy))
+                return false;
+            s = { s.time + UnZigZag(dt), (int)(s.x + UnZigZag(dx)), (int)(s.y + UnZigZag(dy)) };
+            out.push_back(s);
+        }
+        return p == end;
+    }
+
+
+    // Cheap check before the crc, rejects headers that can't have been written
+    inline bool Plausible(const unsigned char* h, const ChunkHeader& header)
+    {
+        return GetU32(h) == ChunkMagic && header.count != 0 && header.payloadBytes <= ChunkPayload + MaxSampleBytes;
+    }
+
+
+    // Reads the chunk at offset and appends its samples if it is intact
+    inline ChunkStatus ReadChunk(std::FILE* file, uint64_t offset, ChunkHeader& header, std::vector<unsigned char>& payload, std::vector<Sample>& samples)
+    {
+        unsigned char h[ChunkHeaderBytes];
+        if (Seek(file, offset) != 0 || std::fread(h, 1, sizeof(h), file) != sizeof(h))
+            return ChunkStatus::End; // end of log or a torn last header
+
+        header = GetHeader(h);
+        if (!Plausible(h, header))
+            return ChunkStatus::Corrupted;
+
+        payload.resize(header.payloadBytes);
+        if (std::fread(payload.data(), 1, payload.size(), file) != payload.size())
+            return ChunkStatus::End;
+
+        const uint32_t crc = Crc32(payload.data(), payload.size(), Crc32(h, HeaderBytes));
+        const size_t size = samples.size();
+        if (crc == GetU32(h + HeaderBytes) && DecodePayload(header, payload.data(), samples))
+            return ChunkStatus::Ok;
+        samples.resize(size);
+        return ChunkStatus::Corrupted;
+    }
+}
+
+
+// Reads a session log chunk by chunk, skipping chunks that fail their crc
+class SessionLogReader
+{
+private:
+    std::FILE* m_File = nullptr;
+    uint64_t m_Offset = 0;
+    uint64_t m_Corrupted = 0;
+    std::vector<unsigned char> m_Payload;
+private:
+    // Moves to the next chunk magic after a corrupted chunk
+    inline bool Resync(uint64_t from)
+    {
+        unsigned char window[4] = {};
+        SessionLog::Seek(m_File, from);
+        m_Offset = from;
+        size_t have = 0;
+        int c;
+        while ((c = std::fgetc(m_File)) != EOF)
+        {
+            std::memmove(window, window + 1, 3);
+            window[3] = (unsigned char)c;
+            ++m_Offset;
+            if (++have >= 4 && SessionLog::GetU32(window) == SessionLog::ChunkMagic)
+            {
+                m_Offset -= 4;
+                SessionLog::Seek(m_File, m_Offset);
+                return true;
+            }
+        }
+        return false;
+    }
+public:
+    inline explicit SessionLogReader(const std::filesystem::path& path)
+    {
+        m_File = std::fopen(path.string().c_str(), "rb");
+        unsigned char header[SessionLog::FileHeaderBytes];
+        if (m_File == nullptr || std::fread(header, 1, sizeof(header), m_File) != sizeof(header) || std::memcmp(header, SessionLog::Magic, sizeof(SessionLog::Magic)) != 0)
+        {
+            Err << "{SessionLogReader} Not a session log [" << path << "]" << std::endl;
+            Close();
+            return;
+        }
+        if (SessionLog::GetU32(header + sizeof(SessionLog::Magic)) > SessionLog::Version)
+        {
+            Err << "{SessionLogReader} Unsupported version [" << path << "]" << std::endl;
+            Close();
+            return;
+        }
+        m_Offset = sizeof(header);
+    }
+
+
+    inline ~SessionLogReader()
+    {
+        Close();
+    }
+
+
+    SessionLogReader(const SessionLogReader&) = delete;
+    SessionLogReader& operator=(const SessionLogReader&) = delete;
+
+
+    inline void Close()
+    {
+        if (m_File != nullptr)
+            std::fclose(m_File);
+        m_File = nullptr;
+    }
+
+
+    // Appends the samples of the next intact chunk, false at the end of the log
+    inline bool Next(SessionLog::ChunkHeader& header, std::vector<Sample>& samples)
+    {
+        while (m_File != nullptr)
+        {
+            const SessionLog::ChunkStatus status = SessionLog::ReadChunk(m_File, m_Offset, header, m_Payload, samples);
+            if (status == SessionLog::ChunkStatus::Ok)
+            {
+                m_Offset += SessionLog::ChunkHeaderBytes + header.payloadBytes;
+                return true;
+            }
+            if (status == SessionLog::ChunkStatus::End)
+                return false;
+
+            ++m_Corrupted;
+            Err << "{SessionLogReader} Skipping corrupted chunk at offset " << m_Offset << std::endl;
+            if (!Resync(m_Offset + 1))
+                return false;
+        }
+        return false;
+    }
+
+
+    // Continues reading at the chunk at offset
+    inline void SetOffset(uint64_t offset)
+    {
+        m_Offset = offset;
+    }
+
+
+    inline bool IsOpen()          const { return m_File != nullptr; }
+    inline uint64_t Offset()      const { return m_Offset;          }
+    inline uint64_t Corrupted()   const { return m_Corrupted;       }
+};
@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#include "SessionLogWriter.h"
+#include "Log.h"
+
+SessionLogWriter::SessionLogWriter(const std::filesystem::path& path, size_t capacity) : m_Ring(capacity)
+{
+    // appending to an existing log continues it, the first chunk starts a new stroke anyway
+    std::error_code ec;
+    const bool exists = std::filesystem::exists(path, ec) && std::filesystem::file_size(path, ec) != 0;
+    if (exists && !SessionLogReader(path).IsOpen())
+    {
+        Err << "{SessionLogWriter} Refusing to append to a file that isn't a session log [" << path << "]" << std::endl;
+        return;
+    }
+
+    m_File = std::fopen(path.string().c_str(), "ab");
+    if (m_File == nullptr)
+    {
+        Err << "{SessionLogWriter} Failed to open session log [" << path << "]" << std::endl;
+        return;
+    }
+    if (!exists)
+    {
+        unsigned char header[SessionLog::FileHeaderBytes];
+        std::memcpy(header, SessionLog::Magic, sizeof(SessionLog::Magic));
+        SessionLog::PutU32(header + sizeof(SessionLog::Magic), SessionLog::Version);
+        std::fwrite(header, 1, sizeof(header), m_File);
+    }
+
+    // brings the index up to date with what is in the log already
+    std::fflush(m_File);
+    m_Offset = std::filesystem::file_size(path, ec);
+    m_Index = std::make_unique<SessionIndex>(path);
+    if (ec || !m_Index->IsOpen() || !m_Index->Persistent())
+    {
+        Err << "{SessionLogWriter} Failed to open the index, logging without it [" << path << "]" << std::endl;
+        m_Index.reset();
+    }
+    m_Payload.reserve(SessionLog::ChunkPayload + SessionLog::MaxSampleBytes);
+    m_Thread = std::thread(&SessionLogWriter::Run, this);
+    Log << "{SessionLogWriter} Logging samples to [" << path << "]" << std::endl;
+}
+
+
+SessionLogWriter::~SessionLogWriter()
+{
+    if (m_File == nullptr)
+        return;
+    m_Running = false;
+    m_Thread.join();
+    std::fclose(m_File);
+    Log << "{SessionLogWriter} Closed session log samples: " << Samples() << " bytes: " << Bytes() << " dropped: " << Dropped() << std::endl;
+}
+
+
+void SessionLogWriter::Append(const Sample& sample)
+{
+    if (m_File == nullptr)
+        return;
+    if (!m_Recording.load(std::memory_order_relaxed))
+    {
+        m_PendingBreak = true;
+        return;
+    }
+
+    if (m_PendingBreak && !m_Ring.Push({ BreakTime, 0, 0 }))
+    {
+        m_Dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    m_PendingBreak = false;
+    if (!m_Ring.Push(sample))
+    {
+        // the stroke has a gap now, don't connect across it
+        m_Dropped.fetch_add(1, std::memory_order_relaxed);
+        m_PendingBreak = true;
+    }
+}
+
+
+void SessionLogWriter::Encode(const Sample& sample)
+{
+    if (sample.time == BreakTime)
+    {
+        CloseChunk();
+        m_StrokeStart = true;
+        return;
+    }
+
+    if (m_Chunk.count == 0)
+    {
+        m_Chunk.flags = m_StrokeStart ? SessionLog::StrokeStart : 0;
+        m_Chunk.first = sample;
+        m_ChunkOpened = std::chrono::steady_clock::now();
+        m_StrokeStart = false;
+        m_Entry = SessionIndex::Entry();
+    }
+    else
+    {
+        const size_t size = m_Payload.size();
+        m_Payload.resize(size + SessionLog::MaxSampleBytes);
+        m_Payload.resize(size + SessionLog::PutDelta(m_Payload.data() + size, m_Last, sample));
+    }
+    m_Last = sample;
+    m_Entry.Add(sample);
+    ++m_Chunk.count;
+    if (m_Payload.size() >= SessionLog::ChunkPayload)
+        CloseChunk();
+}
+
+
+void SessionLogWriter::CloseChunk()
+{
+    if (m_Chunk.count == 0)
+        return;
+
+    m_Chunk.payloadBytes = (uint32_t)m_Payload.size();
+    unsigned char header[SessionLog::HeaderBytes + 4];
+    SessionLog::PutHeader(header, m_Chunk);
+    SessionLog::PutU32(header + SessionLog::HeaderBytes, Crc32(m_Payload.data(), m_Payload.size(), Crc32(header, SessionLog::HeaderBytes)));
+    m_Buffer.insert(m_Buffer.end(), header, header + sizeof(header));
+    m_Buffer.insert(m_Buffer.end(), m_Payload.begin(), m_Payload.end());
+    m_Samples.fetch_add(m_Chunk.count, std::memory_order_relaxed);
+    m_Entry.offset = m_Offset;
+    m_Entry.header = m_Chunk;
+    m_PendingEntries.push_back(m_Entry);
+    m_Offset = m_Entry.End();
+    m_Payload.clear();
+    m_Chunk = SessionLog::ChunkHeader();
+}
+
+
+void SessionLogWriter::Write()
+{
+    if (m_Buffer.empty())
+        return;
+    if (std::fwrite(m_Buffer.data(), 1, m_Buffer.size(), m_File) != m_Buffer.size() || std::fflush(m_File) != 0)
+    {
+        // the offsets of the following chunks are unknown now, the index catches up when the log is opened again
+        Err << "{SessionLogWriter} Failed to write " << m_Buffer.size() << " bytes" << std::endl;
+        m_Index.reset();
+    }
+    else
+        m_Bytes.fetch_add(m_Buffer.size(), std::memory_order_relaxed);
+    m_Buffer.clear();
+
+    if (m_Index != nullptr && !(std::all_of(m_PendingEntries.begin(), m_PendingEntries.end(), [this](const SessionIndex::Entry& e) { return m_Index->Append(e); }) && m_Index->Flush()))
+    {
+        Err << "{SessionLogWriter} Failed to write the index, logging without it" << std::endl;
+        m_Index.reset();
+    }
+    m_PendingEntries.clear();
+}
+
+
+void SessionLogWriter::Run()
+{
+    Sample batch[1024];
+    while (true)
+    {
+        const bool running = m_Running.load(std::memory_order_relaxed);
+        size_t count;
+        while ((count = m_Ring.PopBatch(batch, std::size(batch))) != 0)
+        {
+            for (size_t i = 0; i < count; ++i)
+                Encode(batch[i]);
+        }
+
+        if (!running || (m_Chunk.count != 0 && std::chrono::steady_clock::now() - m_ChunkOpened >= FlushInterval))
+            CloseChunk();
+        Write();
+        if (!running)
+            break;
+        std::this_thread::sleep_for(WakeInterval);
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <filesystem>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <vector>
+
+#include "SessionIndex.h"
+#include "SessionLog.h"
+#include "SpscRing.h"
+#include "Sample.h"
+
+// Appends samples to a session log on a background thread. The capture thread
+// hands samples over through a ring, the writer encodes them into chunks and
+// writes closed chunks in batches so neither the capture nor the render loop
+// ever waits for the disk. The sidecar index is kept up to date alongside.
+class SessionLogWriter
+{
+private:
+    static constexpr int64_t BreakTime = INT64_MIN; // ring marker, the next sample starts a new stroke
+    static constexpr std::chrono::milliseconds WakeInterval{ 100 };
+    static constexpr std::chrono::seconds FlushInterval{ 10 }; // partial chunks reach the disk after this at the latest
+    SpscRing<Sample> m_Ring;
+    std::FILE* m_File = nullptr;
+    std::thread m_Thread;
+    std::atomic<bool> m_Running{ true };
+    std::atomic<bool> m_Recording{ false };
+    bool m_PendingBreak = true; // capture thread only
+
+    // writer thread only
+    SessionLog::ChunkHeader m_Chunk;
+    std::vector<unsigned char> m_Buffer; // closed chunks waiting for the next write, then the open chunk's payload
+    std::vector<unsigned char> m_Payload;
+    Sample m_Last{ 0, 0, 0 };
+    bool m_StrokeStart = true;
+    std::unique_ptr<SessionIndex> m_Index; // entries are added once their chunk is written
+    SessionIndex::Entry m_Entry;
+    std::vector<SessionIndex::Entry> m_PendingEntries;
+    uint64_t m_Offset = 0; // where the next closed chunk starts in the log
+    std::chrono::steady_clock::time_point m_ChunkOpened;
+
+    std::atomic<uint64_t> m_Samples{ 0 };
+    std::atomic<uint64_t> m_Bytes{ 0 };
+    std::atomic<uint64_t> m_Dropped{ 0 };
+private:
+    void Run();
+    void Encode(const Sample& sample);
+    void CloseChunk();
+    void Write();
+public:
+    explicit SessionLogWriter(const std::filesystem::path& path, size_t capacity = 1 << 16);
+    ~SessionLogWriter();
+    SessionLogWriter(const SessionLogWriter&) = delete;
+    SessionLogWriter& operator=(const SessionLogWriter&) = delete;
+
+    // capture thread
+    void Append(const Sample& sample);
+
+    // Samples are only logged while recording, pausing breaks the stroke
+    inline void SetRecording(bool recording) { m_Recording.store(recording, std::memory_order_relaxed); }
+
+    inline bool     IsOpen()   const { return m_File != nullptr;                       }
+    inline uint64_t Samples()  const { return m_Samples.load(std::memory_order_relaxed); }
+    inline uint64_t Bytes()    const { return m_Bytes.load(std::memory_order_relaxed);   }
+    inline uint64_t Dropped()  const { return m_Dropped.load(std::memory_order_relaxed); }
+};
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <utility>
+#include <cstdlib>
+#include <cstdio>
+#include <vector>
+#include <atomic>
+#include <chrono>
+
+#include "SessionReplay.h"
+#include "SessionIndex.h"
+#include "SessionLog.h"
+#include "Rasterizer.h"
+#include "Parallel.h"
+#include "Log.h"
+
+namespace
+{
+    // Draws a - b, skipStart/skipEnd leave out the endpoints if they are inside
+    template <class Plot>
+    void DrawSegment(const Canvas& canvas, Sample a, Sample b, int ox, int oy, bool skipStart, bool skipEnd, Plot&& plot)
+    {
+        const int sx = a.x - ox;
+        const int sy = a.y - oy;
+        const int ex = b.x - ox;
+        const int ey = b.y - oy;
+        int x0 = sx, y0 = sy, x1 = ex, y1 = ey;
+        if (!ClipLine(canvas.Width(), canvas.Height(), x0, y0, x1, y1))
+            return;
+
+        // the endpoints were drawn as part of the neighbouring segments, matters for hit counts
+        bool skip = skipStart && x0 == sx && y0 == sy;
+        const bool skipLast = skipEnd && x1 == ex && y1 == ey && !(x0 == x1 && y0 == y1);
+        RasterizeLine(x0, y0, x1, y1, [&](int x, int y)
+        {
+            if (!std::exchange(skip, false) && !(skipLast && x == x1 && y == y1))
+                plot(x, y);
+        });
+    }
+
+
+    // Draws the samples within range as one stroke, gaps in the range break it
+    template <class Plot>
+    void DrawChunk(const Canvas& canvas, const std::vector<Sample>& samples, int ox, int oy, ReplayRange range, uint64_t& drawn, Plot&& plot)
+    {
+        const Sample* prev = nullptr;
+        for (const Sample& s : samples)
+        {
+            if (!range.Contains(s.time))
+            {
+                prev = nullptr;
+                continue;
+            }
+            DrawSegment(canvas, prev != nullptr ? *prev : s, s, ox, oy, prev != nullptr, false, plot);
+            prev = &s;
+            ++drawn;
+        }
+    }
+
+
+    // Calls draw with plot or, for a brush larger than a pixel, with a plot that stamps it
+    template <class Plot, class Draw>
+    void WithBrush(const Canvas& canvas, const Brush& brush, Plot&& plot, Draw&& draw)
+    {
+        if (brush.Radius() == 0)
+        {
+            draw(plot);
+            return;
+        }
+        draw([&](int x, int y) { brush.Stamp(plot, x, y, canvas.Width(), canvas.Height()); });
+    }
+}
+
+
+std::optional<std::string> SessionReplay::Render(const std::filesystem::path& path, Canvas& target, int ox, int oy, ReplayRange range, const Brush& brush, unsigned threads, ReplayStats* stats)
+{
+    const auto start = std::chrono::steady_clock::now();
+    SessionIndex index(path);
+    if (!index.IsOpen())
+        return { "Failed to open session log [" + path.string() + "]" };
+    const std::optional<std::vector<SessionIndex::Entry>> queried = index.Query(range.from, range.to);
+    if (!queried.has_value())
+        return { "Failed to read the index of session log [" + path.string() + "]" };
+    const std::vector<SessionIndex::Entry>& chunks = queried.value();
+
+    // only chunks that touch the canvas are decoded, the others can still connect to them
+    const int r = brush.Radius();
+    const Rect area = Rect::FromSize(ox - r, oy - r, target.Width() + 2 * r, target.Height() + 2 * r);
+    std::vector<size_t> selected;
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        if (!chunks[i].bounds.Intersect(area).Empty())
+            selected.push_back(i);
+    }
+
+    threads = std::clamp(threads, 1u, (unsigned)std::max<size_t>(selected.size(), 1));
+    std::vector<Canvas> canvases;
+    for (unsigned i = 0; i < threads; ++i)
+        canvases.push_back(target.EmptyCopy());
+
+    std::atomic<size_t> next{ 0 };
+    std::atomic<uint64_t> drawn{ 0 };
+    std::atomic<uint64_t> broken{ 0 };
+    RunParallel(threads, [&](unsigned worker)
+    {
+        std::FILE* file = std::fopen(path.string().c_str(), "rb");
+        if (file == nullptr)
+            return;
+        Canvas& canvas = canvases[worker];
+        std::vector<unsigned char> payload;
+        std::vector<Sample> samples;
+        uint64_t localDrawn = 0;
+        for (size_t k = next++; k < selected.size(); k = next++)
+        {
+            SessionLog::ChunkHeader header;
+            samples.clear();
+            if (SessionLog::ReadChunk(file, chunks[selected[k]].offset, header, payload, samples) != SessionLog::ChunkStatus::Ok)
+            {
+                ++broken;
+                continue;
+            }
+            canvas.Paint([&](auto&& plot)
+            {
+                WithBrush(canvas, brush, plot, [&](auto&& stamp) { DrawChunk(canvas, samples, ox, oy, range, localDrawn, stamp); });
+            });
+        }
+        drawn += localDrawn;
+        std::fclose(file);
+    });
+
+    // every worker reduces its share of the tiles over all canvases
+    const size_t tiles = target.TileCount();
+    RunParallel(threads, [&](unsigned worker)
+    {
+        const size_t begin = tiles * worker / threads;
+        const size_t end = tiles * (worker + 1) / threads;
+        for (Canvas& canvas : canvases)
+            target.MergeTiles(canvas, begin, end);
+    });
+    target.FinishMerge();
+
+    // connect the chunks that continue a stroke, their endpoints are drawn already
+    target.Paint([&](auto&& plot)
+    {
+        WithBrush(target, brush, plot, [&](auto&& stamp)
+        {
+            for (size_t i = 1; i < chunks.size(); ++i)
+            {
+                const SessionIndex::Entry& prev = chunks[i - 1];
+                const SessionIndex::Entry& cur = chunks[i];
+                const bool continues = (cur.header.flags & SessionLog::StrokeStart) == 0 && prev.End() == cur.offset;
+                if (continues && range.Contains(prev.last.time) && range.Contains(cur.header.first.time))
+                    DrawSegment(target, prev.last, cur.header.first, ox, oy, true, true, stamp);
+            }
+        });
+    });
+
+    ReplayStats s;
+    s.chunks = selected.size();
+    s.samples = drawn;
+    s.corrupted = broken;
+    s.threads = threads;
+    s.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    Log << "{SessionReplay} Replayed " << s.samples << " samples from " << s.chunks << " chunks with " << s.threads << " thread(s) in " << s.milliseconds << " ms" << std::endl;
+    if (stats != nullptr)
+        *stats = s;
+    return std::nullopt;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <filesystem>
+#include <optional>
+#include <cstdint>
+#include <string>
+
+#include "Canvas.h"
+#include "Brush.h"
+
+struct ReplayRange
+{
+    int64_t from = INT64_MIN; // microseconds since epoch, inclusive
+    int64_t to = INT64_MAX;   // exclusive
+
+    constexpr bool Contains(int64_t time) const { return time >= from && time < to; }
+};
+
+
+struct ReplayStats
+{
+    uint64_t chunks = 0;    // decoded, the ones outside of the range or the canvas are skipped
+    uint64_t samples = 0;   // within the range
+    uint64_t corrupted = 0;
+    unsigned threads = 0;
+    double milliseconds = 0;
+};
+
+
+// Rebuilds a canvas from a session log. The chunks in range are looked up in
+// the SessionIndex of the log, then decoded and rasterized in parallel, every
+// worker into a private sparse canvas, and the canvases are merged tile range
+// by tile range afterwards (or for visited, sum for counts).
+class SessionReplay
+{
+public:
+    // Draws the samples within range into target, offset by -ox/-oy like Image::DrawStroke()
+    static std::optional<std::string> Render(const std::filesystem::path& path, Canvas& target, int ox, int oy, ReplayRange range, const Brush& brush, unsigned threads, ReplayStats* stats = nullptr);
+};
@@ -4,6 +4,7 @@
 #include <optional>
 #include <cstdlib>
 #include <vector>
+#include <utility>
 #include <string>
 #include <vector>
 #include <Windows.h>
@@ -11,9 +12,16 @@
 #include "ImGui/imgui.h"
 #include "nfd/nfd.h"
 
+#include "SessionLogWriter.h"
+#include "FrameScheduler.h"
+#include "CursorCapture.h"
+#include "ImageSaver.h"
 #include "Monitor.h"
+#include "Brush.h"
 #include "Window.h"
+#include "Sample.h"
 #include "Image.h"
+#include "Rect.h"
 #include "Log.h"
 
 #define CURSOR_POS(cPos, mPos) (cPos - mPos)
@@ -22,10 +30,17 @@ class SettingsWindow
 {
 private:
     Image& m_rImage;
+    CursorCapture& m_rCapture;
+    const FrameScheduler& m_rScheduler;
+    const SessionLogWriter* const m_Log;
     bool m_Tracking = false;
-    bool m_BigPixelMode = false;
+    bool m_UseBrush = false;
+    Brush m_Brush{ BrushShape::Square, 1 }; // stamped along the strokes if m_UseBrush is set
+    Brush m_Pixel;
     bool m_SleepWhileIdle = true;
     size_t m_SelectedMonitor = 0;
+    ImageSaver m_Saver;
+    std::string m_SaveStatus;
 private:
     static inline void PushStyleColors()
     {
@@ -74,22 +89,52 @@ private:
     }
 
 
-    inline void SaveImage() const
+    // Encoding runs on m_Saver, drawing goes on meanwhile but isn't part of the saved image.
+    // extension is "mtrk" for the native track format or "png".
+    inline void SaveImage(const char* extension)
     {
-        const std::optional<std::filesystem::path> path = GetPath(NFD_SaveDialog, "png", "GetSavePath()");
+        if (m_Saver.Busy())
+            return;
+        const std::optional<std::filesystem::path> path = GetPath(NFD_SaveDialog, extension, "GetSavePath()");
         if (!path.has_value())
             return;
-        if (!m_rImage.WriteToFile(path.value()))
+        std::optional<Canvas> snapshot = m_rImage.Snapshot();
+        if (!snapshot.has_value())
         {
-            const std::string errorMsg = "Failed to write image [" + path.value().string() + "]";
+            MsgBoxError("Not enough memory to save the image");
+            return;
+        }
+        m_SaveStatus.clear();
+        m_Saver.Start(std::move(snapshot.value()), Image::WithExtension(path.value(), std::string(".") + extension), m_rImage.GetPngOptions());
+    }
+
+
+    inline void SaveProgress()
+    {
+        if (m_Saver.Busy())
+        {
+            const float progress = m_Saver.Progress();
+            const std::string text = progress < 1.f ? "Saving " + std::to_string((int)(progress * 100.f)) + "%" : "Writing";
+            ImGui::ProgressBar(progress, { -1.f, 0.f }, text.c_str());
+            return;
+        }
+
+        const std::optional<bool> result = m_Saver.TakeResult();
+        if (result.has_value() && result.value())
+            m_SaveStatus = "Saved [" + m_Saver.Path().string() + "]";
+        else if (result.has_value())
+        {
+            const std::string errorMsg = "Failed to write image [" + m_Saver.Path().string() + "]";
             MsgBoxError(errorMsg.c_str());
         }
+        if (!m_SaveStatus.empty())
+            ImGui::Text("%s", m_SaveStatus.c_str());
     }
 
 
     inline void LoadImg()
     {
-        std::optional<std::filesystem::path> path = GetPath(NFD_OpenDialog, "png,jpeg,jpg", "GetImagePath()");
+        std::optional<std::filesystem::path> path = GetPath(NFD_OpenDialog, "mtrk;png,jpeg,jpg", "GetImagePath()");
         if (!path.has_value())
             return;
         const std::optional<std::string> errorMsg = m_rImage.LoadFromFile(path.value().string());
@@ -111,49 +156,92 @@ private:
     }
 
 
-    inline void TextLabels(POINT pos, const std::vector<MonitorInfo>& mInfo) const
+    inline void TextLabels(const Sample& pos, const std::vector<MonitorInfo>& mInfo) const
     {
         const MonitorInfo& sm = mInfo[m_SelectedMonitor];
         ImGui::LabelText("Resolution", "%dx%d", sm.w, sm.h);
-        ImGui::LabelText("Cursor position", "x=%ld y=%ld", CURSOR_POS(pos.x, sm.x), CURSOR_POS(pos.y, sm.y));
+        ImGui::LabelText("Cursor position", "x=%d y=%d", CURSOR_POS(pos.x, sm.x), CURSOR_POS(pos.y, sm.y));
+        ImGui::LabelText("Canvas memory", "%.1f MB", (double)m_rImage.MemoryUsage() / (1024.0 * 1024.0));
+        ImGui::LabelText("GPU upload", "%zu bytes/frame", m_rImage.UploadedBytes());
+        ImGui::LabelText("Frame time", "p50 %.2f ms p99 %.2f ms", (double)m_rScheduler.FrameTime().Percentile(0.5f), (double)m_rScheduler.FrameTime().Percentile(0.99f));
+        ImGui::LabelText("Frames", "%.0f/s wakeups: %.0f/s", (double)m_rScheduler.FramesPerSecond(), (double)m_rScheduler.WakeupsPerSecond());
+        ImGui::LabelText("Upload time", "p50 %.2f ms p99 %.2f ms", (double)m_rImage.UploadTime().Percentile(0.5f), (double)m_rImage.UploadTime().Percentile(0.99f));
+        ImGui::LabelText("Capture queue", "%zu/%zu dropped: %llu", m_rCapture.Occupancy(), m_rCapture.Capacity(), (unsigned long long)m_rCapture.Dropped());
+        if (m_Log != nullptr && m_Log->IsOpen())
+            ImGui::LabelText("Session log", "%llu samples %.1f MB dropped: %llu", (unsigned long long)m_Log->Samples(), (double)m_Log->Bytes() / (1024.0 * 1024.0), (unsigned long long)m_Log->Dropped());
+    }
+
+
+    inline void CaptureRate()
+    {
+        int rate = m_rCapture.Rate();
+        if (rate == 0) // event driven source
+            return;
+        if (ImGui::SliderInt("Capture rate", &rate, CursorCapture::MinRate, CursorCapture::MaxRate, "%d Hz"))
+            m_rCapture.SetRate(rate);
     }
 
 
     inline void RadioButtons()
     {
-        if (ImGui::RadioButton("Sleep while idle [F7]", m_SleepWhileIdle) || KeyPressed(VK_F7))
+        if (ImGui::RadioButton("Sleep while idle [F7]", m_SleepWhileIdle))
             m_SleepWhileIdle = !m_SleepWhileIdle;
 
-        if (ImGui::RadioButton("Big pixel mode [F8]", m_BigPixelMode) || KeyPressed(VK_F8))
-            m_BigPixelMode = !m_BigPixelMode;
+        if (ImGui::RadioButton("Brush [F8]", m_UseBrush))
+            m_UseBrush = !m_UseBrush;
+        BrushSettings();
+
+        const TextureStream& stream = m_rImage.GetTextureStream();
+        if (stream.Supported() && ImGui::RadioButton("Stream uploads (PBO)", stream.Enabled()))
+            m_rImage.StreamUploads(!stream.Enabled());
 
         if (m_Tracking)
             ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(0, 230, 0, 255));
         else
             ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(230, 0, 0, 255));
-        if (ImGui::RadioButton("Tracking [F9]", m_Tracking) || KeyPressed(VK_F9))
+        if (ImGui::RadioButton("Tracking [F9]", m_Tracking))
             m_Tracking = !m_Tracking;
         ImGui::PopStyleColor();
     }
 
 
-    inline void Buttons(const std::vector<MonitorInfo>& mInfo)
+    // The stamp is only rebuilt when the shape or radius changes
+    inline void BrushSettings()
+    {
+        if (!m_UseBrush)
+            return;
+        int shape = (int)m_Brush.Shape();
+        int radius = m_Brush.Radius();
+        ImGui::SetNextItemWidth(120.f);
+        bool changed = ImGui::Combo("##BrushShape", &shape, "Square\0" "Disc\0" "Soft\0");
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(200.f);
+        changed |= ImGui::SliderInt("Brush radius", &radius, 1, Brush::MaxRadius);
+        if (changed)
+            m_Brush = Brush((BrushShape)shape, radius);
+    }
+
+
+    inline void Buttons()
     {
         constexpr float saveImageBtnW = 104.f;
         if (ImGui::Button("Save image", { saveImageBtnW, 0.f }))
-            SaveImage();
+            SaveImage("mtrk");
+
+        constexpr float exportPngX = saveImageBtnW + 20.f; // arbitrary offset
+        ImGui::SameLine(exportPngX);
+        if (ImGui::Button("Export PNG", { saveImageBtnW, 0.f }))
+            SaveImage("png");
 
-        constexpr float loadImageX = saveImageBtnW + 20.f; // arbitrary offset
+        constexpr float loadImageX = exportPngX + saveImageBtnW + 20.f;
         ImGui::SameLine(loadImageX);
         if (ImGui::Button("Load image"))
             LoadImg();
 
         ImGui::SameLine(loadImageX + ImGui::GetItemRectSize().x + 10); // arbitrary offset
         if (ImGui::Button("Reset image") && MsgBoxWarning("Do you really want to reset the tracking image? This change can't be undone!") == IDYES)
-        {
             m_rImage.Reset();
-            SetMultiMonitorImageAlpha(mInfo);
-        }
+        SaveProgress();
     }
 
 
@@ -163,12 +251,35 @@ private:
         if (m_SelectedMonitor != numMonitors)
             return;
 
-        // 'All' was selected
-        m_rImage.SetAllPixel(0); // Not monitor area on the image
+        // 'All' was selected, the area between the monitors becomes transparent
+        std::vector<Rect> monitors;
         for (size_t i = 0; i < numMonitors; ++i)
         {
-            m_rImage.SetPixelRange(CURSOR_POS(mInfo[i].x, mInfo.back().x), CURSOR_POS(mInfo[i].y, mInfo.back().y), mInfo[i].w, mInfo[i].h, 255);
+            monitors.push_back(Rect::FromSize(CURSOR_POS(mInfo[i].x, mInfo.back().x), CURSOR_POS(mInfo[i].y, mInfo.back().y), mInfo[i].w, mInfo[i].h));
+        }
+        m_rImage.SetMonitorMask(std::move(monitors));
+    }
+
+
+    inline void StorageCombo()
+    {
+        int format = (int)m_rImage.GetFormat();
+        if (ImGui::Combo("Storage", &format, "RGBA (4 bytes per pixel)\0" "1-bit (visited or not)\0" "Heatmap (hit count)\0" "Gray (1 byte per pixel)\0"))
+        {
+            const std::optional<std::string> errorMsg = m_rImage.SetFormat((Image::Format)format);
+            if (errorMsg.has_value())
+                MsgBoxError(errorMsg.value().c_str());
         }
+
+        PngOptions png = m_rImage.GetPngOptions();
+        if (ImGui::SliderInt("PNG compression", &png.level, 0, Deflate::MaxLevel, png.level == 0 ? "%d (stored)" : "%d"))
+            m_rImage.SetPngOptions(png);
+
+        if (m_rImage.GetFormat() != Image::Format::Count16)
+            return;
+        int scale = (int)m_rImage.GetHeatmapScale();
+        if (ImGui::Combo("Heatmap scale", &scale, "Linear\0" "Logarithmic\0"))
+            m_rImage.SetHeatmapScale((HeatmapScale)scale);
     }
 
 
@@ -206,9 +317,45 @@ private:
         SetMultiMonitorImageAlpha(mInfo);
     }
 public:
-    inline explicit SettingsWindow(Image& img) : m_rImage(img) {}
+    inline SettingsWindow(Image& img, CursorCapture& capture, const FrameScheduler& scheduler, const SessionLogWriter* log = nullptr) : m_rImage(img), m_rCapture(capture), m_rScheduler(scheduler), m_Log(log) {}
+
+
+    // A radius of 0 draws single pixels, the brush is still there to be switched on
+    inline void SetBrush(const Brush& brush)
+    {
+        m_UseBrush = brush.Radius() != 0;
+        if (m_UseBrush)
+            m_Brush = brush;
+    }
+
+
+    // The hotkeys work while the window isn't focused and without rendering a frame,
+    // true if one of them was pressed
+    inline bool PollHotkeys()
+    {
+        bool pressed = false;
+        const auto toggle = [&](int key, bool& value)
+        {
+            if (!KeyPressed(key))
+                return;
+            value = !value;
+            pressed = true;
+        };
+        toggle(VK_F7, m_SleepWhileIdle);
+        toggle(VK_F8, m_UseBrush);
+        toggle(VK_F9, m_Tracking);
+        return pressed;
+    }
+
+
+    // The UI changes without input, e.g. the progress of a save
+    inline bool Animating() const
+    {
+        return m_Saver.Busy() || m_Saver.HasResult();
+    }
+
 
-    inline void Show(ImVec2 wSize, POINT pos, const std::vector<MonitorInfo>& mInfo)
+    inline void Show(ImVec2 wSize, const Sample& pos, const std::vector<MonitorInfo>& mInfo)
     {
         PushStyleColors();
         ImGui::Begin("Settings", NULL, IMGUI_WINDOW_FLAGS);
@@ -216,14 +363,16 @@ public:
         ImGui::SetWindowSize({ wSize.x, wSize.y * (1.f / 4.f) });
         TextLabels(pos, mInfo);
         MonitorSelectionCombo(mInfo);
+        StorageCombo();
+        CaptureRate();
         RadioButtons();
-        Buttons(mInfo);
+        Buttons();
         ImGui::PopStyleColor(10);
         ImGui::End();
     }
 
     constexpr bool Tracking()          const { return m_Tracking;        }
-    constexpr bool BigPixelMode()      const { return m_BigPixelMode;    }
+    inline const Brush& GetBrush()     const { return m_UseBrush ? m_Brush : m_Pixel; }
     constexpr bool SleepWhileIdle()    const { return m_SleepWhileIdle;  }
     constexpr size_t SelectedMonitor() const { return m_SelectedMonitor; }
 };
\ No newline at end of file
@@ -0,0 +1,78 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <atomic>
+#include <vector>
+
+#ifdef MSC
+#pragma warning(push)
+#pragma warning(disable: 4324) // structure was padded due to alignment specifier
+#endif
+
+// Lock-free ring buffer for exactly one producer and one consumer thread.
+// Head and tail live on separate cache lines, each side keeps a cached copy
+// of the other side's index so the shared line is only touched when the
+// cached value says the ring is full/empty.
+template <class T>
+class SpscRing
+{
+private:
+    static constexpr size_t CacheLine = 64;
+    std::vector<T> m_Buffer;
+    size_t m_Mask;
+    alignas(CacheLine) std::atomic<size_t> m_Head{ 0 }; // written by the producer
+    size_t m_CachedTail = 0;
+    alignas(CacheLine) std::atomic<size_t> m_Tail{ 0 }; // written by the consumer
+    size_t m_CachedHead = 0;
+private:
+    static constexpr size_t RoundUpPow2(size_t v)
+    {
+        size_t p = 1;
+        while (p < v)
+            p <<= 1;
+        return p;
+    }
+public:
+    inline explicit SpscRing(size_t capacity) : m_Buffer(RoundUpPow2(std::max(capacity, (size_t)2))), m_Mask(m_Buffer.size() - 1) {}
+
+    // producer
+    inline bool Push(const T& value)
+    {
+        const size_t head = m_Head.load(std::memory_order_relaxed);
+        if (head - m_CachedTail == m_Buffer.size())
+        {
+            m_CachedTail = m_Tail.load(std::memory_order_acquire);
+            if (head - m_CachedTail == m_Buffer.size())
+                return false;
+        }
+        m_Buffer[head & m_Mask] = value;
+        m_Head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer, returns the number of elements written to out
+    inline size_t PopBatch(T* out, size_t max)
+    {
+        const size_t tail = m_Tail.load(std::memory_order_relaxed);
+        if (m_CachedHead - tail < max)
+            m_CachedHead = m_Head.load(std::memory_order_acquire);
+
+        const size_t count = std::min(m_CachedHead - tail, max);
+        for (size_t i = 0; i < count; ++i)
+            out[i] = m_Buffer[(tail + i) & m_Mask];
+        m_Tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    // approximate when called concurrently
+    inline size_t Size() const
+    {
+        return m_Head.load(std::memory_order_acquire) - m_Tail.load(std::memory_order_acquire);
+    }
+
+    inline size_t Capacity() const { return m_Buffer.size(); }
+};
+
+#ifdef MSC
+#pragma warning(pop)
+#endif
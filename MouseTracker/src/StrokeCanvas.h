@@ -0,0 +1,172 @@
+#pragma once
+#include <filesystem>
+#include <algorithm>
+#include <optional>
+#include <cstdint>
+#include <cstdlib>
+#include <utility>
+#include <string>
+#include <vector>
+
+#include "Rasterizer.h"
+#include "Brush.h"
+#include "TrackFile.h"
+#include "Canvas.h"
+#include "Sample.h"
+#include "Rect.h"
+
+// The canvas the cursor is drawn on, independent of OpenGL so it also runs
+// without a window. Remembers the generation every tile was last changed in,
+// a checkpoint (see Autosave) only has to copy the tiles changed since the
+// previous one.
+class StrokeCanvas
+{
+public:
+    // What changed since the previous checkpoint
+    struct Checkpoint
+    {
+        TrackFile::Header header;
+        std::optional<Canvas> full;          // everything, if the tiles alone don't describe the changes
+        std::vector<Canvas::TileCopy> tiles; // the changed tiles otherwise
+    };
+private:
+    Canvas m_Canvas;
+    std::optional<Sample> m_StrokeEnd;       // last point of the previous DrawStroke() call
+    std::vector<uint64_t> m_TileGenerations; // generation each tile was last changed in
+    uint64_t m_Generation = 1;               // changes since the last checkpoint are part of this one
+    bool m_ChangedAll = true;                // the next checkpoint has to contain everything
+private:
+    // rect in image coordinates, may reach past the edges by the stamp radius
+    inline void Changed(const Rect& rect)
+    {
+        const int tx1 = (std::min(rect.x1, m_Canvas.Width()) - 1) / Canvas::TileSize;
+        const int ty1 = (std::min(rect.y1, m_Canvas.Height()) - 1) / Canvas::TileSize;
+        const size_t tilesX = ((size_t)m_Canvas.Width() + Canvas::TileSize - 1) / Canvas::TileSize;
+        for (int ty = std::max(rect.y0, 0) / Canvas::TileSize; ty <= ty1; ++ty)
+            for (int tx = std::max(rect.x0, 0) / Canvas::TileSize; tx <= tx1; ++tx)
+                m_TileGenerations[(size_t)ty * tilesX + (size_t)tx] = m_Generation;
+    }
+public:
+    inline explicit StrokeCanvas(Canvas::Format format = Canvas::Format::RGBA8) : m_Canvas(format) {}
+
+
+    // Drops the content and the monitor layout
+    inline void Resize(int width, int height)
+    {
+        m_Canvas.Resize(width, height);
+        m_TileGenerations.assign(m_Canvas.TileCount(), 0);
+        ChangedAll();
+        EndStroke();
+    }
+
+
+    // Connects the samples (offset by -ox/-oy) with lines stamped with brush, continuing the
+    // previous stroke. changed(rect) is called with the area of every segment, in image coordinates.
+    template <class ChangedFn>
+    inline void DrawStroke(const Sample* samples, size_t count, int ox, int oy, const Brush& brush, ChangedFn&& changed)
+    {
+        if (count == 0)
+            return;
+
+        bool strokeStart = !m_StrokeEnd.has_value();
+        if (strokeStart)
+            m_StrokeEnd = samples[0]; // degenerate first segment plots the starting pixel
+
+        const int width = m_Canvas.Width();
+        const int height = m_Canvas.Height();
+        const int r = brush.Radius();
+        m_Canvas.Paint([&](auto&& plot)
+        {
+            for (size_t k = 0; k < count; ++k)
+            {
+                const int sx = m_StrokeEnd->x - ox;
+                const int sy = m_StrokeEnd->y - oy;
+                int x0 = sx;
+                int y0 = sy;
+                int x1 = samples[k].x - ox;
+                int y1 = samples[k].y - oy;
+                m_StrokeEnd = samples[k];
+                const bool firstSegment = std::exchange(strokeStart, false);
+                if (!ClipLine(width, height, x0, y0, x1, y1))
+                    continue;
+
+                // the start was already drawn as the end of the previous segment, matters for hit counts
+                bool skip = !firstSegment && x0 == sx && y0 == sy;
+                const Rect area = Rect::FromSize(std::min(x0, x1) - r, std::min(y0, y1) - r, std::abs(x1 - x0) + 1 + 2 * r, std::abs(y1 - y0) + 1 + 2 * r);
+                Changed(area);
+                changed(area);
+                if (r != 0)
+                    RasterizeLine(x0, y0, x1, y1, [&](int x, int y) { if (!std::exchange(skip, false)) brush.Stamp(plot, x, y, width, height); });
+                else
+                    RasterizeLine(x0, y0, x1, y1, [&](int x, int y) { if (!std::exchange(skip, false)) plot(x, y); });
+            }
+        });
+    }
+
+
+    inline void DrawStroke(const Sample* samples, size_t count, int ox, int oy, const Brush& brush)
+    {
+        DrawStroke(samples, count, ox, oy, brush, [](const Rect&) {});
+    }
+
+
+    // The next DrawStroke() call starts a new line instead of connecting to the last point
+    inline void EndStroke()
+    {
+        m_StrokeEnd.reset();
+    }
+
+
+    // Everything changed, the canvas may even have another format or monitor layout
+    inline void ChangedAll()
+    {
+        m_ChangedAll = true;
+    }
+
+
+    // journal (if any) holds the changes made after path, a track, was written
+    inline std::optional<std::string> LoadFromFile(const std::string& path, const std::filesystem::path& journal = {}, unsigned threads = 0)
+    {
+        const std::optional<std::string> errorMsg = m_Canvas.LoadFromFile(path, threads, journal);
+        ChangedAll(); // a corrupted image is only noticed after the canvas was cleared
+        EndStroke();
+        return errorMsg;
+    }
+
+
+    // Copies what changed since the previous checkpoint, everything if full is
+    // set or the tiles alone can't describe it. nullopt if nothing changed or
+    // memory ran out, the changes are part of the next checkpoint then.
+    inline std::optional<Checkpoint> TakeCheckpoint(bool full)
+    {
+        Checkpoint checkpoint;
+        checkpoint.header = m_Canvas.TrackHeader();
+        if (full || m_ChangedAll)
+        {
+            checkpoint.full = m_Canvas.Snapshot();
+            if (!checkpoint.full.has_value())
+                return std::nullopt;
+        }
+        else
+        {
+            std::vector<uint32_t> changed;
+            for (size_t k = 0; k < m_TileGenerations.size(); ++k)
+                if (m_TileGenerations[k] == m_Generation)
+                    changed.push_back((uint32_t)k);
+            if (changed.empty())
+                return std::nullopt;
+            std::optional<std::vector<Canvas::TileCopy>> tiles = m_Canvas.CopyTiles(changed);
+            if (!tiles.has_value())
+                return std::nullopt;
+            checkpoint.tiles = std::move(tiles.value());
+        }
+        m_ChangedAll = false;
+        ++m_Generation;
+        return checkpoint;
+    }
+
+
+    // Changes made directly to the canvas have to be reported with ChangedAll()
+    inline Canvas& GetCanvas()             { return m_Canvas; }
+    inline const Canvas& GetCanvas() const { return m_Canvas; }
+};
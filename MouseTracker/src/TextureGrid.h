@@ -0,0 +1,91 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "Rect.h"
+
+// Splits a pyramid level of the canvas into a grid of textures that respect
+// the texture size limit and keeps the part of each written since its last
+// upload. Knows nothing about OpenGL, Image creates one texture per cell.
+class TextureGrid
+{
+public:
+    struct Cell
+    {
+        unsigned int texture = 0; // GLuint, set by the owner
+        Rect area;                // part of the level shown by the texture
+        Rect dirty;               // written since the last upload, level coordinates
+    };
+private:
+    static constexpr int Channel = 4;
+    std::vector<Cell> m_Cells;
+    int m_Level = 0;
+public:
+    // Largest cell size for a width x height level: cap if it is below maxSize
+    // (GL_MAX_TEXTURE_SIZE), maxSize otherwise, 0 or less means no limit
+    static inline int CellSize(int cap, int maxSize, int width, int height)
+    {
+        const int limit = cap > 0 && (maxSize <= 0 || cap < maxSize) ? cap : maxSize;
+        return limit > 0 ? limit : std::max(width, height);
+    }
+
+
+    // Covers a width x height level with cells of at most size x size, everything is clean
+    inline void Layout(int width, int height, int level, int size)
+    {
+        m_Cells.clear();
+        m_Level = level;
+        for (int y = 0; y < height; y += size)
+            for (int x = 0; x < width; x += size)
+                m_Cells.push_back({ 0, Rect::FromSize(x, y, std::min(size, width - x), std::min(size, height - y)), Rect() });
+    }
+
+
+    inline void Clear()
+    {
+        m_Cells.clear();
+    }
+
+
+    // rect in image coordinates, clipped to the image
+    inline void MarkDirty(const Rect& rect)
+    {
+        const int grow = (1 << m_Level) - 1;
+        const Rect level{ rect.x0 >> m_Level, rect.y0 >> m_Level, (rect.x1 + grow) >> m_Level, (rect.y1 + grow) >> m_Level };
+        for (Cell& cell : m_Cells)
+        {
+            const Rect r = cell.area.Intersect(level);
+            if (!r.Empty())
+                cell.dirty.Add(r.x0, r.y0, r.Width(), r.Height());
+        }
+    }
+
+
+    inline void MarkAllDirty()
+    {
+        for (Cell& cell : m_Cells)
+            cell.dirty = cell.area;
+    }
+
+
+    inline bool Dirty() const
+    {
+        return std::any_of(m_Cells.begin(), m_Cells.end(), [](const Cell& cell) { return !cell.dirty.Empty(); });
+    }
+
+
+    // RGBA bytes uploading every dirty part passes to the driver
+    inline size_t DirtyBytes() const
+    {
+        size_t bytes = 0;
+        for (const Cell& cell : m_Cells)
+            if (!cell.dirty.Empty())
+                bytes += (size_t)cell.dirty.Width() * (size_t)cell.dirty.Height() * Channel;
+        return bytes;
+    }
+
+
+    inline std::vector<Cell>& Cells()             { return m_Cells; }
+    inline const std::vector<Cell>& Cells() const { return m_Cells; }
+};
@@ -0,0 +1,189 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+
+#include "GLFW/glfw3.h"
+
+#include "Log.h"
+
+// Not part of the GL 1.1 headers that ship with Windows, loaded at runtime
+#ifdef WINDOWS
+    #define TEXTURE_STREAM_GLAPI __stdcall
+#else
+    #define TEXTURE_STREAM_GLAPI
+#endif
+
+// Streams texture uploads through a rotation of pixel buffer objects. The
+// caller writes into mapped driver memory and glTexSubImage2D sources from the
+// buffer, so the copy into the texture happens asynchronously instead of
+// stalling the render thread. Without PBO support (or if disabled) it falls
+// back to a client side staging buffer and synchronous uploads.
+class TextureStream
+{
+private:
+    static constexpr int Buffers = 3;
+    static constexpr GLenum PixelUnpackBuffer = 0x88EC; // GL_PIXEL_UNPACK_BUFFER
+    static constexpr GLenum StreamDraw = 0x88E0;        // GL_STREAM_DRAW
+    static constexpr GLenum WriteOnly = 0x88B9;         // GL_WRITE_ONLY
+    static constexpr GLbitfield MapWrite = 0x0002 | 0x0008; // GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT
+
+    using GenBuffers     = void      (TEXTURE_STREAM_GLAPI*)(GLsizei, GLuint*);
+    using DeleteBuffers  = void      (TEXTURE_STREAM_GLAPI*)(GLsizei, const GLuint*);
+    using BindBuffer     = void      (TEXTURE_STREAM_GLAPI*)(GLenum, GLuint);
+    using BufferData     = void      (TEXTURE_STREAM_GLAPI*)(GLenum, std::ptrdiff_t, const void*, GLenum);
+    using MapBuffer      = void*     (TEXTURE_STREAM_GLAPI*)(GLenum, GLenum);
+    using MapBufferRange = void*     (TEXTURE_STREAM_GLAPI*)(GLenum, std::ptrdiff_t, std::ptrdiff_t, GLbitfield);
+    using UnmapBuffer    = GLboolean (TEXTURE_STREAM_GLAPI*)(GLenum);
+
+    GenBuffers     m_GenBuffers     = nullptr;
+    DeleteBuffers  m_DeleteBuffers  = nullptr;
+    BindBuffer     m_BindBuffer     = nullptr;
+    BufferData     m_BufferData     = nullptr;
+    MapBuffer      m_MapBuffer      = nullptr;
+    MapBufferRange m_MapBufferRange = nullptr; // GL 3.0, preferred since it can invalidate without a realloc
+    UnmapBuffer    m_UnmapBuffer    = nullptr;
+
+    bool m_Loaded = false;
+    bool m_Supported = false;
+    bool m_Enabled = true;
+    bool m_Mapped = false;
+    GLuint m_Pbo[Buffers] = {};
+    size_t m_PboSize[Buffers] = {};
+    int m_Next = 0;
+    std::vector<unsigned char> m_Staging;
+private:
+    template <class Fn>
+    static inline Fn Load(const char* name)
+    {
+        return reinterpret_cast<Fn>(glfwGetProcAddress(name));
+    }
+
+
+    static inline bool VersionAtLeast(int major, int minor)
+    {
+        const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+        if (version == nullptr)
+            return false;
+        char* end = nullptr;
+        const long maj = std::strtol(version, &end, 10);
+        const long min = *end == '.' ? std::strtol(end + 1, nullptr, 10) : 0;
+        return maj > major || (maj == major && min >= minor);
+    }
+
+
+    // Needs a current context, done on first use
+    inline void LoadFunctions()
+    {
+        m_Loaded = true;
+        if (!VersionAtLeast(2, 1) && !glfwExtensionSupported("GL_ARB_pixel_buffer_object"))
+        {
+            Log << "{TextureStream} Pixel buffer objects unavailable, using synchronous uploads" << std::endl;
+            return;
+        }
+
+        m_GenBuffers     = Load<GenBuffers>("glGenBuffers");
+        m_DeleteBuffers  = Load<DeleteBuffers>("glDeleteBuffers");
+        m_BindBuffer     = Load<BindBuffer>("glBindBuffer");
+        m_BufferData     = Load<BufferData>("glBufferData");
+        m_MapBuffer      = Load<MapBuffer>("glMapBuffer");
+        m_MapBufferRange = VersionAtLeast(3, 0) ? Load<MapBufferRange>("glMapBufferRange") : nullptr;
+        m_UnmapBuffer    = Load<UnmapBuffer>("glUnmapBuffer");
+        m_Supported = m_GenBuffers && m_DeleteBuffers && m_BindBuffer && m_BufferData && (m_MapBuffer || m_MapBufferRange) && m_UnmapBuffer;
+        if (!m_Supported)
+        {
+            Err << "{TextureStream} Failed to load the buffer functions, using synchronous uploads" << std::endl;
+            return;
+        }
+        m_GenBuffers(Buffers, m_Pbo);
+        Log << "{TextureStream} Streaming uploads through " << Buffers << " pixel buffer objects" << std::endl;
+    }
+
+
+    inline void Disable(const char* reason)
+    {
+        Err << "{TextureStream} " << reason << ", falling back to synchronous uploads" << std::endl;
+        m_BindBuffer(PixelUnpackBuffer, 0);
+        m_Supported = false;
+    }
+public:
+    inline TextureStream() = default;
+    TextureStream(const TextureStream&) = delete;
+    TextureStream& operator=(const TextureStream&) = delete;
+
+
+    inline ~TextureStream()
+    {
+        if (m_Pbo[0] != 0)
+            m_DeleteBuffers(Buffers, m_Pbo);
+    }
+
+
+    // Returns memory for bytes of RGBA pixels, has to be followed by Submit()
+    inline unsigned char* Map(size_t bytes)
+    {
+        if (!m_Loaded)
+            LoadFunctions();
+        if (!Streaming())
+        {
+            if (m_Staging.size() < bytes)
+                m_Staging.resize(bytes);
+            return m_Staging.data();
+        }
+
+        m_BindBuffer(PixelUnpackBuffer, m_Pbo[m_Next]);
+        void* memory = nullptr;
+        if (m_PboSize[m_Next] < bytes)
+        {
+            m_BufferData(PixelUnpackBuffer, (std::ptrdiff_t)bytes, nullptr, StreamDraw);
+            m_PboSize[m_Next] = bytes;
+        }
+        if (m_MapBufferRange != nullptr)
+            memory = m_MapBufferRange(PixelUnpackBuffer, 0, (std::ptrdiff_t)bytes, MapWrite);
+        else
+        {
+            // orphan the storage so the driver doesn't wait for a pending upload from it
+            m_BufferData(PixelUnpackBuffer, (std::ptrdiff_t)m_PboSize[m_Next], nullptr, StreamDraw);
+            memory = m_MapBuffer(PixelUnpackBuffer, WriteOnly);
+        }
+
+        if (memory == nullptr)
+        {
+            Disable("Failed to map a pixel buffer");
+            return Map(bytes);
+        }
+        m_Mapped = true;
+        return static_cast<unsigned char*>(memory);
+    }
+
+
+    // Uploads the memory returned by the last Map() to the bound texture,
+    // returns false if the driver lost the contents (e.g. on a mode switch)
+    inline bool Submit(int x, int y, int width, int height)
+    {
+        if (!m_Mapped)
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, m_Staging.data());
+            return true;
+        }
+
+        m_Mapped = false;
+        if (m_UnmapBuffer(PixelUnpackBuffer) == GL_FALSE)
+        {
+            Disable("Pixel buffer was corrupted");
+            return false;
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        m_BindBuffer(PixelUnpackBuffer, 0);
+        m_Next = (m_Next + 1) % Buffers;
+        return true;
+    }
+
+
+    inline void Enable(bool enable)   { m_Enabled = enable;                }
+    inline bool Enabled()       const { return m_Enabled;                  }
+    inline bool Supported()     const { return m_Supported || !m_Loaded;   } // unknown before the first Map()
+    inline bool Streaming()     const { return m_Supported && m_Enabled;   }
+    inline size_t MemoryUsage() const { return m_Staging.capacity();       }
+};
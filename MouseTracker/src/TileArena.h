@@ -0,0 +1,160 @@
+#pragma once
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+#ifdef WINDOWS
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Address space for a fixed number of equally sized tiles, reserved as one
+// anonymous mapping. The OS hands out zeroed pages when they are first
+// written, so a tile whose blank state is all zero bits costs no memory
+// until something is drawn into it, and only the pages actually written
+// count towards the working set. Reset() gives every page back at once.
+class TileArena
+{
+private:
+    unsigned char* m_Base = nullptr;
+    size_t m_Slots = 0;
+    size_t m_SlotBytes = 0;
+    bool m_PageAligned = false; // every slot starts and ends on a page boundary
+private:
+    static inline size_t PageSize()
+    {
+#ifdef WINDOWS
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return (size_t)info.dwPageSize;
+#else
+        return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+    }
+
+
+    inline size_t Bytes() const
+    {
+        return m_Slots * m_SlotBytes;
+    }
+
+
+    // Replaces [p, p + bytes) with zero pages that aren't backed by memory,
+    // zeroes them in place if the OS refuses to map new ones
+    static inline void Discard(unsigned char* p, size_t bytes)
+    {
+#ifdef WINDOWS
+        VirtualFree(p, bytes, MEM_DECOMMIT);
+#else
+        if (mmap(p, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED)
+            std::memset(p, 0, bytes);
+#endif
+    }
+public:
+    inline TileArena() = default;
+    TileArena(const TileArena&) = delete;
+    TileArena& operator=(const TileArena&) = delete;
+
+
+    inline TileArena(TileArena&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+
+    inline TileArena& operator=(TileArena&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Free();
+            m_Base = std::exchange(other.m_Base, nullptr);
+            m_Slots = std::exchange(other.m_Slots, 0);
+            m_SlotBytes = std::exchange(other.m_SlotBytes, 0);
+            m_PageAligned = other.m_PageAligned;
+        }
+        return *this;
+    }
+
+
+    inline ~TileArena()
+    {
+        Free();
+    }
+
+
+    // Releases the old range, false if the address space couldn't be reserved
+    inline bool Reserve(size_t slots, size_t slotBytes)
+    {
+        Free();
+        if (slots == 0 || slotBytes == 0 || slots > SIZE_MAX / slotBytes)
+            return slots == 0;
+#ifdef WINDOWS
+        void* base = VirtualAlloc(NULL, slots * slotBytes, MEM_RESERVE, PAGE_READWRITE);
+        if (base == NULL)
+            return false;
+#else
+        void* base = mmap(nullptr, slots * slotBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED)
+            return false;
+#endif
+        m_Base = static_cast<unsigned char*>(base);
+        m_Slots = slots;
+        m_SlotBytes = slotBytes;
+        m_PageAligned = slotBytes % PageSize() == 0;
+        return true;
+    }
+
+
+    inline void Free()
+    {
+        if (m_Base != nullptr)
+        {
+#ifdef WINDOWS
+            VirtualFree(m_Base, 0, MEM_RELEASE);
+#else
+            munmap(m_Base, Bytes());
+#endif
+        }
+        m_Base = nullptr;
+        m_Slots = 0;
+        m_SlotBytes = 0;
+    }
+
+
+    // The memory of slot, all zero unless it was written since the last
+    // Release() or Reset(). nullptr if the OS refuses to commit it.
+    inline uint64_t* Commit(size_t slot)
+    {
+        if (m_Base == nullptr)
+            return nullptr;
+        unsigned char* p = m_Base + slot * m_SlotBytes;
+#ifdef WINDOWS
+        // committed pages are still only backed by memory once they are written
+        if (VirtualAlloc(p, m_SlotBytes, MEM_COMMIT, PAGE_READWRITE) == NULL)
+            return nullptr;
+#endif
+        return reinterpret_cast<uint64_t*>(p);
+    }
+
+
+    // Zeroes slot again, its pages are given back if no other slot shares them
+    inline void Release(size_t slot)
+    {
+        unsigned char* p = m_Base + slot * m_SlotBytes;
+        if (m_PageAligned)
+            Discard(p, m_SlotBytes);
+        else
+            std::memset(p, 0, m_SlotBytes);
+    }
+
+
+    // Zeroes all slots and gives back all pages
+    inline void Reset()
+    {
+        if (m_Base != nullptr)
+            Discard(m_Base, Bytes());
+    }
+};
@@ -0,0 +1,375 @@
+#pragma once
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#include "Colormap.h"
+
+// How the pixels of a canvas tile are stored. The values are part of the
+// track format (see TrackFile), new formats are appended.
+enum class TileFormat : uint32_t
+{
+    RGBA8,   // 4 bytes per pixel, arbitrary colors
+    Bit1,    // 1 bit per pixel (visited or not)
+    Count16, // saturating hit count per pixel, rendered through a colormap (heatmap)
+    Gray8    // 1 byte per pixel, shades of gray stored inverted (0 = white)
+};
+
+
+// One policy per TileFormat with everything that depends on the pixel
+// layout: writing visited pixels, the value of a blank tile, expanding rows
+// to RGBA for uploads and PNGs and merging tiles. Canvas picks the policy
+// once per operation with VisitTileFormat(), so the loops over pixels are
+// compiled for one format each and can be inlined and vectorized.
+//
+// Plot() and Span() take the largest hit count so far, only Count16 updates it.
+// Square brush stamps smaller than SpanRadius are plotted pixel by pixel, the
+// spans of a few pixels cost more than they save there (see Brush::Stamp()).
+namespace TileFormats
+{
+    constexpr int TileSize = 64;
+    constexpr int Channel = 4;
+    constexpr size_t TilePixels = TileSize * TileSize;
+    constexpr unsigned char White[Channel] = { 255, 255, 255, 255 };
+    constexpr unsigned char Black[Channel] = { 0, 0, 0, 255 };
+
+
+    struct Rgba8
+    {
+        static constexpr TileFormat Id = TileFormat::RGBA8;
+        static constexpr size_t TileBytes = TilePixels * Channel;
+        static constexpr uint32_t Planes = Channel; // byte planes of a track
+        static constexpr unsigned char Fill = 255;  // every byte of a blank tile
+        static constexpr size_t LoadChannels = Channel;
+        static constexpr int SpanRadius = 4;        // smaller square stamps are faster pixel by pixel
+
+
+        static inline unsigned char* Pixel(uint64_t* tile, int lx, int ly)
+        {
+            return reinterpret_cast<unsigned char*>(tile) + ((size_t)ly * TileSize + (size_t)lx) * Channel;
+        }
+
+
+        static inline const unsigned char* Pixel(const uint64_t* tile, int lx, int ly)
+        {
+            return reinterpret_cast<const unsigned char*>(tile) + ((size_t)ly * TileSize + (size_t)lx) * Channel;
+        }
+
+
+        // Only the color is drawn, the alpha of loaded images stays
+        static inline void Plot(uint64_t* tile, int lx, int ly, uint16_t&)
+        {
+            unsigned char* p = Pixel(tile, lx, ly);
+            p[0] = 0; // R
+            p[1] = 0; // G
+            p[2] = 0; // B
+        }
+
+
+        static inline void Span(uint64_t* tile, int lx, int ly, int n, uint16_t& maxCount)
+        {
+            if (n < 8)
+            {
+                for (int k = 0; k < n; ++k)
+                    Plot(tile, lx + k, ly, maxCount);
+                return;
+            }
+            // masks whole pixels and keeps their alpha, vectorizes unlike the byte stores
+            uint32_t alpha;
+            std::memcpy(&alpha, Black, sizeof(alpha));
+            unsigned char* p = Pixel(tile, lx, ly);
+            for (int k = 0; k < n; ++k, p += Channel)
+            {
+                uint32_t pixel;
+                std::memcpy(&pixel, p, sizeof(pixel));
+                pixel &= alpha;
+                std::memcpy(p, &pixel, sizeof(pixel));
+            }
+        }
+
+
+        // transparent pixels of loaded images are off screen
+        static inline bool Visited(const uint64_t* tile, int lx, int ly)
+        {
+            const unsigned char* p = Pixel(tile, lx, ly);
+            return p[3] >= 128 && (p[0] + p[1] + p[2]) / 3 < 128;
+        }
+
+
+        static inline void Expand(const uint64_t* tile, int lx, int ly, size_t n, unsigned char* out, const Colormap&)
+        {
+            std::memcpy(out, Pixel(tile, lx, ly), n * Channel);
+        }
+
+
+        // n RGBA pixels of an image into row ly
+        static inline void Load(uint64_t* tile, int ly, const unsigned char* src, size_t n)
+        {
+            std::memcpy(Pixel(tile, 0, ly), src, n * Channel);
+        }
+
+
+        static inline bool LoadsBlank(const unsigned char* src, size_t n)
+        {
+            return std::all_of(src, src + n * Channel, [](unsigned char c) { return c == 255; });
+        }
+
+
+        // drawing only ever darkens, the alpha of both is the same
+        static inline void Merge(uint64_t* dst, const uint64_t* src)
+        {
+            unsigned char* d = reinterpret_cast<unsigned char*>(dst);
+            const unsigned char* s = reinterpret_cast<const unsigned char*>(src);
+            for (size_t k = 0; k < TileBytes; ++k)
+                d[k] = std::min(d[k], s[k]);
+        }
+
+
+        static inline uint16_t MaxCount(const uint64_t*) { return 0; }
+    };
+
+
+    struct Bit1
+    {
+        static constexpr TileFormat Id = TileFormat::Bit1;
+        static constexpr size_t TileBytes = TilePixels / 8; // one uint64_t per row, lsb first
+        static constexpr uint32_t Planes = 1;
+        static constexpr unsigned char Fill = 0;
+        static constexpr int SpanRadius = 1;
+
+
+        static inline void Plot(uint64_t* tile, int lx, int ly, uint16_t&)
+        {
+            tile[ly] |= uint64_t(1) << lx;
+        }
+
+
+        static inline void Span(uint64_t* tile, int lx, int ly, int n, uint16_t&)
+        {
+            const uint64_t bits = n == TileSize ? ~uint64_t(0) : (uint64_t(1) << n) - 1;
+            tile[ly] |= bits << lx;
+        }
+
+
+        static inline bool Visited(const uint64_t* tile, int lx, int ly)
+        {
+            return (tile[ly] >> lx) & 1;
+        }
+
+
+        static inline void Expand(const uint64_t* tile, int lx, int ly, size_t n, unsigned char* out, const Colormap&)
+        {
+            const uint64_t bits = tile[ly] >> lx;
+            for (size_t i = 0; i < n; ++i, out += Channel)
+                std::memcpy(out, ((bits >> i) & 1) ? Black : White, Channel);
+        }
+
+
+        static inline void Merge(uint64_t* dst, const uint64_t* src)
+        {
+            for (size_t y = 0; y < TileSize; ++y)
+                dst[y] |= src[y];
+        }
+
+
+        static inline uint16_t MaxCount(const uint64_t*) { return 0; }
+    };
+
+
+    struct Count16
+    {
+        static constexpr TileFormat Id = TileFormat::Count16;
+        static constexpr size_t TileBytes = TilePixels * sizeof(uint16_t);
+        static constexpr uint32_t Planes = sizeof(uint16_t);
+        static constexpr unsigned char Fill = 0;
+        static constexpr int SpanRadius = 1;
+
+
+        static inline uint16_t* Counts(uint64_t* tile, int ly)
+        {
+            return reinterpret_cast<uint16_t*>(tile) + (size_t)ly * TileSize;
+        }
+
+
+        static inline const uint16_t* Counts(const uint64_t* tile, int ly)
+        {
+            return reinterpret_cast<const uint16_t*>(tile) + (size_t)ly * TileSize;
+        }
+
+
+        // Branch free, sticks at 65535
+        static inline void Increment(uint16_t& count, uint16_t& maxCount)
+        {
+            const uint32_t v = count + 1u;
+            count = (uint16_t)(v - (v >> 16));
+            maxCount = std::max(maxCount, count);
+        }
+
+
+        static inline void Plot(uint64_t* tile, int lx, int ly, uint16_t& maxCount)
+        {
+            Increment(Counts(tile, ly)[lx], maxCount);
+        }
+
+
+        static inline void Span(uint64_t* tile, int lx, int ly, int n, uint16_t& maxCount)
+        {
+            uint16_t* counts = Counts(tile, ly) + lx;
+            for (int k = 0; k < n; ++k)
+                Increment(counts[k], maxCount);
+        }
+
+
+        static inline bool Visited(const uint64_t* tile, int lx, int ly)
+        {
+            return Counts(tile, ly)[lx] != 0;
+        }
+
+
+        static inline void Expand(const uint64_t* tile, int lx, int ly, size_t n, unsigned char* out, const Colormap& colormap)
+        {
+            const uint16_t* counts = Counts(tile, ly) + lx;
+            for (size_t i = 0; i < n; ++i, out += Channel)
+                std::memcpy(out, colormap[counts[i]].data(), Channel);
+        }
+
+
+        static inline void Merge(uint64_t* dst, const uint64_t* src)
+        {
+            uint16_t* d = Counts(dst, 0);
+            const uint16_t* s = Counts(src, 0);
+            for (size_t k = 0; k < TilePixels; ++k)
+                d[k] = (uint16_t)std::min(d[k] + s[k], 65535);
+        }
+
+
+        static inline uint16_t MaxCount(const uint64_t* tile)
+        {
+            const uint16_t* counts = Counts(tile, 0);
+            return *std::max_element(counts, counts + TilePixels);
+        }
+    };
+
+
+    // Stores how much darker than white a pixel is, so a blank tile is all
+    // zero bits and can stay on the zero pages of a TileArena until drawn to
+    struct Gray8
+    {
+        static constexpr TileFormat Id = TileFormat::Gray8;
+        static constexpr size_t TileBytes = TilePixels;
+        static constexpr uint32_t Planes = 1;
+        static constexpr unsigned char Fill = 0;
+        static constexpr size_t LoadChannels = 2; // gray and alpha
+        static constexpr int SpanRadius = 2;      // a 3x3 stamp is faster pixel by pixel
+
+
+        static inline unsigned char* Pixel(uint64_t* tile, int lx, int ly)
+        {
+            return reinterpret_cast<unsigned char*>(tile) + (size_t)ly * TileSize + (size_t)lx;
+        }
+
+
+        static inline const unsigned char* Pixel(const uint64_t* tile, int lx, int ly)
+        {
+            return reinterpret_cast<const unsigned char*>(tile) + (size_t)ly * TileSize + (size_t)lx;
+        }
+
+
+        static inline void Plot(uint64_t* tile, int lx, int ly, uint16_t&)
+        {
+            *Pixel(tile, lx, ly) = 255;
+        }
+
+
+        static inline void Span(uint64_t* tile, int lx, int ly, int n, uint16_t&)
+        {
+            std::memset(Pixel(tile, lx, ly), 255, (size_t)n);
+        }
+
+
+        static inline bool Visited(const uint64_t* tile, int lx, int ly)
+        {
+            return *Pixel(tile, lx, ly) >= 128;
+        }
+
+
+        // n gray levels starting at (lx, ly)
+        static inline void Gray(const uint64_t* tile, int lx, int ly, size_t n, unsigned char* out)
+        {
+            const unsigned char* p = Pixel(tile, lx, ly);
+            for (size_t i = 0; i < n; ++i)
+                out[i] = (unsigned char)~p[i];
+        }
+
+
+        static inline void Expand(const uint64_t* tile, int lx, int ly, size_t n, unsigned char* out, const Colormap&)
+        {
+            const unsigned char* p = Pixel(tile, lx, ly);
+            for (size_t i = 0; i < n; ++i, out += Channel)
+            {
+                out[0] = out[1] = out[2] = (unsigned char)~p[i];
+                out[3] = 255;
+            }
+        }
+
+
+        // n gray and alpha pairs of an image into row ly, transparent pixels stay white
+        static inline void Load(uint64_t* tile, int ly, const unsigned char* src, size_t n)
+        {
+            unsigned char* p = Pixel(tile, 0, ly);
+            for (size_t i = 0; i < n; ++i)
+                p[i] = src[i * 2 + 1] < 128 ? 0 : (unsigned char)~src[i * 2];
+        }
+
+
+        static inline bool LoadsBlank(const unsigned char* src, size_t n)
+        {
+            for (size_t i = 0; i < n; ++i)
+                if (src[i * 2] != 255 && src[i * 2 + 1] >= 128)
+                    return false;
+            return true;
+        }
+
+
+        static inline void Merge(uint64_t* dst, const uint64_t* src)
+        {
+            unsigned char* d = reinterpret_cast<unsigned char*>(dst);
+            const unsigned char* s = reinterpret_cast<const unsigned char*>(src);
+            for (size_t k = 0; k < TileBytes; ++k)
+                d[k] = std::max(d[k], s[k]);
+        }
+
+
+        static inline uint16_t MaxCount(const uint64_t*) { return 0; }
+    };
+}
+
+
+// Name on the command line: rgba, bit1, heatmap or gray, RGBA8 for anything else
+inline TileFormat TileFormatFromName(const std::string& name)
+{
+    if (name == "bit1")
+        return TileFormat::Bit1;
+    if (name == "heatmap")
+        return TileFormat::Count16;
+    if (name == "gray")
+        return TileFormat::Gray8;
+    return TileFormat::RGBA8;
+}
+
+
+// Calls fn with the policy of format (a default constructed TileFormats:: struct)
+template <class Fn>
+inline decltype(auto) VisitTileFormat(TileFormat format, Fn&& fn)
+{
+    switch (format)
+    {
+    case TileFormat::Bit1:    return fn(TileFormats::Bit1{});
+    case TileFormat::Count16: return fn(TileFormats::Count16{});
+    case TileFormat::Gray8:   return fn(TileFormats::Gray8{});
+    case TileFormat::RGBA8:
+    default:                  return fn(TileFormats::Rgba8{});
+    }
+}
@@ -0,0 +1,351 @@
+#pragma once
+#include <filesystem>
+#include <algorithm>
+#include <optional>
+#include <cstring>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+
+#include "MappedFile.h"
+#include "SessionLog.h"
+#include "Parallel.h"
+#include "Deflate.h"
+#include "Pixels.h"
+#include "Crc32.h"
+#include "Lz.h"
+
+// Native tracking image (".mtrk"), the canvas tiles as they are in memory.
+//
+// file      := header tile* directory
+// header    := "MTRACK\r\n" u32 version u32 format i32 width i32 height u32 tileSize
+//              u32 tileBytes u32 planes u32 maxCount u32 tiles u64 directoryOffset u32 id u32 crc
+// directory := entry* u32 crc
+// entry     := u32 index u32 bytes u64 offset u32 adler
+//
+// All integers are little endian, tile contents are stored in the byte order
+// of the canvas, which is little endian on every platform we build for.
+// Only tiles with content are stored. The bytes of a tile are split into
+// planes first, byte k of every pixel goes to plane k, so the runs of equal
+// channels and high bytes of counts become long matches. Then each tile is
+// compressed with Lz on its own or stored raw if that doesn't make it smaller
+// (bytes == tileBytes). The adler covers the stored bytes. The directory is
+// sorted by tile index, so a file that is mapped into memory can decode any
+// single tile without reading the others. The id is random, every written
+// track gets a new one even if its content is the same as the one it replaces.
+// Version 1 headers have no id, they are read with their crc as the id, which
+// is what the journals written next to them name.
+class TrackFile
+{
+public:
+    struct Header
+    {
+        uint32_t format = 0; // Canvas::Format
+        int width = 0;
+        int height = 0;
+        uint32_t tileSize = 0;
+        uint32_t tileBytes = 0;
+        uint32_t planes = 1; // bytes per pixel, 1 keeps the tiles as they are
+        uint32_t maxCount = 0;
+    };
+
+    struct Entry
+    {
+        uint32_t index = 0; // row major in the tile grid
+        uint32_t bytes = 0;
+        uint64_t offset = 0;
+        uint32_t adler = 0;
+    };
+
+    static constexpr char Magic[8] = { 'M', 'T', 'R', 'A', 'C', 'K', '\r', '\n' };
+    static constexpr const char* Extension = ".mtrk";
+    static constexpr uint32_t Version = 2;
+    static constexpr size_t HeaderBytes = sizeof(Magic) + 8 * 4 + 4 + 8 + 4 + 4;
+    static constexpr size_t HeaderBytesV1 = HeaderBytes - 4; // without the id
+    static constexpr size_t EntryBytes = 20;
+    static constexpr size_t Batch = 1024; // tiles compressed before they are written
+private:
+    MappedFile m_File;
+    Header m_Header;
+    uint32_t m_Id = 0; // tells tracks apart
+    std::vector<Entry> m_Entries;
+private:
+    // Byte k of every pixel of src goes to plane k of dst
+    static inline void Split(const unsigned char* src, size_t size, size_t planes, unsigned char* dst)
+    {
+        const size_t n = size / planes;
+        if (planes == 4)
+            return Pixels::SplitChannels(src, n, dst);
+        for (size_t i = 0; i < n; ++i)
+            for (size_t k = 0; k < planes; ++k)
+                dst[k * n + i] = src[i * planes + k];
+    }
+
+
+    static inline void Join(const unsigned char* src, size_t size, size_t planes, unsigned char* dst)
+    {
+        const size_t n = size / planes;
+        if (planes == 4)
+            return Pixels::JoinChannels(src, n, dst);
+        for (size_t i = 0; i < n; ++i)
+            for (size_t k = 0; k < planes; ++k)
+                dst[i * planes + k] = src[k * n + i];
+    }
+
+
+    // random_device is a fixed-seed mt19937 on MinGW before gcc 9.2, every instance
+    // returns the same numbers there, so the clock tells apart tracks written there
+    static inline uint32_t NewId()
+    {
+        const uint64_t now = (uint64_t)std::chrono::high_resolution_clock::now().time_since_epoch().count();
+        return std::random_device{}() ^ (uint32_t)now ^ (uint32_t)(now >> 32);
+    }
+
+
+    inline std::optional<std::string> ReadDirectory(uint32_t tiles, uint64_t directoryOffset, size_t headerBytes)
+    {
+        const uint64_t tilesX = ((uint64_t)m_Header.width + m_Header.tileSize - 1) / m_Header.tileSize;
+        const uint64_t tilesY = ((uint64_t)m_Header.height + m_Header.tileSize - 1) / m_Header.tileSize;
+        if (directoryOffset < headerBytes || directoryOffset > m_File.Size() || (m_File.Size() - directoryOffset) / EntryBytes < tiles
+            || m_File.Size() - directoryOffset != (uint64_t)tiles * EntryBytes + 4)
+            return std::string("truncated file");
+
+        const unsigned char* directory = m_File.Data() + directoryOffset;
+        const size_t directoryBytes = (size_t)tiles * EntryBytes;
+        if (Crc32(directory, directoryBytes) != SessionLog::GetU32(directory + directoryBytes))
+            return std::string("corrupted tile directory");
+
+        m_Entries.resize(tiles);
+        for (size_t i = 0; i < tiles; ++i)
+        {
+            const unsigned char* p = directory + i * EntryBytes;
+            Entry& e = m_Entries[i];
+            e.index = SessionLog::GetU32(p);
+            e.bytes = SessionLog::GetU32(p + 4);
+            e.offset = SessionLog::GetU64(p + 8);
+            e.adler = SessionLog::GetU32(p + 16);
+            if ((i != 0 && e.index <= m_Entries[i - 1].index) || e.index >= tilesX * tilesY || e.bytes == 0 || e.bytes > m_Header.tileBytes
+                || e.offset < headerBytes || e.offset > directoryOffset || directoryOffset - e.offset < e.bytes)
+                return std::string("invalid tile directory");
+        }
+        return std::nullopt;
+    }
+public:
+    inline TrackFile() = default;
+
+
+    static inline bool HasExtension(const std::filesystem::path& path)
+    {
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        return extension == Extension;
+    }
+
+
+    // True if the file starts like a track, says nothing about the rest of it
+    static inline bool IsTrack(const std::filesystem::path& path)
+    {
+        std::FILE* file = std::fopen(path.string().c_str(), "rb");
+        if (file == nullptr)
+            return false;
+        char magic[sizeof(Magic)];
+        const bool isTrack = std::fread(magic, 1, sizeof(magic), file) == sizeof(magic) && std::memcmp(magic, Magic, sizeof(Magic)) == 0;
+        std::fclose(file);
+        return isTrack;
+    }
+
+
+    // Maps the file and validates header and directory, tiles are only read by Decode()
+    inline std::optional<std::string> Open(const std::filesystem::path& path)
+    {
+        m_Entries.clear();
+        if (!m_File.Open(path))
+            return std::string("couldn't open the file");
+
+        const unsigned char* h = m_File.Data();
+        const uint32_t version = m_File.Size() >= HeaderBytesV1 ? SessionLog::GetU32(h + 8) : 0;
+        const size_t headerBytes = version == 1 ? HeaderBytesV1 : HeaderBytes;
+        if (m_File.Size() < headerBytes || std::memcmp(h, Magic, sizeof(Magic)) != 0 || Crc32(h, headerBytes - 4) != SessionLog::GetU32(h + headerBytes - 4))
+        {
+            m_File.Close();
+            return std::string("not a track file or corrupted header");
+        }
+        if (version != 1 && version != Version)
+        {
+            m_File.Close();
+            return std::string("unsupported version");
+        }
+
+        m_Id = SessionLog::GetU32(h + 52); // the crc in version 1
+        m_Header.format = SessionLog::GetU32(h + 12);
+        m_Header.width = (int)SessionLog::GetU32(h + 16);
+        m_Header.height = (int)SessionLog::GetU32(h + 20);
+        m_Header.tileSize = SessionLog::GetU32(h + 24);
+        m_Header.tileBytes = SessionLog::GetU32(h + 28);
+        m_Header.planes = SessionLog::GetU32(h + 32);
+        m_Header.maxCount = SessionLog::GetU32(h + 36);
+        if (m_Header.width <= 0 || m_Header.height <= 0 || m_Header.tileSize == 0 || m_Header.tileBytes == 0 || m_Header.tileBytes > Lz::MaxBlock
+            || m_Header.planes == 0 || m_Header.tileBytes % m_Header.planes != 0)
+        {
+            m_File.Close();
+            return std::string("invalid header");
+        }
+
+        const std::optional<std::string> errorMsg = ReadDirectory(SessionLog::GetU32(h + 40), SessionLog::GetU64(h + 44), headerBytes);
+        if (errorMsg.has_value())
+        {
+            m_Entries.clear();
+            m_File.Close();
+        }
+        return errorMsg;
+    }
+
+
+    // The stored tile with the given index, nullptr if it is empty
+    inline const Entry* Find(uint32_t index) const
+    {
+        const auto it = std::lower_bound(m_Entries.begin(), m_Entries.end(), index, [](const Entry& e, uint32_t i) { return e.index < i; });
+        return it != m_Entries.end() && it->index == index ? &*it : nullptr;
+    }
+
+
+    // Writes the tileBytes of the tile to dst, false if it is corrupted.
+    // May be called concurrently.
+    inline bool Decode(const Entry& e, unsigned char* dst) const
+    {
+        const unsigned char* src = m_File.Data() + e.offset;
+        return Deflate::Adler32(src, e.bytes) == e.adler && Unpack(m_Header, src, e.bytes, dst);
+    }
+
+
+    // Splits the tileBytes of raw into planes and compresses them, stored holds
+    // the bytes to store afterwards: compressed, or the planes if that isn't smaller
+    static inline void Pack(const Header& header, const unsigned char* raw, std::vector<unsigned char>& planar, std::vector<unsigned char>& stored)
+    {
+        if (header.planes > 1)
+        {
+            planar.resize(header.tileBytes);
+            Split(raw, header.tileBytes, header.planes, planar.data());
+            raw = planar.data();
+        }
+        stored.clear();
+        const size_t stride = header.planes > 1 ? header.tileBytes / header.planes : 0; // equal channels repeat the previous plane
+        Lz::Compress(raw, header.tileBytes, stored, stride);
+        if (stored.size() >= header.tileBytes)
+            stored.assign(raw, raw + header.tileBytes);
+    }
+
+
+    // Inverse of Pack(), false if the stored bytes are malformed. May be called concurrently.
+    static inline bool Unpack(const Header& header, const unsigned char* stored, size_t bytes, unsigned char* dst)
+    {
+        if (bytes > header.tileBytes)
+            return false;
+        thread_local std::vector<unsigned char> planar;
+        unsigned char* out = dst;
+        if (header.planes > 1)
+        {
+            planar.resize(header.tileBytes);
+            out = planar.data();
+        }
+        if (bytes < header.tileBytes && !Lz::Decompress(stored, bytes, out, header.tileBytes))
+            return false;
+        if (bytes == header.tileBytes)
+            std::memcpy(out, stored, bytes);
+        if (out != dst)
+            Join(out, header.tileBytes, header.planes, dst);
+        return true;
+    }
+
+
+    // Writes a track of tileCount tiles, tile(i) returns the tileBytes of tile i
+    // or nullptr if it is empty. It is called concurrently for different tiles,
+    // which are compressed on threads threads (0 = all hardware threads).
+    // tilesDone (if any) counts the tiles compressed so far.
+    template <class TileFn>
+    static inline bool Write(const std::filesystem::path& path, const Header& header, size_t tileCount, TileFn&& tile, unsigned threads = 0, std::atomic<int>* tilesDone = nullptr)
+    {
+        std::FILE* file = std::fopen(path.string().c_str(), "wb");
+        if (file == nullptr)
+            return false;
+
+        // the header is written again once the directory offset is known
+        unsigned char h[HeaderBytes] = {};
+        bool ok = std::fwrite(h, 1, sizeof(h), file) == sizeof(h);
+
+        struct Slot
+        {
+            bool empty = true;
+            std::vector<unsigned char> planar;
+            std::vector<unsigned char> stored;
+        };
+        std::vector<Slot> slots(std::min(Batch, tileCount));
+        std::vector<unsigned char> directory;
+        uint64_t offset = HeaderBytes;
+        threads = std::max(1u, std::min<unsigned>(threads != 0 ? threads : HardwareThreads(), (unsigned)slots.size()));
+        for (size_t begin = 0; begin < tileCount && ok; begin += Batch)
+        {
+            const size_t n = std::min(Batch, tileCount - begin);
+            std::atomic<size_t> next{ 0 };
+            RunParallel(threads, [&](unsigned)
+            {
+                for (size_t i = next++; i < n; i = next++)
+                {
+                    Slot& s = slots[i];
+                    const unsigned char* raw = tile(begin + i);
+                    s.empty = raw == nullptr;
+                    if (raw != nullptr)
+                        Pack(header, raw, s.planar, s.stored);
+                    if (tilesDone != nullptr)
+                        tilesDone->fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+
+            for (size_t i = 0; i < n && ok; ++i)
+            {
+                const Slot& s = slots[i];
+                if (s.empty)
+                    continue;
+                unsigned char e[EntryBytes];
+                SessionLog::PutU32(e, (uint32_t)(begin + i));
+                SessionLog::PutU32(e + 4, (uint32_t)s.stored.size());
+                SessionLog::PutU64(e + 8, offset);
+                SessionLog::PutU32(e + 16, Deflate::Adler32(s.stored.data(), s.stored.size()));
+                directory.insert(directory.end(), e, e + EntryBytes);
+                ok = std::fwrite(s.stored.data(), 1, s.stored.size(), file) == s.stored.size();
+                offset += s.stored.size();
+            }
+        }
+
+        unsigned char crc[4];
+        SessionLog::PutU32(crc, Crc32(directory.data(), directory.size()));
+        ok = ok && (directory.empty() || std::fwrite(directory.data(), 1, directory.size(), file) == directory.size()) && std::fwrite(crc, 1, sizeof(crc), file) == sizeof(crc);
+
+        std::memcpy(h, Magic, sizeof(Magic));
+        SessionLog::PutU32(h + 8, Version);
+        SessionLog::PutU32(h + 12, header.format);
+        SessionLog::PutU32(h + 16, (uint32_t)header.width);
+        SessionLog::PutU32(h + 20, (uint32_t)header.height);
+        SessionLog::PutU32(h + 24, header.tileSize);
+        SessionLog::PutU32(h + 28, header.tileBytes);
+        SessionLog::PutU32(h + 32, header.planes);
+        SessionLog::PutU32(h + 36, header.maxCount);
+        SessionLog::PutU32(h + 40, (uint32_t)(directory.size() / EntryBytes));
+        SessionLog::PutU64(h + 44, offset);
+        SessionLog::PutU32(h + 52, NewId());
+        SessionLog::PutU32(h + 56, Crc32(h, HeaderBytes - 4));
+        ok = ok && std::fseek(file, 0, SEEK_SET) == 0 && std::fwrite(h, 1, sizeof(h), file) == sizeof(h);
+        return std::fclose(file) == 0 && ok;
+    }
+
+
+    inline const Header& GetHeader()           const { return m_Header;        }
+    inline uint32_t Id()                       const { return m_Id;            }
+    inline const std::vector<Entry>& Entries() const { return m_Entries;       }
+    inline bool IsOpen()                       const { return m_File.IsOpen(); }
+};
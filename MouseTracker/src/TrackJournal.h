@@ -0,0 +1,170 @@
+#pragma once
+#include <system_error>
+#include <filesystem>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#ifdef WINDOWS
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "MappedFile.h"
+#include "SessionLog.h"
+#include "TrackFile.h"
+#include "Crc32.h"
+
+// Tiles changed after a track was written, appended in checkpoints.
+//
+// journal    := "MTJRNL\r\n" u32 version u32 base checkpoint*
+// checkpoint := u32 'MTCP' u32 tiles u32 payloadBytes u32 crc payload
+// payload    := (u32 index u32 bytes byte*)*
+//
+// base is the Id() of the track the journal continues, a journal that doesn't
+// belong to the track next to it is ignored. Tiles are stored like in the
+// track (TrackFile::Pack), bytes = 0 for a tile that is blank again. The crc
+// covers the first 12 bytes of the checkpoint and the payload, replaying stops
+// at the first checkpoint that is torn or damaged, so a crash while appending
+// only loses that checkpoint.
+namespace TrackJournal
+{
+    static constexpr char Magic[8] = { 'M', 'T', 'J', 'R', 'N', 'L', '\r', '\n' };
+    static constexpr uint32_t Version = 1;
+    static constexpr uint32_t CheckpointMagic = 0x50434D54; // "MTCP"
+    static constexpr size_t FileHeaderBytes = sizeof(Magic) + 8;
+    static constexpr size_t CheckpointHeaderBytes = 16;
+
+
+    // Makes sure what was written to the file survives a crash of the machine
+    inline bool Sync(std::FILE* file)
+    {
+        if (std::fflush(file) != 0)
+            return false;
+#ifdef WINDOWS
+        return _commit(_fileno(file)) == 0;
+#else
+        return fsync(fileno(file)) == 0;
+#endif
+    }
+
+
+    inline bool Sync(const std::filesystem::path& path)
+    {
+        std::FILE* file = std::fopen(path.string().c_str(), "ab");
+        if (file == nullptr)
+            return false;
+        const bool ok = Sync(file);
+        return std::fclose(file) == 0 && ok;
+    }
+
+
+    // Renames from to to, replacing to, and makes the rename durable where the OS allows it
+    inline bool Replace(const std::filesystem::path& from, const std::filesystem::path& to)
+    {
+        std::error_code ec;
+        std::filesystem::rename(from, to, ec);
+        if (ec)
+            return false;
+#ifndef WINDOWS
+        const std::filesystem::path parent = to.has_parent_path() ? to.parent_path() : std::filesystem::path(".");
+        const int fd = open(parent.c_str(), O_RDONLY);
+        if (fd >= 0)
+        {
+            fsync(fd);
+            close(fd);
+        }
+#endif
+        return true;
+    }
+
+
+    // Starts an empty journal for the track with the given id, atomically replacing an old one
+    inline bool Create(const std::filesystem::path& path, uint32_t base)
+    {
+        const std::filesystem::path tmp = path.string() + ".tmp";
+        std::FILE* file = std::fopen(tmp.string().c_str(), "wb");
+        if (file == nullptr)
+            return false;
+        unsigned char header[FileHeaderBytes];
+        std::memcpy(header, Magic, sizeof(Magic));
+        SessionLog::PutU32(header + sizeof(Magic), Version);
+        SessionLog::PutU32(header + sizeof(Magic) + 4, base);
+        const bool ok = std::fwrite(header, 1, sizeof(header), file) == sizeof(header) && Sync(file);
+        return std::fclose(file) == 0 && ok && Replace(tmp, path);
+    }
+
+
+    // Appends one tile to the payload of a checkpoint, stored = nullptr for a blank tile
+    inline void PutTile(std::vector<unsigned char>& payload, uint32_t index, const unsigned char* stored, size_t bytes)
+    {
+        unsigned char h[8];
+        SessionLog::PutU32(h, index);
+        SessionLog::PutU32(h + 4, stored == nullptr ? 0 : (uint32_t)bytes);
+        payload.insert(payload.end(), h, h + sizeof(h));
+        if (stored != nullptr)
+            payload.insert(payload.end(), stored, stored + bytes);
+    }
+
+
+    // Appends a checkpoint of tiles tiles and syncs it to the disk
+    inline bool Append(const std::filesystem::path& path, uint32_t tiles, const std::vector<unsigned char>& payload)
+    {
+        unsigned char h[CheckpointHeaderBytes];
+        SessionLog::PutU32(h, CheckpointMagic);
+        SessionLog::PutU32(h + 4, tiles);
+        SessionLog::PutU32(h + 8, (uint32_t)payload.size());
+        SessionLog::PutU32(h + 12, Crc32(payload.data(), payload.size(), Crc32(h, 12)));
+
+        std::FILE* file = std::fopen(path.string().c_str(), "ab");
+        if (file == nullptr)
+            return false;
+        const bool ok = std::fwrite(h, 1, sizeof(h), file) == sizeof(h) && std::fwrite(payload.data(), 1, payload.size(), file) == payload.size() && Sync(file);
+        return std::fclose(file) == 0 && ok;
+    }
+
+
+    // Calls apply(index, stored, bytes) for the tiles of every intact checkpoint
+    // in order, stored = nullptr for a blank tile. Returns the number of
+    // checkpoints, 0 if the journal is missing or belongs to another track.
+    template <class ApplyFn>
+    inline size_t Replay(const std::filesystem::path& path, uint32_t base, ApplyFn&& apply)
+    {
+        MappedFile file;
+        if (!file.Open(path) || file.Size() < FileHeaderBytes || std::memcmp(file.Data(), Magic, sizeof(Magic)) != 0
+            || SessionLog::GetU32(file.Data() + sizeof(Magic)) != Version || SessionLog::GetU32(file.Data() + sizeof(Magic) + 4) != base)
+            return 0;
+
+        size_t checkpoints = 0;
+        const unsigned char* p = file.Data() + FileHeaderBytes;
+        const unsigned char* const end = file.Data() + file.Size();
+        while ((size_t)(end - p) >= CheckpointHeaderBytes && SessionLog::GetU32(p) == CheckpointMagic)
+        {
+            const uint32_t tiles = SessionLog::GetU32(p + 4);
+            const uint32_t payloadBytes = SessionLog::GetU32(p + 8);
+            const unsigned char* payload = p + CheckpointHeaderBytes;
+            if ((size_t)(end - payload) < payloadBytes || Crc32(payload, payloadBytes, Crc32(p, 12)) != SessionLog::GetU32(p + 12))
+                break;
+
+            // a valid crc doesn't make the content plausible, check every tile before applying any
+            const unsigned char* const payloadEnd = payload + payloadBytes;
+            const unsigned char* q = payload;
+            for (uint32_t i = 0; i < tiles && q != nullptr; ++i)
+                q = (size_t)(payloadEnd - q) < 8 || (size_t)(payloadEnd - q - 8) < SessionLog::GetU32(q + 4) ? nullptr : q + 8 + SessionLog::GetU32(q + 4);
+            if (q != payloadEnd)
+                break;
+
+            for (q = payload; q != payloadEnd; q += 8 + SessionLog::GetU32(q + 4))
+            {
+                const uint32_t bytes = SessionLog::GetU32(q + 4);
+                apply(SessionLog::GetU32(q), bytes == 0 ? nullptr : q + 8, (size_t)bytes);
+            }
+            p = payloadEnd;
+            ++checkpoints;
+        }
+        return checkpoints;
+    }
+}
@@ -0,0 +1,51 @@
+#ifdef WINDOWS
+#include <thread>
+#include <Windows.h>
+
+#include "CursorSource.h"
+#include "Log.h"
+
+Win32CursorSource::Win32CursorSource(int rateHz) : m_Rate(rateHz), m_Next(std::chrono::steady_clock::now())
+{
+    timeBeginPeriod(1); // default scheduler granularity is ~15 ms
+}
+
+
+Win32CursorSource::~Win32CursorSource()
+{
+    timeEndPeriod(1);
+}
+
+
+bool Win32CursorSource::Next(Sample& sample)
+{
+    m_Next += std::chrono::microseconds(1000000 / Rate());
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (m_Next < now)
+        m_Next = now; // fell behind, don't try to catch up with a burst
+    std::this_thread::sleep_until(m_Next);
+
+    POINT pos;
+    if (GetCursorPos(&pos) == 0)
+    {
+        if (!m_Failed)
+            Err << "GetCursorPos() error: " << GetLastError() << std::endl;
+        m_Failed = true;
+        return false;
+    }
+    m_Failed = false;
+    if (pos.x == m_PrevX && pos.y == m_PrevY)
+        return false;
+
+    m_PrevX = pos.x;
+    m_PrevY = pos.y;
+    sample = { SampleTimeNow(), (int)pos.x, (int)pos.y };
+    return true;
+}
+
+
+std::unique_ptr<CursorSource> CreateSystemCursorSource(int rateHz)
+{
+    return std::make_unique<Win32CursorSource>(rateHz);
+}
+#endif
@@ -11,8 +11,20 @@
 void WindowSizeCallback(GLFWwindow*, int, int)
 {
     GetWindow().SetResized();
+    GetWindow().SetInput();
 }
 
+
+// ImGui chains these, it installs its own callbacks after them
+void InputCallback(GLFWwindow*)                      { GetWindow().SetInput(); }
+void FocusCallback(GLFWwindow*, int)                 { GetWindow().SetInput(); }
+void CursorPosCallback(GLFWwindow*, double, double)  { GetWindow().SetInput(); }
+void CursorEnterCallback(GLFWwindow*, int)           { GetWindow().SetInput(); }
+void MouseButtonCallback(GLFWwindow*, int, int, int) { GetWindow().SetInput(); }
+void ScrollCallback(GLFWwindow*, double, double)     { GetWindow().SetInput(); }
+void KeyCallback(GLFWwindow*, int, int, int, int)    { GetWindow().SetInput(); }
+void CharCallback(GLFWwindow*, unsigned int)         { GetWindow().SetInput(); }
+
 //public
 Window::Window(int width, int height, const char* title, GLFWmonitor* monitor, GLFWwindow* share)
 {
@@ -39,6 +51,14 @@ Window::Window(int width, int height, const char* title, GLFWmonitor* monitor, G
     glfwSetWindowPos(m_Window, (mode->width - width) / 2, (mode->height - height) / 2);
 
     glfwSetWindowSizeCallback(m_Window, WindowSizeCallback);
+    glfwSetWindowRefreshCallback(m_Window, InputCallback);
+    glfwSetWindowFocusCallback(m_Window, FocusCallback);
+    glfwSetCursorPosCallback(m_Window, CursorPosCallback);
+    glfwSetCursorEnterCallback(m_Window, CursorEnterCallback);
+    glfwSetMouseButtonCallback(m_Window, MouseButtonCallback);
+    glfwSetScrollCallback(m_Window, ScrollCallback);
+    glfwSetKeyCallback(m_Window, KeyCallback);
+    glfwSetCharCallback(m_Window, CharCallback);
     glfwMakeContextCurrent(m_Window);
     glfwSwapInterval(1);
     glClearColor(0.27f, 0.27f, 0.27f, 1.0f);
@@ -14,6 +14,7 @@ class Window
 private:
 	GLFWwindow* m_Window = nullptr;
 	mutable bool m_Resized = true;
+	mutable bool m_Input = true; // an event since the last TakeInput() that may change the UI
 public:
 	Window(int width = 1600, int height = 920, const char* title = "Mouse Tracker", GLFWmonitor* monitor = NULL, GLFWwindow* share = NULL);
 	~Window();
@@ -25,11 +26,23 @@ public:
 	inline void PollEvents() const { glfwPollEvents();                        }
 	inline void WaitEvents() const { glfwWaitEvents();                        }
 	inline void StartFrame() const { Clear(); ImGuiStartFrame();              }
-	inline void EndFrame()   const { ImGuiRender(); PollEvents(); Swap();     }
+	inline void EndFrame()   const { ImGuiRender(); Swap();                   }
+
+	// Processes the pending events, waiting at most timeout seconds for the first one
+	inline void WaitEvents(double timeout) const
+	{
+		if (timeout > 0.0)
+			glfwWaitEventsTimeout(timeout);
+		else
+			PollEvents();
+	}
 
 	ImVec2 GetSize() const;
 	inline HWND GetNativeHandle() const { return glfwGetWin32Window(m_Window); }
 	inline void SetResized()      const { m_Resized = true;                    }
+	inline void SetInput()        const { m_Input = true;                      }
+	inline bool TakeInput()       const { return std::exchange(m_Input, false); }
+	inline bool Visible()         const { return glfwGetWindowAttrib(m_Window, GLFW_ICONIFIED) == 0; }
 
 	// ImGui
 	void ImGuiInit(const char* iniFileName = nullptr) const;
@@ -0,0 +1,107 @@
+#ifdef X11
+#include <poll.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/XInput2.h>
+
+#include "CursorSource.h"
+#include "Log.h"
+
+X11CursorSource::X11CursorSource()
+{
+    m_Display = XOpenDisplay(nullptr);
+    if (m_Display == nullptr)
+    {
+        Err << "{X11CursorSource} XOpenDisplay() failed, is DISPLAY set?" << std::endl;
+        return;
+    }
+
+    int event, error;
+    if (!XQueryExtension(m_Display, "XInputExtension", &m_XiOpcode, &event, &error))
+    {
+        Err << "{X11CursorSource} XInput extension not available" << std::endl;
+        XCloseDisplay(m_Display);
+        m_Display = nullptr;
+        return;
+    }
+
+    int major = 2;
+    int minor = 0;
+    if (XIQueryVersion(m_Display, &major, &minor) != Success)
+    {
+        Err << "{X11CursorSource} XInput2 not supported, server has " << major << '.' << minor << std::endl;
+        XCloseDisplay(m_Display);
+        m_Display = nullptr;
+        return;
+    }
+
+    // raw events are delivered regardless of which window has the pointer but
+    // only come from devices, warps (XWarpPointer, remote desktops) only send
+    // motion events, which reach the root window while no other window takes them
+    unsigned char mask[XIMaskLen(XI_LASTEVENT)] = {};
+    XISetMask(mask, XI_RawMotion);
+    XISetMask(mask, XI_Motion);
+    XIEventMask eventMask{ XIAllMasterDevices, sizeof(mask), mask };
+    XISelectEvents(m_Display, DefaultRootWindow(m_Display), &eventMask, 1);
+    XSync(m_Display, False); // moves after the constructor returned are seen
+    Log << "Opened X11 cursor source XInput " << major << '.' << minor << std::endl;
+}
+
+
+X11CursorSource::~X11CursorSource()
+{
+    if (m_Display != nullptr)
+        XCloseDisplay(m_Display);
+}
+
+
+bool X11CursorSource::Next(Sample& sample)
+{
+    if (m_Display == nullptr)
+    {
+        poll(nullptr, 0, 100);
+        return false;
+    }
+
+    if (XPending(m_Display) == 0)
+    {
+        pollfd fd{ ConnectionNumber(m_Display), POLLIN, 0 };
+        if (poll(&fd, 1, 100) <= 0)
+            return false;
+    }
+
+    // coalesce everything that queued up into one sample
+    bool moved = false;
+    while (XPending(m_Display) != 0)
+    {
+        XEvent ev;
+        XNextEvent(m_Display, &ev);
+        XGenericEventCookie* cookie = &ev.xcookie;
+        if (cookie->type != GenericEvent || cookie->extension != m_XiOpcode || !XGetEventData(m_Display, cookie))
+            continue;
+        moved |= cookie->evtype == XI_RawMotion || cookie->evtype == XI_Motion;
+        XFreeEventData(m_Display, cookie);
+    }
+    if (!moved)
+        return false;
+
+    // raw events carry device deltas, the absolute position has to be queried
+    ::Window root, child;
+    int x, y, wx, wy;
+    unsigned int buttons;
+    if (!XQueryPointer(m_Display, DefaultRootWindow(m_Display), &root, &child, &x, &y, &wx, &wy, &buttons))
+        return false;
+    if (x == m_PrevX && y == m_PrevY)
+        return false;
+
+    m_PrevX = x;
+    m_PrevY = y;
+    sample = { SampleTimeNow(), x, y };
+    return true;
+}
+
+
+std::unique_ptr<CursorSource> CreateSystemCursorSource(int)
+{
+    return std::make_unique<X11CursorSource>();
+}
+#endif
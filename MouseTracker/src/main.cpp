@@ -1,19 +1,39 @@
+#include <algorithm>
 #include <cstdlib>
+#include <optional>
+#include <utility>
+#include <memory>
 #include <string>
-#include <thread>
+#include <vector>
 #include <chrono>
 #include <Windows.h>
 
 #include "ImGui/imgui.h"
 
+#include "SessionLogWriter.h"
 #include "SettingsWindow.h"
+#include "FrameScheduler.h"
+#include "Autosave.h"
+#include "Headless.h"
+#include "CursorCapture.h"
+#include "CursorSource.h"
 #include "Window.h"
+#include "Parallel.h"
 #include "Monitor.h"
+#include "Options.h"
 #include "Clang.h"
+#include "Sample.h"
 #include "Image.h"
 #include "Log.h"
 
-inline void ImageWindow(ImVec2 wSize, ImVec2 imgRes, GLuint gpuImage)
+// Displayed / image size, the image fills the lower three quarters of the window keeping its aspect ratio
+inline float ImageScale(ImVec2 wSize, ImVec2 imgRes)
+{
+    return std::min(wSize.x / imgRes.x, wSize.y * (3.f / 4.f) / imgRes.y);
+}
+
+
+inline void ImageWindow(ImVec2 wSize, const Image& img)
 {
     static constexpr float oneQuarter = 1.f / 4.f;
     static constexpr float threeQuarters = 3.f / 4.f;
@@ -23,22 +43,16 @@ inline void ImageWindow(ImVec2 wSize, ImVec2 imgRes, GLuint gpuImage)
     ImGui::SetWindowPos({ 0, wSize.y * oneQuarter });
     ImGui::SetWindowSize({ wSize.x, wSize.y * threeQuarters });
 
-    const float yRatio = imgRes.y / (wSize.y * threeQuarters);
-    const float xPos = (wSize.x - imgRes.x / yRatio) / 2.f;
-    if (xPos >= 0.f)
+    // the textures are laid out like the image, scaled as one
+    const ImVec2 imgRes = img.Resolution();
+    const float scale = ImageScale(wSize, imgRes);
+    const float textureScale = scale * (float)img.PreviewFactor();
+    const ImVec2 p = ImGui::GetCursorScreenPos();
+    const ImVec2 origin{ p.x + (wSize.x - imgRes.x * scale) / 2.f, p.y + (wSize.y * threeQuarters - imgRes.y * scale) / 2.f };
+    for (const Image::GpuTile& tile : img.GetGpuTiles())
     {
-        const ImVec2 p = ImGui::GetCursorScreenPos();
-        ImGui::SetCursorScreenPos(ImVec2(p.x + xPos, p.y));
-        ImGui::Image((void*)(intptr_t)gpuImage, { imgRes.x / yRatio, imgRes.y / yRatio });
-    }
-    else
-    {
-        const float xRatio = imgRes.x / wSize.x;
-        const float yPos = (wSize.y * threeQuarters - imgRes.y / xRatio) / 2.f;
-
-        const ImVec2 p = ImGui::GetCursorScreenPos();
-        ImGui::SetCursorScreenPos(ImVec2(p.x, p.y + yPos));
-        ImGui::Image((void*)(intptr_t)gpuImage, { imgRes.x / xRatio, imgRes.y / xRatio });
+        ImGui::SetCursorScreenPos({ origin.x + (float)tile.area.x0 * textureScale, origin.y + (float)tile.area.y0 * textureScale });
+        ImGui::Image((void*)(intptr_t)tile.texture, { (float)tile.area.Width() * textureScale, (float)tile.area.Height() * textureScale });
     }
 
     ImGui::End();
@@ -48,37 +62,104 @@ inline void ImageWindow(ImVec2 wSize, ImVec2 imgRes, GLuint gpuImage)
 
 int main()
 {
+    const Options opt = ParseOptions(__argc, __argv);
+    if (opt.headless)
+        return RunHeadless(opt);
+
     const Window& window = GetWindow();
     std::vector<MonitorInfo> mInfo = GetMonitors(); // mInfo[0] primary monitor
     if (mInfo.empty())
         return MsgBoxError("Failed to load monitor data");
-    Image i(mInfo[0].w, mInfo[0].h);
+    const Image::Format format = TileFormatFromName(opt.format);
+    Image i(mInfo[0].w, mInfo[0].h, format);
+    i.StreamUploads(opt.streamUploads);
+    if (opt.maxTextureSize > 0)
+        i.LimitTextureSize(opt.maxTextureSize);
+    i.SetPngOptions({ opt.pngLevel, opt.threads });
 
-    POINT pos{0, 0};
-    POINT prevPos{1, 1};
-    auto startTime = std::chrono::high_resolution_clock::now();
-    SettingsWindow sw(i);
-    while (window.IsOpen())
+    std::unique_ptr<Autosave> autosave;
+    if (!opt.autosavePath.empty())
+        autosave = std::make_unique<Autosave>(Image::WithExtension(opt.autosavePath, TrackFile::Extension), std::chrono::seconds(opt.autosaveInterval));
+    if (!opt.replayLogPath.empty())
     {
-        window.StartFrame();
-        prevPos = pos;
-        if (GetCursorPos(&pos) == 0)
+        const unsigned threads = opt.threads != 0 ? opt.threads : HardwareThreads();
+        const std::optional<std::string> errorMsg = i.ReplayLog(opt.replayLogPath, mInfo[0].x, mInfo[0].y, { opt.replayFrom, opt.replayTo }, Brush(opt.brushShape, opt.brushRadius), threads);
+        if (errorMsg.has_value())
+            MsgBoxError(errorMsg.value().c_str());
+    }
+    else if (autosave != nullptr)
+    {
+        // an autosave that can't be restored must not be overwritten by the next checkpoint
+        const std::optional<std::string> errorMsg = autosave->Restore(i);
+        if (errorMsg.has_value())
         {
-            Err << "GetCursorPos() error: " << GetLastError() << std::endl;
+            MsgBoxError((errorMsg.value() + "\nAutosave is disabled for this session.").c_str());
+            autosave.reset();
         }
-        else if (sw.Tracking() && (pos.x != prevPos.x || pos.y != prevPos.y))
+    }
+
+    std::unique_ptr<CursorSource> source;
+    if (opt.replayPath.empty())
+        source = CreateSystemCursorSource(opt.rate);
+    else
+        source = std::make_unique<ReplayCursorSource>(opt.replayPath, opt.replayMaxSpeed);
+
+    std::unique_ptr<SessionLogWriter> log;
+    if (!opt.logPath.empty())
+        log = std::make_unique<SessionLogWriter>(opt.logPath);
+
+    CursorCapture capture(std::move(source), 1 << 14, log.get());
+    std::vector<Sample> samples(capture.Capacity());
+    Sample pos{ 0, 0, 0 };
+    FrameScheduler scheduler;
+    SettingsWindow sw(i, capture, scheduler, log.get());
+    sw.SetBrush(Brush(opt.brushShape, opt.brushRadius));
+    while (window.IsOpen())
+    {
+        // blocks while there is nothing to render, capture goes on meanwhile
+        window.WaitEvents(scheduler.Timeout());
+        if (window.TakeInput())
+            scheduler.Request(FrameScheduler::InputFrames);
+        if (sw.PollHotkeys() || sw.Animating())
+            scheduler.Request();
+
+        const size_t count = capture.Drain(samples.data(), samples.size());
+        if (count != 0)
         {
-            i.Update(CURSOR_POS(pos.x, mInfo[sw.SelectedMonitor()].x), CURSOR_POS(pos.y, mInfo[sw.SelectedMonitor()].y), sw.BigPixelMode());
-            startTime = std::chrono::high_resolution_clock::now();
+            pos = samples[count - 1];
+            scheduler.Activity();
+            scheduler.Refresh(); // cursor position label
         }
-        else if(sw.SleepWhileIdle() && std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - startTime).count() > 200)
+
+        if (!sw.Tracking())
+            i.EndStroke();
+        if (log != nullptr)
+            log->SetRecording(sw.Tracking());
+
+        if (sw.Tracking() && count != 0)
         {
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            const MonitorInfo& sm = mInfo[sw.SelectedMonitor()];
+            i.DrawStroke(samples.data(), count, sm.x, sm.y, sw.GetBrush());
         }
+        if (i.Dirty())
+            scheduler.Request();
+        if (autosave != nullptr)
+            autosave->Update(i.Strokes());
+
+        scheduler.SetOnDemand(sw.SleepWhileIdle());
+        if (!scheduler.BeginFrame(window.Visible()))
+            continue;
+        window.StartFrame();
         const ImVec2 windowSize = window.GetSize();
-        ImageWindow(windowSize, i.Resolution(), i.GetGpuImage());
+        i.SetViewScale(ImageScale(windowSize, i.Resolution()));
+        i.Upload();
+        ImageWindow(windowSize, i);
         sw.Show(windowSize, pos, mInfo);
-        window.EndFrame();
+        window.ImGuiRender();
+        scheduler.EndFrame();
+        window.Swap();
     }
+    if (autosave != nullptr)
+        autosave->Update(i.Strokes(), true);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,103 @@
+project "MouseTrackerBench"
+    language "C++"
+    cppdialect "C++17"
+    kind "ConsoleApp"
+    defines "_CRT_SECURE_NO_WARNINGS"
+
+    -- headless, only the canvas, brushes, capture, autosave and session logs of MouseTracker
+    files {
+        "src/**.cpp",
+        "../MouseTracker/src/Autosave.cpp",
+        "../MouseTracker/src/CursorCapture.cpp",
+        "../MouseTracker/src/SessionLogWriter.cpp",
+        "../MouseTracker/src/SessionReplay.cpp",
+        "../MouseTracker/src/X11CursorSource.cpp",
+        "../MouseTracker/src/stb.cpp"
+    }
+
+    includedirs {
+        "src",
+        "../MouseTracker/src",
+        "../MouseTracker/vendor"
+    }
+
+    externalincludedirs {
+        "../MouseTracker/vendor"
+    }
+
+    flags "FatalWarnings"
+
+    filter "system:windows"
+        links "psapi"
+    filter "system:linux"
+        defines "X11"
+        links { "pthread", "X11", "Xi" }
+    filter {}
+
+    -- gcc* clang* msc*
+    filter "toolset:msc*"
+        warnings "High"
+        externalwarnings "Default" -- Default
+        disablewarnings {}
+        buildoptions { "/sdl" }
+        defines "MSC"
+
+    filter { "toolset:gcc* or toolset:clang*" }
+        enablewarnings {
+            "cast-align",
+            "cast-qual",
+            "ctor-dtor-privacy",
+            "disabled-optimization",
+            "format=2",
+            "init-self",
+            "missing-include-dirs",
+            "overloaded-virtual",
+            "redundant-decls",
+            "shadow",
+            "sign-conversion",
+            "sign-promo",
+            "switch-default",
+            "undef",
+            "uninitialized",
+            "unreachable-code",
+            "unused",
+            "alloca",
+            "conversion",
+            "deprecated",
+            "format-security",
+            "null-dereference",
+            "stack-protector",
+            "vla",
+            "shift-overflow"
+        }
+
+    filter "toolset:gcc*"
+        warnings "Extra"
+        externalwarnings "Off"
+        linkgroups "on" -- activate position independent linking
+        enablewarnings {
+            "noexcept",
+            "strict-null-sentinel",
+            "array-bounds=2",
+            "duplicated-branches",
+            "duplicated-cond",
+            "logical-op",
+            "arith-conversion",
+            "stringop-overflow=4",
+            "implicit-fallthrough=3",
+            "trampolines"
+        }
+        disablewarnings "cast-function-type"
+        defines "GCC"
+
+    filter "toolset:clang*"
+        warnings "Extra"
+        externalwarnings "Everything"
+        enablewarnings {
+            "array-bounds",
+            "long-long",
+            "implicit-fallthrough", 
+        }
+        disablewarnings "cast-align"
+        defines "CLANG"
+    filter {}
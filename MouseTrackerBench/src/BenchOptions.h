@@ -0,0 +1,78 @@
+#pragma once
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "TileFormat.h"
+#include "Sample.h"
+#include "Log.h"
+
+// Command line of MouseTrackerBench (see main.cpp) and the workloads the suites share
+struct BenchOptions
+{
+    std::string suite;                        // --suite <name> (see the usage in main.cpp), all of them if empty
+    TileFormat format = TileFormat::RGBA8;    // --format rgba|bit1|heatmap|gray, brushes only
+    size_t stamps = 200000;                   // --stamps <n> per measurement
+    int width = 1920;                         // --width <pixels>
+    int height = 1080;                        // --height <pixels>
+};
+
+
+constexpr const char* FormatNames[] = { "rgba", "bit1", "heatmap", "gray" }; // in TileFormat order
+
+
+inline BenchOptions ParseBenchOptions(int argc, char** argv)
+{
+    BenchOptions opt;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const char* const arg = argv[i];
+        const char* const value = argv[i + 1];
+        if (std::strcmp(arg, "--suite") == 0)
+            opt.suite = value;
+        else if (std::strcmp(arg, "--format") == 0)
+            opt.format = TileFormatFromName(value);
+        else if (std::strcmp(arg, "--stamps") == 0)
+            opt.stamps = (size_t)std::max(1, std::atoi(value));
+        else if (std::strcmp(arg, "--width") == 0)
+            opt.width = std::max(1, std::atoi(value));
+        else if (std::strcmp(arg, "--height") == 0)
+            opt.height = std::max(1, std::atoi(value));
+        else
+            Err << "Ignoring unknown argument: " << arg << std::endl;
+    }
+    return opt;
+}
+
+
+inline double Seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+// A cursor wandering over the canvas in steps of up to 32 pixels
+inline std::vector<Sample> Walk(const BenchOptions& opt)
+{
+    std::vector<Sample> samples(opt.stamps);
+    uint32_t state = 0x2545F491u;
+    const auto step = [&]()
+    {
+        state = state * 1664525u + 1013904223u;
+        return (int)(state >> 27) * 2 - 31;
+    };
+    int x = opt.width / 2;
+    int y = opt.height / 2;
+    for (size_t i = 0; i < samples.size(); ++i)
+    {
+        x = std::clamp(x + step(), 0, opt.width - 1);
+        y = std::clamp(y + step(), 0, opt.height - 1);
+        samples[i] = { (int64_t)i * 1000, x, y };
+    }
+    return samples;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include "BenchOptions.h"
+
+// Suites of MouseTrackerBench besides brushes and formats (main.cpp), each
+// prints a table to stdout. See main.cpp for what they measure.
+void BenchRaster(const BenchOptions& opt);
+void BenchIncrement(const BenchOptions& opt);
+void BenchReplay(const BenchOptions& opt);
+void BenchPng(const BenchOptions& opt);
+void BenchPixels(const BenchOptions& opt);
+void BenchUploads(const BenchOptions& opt);
+void BenchFrames(const BenchOptions& opt);
+void BenchMemory(const BenchOptions& opt);
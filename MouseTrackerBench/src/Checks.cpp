@@ -0,0 +1,413 @@
+#include <filesystem>
+#include <algorithm>
+#include <optional>
+#include <utility>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#include "stb/stb_image.h"
+
+#include "CursorCapture.h"
+#include "CursorSource.h"
+#include "BenchOptions.h"
+#include "SpscRing.h"
+#include "TextureGrid.h"
+#include "TrackJournal.h"
+#include "TrackFile.h"
+#include "TileArena.h"
+#include "Checks.h"
+#include "Canvas.h"
+#include "Sample.h"
+#include "Rect.h"
+
+namespace
+{
+    // Pixels the canvas counts as visited
+    inline size_t VisitedPixels(const Canvas& canvas)
+    {
+        std::optional<Canvas> bits = canvas.Snapshot();
+        if (!bits.has_value() || !bits->SetFormat(Canvas::Format::Bit1))
+            return 0;
+        size_t visited = 0;
+        std::vector<unsigned char> row((size_t)canvas.Width() * Canvas::Channel);
+        for (int y = 0; y < canvas.Height(); ++y)
+        {
+            bits->ExpandRow(y, 0, canvas.Width(), row.data());
+            for (int x = 0; x < canvas.Width(); ++x)
+                visited += row[(size_t)x * Canvas::Channel] == 0 && row[(size_t)x * Canvas::Channel + 3] != 0; // off screen is transparent black
+        }
+        return visited;
+    }
+
+
+    inline size_t CoveredPixels(const std::vector<Rect>& layout, int width, int height)
+    {
+        size_t covered = 0;
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x)
+                covered += std::any_of(layout.begin(), layout.end(), [&](const Rect& r) { return x >= r.x0 && x < r.x1 && y >= r.y0 && y < r.y1; });
+        return covered;
+    }
+
+
+    inline bool SameArea(const std::vector<Rect>& a, const std::vector<Rect>& b, int width, int height)
+    {
+        const auto covers = [](const std::vector<Rect>& layout, int x, int y)
+        {
+            return std::any_of(layout.begin(), layout.end(), [&](const Rect& r) { return x >= r.x0 && x < r.x1 && y >= r.y0 && y < r.y1; });
+        };
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x)
+                if (covers(a, x, y) != covers(b, x, y))
+                    return false;
+        return true;
+    }
+
+
+    // Black opaque and transparent pixels of a PNG the way other programs see it
+    inline std::pair<size_t, size_t> DecodedPixels(const std::string& path)
+    {
+        int width, height, cmp;
+        unsigned char* data = stbi_load(path.c_str(), &width, &height, &cmp, 4);
+        if (data == NULL)
+            return { 0, 0 };
+        size_t black = 0;
+        size_t transparent = 0;
+        for (size_t i = 0; i < (size_t)width * (size_t)height; ++i)
+        {
+            const unsigned char* p = data + i * 4;
+            black += p[3] >= 128 && p[0] < 128;
+            transparent += p[3] < 128;
+        }
+        stbi_image_free(data);
+        return { black, transparent };
+    }
+
+
+    // A 300x200 canvas on two monitors of different height with a line of 241
+    // pixels over both, saved as PNG. Loading it into a canvas without layout
+    // has to find the same pixels and monitors, merging it (what
+    // MouseTrackerMerge does, with and without --sum) has to keep the off
+    // screen area transparent. Heatmap PNGs are left out, they hold the colors
+    // of the colormap and the light ones don't count as visited.
+    inline bool CheckMultiMonitorPng(Canvas::Format format)
+    {
+        const int width = 300;
+        const int height = 200;
+        const std::vector<Rect> layout = { Rect::FromSize(0, 0, 180, 200), Rect::FromSize(180, 40, 120, 120) };
+        const size_t offScreen = (size_t)width * (size_t)height - CoveredPixels(layout, width, height);
+        const std::string png = TempFile("MouseTrackerChecks.png").string();
+        const std::string merged = TempFile("MouseTrackerChecksMerged.png").string();
+        const std::string check = std::string("multi monitor png ") + FormatNames[(int)format];
+
+        Canvas drawn(format);
+        drawn.Resize(width, height);
+        drawn.SetMonitors(layout);
+        drawn.Paint([&](auto&& plot) { plot.Span(100, 30, 271); });
+        if (!drawn.SaveToFile(png.c_str()))
+            return Report(check.c_str(), false, "saving failed");
+
+        Canvas loaded(format);
+        loaded.Resize(width, height);
+        if (loaded.LoadFromFile(png).has_value())
+            return Report(check.c_str(), false, "loading failed");
+        const size_t visited = VisitedPixels(loaded);
+        if (visited != 241)
+            return Report(check.c_str(), false, std::to_string(visited) + " visited pixels after loading, 241 drawn");
+        if (format != Canvas::Format::RGBA8 && !SameArea(loaded.Monitors(), layout, width, height))
+            return Report(check.c_str(), false, "the monitor layout got lost");
+
+        for (Canvas::Format mergeFormat : { Canvas::Format::Bit1, Canvas::Format::Count16 })
+        {
+            Canvas input(mergeFormat);
+            input.Resize(width, height);
+            Canvas target = input.EmptyCopy();
+            if (input.LoadFromFile(png).has_value())
+                return Report(check.c_str(), false, "loading for the merge failed");
+            target.SetMonitors(input.Monitors());
+            target.MergeTiles(input, 0, input.TileCount());
+            target.FinishMerge();
+            if (VisitedPixels(target) != 241)
+                return Report(check.c_str(), false, std::to_string(VisitedPixels(target)) + " visited pixels after merging, 241 drawn");
+            if (!target.SaveToFile(merged.c_str()))
+                return Report(check.c_str(), false, "saving the merge failed");
+
+            const std::pair<size_t, size_t> pixels = DecodedPixels(merged);
+            if (mergeFormat == Canvas::Format::Bit1 && pixels.first != 241)
+                return Report(check.c_str(), false, std::to_string(pixels.first) + " black pixels in the merged png, 241 drawn");
+            if (pixels.second != offScreen)
+                return Report(check.c_str(), false, std::to_string(pixels.second) + " transparent pixels in the merged png, " + std::to_string(offScreen) + " off screen");
+        }
+        std::filesystem::remove(png);
+        std::filesystem::remove(merged);
+        return Report(check.c_str(), true);
+    }
+
+
+    // One producer and one consumer thread pass a counter through a small
+    // ring, the consumer has to see every value exactly once and in order
+    inline bool CheckSpscRing()
+    {
+        constexpr uint64_t Count = 2000000;
+        SpscRing<uint64_t> ring(64);
+        std::thread producer([&]()
+        {
+            for (uint64_t v = 0; v < Count; ++v)
+                while (!ring.Push(v))
+                    std::this_thread::yield();
+        });
+
+        uint64_t expected = 0;
+        bool inOrder = true;
+        uint64_t batch[16];
+        while (expected < Count && inOrder)
+        {
+            const size_t n = ring.PopBatch(batch, 16);
+            for (size_t i = 0; i < n; ++i)
+                inOrder &= batch[i] == expected++;
+            if (n == 0)
+                std::this_thread::yield();
+        }
+        producer.join();
+        if (!inOrder)
+            return Report("spsc ring", false, "value " + std::to_string(expected - 1) + " out of order");
+        return Report("spsc ring", ring.Size() == 0 && ring.Capacity() == 64, "ring not empty at the end");
+    }
+
+
+    // Synthetic cursor moving one pixel per sample, as fast as it is asked
+    class SyntheticCursorSource : public CursorSource
+    {
+    private:
+        const int m_Count;
+        const bool m_Lossless;
+        int m_Next = 0;
+    public:
+        inline SyntheticCursorSource(int count, bool lossless) : m_Count(count), m_Lossless(lossless) {}
+
+        inline bool Next(Sample& sample) override
+        {
+            if (m_Next == m_Count)
+                return false;
+            sample = { m_Next, m_Next % 1920, m_Next / 1920 };
+            ++m_Next;
+            return true;
+        }
+
+        inline bool Exhausted() const override { return m_Next == m_Count; }
+        inline bool Lossless()  const override { return m_Lossless;        }
+    };
+
+
+    // Drains capture until its thread finished and the ring is empty, false if a sample is out of order
+    inline bool DrainInOrder(CursorCapture& capture, size_t& drained)
+    {
+        Sample batch[256];
+        int64_t expected = 0;
+        bool inOrder = true;
+        for (bool finished = false; !finished;)
+        {
+            finished = capture.Finished(); // checked before the drain so nothing pushed after it is missed
+            for (size_t n; (n = capture.Drain(batch, 256)) != 0; drained += n)
+            {
+                for (size_t i = 0; i < n; ++i)
+                {
+                    inOrder &= batch[i].time == expected;
+                    expected = batch[i].time + 1;
+                }
+            }
+            if (!finished)
+                std::this_thread::yield();
+        }
+        return inOrder;
+    }
+
+
+    // The capture thread fed by a synthetic source: a lossless source loses
+    // nothing, a lossy one that nobody drains fills the ring and counts the rest as dropped
+    inline bool CheckCursorCapture()
+    {
+        constexpr int Count = 500000;
+        constexpr size_t Capacity = 1024;
+        {
+            CursorCapture capture(std::make_unique<SyntheticCursorSource>(Count, true), Capacity);
+            size_t drained = 0;
+            const bool inOrder = DrainInOrder(capture, drained);
+            if (!inOrder || drained != (size_t)Count || capture.Captured() != (uint64_t)Count || capture.Dropped() != 0)
+                return Report("cursor capture", false, "lossless source: drained " + std::to_string(drained) + " of " + std::to_string(Count) + (inOrder ? "" : " out of order"));
+        }
+
+        CursorCapture capture(std::make_unique<SyntheticCursorSource>(Count, false), Capacity);
+        while (!capture.Finished())
+            std::this_thread::yield();
+        if (capture.Occupancy() != Capacity || capture.Captured() != Capacity || capture.Dropped() != Count - Capacity)
+            return Report("cursor capture", false, "lossy source: occupancy " + std::to_string(capture.Occupancy()) + " captured " + std::to_string(capture.Captured()) + " dropped " + std::to_string(capture.Dropped()));
+        size_t drained = 0;
+        const bool inOrder = DrainInOrder(capture, drained);
+        return Report("cursor capture", inOrder && drained == Capacity && capture.Occupancy() == 0, "lossy source: drained " + std::to_string(drained) + " of " + std::to_string(Capacity));
+    }
+
+
+    // The cells have to cover the level exactly once and none may be larger than size
+    inline bool CoversOnce(const TextureGrid& grid, int width, int height, int size)
+    {
+        std::vector<unsigned char> hits((size_t)width * (size_t)height, 0);
+        for (const TextureGrid::Cell& cell : grid.Cells())
+        {
+            const Rect& a = cell.area;
+            if (a.Empty() || a.Width() > size || a.Height() > size || a.x0 < 0 || a.y0 < 0 || a.x1 > width || a.y1 > height)
+                return false;
+            for (int y = a.y0; y < a.y1; ++y)
+                for (int x = a.x0; x < a.x1; ++x)
+                    ++hits[(size_t)y * (size_t)width + (size_t)x];
+        }
+        return std::all_of(hits.begin(), hits.end(), [](unsigned char h) { return h == 1; });
+    }
+
+
+    // The texture grid with the size limit forced far below GL_MAX_TEXTURE_SIZE
+    // (what LimitTextureSize() does): cells cover the level, a dirty rect marks
+    // only the cells it touches and is rounded outwards on coarser levels
+    inline bool CheckTextureGrid()
+    {
+        if (TextureGrid::CellSize(0, 16384, 19200, 2160) != 16384 || TextureGrid::CellSize(1000, 16384, 19200, 2160) != 1000 ||
+            TextureGrid::CellSize(1000, 512, 19200, 2160) != 512 || TextureGrid::CellSize(0, 0, 19200, 2160) != 19200)
+            return Report("texture grid", false, "wrong cell size");
+
+        TextureGrid grid;
+        const int sizes[][3] = { { 19200, 2160, 16384 }, { 2500, 1300, 1000 }, { 2500, 1300, 64 }, { 999, 1000, 1000 }, { 1, 1, 1 } };
+        for (const auto& s : sizes)
+        {
+            grid.Layout(s[0], s[1], 0, s[2]);
+            const size_t expected = (size_t)((s[0] + s[2] - 1) / s[2]) * (size_t)((s[1] + s[2] - 1) / s[2]);
+            if (grid.Cells().size() != expected || !CoversOnce(grid, s[0], s[1], s[2]) || grid.Dirty())
+                return Report("texture grid", false, "bad layout of " + std::to_string(s[0]) + "x" + std::to_string(s[1]) + " in cells of " + std::to_string(s[2]));
+        }
+
+        // 2500x1300 in cells of 1000: 3x2 cells, the rect straddles the first two columns of the top row
+        grid.Layout(2500, 1300, 0, 1000);
+        grid.MarkDirty(Rect::FromSize(990, 10, 20, 5));
+        const std::vector<TextureGrid::Cell>& cells = grid.Cells();
+        if (!(cells[0].dirty == Rect::FromSize(990, 10, 10, 5)) || !(cells[1].dirty == Rect::FromSize(1000, 10, 10, 5)) ||
+            std::any_of(cells.begin() + 2, cells.end(), [](const TextureGrid::Cell& c) { return !c.dirty.Empty(); }) || grid.DirtyBytes() != 20 * 5 * 4)
+            return Report("texture grid", false, "dirty rect on a cell border");
+        grid.MarkAllDirty();
+        if (grid.DirtyBytes() != 2500 * 1300 * 4)
+            return Report("texture grid", false, "everything dirty doesn't upload everything");
+
+        // level 2 of the same image in cells of 100: 625x325, (5, 5)-(10, 10) becomes (1, 1)-(3, 3)
+        grid.Layout(625, 325, 2, 100);
+        grid.MarkDirty(Rect::FromSize(5, 5, 5, 5));
+        if (!(grid.Cells()[0].dirty == Rect::FromSize(1, 1, 2, 2)) || grid.DirtyBytes() != 2 * 2 * 4)
+            return Report("texture grid", false, "dirty rect on level 2");
+        return Report("texture grid", true);
+    }
+
+
+    // Every byte of slot equals value, Commit() first since Windows decommits released slots
+    inline bool SlotIs(TileArena& arena, size_t slot, size_t slotBytes, unsigned char value)
+    {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(arena.Commit(slot));
+        return p != nullptr && std::all_of(p, p + slotBytes, [=](unsigned char c) { return c == value; });
+    }
+
+
+    // Release() zeroes one slot and keeps the others, Reset() zeroes all of them,
+    // for slots on page boundaries (given back to the OS) and in between (memset)
+    inline bool CheckTileArena()
+    {
+        constexpr size_t Slots = 4;
+        for (size_t slotBytes : { (size_t)1 << 16, (size_t)1000 })
+        {
+            TileArena arena;
+            if (!arena.Reserve(Slots, slotBytes))
+                return Report("tile arena", false, "Reserve() failed");
+            for (size_t slot = 0; slot < Slots; ++slot)
+            {
+                if (!SlotIs(arena, slot, slotBytes, 0))
+                    return Report("tile arena", false, "new slot isn't zero");
+                std::memset(arena.Commit(slot), 0xAB, slotBytes);
+            }
+
+            arena.Release(1);
+            if (!SlotIs(arena, 1, slotBytes, 0))
+                return Report("tile arena", false, "released slot of " + std::to_string(slotBytes) + " bytes isn't zero");
+            if (!SlotIs(arena, 0, slotBytes, 0xAB) || !SlotIs(arena, 2, slotBytes, 0xAB))
+                return Report("tile arena", false, "Release() changed the neighbours of a slot of " + std::to_string(slotBytes) + " bytes");
+
+            std::memset(arena.Commit(1), 0xAB, slotBytes);
+            arena.Reset();
+            for (size_t slot = 0; slot < Slots; ++slot)
+                if (!SlotIs(arena, slot, slotBytes, 0))
+                    return Report("tile arena", false, "slot of " + std::to_string(slotBytes) + " bytes isn't zero after Reset()");
+        }
+        return Report("tile arena", true);
+    }
+
+
+    // What autosave does when the image is reset twice and the machine crashes
+    // after the second track was written, before its journal: the journal of
+    // the first track must not be replayed onto the second, although both
+    // tracks are blank and their headers and directories are the same
+    inline bool CheckTrackIds()
+    {
+        const std::filesystem::path path = TempFile("MouseTrackerChecks.mtrk");
+        const std::filesystem::path journal = path.string() + ".journal";
+        Canvas canvas(Canvas::Format::Bit1);
+        canvas.Resize(300, 200);
+
+        {
+            TrackFile first;
+            if (!canvas.SaveTrack(path) || first.Open(path).has_value())
+                return Report("track ids", false, "writing the first track failed");
+            std::vector<unsigned char> payload;
+            TrackJournal::PutTile(payload, 0, nullptr, 0);
+            if (!TrackJournal::Create(journal, first.Id()) || !TrackJournal::Append(journal, 1, payload))
+                return Report("track ids", false, "writing the journal failed");
+        }
+
+        bool ok = false;
+        {
+            TrackFile second;
+            if (!canvas.SaveTrack(path) || second.Open(path).has_value())
+                return Report("track ids", false, "writing the second track failed");
+            ok = TrackJournal::Replay(journal, second.Id(), [](uint32_t, const unsigned char*, size_t) {}) == 0;
+        }
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        std::filesystem::remove(journal, ec);
+        return Report("track ids", ok, "the journal of the first track was replayed onto the second");
+    }
+}
+
+
+bool RunChecks()
+{
+    bool ok = true;
+    ok &= CheckSpscRing();
+    ok &= CheckCursorCapture();
+#ifdef X11
+    ok &= CheckX11CursorSource();
+#endif
+    ok &= CheckTextureGrid();
+    ok &= CheckTileArena();
+    ok &= CheckLz();
+    ok &= CheckTrackFile();
+    ok &= CheckTrackVersion1();
+    ok &= CheckAutosave();
+    ok &= CheckTrackIds();
+    ok &= CheckAdler32();
+    ok &= CheckPngWriter();
+    ok &= CheckPngReader();
+    ok &= CheckSessionLog();
+    ok &= CheckSessionIndex();
+    for (Canvas::Format format : { Canvas::Format::RGBA8, Canvas::Format::Bit1, Canvas::Format::Gray8 })
+        ok &= CheckMultiMonitorPng(format);
+    return ok;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <filesystem>
+#include <cstdio>
+#include <string>
+
+// Correctness checks of the canvas and the code around it that don't need a
+// window or GL context. Every check prints one line, ok or FAILED with what
+// went wrong. Returns true if all passed.
+bool RunChecks();
+
+
+// Prints the outcome of one check and passes ok through, detail tells what went wrong
+inline bool Report(const char* name, bool ok, const std::string& detail = {})
+{
+    if (ok || detail.empty())
+        std::printf("%-40s %s\n", name, ok ? "ok" : "FAILED");
+    else
+        std::printf("%-40s FAILED: %s\n", name, detail.c_str());
+    return ok;
+}
+
+
+inline std::filesystem::path TempFile(const char* name)
+{
+    return std::filesystem::temp_directory_path() / name;
+}
+
+
+// CodecChecks.cpp
+bool CheckAdler32();
+bool CheckPngWriter();
+bool CheckPngReader();
+
+
+// TrackChecks.cpp
+bool CheckLz();
+bool CheckTrackFile();
+bool CheckTrackVersion1();
+bool CheckAutosave();
+
+
+// SessionChecks.cpp
+bool CheckSessionLog();
+bool CheckSessionIndex();
+
+
+#ifdef X11
+// X11Checks.cpp, Xlib doesn't mix with the canvas headers
+bool CheckX11CursorSource();
+#endif
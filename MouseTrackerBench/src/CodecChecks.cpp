@@ -0,0 +1,464 @@
+#include <algorithm>
+#include <optional>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "stb/stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION // only the checks write with stb
+#include "stb/stb_image_write.h"
+
+#include "PngWriter.h"
+#include "PngReader.h"
+#include "Deflate.h"
+#include "Checks.h"
+#include "Crc32.h"
+
+namespace
+{
+    struct Lcg
+    {
+        uint32_t state;
+
+        inline uint32_t Next(uint32_t range)
+        {
+            state = state * 1664525u + 1013904223u;
+            return (uint32_t)((uint64_t)(state >> 8) * range >> 24);
+        }
+    };
+
+
+    // Packed rows of an image in fmt, noise if random, else bands of flat
+    // runs, gradients, rows repeating a few rows up and sparse dots, the
+    // content deflate finds long and far matches in
+    inline std::vector<unsigned char> TestImage(const PngFormat& fmt, int w, int h, bool random)
+    {
+        const size_t rowBytes = fmt.RowBytes(w);
+        std::vector<unsigned char> pixels(rowBytes * (size_t)h);
+        Lcg lcg{ random ? 0x1B873593u : 0xCC9E2D51u };
+        for (int y = 0; y < h; ++y)
+        {
+            unsigned char* row = &pixels[(size_t)y * rowBytes];
+            for (size_t i = 0; i < rowBytes; ++i)
+            {
+                if (random)
+                {
+                    row[i] = (unsigned char)lcg.Next(256);
+                    continue;
+                }
+                switch (y / 37 % 4)
+                {
+                case 0:  row[i] = (unsigned char)(i / 97 * 41); break;
+                case 1:  row[i] = (unsigned char)(i + (size_t)y); break;
+                case 2:  row[i] = y % 37 < 7 ? (unsigned char)lcg.Next(256) : row[i - rowBytes * 7]; break;
+                default: row[i] = lcg.Next(64) == 0 ? (unsigned char)lcg.Next(256) : 0; break;
+                }
+            }
+        }
+        return pixels;
+    }
+
+
+    // The packed rows scaled to 8 bits per sample, what stbi_load returns in the file's channels
+    inline std::vector<unsigned char> Unpacked(const PngFormat& fmt, int w, int h, const std::vector<unsigned char>& pixels)
+    {
+        if (fmt.bitDepth == 8)
+            return pixels;
+        const size_t rowBytes = fmt.RowBytes(w);
+        const int d = fmt.bitDepth;
+        std::vector<unsigned char> result;
+        for (int y = 0; y < h; ++y)
+            for (size_t x = 0; x < (size_t)w; ++x)
+            {
+                const unsigned v = (unsigned)(pixels[(size_t)y * rowBytes + x * (size_t)d / 8] >> (8 - d - (int)(x * (size_t)d % 8))) & ((1u << d) - 1);
+                result.push_back((unsigned char)(v * (255 / ((1u << d) - 1))));
+            }
+        return result;
+    }
+
+
+    inline uint32_t GetBigU32(const unsigned char* p)
+    {
+        return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+    }
+
+
+    inline std::vector<unsigned char> ReadFile(const std::string& path)
+    {
+        std::vector<unsigned char> data;
+        std::FILE* f = std::fopen(path.c_str(), "rb");
+        if (f == nullptr)
+            return data;
+        unsigned char buffer[64 * 1024];
+        size_t n;
+        while ((n = std::fread(buffer, 1, sizeof(buffer), f)) != 0)
+            data.insert(data.end(), buffer, buffer + n);
+        std::fclose(f);
+        return data;
+    }
+
+
+    // The zlib stream of all IDAT chunks, empty if a chunk fails its crc
+    inline std::vector<unsigned char> ZlibStream(const std::vector<unsigned char>& file)
+    {
+        std::vector<unsigned char> stream;
+        for (size_t p = 8; p + 12 <= file.size();)
+        {
+            const size_t length = GetBigU32(&file[p]);
+            if (p + 12 + length > file.size() || Crc32(&file[p + 8], length, Crc32(&file[p + 4], 4)) != GetBigU32(&file[p + 8 + length]))
+                return {};
+            if (std::memcmp(&file[p + 4], "IDAT", 4) == 0)
+                stream.insert(stream.end(), file.begin() + (std::ptrdiff_t)(p + 8), file.begin() + (std::ptrdiff_t)(p + 8 + length));
+            p += 12 + length;
+        }
+        return stream;
+    }
+
+
+    // Offset of the chunk after the first one of type, the file size if there is none
+    inline size_t ChunkEnd(const std::vector<unsigned char>& file, const char* type, bool last = false)
+    {
+        size_t end = file.size();
+        for (size_t p = 8; p + 12 <= file.size(); p += 12 + GetBigU32(&file[p]))
+        {
+            if (std::memcmp(&file[p + 4], type, 4) != 0)
+                continue;
+            end = p + 12 + GetBigU32(&file[p]);
+            if (!last)
+                break;
+        }
+        return end;
+    }
+
+
+    inline void AppendChunk(std::vector<unsigned char>& file, const char* type, const std::vector<unsigned char>& data)
+    {
+        Png::PutU32(file, (uint32_t)data.size());
+        file.insert(file.end(), type, type + 4);
+        file.insert(file.end(), data.begin(), data.end());
+        Png::PutU32(file, Crc32(data.data(), data.size(), Crc32(type, 4)));
+    }
+
+
+    // A PNG of packed rows without filters, in one IDAT after the given chunks, for
+    // the color types and headers WritePng and stb_image_write don't produce
+    inline std::vector<unsigned char> RawPng(int w, int h, const PngFormat& fmt, bool interlaced, const std::vector<std::pair<const char*, std::vector<unsigned char>>>& chunks, const std::vector<unsigned char>& pixels)
+    {
+        const size_t rowBytes = fmt.RowBytes(w);
+        std::vector<unsigned char> filtered;
+        for (int y = 0; y < h; ++y)
+        {
+            filtered.push_back(0);
+            filtered.insert(filtered.end(), pixels.begin() + (std::ptrdiff_t)((size_t)y * rowBytes), pixels.begin() + (std::ptrdiff_t)((size_t)(y + 1) * rowBytes));
+        }
+        std::vector<unsigned char> zlib;
+        Png::PutZlibHeader(zlib, 6);
+        Deflate::Encoder(6).Compress(filtered.data(), 0, filtered.size(), true, zlib);
+        Png::PutU32(zlib, Deflate::Adler32(filtered.data(), filtered.size()));
+
+        std::vector<unsigned char> ihdr;
+        Png::PutU32(ihdr, (uint32_t)w);
+        Png::PutU32(ihdr, (uint32_t)h);
+        ihdr.insert(ihdr.end(), { (unsigned char)fmt.bitDepth, (unsigned char)fmt.color, 0, 0, (unsigned char)interlaced });
+        std::vector<unsigned char> file = { 137, 80, 78, 71, 13, 10, 26, 10 };
+        AppendChunk(file, "IHDR", ihdr);
+        for (const auto& [type, data] : chunks)
+            AppendChunk(file, type, data);
+        AppendChunk(file, "IDAT", zlib);
+        AppendChunk(file, "IEND", {});
+        return file;
+    }
+
+
+    inline bool WriteFile(const std::string& path, const std::vector<unsigned char>& data)
+    {
+        std::FILE* f = std::fopen(path.c_str(), "wb");
+        if (f == nullptr)
+            return false;
+        const bool ok = std::fwrite(data.data(), 1, data.size(), f) == data.size();
+        return std::fclose(f) == 0 && ok;
+    }
+
+
+    // The rows PngReader decodes in channels, the error if Open() or ReadRows() fails
+    inline std::optional<std::string> ReaderPixels(const std::string& path, int channels, std::vector<unsigned char>& pixels)
+    {
+        PngReader png;
+        pixels.clear();
+        if (!png.Open(path.c_str()))
+            return std::string("Open() failed");
+        int next = 0;
+        std::optional<std::string> error = png.ReadRows(channels, [&](int y, const unsigned char* row)
+        {
+            next += y == next ? 1 : png.Height(); // out of order shows as too many rows
+            pixels.insert(pixels.end(), row, row + (size_t)png.Width() * (size_t)channels);
+        });
+        if (!error.has_value() && next != png.Height())
+            error = std::to_string(next) + " rows delivered";
+        return error;
+    }
+
+
+    // PngReader against stbi_load in 1, 2 and 4 channels, the failure if they
+    // differ. Then the file with a bad crc on its last IDAT has to fail, the
+    // inflater may have read all of it before it gets to the crc.
+    inline std::optional<std::string> SameAsStb(const std::string& path)
+    {
+        for (int channels : { 1, 2, 4 })
+        {
+            std::vector<unsigned char> pixels;
+            const std::optional<std::string> error = ReaderPixels(path, channels, pixels);
+            if (error.has_value())
+                return error.value() + " in " + std::to_string(channels) + " channels";
+            int width, height, cmp;
+            unsigned char* data = stbi_load(path.c_str(), &width, &height, &cmp, channels);
+            const bool same = data != NULL && pixels.size() == (size_t)width * (size_t)height * (size_t)channels && std::memcmp(data, pixels.data(), pixels.size()) == 0;
+            stbi_image_free(data);
+            if (!same)
+                return "the pixels in " + std::to_string(channels) + " channels differ from stbi_load";
+        }
+
+        std::vector<unsigned char> file = ReadFile(path);
+        file[ChunkEnd(file, "IDAT", true) - 1] ^= 1;
+        std::vector<unsigned char> pixels;
+        if (!WriteFile(path, file) || !ReaderPixels(path, 4, pixels).has_value())
+            return std::string("a bad crc of the last IDAT was accepted");
+        return std::nullopt;
+    }
+}
+
+
+// Adler32 against the textbook loop at the lengths its 16 byte steps and
+// modulo runs switch at, then the checksums of random splits combined
+bool CheckAdler32()
+{
+    Lcg lcg{ 0x85EBCA6Bu };
+    std::vector<unsigned char> data(300000);
+    for (unsigned char& c : data)
+        c = (unsigned char)(lcg.Next(8) == 0 ? 255 : lcg.Next(256));
+
+    for (size_t size : { (size_t)0, (size_t)1, (size_t)15, (size_t)16, (size_t)17, (size_t)5552, (size_t)5553, (size_t)65521, data.size() })
+    {
+        uint32_t a = 1, b = 0;
+        for (size_t i = 0; i < size; ++i)
+        {
+            a = (a + data[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        if (Deflate::Adler32(data.data(), size) != (b << 16 | a))
+            return Report("adler32", false, "wrong checksum of " + std::to_string(size) + " bytes");
+    }
+
+    // empty pieces and pieces longer than the modulus included
+    const uint32_t whole = Deflate::Adler32(data.data(), data.size());
+    for (int round = 0; round < 100; ++round)
+    {
+        std::vector<size_t> cuts = { 0, data.size() };
+        for (uint32_t i = lcg.Next(8); i != 0; --i)
+            cuts.push_back(round % 2 == 0 ? lcg.Next((uint32_t)data.size()) : cuts[lcg.Next((uint32_t)cuts.size())]);
+        std::sort(cuts.begin(), cuts.end());
+        uint32_t combined = Deflate::Adler32(data.data(), cuts[1]);
+        for (size_t i = 1; i + 1 < cuts.size(); ++i)
+            combined = Deflate::Adler32Combine(combined, Deflate::Adler32(data.data() + cuts[i], cuts[i + 1] - cuts[i]), cuts[i + 1] - cuts[i]);
+        if (combined != whole)
+            return Report("adler32", false, "combined checksum of " + std::to_string(cuts.size() - 1) + " pieces differs");
+    }
+    return Report("adler32", true);
+}
+
+
+// Noise and structured images of a few strips, written at every deflate level
+// on 1 to 4 threads and read back with stb_image. The pixels have to come back
+// as written, the file may not depend on the thread count and the adler at the
+// end of the zlib stream (which stb_image doesn't check) has to be the one of
+// the inflated data. Then every other color type and bit depth at level 6.
+bool CheckPngWriter()
+{
+    const std::string path = TempFile("MouseTrackerChecks.png").string();
+    const PngFormat formats[] = {
+        { PngColor::RGBA, 8, -1 }, { PngColor::RGB, 8, -1 }, { PngColor::GrayAlpha, 8, -1 },
+        { PngColor::Gray, 8, -1 }, { PngColor::Gray, 4, -1 }, { PngColor::Gray, 2, -1 }, { PngColor::Gray, 1, -1 }
+    };
+    for (const PngFormat& fmt : formats)
+    {
+        const int w = 613;
+        const int h = (int)(Png::StripBytes * 5 / 2 / (fmt.RowBytes(w) + 1)) + 1;
+        for (int level = 0; level <= Deflate::MaxLevel; ++level)
+        {
+            if (fmt.color != PngColor::RGBA && level != 6)
+                continue;
+            for (bool random : { true, false })
+            {
+                const std::string name = "png writer " + std::to_string(fmt.Channels()) + "x" + std::to_string(fmt.bitDepth) + " bit level " + std::to_string(level) + (random ? " noise" : " structured");
+                const std::vector<unsigned char> pixels = TestImage(fmt, w, h, random);
+                const std::vector<unsigned char> expected = Unpacked(fmt, w, h, pixels);
+                const size_t rowBytes = fmt.RowBytes(w);
+                std::vector<unsigned char> first;
+                for (unsigned threads = 1; threads <= 4; ++threads)
+                {
+                    const auto fill = [&](int y, unsigned char* row) { std::memcpy(row, &pixels[(size_t)y * rowBytes], rowBytes); };
+                    if (!WritePng(path.c_str(), w, h, fmt, fill, { level, threads }))
+                        return Report(name.c_str(), false, "writing failed");
+
+                    const std::vector<unsigned char> file = ReadFile(path);
+                    if (threads == 1)
+                        first = file;
+                    else if (file != first)
+                        return Report(name.c_str(), false, "the file differs on " + std::to_string(threads) + " threads");
+
+                    int width, height, cmp;
+                    unsigned char* data = stbi_load(path.c_str(), &width, &height, &cmp, 0);
+                    const bool same = data != NULL && width == w && height == h && cmp == fmt.Channels() && std::memcmp(data, expected.data(), expected.size()) == 0;
+                    stbi_image_free(data);
+                    if (!same)
+                        return Report(name.c_str(), false, "decoded pixels differ on " + std::to_string(threads) + " threads");
+
+                    const std::vector<unsigned char> stream = ZlibStream(file);
+                    int size = 0;
+                    char* filtered = stream.size() < 6 ? NULL : stbi_zlib_decode_malloc((const char*)stream.data(), (int)stream.size(), &size);
+                    const bool adler = filtered != NULL && (size_t)size == (rowBytes + 1) * (size_t)h && Deflate::Adler32((const unsigned char*)filtered, (size_t)size) == GetBigU32(&stream[stream.size() - 4]);
+                    stbi_image_free(filtered);
+                    if (!adler)
+                        return Report(name.c_str(), false, stream.empty() ? "a chunk fails its crc" : "the adler of the zlib stream is wrong");
+                }
+            }
+        }
+    }
+    std::remove(path.c_str());
+    return Report("png writer", true);
+}
+
+
+// PngReader against stbi_load on PNGs of stb_image_write with every filter
+// type, WritePng's gray with a transparent level and palette and 16 bit
+// images. Then damaged files: a bad crc, a palette of more than 256
+// entries or of 16 bits and interlaced data are rejected, a file cut short
+// anywhere in the image data and flipped bytes in the deflate stream (with
+// a valid crc) return an error or the original pixels.
+bool CheckPngReader()
+{
+    const std::string path = TempFile("MouseTrackerChecks.png").string();
+    const int w = 257, h = 131;
+    for (int filter = -1; filter <= 4; ++filter)
+        for (int channels = 1; channels <= 4; ++channels)
+        {
+            const std::string name = "png reader stb " + std::to_string(channels) + " channels filter " + std::to_string(filter);
+            const std::vector<unsigned char> pixels = TestImage({ PngColor::RGBA, 8, -1 }, w * channels / 4 + 1, h, filter % 2 == 0);
+            stbi_write_force_png_filter = filter;
+            stbi_write_png_compression_level = filter < 0 ? 1 : 8;
+            const bool written = stbi_write_png(path.c_str(), w, h, channels, pixels.data(), w * channels) != 0;
+            const std::optional<std::string> failure = written ? SameAsStb(path) : "writing failed";
+            if (failure.has_value())
+                return Report(name.c_str(), false, failure.value());
+        }
+
+    for (int depth : { 1, 2, 4, 8 })
+    {
+        const PngFormat fmt = { PngColor::Gray, depth, 1 };
+        const std::vector<unsigned char> pixels = TestImage(fmt, w, h, depth != 8);
+        const std::string name = "png reader gray " + std::to_string(depth) + " bit";
+        const auto fill = [&](int y, unsigned char* row) { std::memcpy(row, &pixels[(size_t)y * fmt.RowBytes(w)], fmt.RowBytes(w)); };
+        const std::optional<std::string> failure = WritePng(path.c_str(), w, h, fmt, fill) ? SameAsStb(path) : "writing failed";
+        if (failure.has_value())
+            return Report(name.c_str(), false, failure.value());
+    }
+
+    std::vector<unsigned char> palette, alpha;
+    for (int i = 0; i < 256; ++i)
+    {
+        palette.insert(palette.end(), { (unsigned char)(i * 7), (unsigned char)(255 - i), (unsigned char)(i * i) });
+        alpha.push_back((unsigned char)(i < 100 ? i * 2 : 255));
+    }
+    std::vector<std::pair<std::string, std::vector<unsigned char>>> files;
+    for (int depth : { 1, 2, 4, 8 })
+        files.push_back({ "png reader palette " + std::to_string(depth) + " bit", RawPng(w, h, { PngColor::Palette, depth, -1 }, false, { { "PLTE", palette }, { "tRNS", alpha } }, TestImage({ PngColor::Palette, depth, -1 }, w, h, true)) });
+    for (PngColor color : { PngColor::Gray, PngColor::GrayAlpha, PngColor::RGB, PngColor::RGBA })
+    {
+        const PngFormat fmt = { color, 16, -1 };
+        const std::vector<unsigned char> pixels = TestImage(fmt, w, h, false);
+        std::vector<std::pair<const char*, std::vector<unsigned char>>> chunks;
+        if (color == PngColor::Gray || color == PngColor::RGB)
+            chunks.push_back({ "tRNS", std::vector<unsigned char>(pixels.begin(), pixels.begin() + fmt.Channels() * 2) }); // the first pixel is transparent
+        files.push_back({ "png reader " + std::to_string(fmt.Channels()) + "x16 bit", RawPng(w, h, fmt, false, chunks, pixels) });
+    }
+    for (const auto& [name, file] : files)
+    {
+        const std::optional<std::string> failure = WriteFile(path, file) ? SameAsStb(path) : "writing failed";
+        if (failure.has_value())
+            return Report(name.c_str(), false, failure.value());
+    }
+
+    // rejected up front, crcs are checked before the data is used
+    const PngFormat indexed = { PngColor::Palette, 8, -1 };
+    const std::vector<unsigned char> indices = TestImage(indexed, w, h, true);
+    std::vector<unsigned char> longPalette = palette;
+    longPalette.resize(300 * 3);
+    std::vector<unsigned char> badIhdr = files[3].second;
+    badIhdr[8 + 8 + 3] ^= 1;
+    std::vector<unsigned char> badPlte = files[3].second;
+    badPlte[ChunkEnd(badPlte, "PLTE") - 1] ^= 1;
+    const std::pair<const char*, std::vector<unsigned char>> rejected[] = {
+        { "palette of 300 entries", RawPng(w, h, indexed, false, { { "PLTE", longPalette } }, indices) },
+        { "16 bit palette", RawPng(w, h / 2, { PngColor::Palette, 16, -1 }, false, { { "PLTE", palette } }, indices) },
+        { "bad IHDR crc", badIhdr },
+        { "bad PLTE crc", badPlte }
+    };
+    std::vector<unsigned char> decoded;
+    for (const auto& [what, file] : rejected)
+    {
+        PngReader png;
+        if (!WriteFile(path, file) || png.Open(path.c_str()))
+            return Report("png reader rejects", false, std::string("a ") + what + " was accepted");
+    }
+    {
+        PngReader png;
+        bool rows = false;
+        if (!WriteFile(path, RawPng(w, h, indexed, true, { { "PLTE", palette } }, indices)) || !png.Open(path.c_str()) || !png.Interlaced()
+            || !png.ReadRows(4, [&](int, const unsigned char*) { rows = true; }).has_value() || rows)
+            return Report("png reader rejects", false, "an interlaced image was streamed");
+    }
+
+    // a multi strip file of WritePng, damaged
+    const PngFormat rgba = { PngColor::RGBA, 8, -1 };
+    const int tall = (int)(Png::StripBytes * 5 / 2 / rgba.RowBytes(w)) + 1;
+    const std::vector<unsigned char> pixels = TestImage(rgba, w, tall, false);
+    const auto fill = [&](int y, unsigned char* row) { std::memcpy(row, &pixels[(size_t)y * rgba.RowBytes(w)], rgba.RowBytes(w)); };
+    std::vector<unsigned char> expected;
+    if (!WritePng(path.c_str(), w, tall, rgba, fill) || ReaderPixels(path, 4, expected).has_value() || expected != pixels)
+        return Report("png reader damaged", false, "the intact file doesn't decode");
+    const std::vector<unsigned char> intact = ReadFile(path);
+    const size_t dataEnd = ChunkEnd(intact, "IDAT", true);
+    for (bool last : { false, true })
+    {
+        std::vector<unsigned char> file = intact;
+        file[ChunkEnd(file, "IDAT", last) - 2] ^= 0x10;
+        if (!WriteFile(path, file) || !ReaderPixels(path, 4, decoded).has_value())
+            return Report("png reader damaged", false, std::string("a bad crc of the ") + (last ? "last" : "first") + " IDAT was accepted");
+    }
+    for (size_t cut = 33; cut < intact.size(); cut += intact.size() / 97)
+    {
+        const std::optional<std::string> error = WriteFile(path, std::vector<unsigned char>(intact.begin(), intact.begin() + (std::ptrdiff_t)cut)) ? ReaderPixels(path, 4, decoded) : "writing failed";
+        if (error.has_value() ? cut >= dataEnd : cut < dataEnd || decoded != pixels)
+            return Report("png reader damaged", false, "cut after " + std::to_string(cut) + " of " + std::to_string(intact.size()) + " bytes: " + error.value_or("wrong pixels"));
+    }
+    Lcg lcg{ 0x27D4EB2Fu };
+    for (int flip = 0; flip < 300; ++flip)
+    {
+        // chunk by chunk to a random IDAT, where a random byte is damaged and the crc fixed
+        std::vector<unsigned char> file = intact;
+        size_t p = 8;
+        while (std::memcmp(&file[p + 4], "IDAT", 4) != 0 || (lcg.Next(3) != 0 && ChunkEnd(file, "IDAT", true) != p + 12 + GetBigU32(&file[p])))
+            p += 12 + GetBigU32(&file[p]);
+        const size_t length = GetBigU32(&file[p]);
+        file[p + 8 + lcg.Next((uint32_t)length)] ^= (unsigned char)(1 + lcg.Next(255));
+        file.erase(file.begin() + (std::ptrdiff_t)(p + 8 + length), file.begin() + (std::ptrdiff_t)(p + 12 + length));
+        const uint32_t crc = Crc32(&file[p + 4], length + 4);
+        file.insert(file.begin() + (std::ptrdiff_t)(p + 8 + length), { (unsigned char)(crc >> 24), (unsigned char)(crc >> 16), (unsigned char)(crc >> 8), (unsigned char)crc });
+        if (!WriteFile(path, file) || (!ReaderPixels(path, 4, decoded).has_value() && decoded != pixels))
+            return Report("png reader damaged", false, "flipped image data decoded to wrong pixels");
+    }
+    std::remove(path.c_str());
+    return Report("png reader", true);
+}
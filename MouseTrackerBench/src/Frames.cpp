@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <vector>
+
+#include "StrokeCanvas.h"
+#include "TextureGrid.h"
+#include "FrameStats.h"
+#include "Benchmarks.h"
+#include "SpscRing.h"
+#include "Pyramid.h"
+#include "Sample.h"
+#include "Brush.h"
+#include "Rect.h"
+
+namespace
+{
+    constexpr size_t SamplesPerFrame = 17; // 1 kHz capture at 60 fps
+    constexpr size_t Frames = 512;         // as many as FrameStats keeps
+
+
+    // CPU time of the frames of Image: draining the cursor samples, drawing
+    // them and expanding the textures to RGBA for the upload, either the
+    // whole image (before) or only the dirty rects (after)
+    inline FrameStats TimeFrames(const BenchOptions& opt, const std::vector<Sample>& samples, bool whole)
+    {
+        StrokeCanvas strokes(opt.format);
+        strokes.Resize(opt.width, opt.height);
+        TextureGrid grid;
+        grid.Layout(opt.width, opt.height, 0, TextureGrid::CellSize(0, 16384, opt.width, opt.height));
+        Pyramid pyramid;
+        SpscRing<Sample> ring(SamplesPerFrame * 4);
+        const Brush brush(BrushShape::Disc, 2);
+        std::vector<Sample> batch(ring.Capacity());
+        std::vector<unsigned char> band;
+        FrameStats stats;
+
+        for (size_t frame = 0; frame < Frames; ++frame)
+        {
+            // the capture thread's share of the frame, not timed
+            for (size_t i = frame * SamplesPerFrame; i < std::min((frame + 1) * SamplesPerFrame, samples.size()); ++i)
+                ring.Push(samples[i]);
+
+            const auto start = std::chrono::steady_clock::now();
+            const size_t count = ring.PopBatch(batch.data(), batch.size());
+            strokes.DrawStroke(batch.data(), count, 0, 0, brush, [&](const Rect& area) { grid.MarkDirty(area); });
+            if (whole)
+                grid.MarkAllDirty();
+            for (TextureGrid::Cell& cell : grid.Cells())
+            {
+                const Rect dirty = cell.dirty;
+                cell.dirty = Rect();
+                if (dirty.Empty())
+                    continue;
+                const size_t rowBytes = (size_t)dirty.Width() * TileFormats::Channel;
+                band.resize(rowBytes);
+                for (int y = dirty.y0; y < dirty.y1; ++y)
+                    pyramid.ExpandRow(strokes.GetCanvas(), 0, y, dirty.x0, dirty.x1, band.data());
+            }
+            stats.Add(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        return stats;
+    }
+}
+
+
+void BenchFrames(const BenchOptions& opt)
+{
+    const int sizes[][2] = { { 1920, 1080 }, { 11520, 2160 } };
+    std::printf("frames: %zu of %zu samples (disc brush, radius 2), CPU time per frame in ms\n", Frames, SamplesPerFrame);
+    std::printf("canvas       whole image p50    p99  dirty rects p50    p99\n");
+    for (const auto& size : sizes)
+    {
+        BenchOptions sized = opt;
+        sized.width = size[0];
+        sized.height = size[1];
+        sized.stamps = Frames * SamplesPerFrame;
+        const std::vector<Sample> samples = Walk(sized);
+        const FrameStats before = TimeFrames(sized, samples, true);
+        const FrameStats after = TimeFrames(sized, samples, false);
+        std::printf("%5dx%-5d %18.3f %6.3f %16.3f %6.3f\n", sized.width, sized.height, before.Percentile(0.5f), before.Percentile(0.99f), after.Percentile(0.5f), after.Percentile(0.99f));
+    }
+}
@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <cstdio>
+#include <vector>
+#include <chrono>
+
+#include "Benchmarks.h"
+#include "TileFormat.h"
+#include "Canvas.h"
+
+namespace
+{
+    // A cursor wandering in steps of up to 3 pixels, now and then slightly past the edges
+    inline std::vector<std::pair<int, int>> Visits(const BenchOptions& opt)
+    {
+        std::vector<std::pair<int, int>> visits(opt.stamps * 10);
+        uint32_t state = 0x1B873593u;
+        int x = opt.width / 2;
+        int y = opt.height / 2;
+        for (std::pair<int, int>& v : visits)
+        {
+            state = state * 1664525u + 1013904223u;
+            x = std::clamp(x + (int)(state >> 29) - 3, -2, opt.width + 1);
+            y = std::clamp(y + (int)(state >> 26 & 7) - 3, -2, opt.height + 1);
+            v = { x, y };
+        }
+        return visits;
+    }
+
+
+    // Counts of a flat width x height buffer, every other pixel at random is saturated
+    inline std::vector<uint16_t> HalfSaturated(const BenchOptions& opt)
+    {
+        std::vector<uint16_t> counts((size_t)opt.width * (size_t)opt.height);
+        uint32_t state = 0x85EBCA6Bu;
+        for (uint16_t& c : counts)
+        {
+            state = state * 1664525u + 1013904223u;
+            c = (state >> 31) != 0 ? 65535 : (uint16_t)(state >> 20 & 0xFF);
+        }
+        return counts;
+    }
+
+
+    // Million visits per second of visit(x, y)
+    template <class VisitFn>
+    inline double Measure(const std::vector<std::pair<int, int>>& visits, VisitFn&& visit)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (const std::pair<int, int>& v : visits)
+            visit(v.first, v.second);
+        return (double)visits.size() / Seconds(start) / 1e6;
+    }
+}
+
+
+void BenchIncrement(const BenchOptions& opt)
+{
+    const std::vector<std::pair<int, int>> visits = Visits(opt);
+    const int width = opt.width;
+    const int height = opt.height;
+    const auto index = [&](int x, int y) { return x < 0 || y < 0 || x >= width || y >= height ? -1 : width * y + x; };
+    std::printf("canvas: %dx%d visits: %zu, million visits/s\n", width, height, visits.size());
+    std::printf("counts          SetDataAtIndex  branchy count  branch free  heatmap canvas\n");
+    for (int saturated = 0; saturated < 2; ++saturated)
+    {
+        // the old path: a bounds checked index into the RGBA image, the pixel turns black
+        std::vector<unsigned char> rgba((size_t)width * (size_t)height * Canvas::Channel, 255);
+        const double setData = Measure(visits, [&](int x, int y)
+        {
+            const int i = index(x, y);
+            if (i != -1)
+            {
+                unsigned char* p = &rgba[(size_t)i * Canvas::Channel];
+                p[0] = 0;
+                p[1] = 0;
+                p[2] = 0;
+            }
+        });
+
+        std::vector<uint16_t> counts = saturated != 0 ? HalfSaturated(opt) : std::vector<uint16_t>((size_t)width * (size_t)height);
+        uint16_t maxCount = 0;
+        const double branchy = Measure(visits, [&](int x, int y)
+        {
+            const int i = index(x, y);
+            if (i == -1)
+                return;
+            uint16_t& c = counts[(size_t)i];
+            if (c != 65535)
+                ++c;
+            if (c > maxCount)
+                maxCount = c;
+        });
+
+        counts = saturated != 0 ? HalfSaturated(opt) : std::vector<uint16_t>((size_t)width * (size_t)height);
+        maxCount = 0;
+        const double branchFree = Measure(visits, [&](int x, int y)
+        {
+            const int i = index(x, y);
+            if (i != -1)
+                TileFormats::Count16::Increment(counts[(size_t)i], maxCount);
+        });
+
+        // the tiled canvas can't be preset, its counts start at zero in both rows
+        Canvas canvas(Canvas::Format::Count16);
+        canvas.Resize(width, height);
+        const auto start = std::chrono::steady_clock::now();
+        canvas.Paint([&](auto&& plot)
+        {
+            for (const std::pair<int, int>& v : visits)
+                if (v.first >= 0 && v.second >= 0 && v.first < width && v.second < height)
+                    plot(v.first, v.second);
+        });
+        const double tiled = (double)visits.size() / Seconds(start) / 1e6;
+
+        std::printf("%-15s %14.1f %14.1f %12.1f %15.1f\n", saturated != 0 ? "half saturated" : "zero", setData, branchy, branchFree, tiled);
+    }
+}
@@ -0,0 +1,84 @@
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#ifdef WINDOWS
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "StrokeCanvas.h"
+#include "Benchmarks.h"
+#include "Sample.h"
+#include "Brush.h"
+
+namespace
+{
+    // Resident memory of the process in bytes, 0 if the OS doesn't tell
+    inline size_t ResidentBytes()
+    {
+#ifdef WINDOWS
+        PROCESS_MEMORY_COUNTERS counters;
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return 0;
+        return counters.WorkingSetSize;
+#else
+        std::FILE* file = std::fopen("/proc/self/statm", "r");
+        if (file == nullptr)
+            return 0;
+        unsigned long long pages = 0;
+        unsigned long long resident = 0;
+        const bool ok = std::fscanf(file, "%llu %llu", &pages, &resident) == 2;
+        std::fclose(file);
+        return ok ? (size_t)resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+#endif
+    }
+
+
+    inline double Megabytes(size_t after, size_t before)
+    {
+        return after > before ? (double)(after - before) / (1024.0 * 1024.0) : 0.0;
+    }
+}
+
+
+void BenchMemory(const BenchOptions& opt)
+{
+    const int layouts[][2] = { { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 }, { 11520, 2160 } };
+    const Brush brush(BrushShape::Disc, 2);
+    std::printf("samples: %zu (disc brush, radius 2), resident memory the canvas adds in MB\n", opt.stamps);
+    std::printf("canvas      old rgba  format    blank  drawn  computed\n");
+    for (const auto& layout : layouts)
+    {
+        BenchOptions sized = opt;
+        sized.width = layout[0];
+        sized.height = layout[1];
+        const std::vector<Sample> samples = Walk(sized);
+
+        // the image before tiled canvases: one white RGBA buffer, written once
+        size_t before = ResidentBytes();
+        double old = 0.0;
+        {
+            const std::vector<unsigned char> pixels((size_t)sized.width * (size_t)sized.height * 4, 255);
+            old = Megabytes(ResidentBytes(), before);
+        }
+
+        for (int f = 0; f < 4; ++f)
+        {
+            before = ResidentBytes();
+            StrokeCanvas strokes((Canvas::Format)f);
+            strokes.Resize(sized.width, sized.height);
+            const double blank = Megabytes(ResidentBytes(), before);
+            strokes.DrawStroke(samples.data(), samples.size(), 0, 0, brush);
+            const double drawn = Megabytes(ResidentBytes(), before);
+            const double computed = (double)strokes.GetCanvas().MemoryUsage() / (1024.0 * 1024.0);
+            if (f == 0)
+                std::printf("%5dx%-5d %8.1f", sized.width, sized.height, old);
+            else
+                std::printf("%20s", "");
+            std::printf("  %-8s %6.1f %6.1f %9.1f\n", FormatNames[f], blank, drawn, computed);
+        }
+    }
+}
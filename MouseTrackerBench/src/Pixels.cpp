@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <chrono>
+
+#include "Benchmarks.h"
+#include "Pixels.h"
+
+namespace
+{
+    volatile bool Sink; // keeps the results from being optimized away
+
+
+    // The old Image::AlphaIsNeeded() followed by Image::RemoveGBAFromData()
+    inline bool TwoPass(const unsigned char* rgba, size_t pixels, unsigned char* gray)
+    {
+        for (size_t i = 3; i < pixels * 4; i += 4)
+            if (rgba[i] == 0)
+                return false;
+        for (size_t i = 0; i < pixels; ++i)
+            gray[i] = static_cast<unsigned char>((rgba[i * 4] + rgba[i * 4 + 1] + rgba[i * 4 + 2]) / 3);
+        return true;
+    }
+
+
+    // GB/s of RGBA pixels, the best of a few runs of kernel(rgba, pixels, gray)
+    template <class Kernel>
+    inline double Measure(const std::vector<unsigned char>& rgba, std::vector<unsigned char>& gray, Kernel&& kernel)
+    {
+        double best = 0.0;
+        for (int run = 0; run < 5; ++run)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            Sink = kernel(rgba.data(), gray.size(), gray.data());
+            best = std::max(best, (double)rgba.size() / Seconds(start) / 1e9);
+        }
+        return best;
+    }
+}
+
+
+void BenchPixels(const BenchOptions&)
+{
+    const int sizes[][2] = { { 1920, 1080 }, { 3840, 2160 }, { 11520, 2160 } };
+    const char* const isa[] = { "scalar", "sse2", "avx2" };
+    std::printf("runtime pick: %s, GB/s of RGBA pixels turned into gray\n", isa[(int)Pixels::Detect()]);
+    std::printf("canvas       two pass   scalar     sse2     avx2  runtime  transparent at 10%%\n");
+    for (const auto& size : sizes)
+    {
+        const size_t pixels = (size_t)size[0] * (size_t)size[1];
+        std::vector<unsigned char> rgba(pixels * 4);
+        uint32_t state = 0x27D4EB2Fu;
+        for (size_t i = 0; i < pixels; ++i)
+        {
+            state = state * 1664525u + 1013904223u;
+            rgba[i * 4] = (unsigned char)(state >> 24);
+            rgba[i * 4 + 1] = (unsigned char)(state >> 16);
+            rgba[i * 4 + 2] = (unsigned char)(state >> 8);
+            rgba[i * 4 + 3] = 255;
+        }
+
+        std::vector<unsigned char> reference(pixels);
+        std::vector<unsigned char> gray(pixels);
+        const double twoPass = Measure(rgba, reference, TwoPass);
+        bool same = true;
+        const auto check = [&]() { same &= gray == reference; std::fill(gray.begin(), gray.end(), 0); };
+        const double scalar = Measure(rgba, gray, Pixels::Scalar::GrayIfOpaque);
+        check();
+#if PIXELS_X86
+        const double sse2 = Measure(rgba, gray, Pixels::Sse2::GrayIfOpaque);
+        check();
+        const double avx2 = Pixels::HasAvx2() ? Measure(rgba, gray, Pixels::Avx2::GrayIfOpaque) : 0.0;
+        if (Pixels::HasAvx2())
+            check();
+#else
+        const double sse2 = 0.0;
+        const double avx2 = 0.0;
+#endif
+        const double runtime = Measure(rgba, gray, Pixels::GrayIfOpaque);
+        check();
+
+        // the fused pass stops at the first transparent pixel
+        rgba[pixels / 10 * 4 + 3] = 0;
+        const double early = Measure(rgba, gray, Pixels::GrayIfOpaque);
+
+        std::printf("%5dx%-5d %9.2f %8.2f %8.2f %8.2f %8.2f %19.2f%s\n", size[0], size[1], twoPass, scalar, sse2, avx2, runtime, early, same ? "" : " (gray differs)");
+    }
+}
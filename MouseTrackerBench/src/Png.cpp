@@ -0,0 +1,64 @@
+#include <system_error>
+#include <filesystem>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "StrokeCanvas.h"
+#include "Benchmarks.h"
+#include "PngWriter.h"
+#include "Canvas.h"
+#include "Sample.h"
+#include "Brush.h"
+#include "Log.h"
+
+void BenchPng(const BenchOptions& opt)
+{
+    const int sizes[][2] = { { 3840, 2160 }, { 7680, 4320 } };
+    const unsigned threads[] = { 1, 2, 4, 8, 16 };
+    const int levels[] = { 1, 6 };
+    const std::string png = (std::filesystem::temp_directory_path() / "MouseTrackerBench.png").string();
+    const Brush brush(BrushShape::Disc, 2);
+
+    std::printf("format: %s samples: %zu (disc brush, radius 2), MB/s of RGBA pixels\n", FormatNames[(int)opt.format], opt.stamps);
+    std::printf("canvas     level  size KB        1        2        4        8       16 threads\n");
+    for (const auto& size : sizes)
+    {
+        BenchOptions sized = opt;
+        sized.width = size[0];
+        sized.height = size[1];
+        const std::vector<Sample> samples = Walk(sized);
+        StrokeCanvas strokes(opt.format);
+        strokes.Resize(sized.width, sized.height);
+        strokes.DrawStroke(samples.data(), samples.size(), 0, 0, brush);
+        const Canvas& canvas = strokes.GetCanvas();
+        const double megabytes = (double)sized.width * (double)sized.height * Canvas::Channel / 1e6;
+
+        for (int level : levels)
+        {
+            std::printf("%5dx%-5d %4d", sized.width, sized.height, level);
+            for (unsigned t : threads)
+            {
+                const auto start = std::chrono::steady_clock::now();
+                const bool saved = canvas.SaveToFile(png.c_str(), { level, t });
+                const double seconds = Seconds(start);
+                if (!saved)
+                {
+                    Err << "Failed to save [" << png << "]" << std::endl;
+                    return;
+                }
+                if (t == threads[0])
+                {
+                    std::error_code ec;
+                    std::printf(" %8ju", std::filesystem::file_size(png, ec) / 1024);
+                }
+                std::printf(" %8.1f", megabytes / seconds);
+            }
+            std::printf("\n");
+        }
+    }
+    std::filesystem::remove(png);
+}
@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <chrono>
+
+#include "StrokeCanvas.h"
+#include "Benchmarks.h"
+#include "Rasterizer.h"
+#include "Sample.h"
+#include "Brush.h"
+
+namespace
+{
+    volatile uint64_t Sink; // keeps the plotted pixels from being optimized away
+
+    // Jumps to random points up to an eighth of the size past the edges, so
+    // segments are long and clipping is part of it
+    inline std::vector<Sample> Jumps(size_t count, int width, int height)
+    {
+        std::vector<Sample> samples(count);
+        uint32_t state = 0x6C078965u;
+        const auto next = [&](int range)
+        {
+            state = state * 1664525u + 1013904223u;
+            return (int)((uint64_t)(state >> 8) * (uint64_t)range >> 24);
+        };
+        for (size_t i = 0; i < count; ++i)
+            samples[i] = { (int64_t)i * 1000, next(width * 5 / 4) - width / 8, next(height * 5 / 4) - height / 8 };
+        return samples;
+    }
+}
+
+
+void BenchRaster(const BenchOptions& opt)
+{
+    const int sizes[][2] = { { 1920, 1080 }, { 7680, 4320 } };
+    const size_t segments = std::max<size_t>(opt.stamps / 20, 1);
+    std::printf("format: %s segments: %zu (radius 0), million pixels/s\n", FormatNames[(int)opt.format], segments);
+    std::printf("canvas      pixels/segment  per pixel clip  segment clip      stroke\n");
+    for (const auto& size : sizes)
+    {
+        const int width = size[0];
+        const int height = size[1];
+        const std::vector<Sample> samples = Jumps(segments + 1, width, height);
+
+        // every pixel of the unclipped line is checked against the canvas, the way SetPixel/GetIndex did it
+        uint64_t sum = 0;
+        size_t pixels = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 1; i < samples.size(); ++i)
+        {
+            RasterizeLine(samples[i - 1].x, samples[i - 1].y, samples[i].x, samples[i].y, [&](int x, int y)
+            {
+                if (x >= 0 && y >= 0 && x < width && y < height)
+                {
+                    sum += (uint64_t)y * (uint64_t)width + (uint64_t)x;
+                    ++pixels;
+                }
+            });
+        }
+        const double perPixel = (double)pixels / Seconds(start) / 1e6;
+
+        Sink = sum;
+
+        // clipped once per segment, no checks in the loop. The clipped endpoints
+        // are rounded, so the pixels differ slightly from the ones above.
+        size_t clipped = 0;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 1; i < samples.size(); ++i)
+        {
+            int x0 = samples[i - 1].x;
+            int y0 = samples[i - 1].y;
+            int x1 = samples[i].x;
+            int y1 = samples[i].y;
+            if (!ClipLine(width, height, x0, y0, x1, y1))
+                continue;
+            RasterizeLine(x0, y0, x1, y1, [&](int x, int y)
+            {
+                sum += (uint64_t)y * (uint64_t)width + (uint64_t)x;
+                ++clipped;
+            });
+        }
+        const double perSegment = (double)clipped / Seconds(start) / 1e6;
+        Sink = sum;
+
+        // the whole batch drawn onto the canvas, the first pass allocates the tiles
+        StrokeCanvas strokes(opt.format);
+        strokes.Resize(width, height);
+        const Brush brush;
+        strokes.DrawStroke(samples.data(), samples.size(), 0, 0, brush);
+        strokes.EndStroke();
+        start = std::chrono::steady_clock::now();
+        strokes.DrawStroke(samples.data(), samples.size(), 0, 0, brush);
+        const double stroke = (double)clipped / Seconds(start) / 1e6;
+
+        std::printf("%5dx%-5d %14zu %15.1f %13.1f %11.1f\n", width, height, pixels / segments, perPixel, perSegment, stroke);
+    }
+}
@@ -0,0 +1,78 @@
+#include <system_error>
+#include <filesystem>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <chrono>
+
+#include "SessionLogWriter.h"
+#include "SessionReplay.h"
+#include "SessionIndex.h"
+#include "Benchmarks.h"
+#include "Parallel.h"
+#include "Canvas.h"
+#include "Brush.h"
+#include "Log.h"
+
+namespace
+{
+    // Session log of a cursor wandering over the canvas at 1 kHz, count samples long
+    inline bool WriteLog(const std::filesystem::path& path, size_t count, int width, int height)
+    {
+        constexpr size_t Capacity = 1 << 18;
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        std::filesystem::remove(SessionIndex::PathFor(path), ec);
+
+        SessionLogWriter writer(path, Capacity);
+        if (!writer.IsOpen())
+            return false;
+        writer.SetRecording(true);
+        uint32_t state = 0x68E31DA4u;
+        int x = width / 2;
+        int y = height / 2;
+        for (size_t i = 0; i < count; ++i)
+        {
+            // the writer drains the ring every 100 ms, appending faster than that drops samples
+            while (i - std::min<size_t>(i, (size_t)writer.Samples()) >= Capacity / 2)
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            state = state * 1664525u + 1013904223u;
+            x = std::clamp(x + (int)(state >> 27) - 16, 0, width - 1);
+            y = std::clamp(y + (int)(state >> 22 & 31) - 16, 0, height - 1);
+            writer.Append({ (int64_t)i * 1000, x, y });
+        }
+        return writer.Dropped() == 0;
+    }
+}
+
+
+void BenchReplay(const BenchOptions& opt)
+{
+    const size_t count = opt.stamps * 20;
+    const std::filesystem::path log = std::filesystem::temp_directory_path() / "MouseTrackerBench.mtlog";
+    if (!WriteLog(log, count, opt.width, opt.height))
+    {
+        Err << "Failed to write the session log [" << log << "]" << std::endl;
+        return;
+    }
+
+    std::error_code ec;
+    std::printf("format: %s canvas: %dx%d samples: %zu log: %ju KB (disc brush, radius 2)\n", FormatNames[(int)opt.format], opt.width, opt.height, count, std::filesystem::file_size(log, ec) / 1024);
+    std::printf("threads   chunks       ms  M samples/s  speedup\n");
+    const Brush brush(BrushShape::Disc, 2);
+    double single = 0.0;
+    for (unsigned threads = 1; threads <= std::max(HardwareThreads(), 8u); threads *= 2)
+    {
+        Canvas canvas(opt.format);
+        canvas.Resize(opt.width, opt.height);
+        ReplayStats stats;
+        if (SessionReplay::Render(log, canvas, 0, 0, {}, brush, threads, &stats).has_value())
+            break; // the reason was logged already
+        if (threads == 1)
+            single = stats.milliseconds;
+        std::printf("%7u %8ju %8.1f %12.2f %7.2fx\n", stats.threads, (uintmax_t)stats.chunks, stats.milliseconds, (double)stats.samples / stats.milliseconds / 1e3, single / stats.milliseconds);
+    }
+    std::filesystem::remove(log, ec);
+    std::filesystem::remove(SessionIndex::PathFor(log), ec);
+}
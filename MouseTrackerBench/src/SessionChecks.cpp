@@ -0,0 +1,263 @@
+#include <system_error>
+#include <filesystem>
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <climits>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "SessionLogWriter.h"
+#include "SessionIndex.h"
+#include "SessionLog.h"
+#include "Checks.h"
+#include "Sample.h"
+#include "Rect.h"
+
+namespace
+{
+    // Strokes of a cursor on three monitors left and right of the primary
+    // one, with pauses of hours, jumps across the desktop and samples sharing
+    // a timestamp, so every delta of the encoding gets exercised
+    inline std::vector<std::vector<Sample>> SessionStrokes(size_t strokes, size_t samplesPerStroke)
+    {
+        uint32_t state = 0x2545F491u;
+        const auto next = [&](int range)
+        {
+            state = state * 1664525u + 1013904223u;
+            return (int)((uint64_t)(state >> 8) * (uint64_t)range >> 24);
+        };
+
+        std::vector<std::vector<Sample>> result(strokes);
+        Sample s{ 1700000000000000, 0, 0 };
+        for (std::vector<Sample>& stroke : result)
+        {
+            s.time += (int64_t)next(4) * 3600000000 + 1;
+            for (size_t i = 0; i < samplesPerStroke; ++i)
+            {
+                s.time += next(8) == 0 ? 0 : next(2000);
+                if (next(64) == 0)
+                    s = { s.time, next(5760) - 1920, next(1080) - 100 };
+                else
+                    s = { s.time, s.x + next(65) - 32, s.y + next(65) - 32 };
+                stroke.push_back(s);
+            }
+        }
+        return result;
+    }
+
+
+    // Logs the strokes with a pause in between, false if samples were dropped
+    inline bool WriteSession(const std::filesystem::path& path, const std::vector<std::vector<Sample>>& strokes)
+    {
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        std::filesystem::remove(SessionIndex::PathFor(path), ec);
+
+        size_t count = 0;
+        for (const std::vector<Sample>& stroke : strokes)
+            count += stroke.size() + 1;
+        SessionLogWriter writer(path, count);
+        if (!writer.IsOpen())
+            return false;
+        for (const std::vector<Sample>& stroke : strokes)
+        {
+            writer.SetRecording(true);
+            for (const Sample& s : stroke)
+                writer.Append(s);
+            writer.SetRecording(false);
+            writer.Append(stroke.front()); // not recorded, breaks the stroke
+        }
+        return writer.Dropped() == 0;
+    }
+
+
+    struct Chunk
+    {
+        uint64_t offset = 0;
+        SessionLog::ChunkHeader header;
+        size_t firstSample = 0; // into the samples of the whole log
+    };
+
+
+    // Every intact chunk of the log and all their samples
+    inline std::vector<Chunk> ReadSession(const std::filesystem::path& path, std::vector<Sample>& samples, uint64_t& corrupted)
+    {
+        std::vector<Chunk> chunks;
+        SessionLogReader reader(path);
+        Chunk c;
+        c.firstSample = samples.size();
+        while (reader.Next(c.header, samples))
+        {
+            c.offset = reader.Offset() - SessionLog::ChunkHeaderBytes - c.header.payloadBytes;
+            chunks.push_back(c);
+            c.firstSample = samples.size();
+        }
+        corrupted = reader.Corrupted();
+        return chunks;
+    }
+
+
+    inline bool SameSamples(const std::vector<Sample>& a, const std::vector<Sample>& b)
+    {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const Sample& l, const Sample& r) { return l.time == r.time && l.x == r.x && l.y == r.y; });
+    }
+}
+
+
+// Zigzag varints at the extremes, then a session written by SessionLogWriter
+// read back chunk by chunk: intact, with a flipped crc byte in one chunk
+// (only that chunk is lost) and torn in the middle of the last chunk
+bool CheckSessionLog()
+{
+    for (int64_t v : { (int64_t)0, (int64_t)1, (int64_t)-1, (int64_t)300, (int64_t)-300, INT64_MAX, INT64_MIN })
+    {
+        unsigned char buffer[10];
+        const size_t n = SessionLog::PutVarint(buffer, SessionLog::ZigZag(v));
+        const unsigned char* p = buffer;
+        uint64_t read = 0;
+        if (n > sizeof(buffer) || !SessionLog::GetVarint(p, buffer + n, read) || p != buffer + n || SessionLog::UnZigZag(read) != v)
+            return Report("session log", false, "varint of " + std::to_string(v) + " doesn't round trip");
+        p = buffer;
+        if (n > 1 && SessionLog::GetVarint(p, buffer + n - 1, read))
+            return Report("session log", false, "truncated varint of " + std::to_string(v) + " was accepted");
+    }
+
+    const std::filesystem::path path = TempFile("MouseTrackerChecks.mtlog");
+    const std::vector<std::vector<Sample>> strokes = SessionStrokes(6, 8000);
+    if (!WriteSession(path, strokes))
+        return Report("session log", false, "writing the log failed or dropped samples");
+    std::vector<Sample> expected;
+    for (const std::vector<Sample>& stroke : strokes)
+        expected.insert(expected.end(), stroke.begin(), stroke.end());
+
+    std::vector<Sample> samples;
+    uint64_t corrupted = 0;
+    const std::vector<Chunk> chunks = ReadSession(path, samples, corrupted);
+    size_t strokeStarts = 0;
+    for (const Chunk& c : chunks)
+        strokeStarts += (c.header.flags & SessionLog::StrokeStart) != 0;
+    if (!SameSamples(samples, expected) || corrupted != 0)
+        return Report("session log", false, "read back " + std::to_string(samples.size()) + " of " + std::to_string(expected.size()) + " samples");
+    if (chunks.size() < 4 || strokeStarts != strokes.size())
+        return Report("session log", false, std::to_string(chunks.size()) + " chunks with " + std::to_string(strokeStarts) + " stroke starts for " + std::to_string(strokes.size()) + " strokes");
+
+    // a flipped crc byte loses exactly that chunk, the reader finds the next one
+    const Chunk& damaged = chunks[1];
+    {
+        std::FILE* file = std::fopen(path.string().c_str(), "r+b");
+        unsigned char crc = 0;
+        const bool flipped = file != nullptr && SessionLog::Seek(file, damaged.offset + SessionLog::HeaderBytes) == 0 && std::fread(&crc, 1, 1, file) == 1
+            && SessionLog::Seek(file, damaged.offset + SessionLog::HeaderBytes) == 0 && std::fputc(crc ^ 0x40, file) != EOF;
+        if (file != nullptr)
+            std::fclose(file);
+        if (!flipped)
+            return Report("session log", false, "couldn't damage the log");
+    }
+    expected.erase(expected.begin() + (std::ptrdiff_t)damaged.firstSample, expected.begin() + (std::ptrdiff_t)(damaged.firstSample + damaged.header.count));
+    samples.clear();
+    ReadSession(path, samples, corrupted);
+    if (!SameSamples(samples, expected) || corrupted != 1)
+        return Report("session log", false, "with a damaged crc: read " + std::to_string(samples.size()) + " of " + std::to_string(expected.size()) + " samples, " + std::to_string(corrupted) + " corrupted chunk(s)");
+
+    // a torn write at the end loses the last chunk only
+    const Chunk& last = chunks.back();
+    std::error_code ec;
+    std::filesystem::resize_file(path, last.offset + SessionLog::ChunkHeaderBytes + last.header.payloadBytes / 2, ec);
+    expected.resize(expected.size() - last.header.count);
+    samples.clear();
+    ReadSession(path, samples, corrupted);
+    const bool ok = !ec && SameSamples(samples, expected) && corrupted == 1;
+    std::filesystem::remove(path, ec);
+    std::filesystem::remove(SessionIndex::PathFor(path), ec);
+    return Report("session log", ok, "torn at the end: read " + std::to_string(samples.size()) + " of " + std::to_string(expected.size()) + " samples");
+}
+
+
+// Time range and region queries of the sidecar index against a scan of the
+// whole log: a query has to return exactly the chunks whose time span and
+// bounding box overlap it, which includes every chunk with a matching sample.
+// Then again with a damaged and with a missing index, which are rebuilt.
+bool CheckSessionIndex()
+{
+    const std::filesystem::path path = TempFile("MouseTrackerChecks.mtlog");
+    const std::filesystem::path indexPath = SessionIndex::PathFor(path);
+    if (!WriteSession(path, SessionStrokes(8, 6000)))
+        return Report("session index", false, "writing the log failed or dropped samples");
+    std::vector<Sample> samples;
+    uint64_t corrupted = 0;
+    const std::vector<Chunk> chunks = ReadSession(path, samples, corrupted);
+
+    uint32_t state = 0x68E31DA4u;
+    const auto next = [&](int64_t range)
+    {
+        state = state * 1664525u + 1013904223u;
+        return (int64_t)((uint64_t)(state >> 8) * (uint64_t)range >> 24);
+    };
+
+    for (int round = 0; round < 3; ++round)
+    {
+        std::error_code ec;
+        if (round == 1)
+        {
+            // a damaged entry in the middle makes the next query rebuild the index
+            std::FILE* file = std::fopen(indexPath.string().c_str(), "r+b");
+            const bool damaged = file != nullptr && SessionLog::Seek(file, SessionIndex::FileHeaderBytes + chunks.size() / 2 * SessionIndex::EntryBytes + 4) == 0 && std::fputc(0xFF, file) != EOF;
+            if (file != nullptr)
+                std::fclose(file);
+            if (!damaged)
+                return Report("session index", false, "couldn't damage the index");
+        }
+        else if (round == 2)
+            std::filesystem::remove(indexPath, ec);
+
+        SessionIndex index(path);
+        if (!index.IsOpen() || index.Size() != chunks.size())
+            return Report("session index", false, "round " + std::to_string(round) + ": " + std::to_string(index.Size()) + " of " + std::to_string(chunks.size()) + " chunks indexed");
+
+        for (int q = 0; q < 200; ++q)
+        {
+            // around a random sample, most of the log is pauses between strokes
+            const Sample& around = samples[(size_t)next((int64_t)samples.size())];
+            const int64_t from = around.time - next(4000000);
+            const int64_t to = q % 4 == 0 ? from + 1 : from + 1 + next(8000000);
+            const Rect area = q % 5 == 0 ? SessionIndex::Everywhere : Rect::FromSize(around.x - (int)next(400), around.y - (int)next(300), 1 + (int)next(800), 1 + (int)next(600));
+            const std::optional<std::vector<SessionIndex::Entry>> result = index.Query(from, to, area);
+            if (!result.has_value())
+                return Report("session index", false, "round " + std::to_string(round) + ": query failed");
+
+            std::vector<uint64_t> expected;
+            bool missed = false;
+            size_t r = 0;
+            for (const Chunk& c : chunks)
+            {
+                Rect bounds;
+                bool matches = false; // a sample in the range and the area
+                for (size_t i = c.firstSample; i < c.firstSample + c.header.count; ++i)
+                {
+                    const Sample& s = samples[i];
+                    bounds.Add(s.x, s.y, 1, 1);
+                    matches |= s.time >= from && s.time < to && s.x >= area.x0 && s.x < area.x1 && s.y >= area.y0 && s.y < area.y1;
+                }
+                const int64_t first = samples[c.firstSample].time;
+                const int64_t last = samples[c.firstSample + c.header.count - 1].time;
+                if (last >= from && first < to && !bounds.Intersect(area).Empty())
+                    expected.push_back(c.offset);
+                while (r < result->size() && (*result)[r].offset < c.offset)
+                    ++r;
+                missed |= matches && (r == result->size() || (*result)[r].offset != c.offset);
+            }
+            std::vector<uint64_t> offsets;
+            for (const SessionIndex::Entry& e : *result)
+                offsets.push_back(e.offset);
+            if (missed || offsets != expected)
+                return Report("session index", false, "round " + std::to_string(round) + ": query " + std::to_string(q) + " returned " + std::to_string(offsets.size()) + " chunks instead of " + std::to_string(expected.size()) + (missed ? ", missing matching samples" : ""));
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    std::filesystem::remove(indexPath, ec);
+    return Report("session index", true);
+}
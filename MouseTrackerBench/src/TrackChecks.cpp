@@ -0,0 +1,433 @@
+#include <system_error>
+#include <filesystem>
+#include <algorithm>
+#include <optional>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#include "StrokeCanvas.h"
+#include "TrackJournal.h"
+#include "MappedFile.h"
+#include "TrackFile.h"
+#include "Autosave.h"
+#include "Checks.h"
+#include "Canvas.h"
+#include "Sample.h"
+#include "Brush.h"
+#include "Lz.h"
+
+namespace
+{
+    struct Lcg
+    {
+        uint32_t state;
+
+        inline uint32_t Next(uint32_t range)
+        {
+            state = state * 1664525u + 1013904223u;
+            return (uint32_t)((uint64_t)(state >> 8) * range >> 24);
+        }
+    };
+
+
+    // Runs of literals and copies of earlier data at any distance, long
+    // enough that both counts of a sequence need extra bytes
+    inline std::vector<unsigned char> Repetitive(size_t size, Lcg& lcg)
+    {
+        std::vector<unsigned char> data;
+        while (data.size() < size)
+        {
+            for (uint32_t n = lcg.Next(600); n != 0; --n)
+                data.push_back((unsigned char)lcg.Next(256));
+            if (data.empty())
+                continue;
+            const unsigned char run = data[lcg.Next((uint32_t)data.size())];
+            data.insert(data.end(), lcg.Next(2000), run);
+            const size_t copyFrom = data.size() - 1 - lcg.Next((uint32_t)data.size());
+            for (size_t i = 0, n = lcg.Next(700); i < n; ++i)
+                data.push_back(data[copyFrom + i]);
+        }
+        data.resize(size);
+        return data;
+    }
+
+
+    // The content of tile i of a track: empty, noise that is stored raw,
+    // sparse dots or one color, RGBA like the tiles of an RGBA8 canvas
+    inline std::vector<unsigned char> TrackTile(size_t i, size_t tileBytes)
+    {
+        std::vector<unsigned char> tile;
+        Lcg lcg{ (uint32_t)i * 0x9E3779B9u + 1 };
+        switch (i % 4)
+        {
+        case 0:
+            break;
+        case 1:
+            for (size_t k = 0; k < tileBytes; ++k)
+                tile.push_back((unsigned char)lcg.Next(256));
+            break;
+        case 2:
+            tile.assign(tileBytes, 255);
+            for (size_t k = 0; k < tileBytes; k += 4)
+                if (lcg.Next(50) == 0)
+                    std::memset(&tile[k], 0, 3);
+            break;
+        default:
+            for (size_t k = 0; k < tileBytes; ++k)
+                tile.push_back(k % 4 == 3 ? 255 : (unsigned char)(i * 40 + k % 4));
+            break;
+        }
+        return tile;
+    }
+
+
+    inline std::vector<std::vector<unsigned char>> TrackTiles(const TrackFile::Header& header)
+    {
+        const size_t tilesX = (size_t)(header.width + Canvas::TileSize - 1) / Canvas::TileSize;
+        const size_t tilesY = (size_t)(header.height + Canvas::TileSize - 1) / Canvas::TileSize;
+        std::vector<std::vector<unsigned char>> tiles;
+        for (size_t i = 0; i < tilesX * tilesY; ++i)
+            tiles.push_back(TrackTile(i, header.tileBytes));
+        return tiles;
+    }
+
+
+    // True if the track at path with journal (if any) loads into an RGBA8
+    // canvas as the given tiles, empty ones read as blank
+    inline bool LoadsAs(const std::filesystem::path& path, const std::filesystem::path& journal, const TrackFile::Header& header, const std::vector<std::vector<unsigned char>>& tiles)
+    {
+        Canvas loaded(Canvas::Format::RGBA8);
+        loaded.Resize(header.width, header.height);
+        if (loaded.LoadFromFile(path.string(), 0, journal).has_value())
+            return false;
+        const size_t tilesX = (size_t)(header.width + Canvas::TileSize - 1) / Canvas::TileSize;
+        std::vector<unsigned char> row((size_t)header.width * Canvas::Channel);
+        for (int y = 0; y < header.height; ++y)
+        {
+            loaded.ExpandRow(y, 0, header.width, row.data());
+            for (int x = 0; x < header.width; ++x)
+            {
+                const std::vector<unsigned char>& tile = tiles[(size_t)(y / Canvas::TileSize) * tilesX + (size_t)(x / Canvas::TileSize)];
+                const size_t k = ((size_t)(y % Canvas::TileSize) * Canvas::TileSize + (size_t)(x % Canvas::TileSize)) * Canvas::Channel;
+                for (size_t c = 0; c < Canvas::Channel; ++c)
+                    if (row[(size_t)x * Canvas::Channel + c] != (tile.empty() ? 255 : tile[k + c]))
+                        return false;
+            }
+        }
+        return true;
+    }
+
+
+    // Every row of the canvas expanded to RGBA
+    inline std::vector<unsigned char> Expanded(const Canvas& canvas)
+    {
+        const size_t rowBytes = (size_t)canvas.Width() * Canvas::Channel;
+        std::vector<unsigned char> pixels((size_t)canvas.Height() * rowBytes);
+        for (int y = 0; y < canvas.Height(); ++y)
+            canvas.ExpandRow(y, 0, canvas.Width(), pixels.data() + (size_t)y * rowBytes);
+        return pixels;
+    }
+
+
+    inline bool FlipByte(const std::filesystem::path& path, uint64_t offset)
+    {
+        std::FILE* file = std::fopen(path.string().c_str(), "r+b");
+        unsigned char c = 0;
+        const bool flipped = file != nullptr && SessionLog::Seek(file, offset) == 0 && std::fread(&c, 1, 1, file) == 1
+            && SessionLog::Seek(file, offset) == 0 && std::fputc(c ^ 0x20, file) != EOF;
+        if (file != nullptr)
+            std::fclose(file);
+        return flipped;
+    }
+}
+
+
+// Lz round trips of empty and tiny blocks, noise, one color, long literal
+// runs and copies and strided planes, then the compressed blocks decoded into
+// a buffer that is one byte short or long and cut short, which has to fail,
+// and with flipped bytes, which mustn't write past the buffer
+bool CheckLz()
+{
+    Lcg lcg{ 0x5BD1E995u };
+    std::vector<std::pair<std::string, std::vector<unsigned char>>> blocks;
+    for (size_t size : { (size_t)0, (size_t)1, (size_t)3, (size_t)4, (size_t)5, (size_t)17 })
+    {
+        std::vector<unsigned char> data(size);
+        for (unsigned char& c : data)
+            c = (unsigned char)lcg.Next(4);
+        blocks.push_back({ std::to_string(size) + " bytes", data });
+    }
+    std::vector<unsigned char> noise(Lz::MaxBlock);
+    for (unsigned char& c : noise)
+        c = (unsigned char)lcg.Next(256);
+    blocks.push_back({ "noise", noise });
+    blocks.push_back({ "one color", std::vector<unsigned char>(Lz::MaxBlock, 0xAB) });
+    blocks.push_back({ "repetitive", Repetitive(Lz::MaxBlock, lcg) });
+    std::vector<unsigned char> planes(noise.begin(), noise.begin() + 4096);
+    planes.insert(planes.end(), planes.begin(), planes.end());
+    planes.resize(4096 * 3, 0);
+    planes.insert(planes.end(), noise.begin(), noise.begin() + 4096);
+    blocks.push_back({ "planes", planes });
+
+    for (const auto& [name, data] : blocks)
+    {
+        const size_t size = data.size();
+        const std::string check = "lz " + name;
+        std::vector<unsigned char> compressed;
+        Lz::Compress(data.data(), size, compressed, name == "planes" ? 4096 : 0);
+        std::vector<unsigned char> out(std::max<size_t>(size, 1)); // data() of an empty vector may be null
+        if (!Lz::Decompress(compressed.data(), compressed.size(), out.data(), size) || !std::equal(data.begin(), data.end(), out.begin()))
+            return Report(check.c_str(), false, "doesn't round trip");
+        if (compressed.size() > size + size / 255 + 16)
+            return Report(check.c_str(), false, std::to_string(size) + " bytes grew to " + std::to_string(compressed.size()));
+        if (name == "planes" && compressed.size() > 4096 * 2 + 100)
+            return Report(check.c_str(), false, "the repeated planes weren't matched, " + std::to_string(compressed.size()) + " bytes");
+
+        // every other decode goes into a buffer of exactly the size it is given
+        std::vector<unsigned char> shorter(std::max<size_t>(size, 2) - 1);
+        std::vector<unsigned char> longer(size + 1);
+        if ((size != 0 && Lz::Decompress(compressed.data(), compressed.size(), shorter.data(), size - 1)) || Lz::Decompress(compressed.data(), compressed.size(), longer.data(), longer.size()))
+            return Report(check.c_str(), false, "decoded to the wrong size");
+        for (size_t cut = 0; size != 0 && cut < compressed.size(); cut += std::max<size_t>(1, compressed.size() / 101))
+        {
+            std::vector<unsigned char> head(compressed.begin(), compressed.begin() + (std::ptrdiff_t)cut);
+            if (Lz::Decompress(head.data(), head.size(), out.data(), size))
+                return Report(check.c_str(), false, "cut after " + std::to_string(cut) + " of " + std::to_string(compressed.size()) + " bytes and decoded");
+        }
+        for (int flip = 0; flip < 200 && !compressed.empty(); ++flip)
+        {
+            std::vector<unsigned char> damaged = compressed;
+            damaged[lcg.Next((uint32_t)damaged.size())] ^= (unsigned char)(1 + lcg.Next(255));
+            Lz::Decompress(damaged.data(), damaged.size(), out.data(), size); // may or may not fail, but stays in out
+        }
+    }
+    return Report("lz", true);
+}
+
+
+// A track of an RGBA8 canvas with empty tiles, noise tiles (stored raw,
+// bytes == tileBytes) and compressible ones, written on 1 and 3 threads and
+// read back tile by tile and into a canvas. A flipped byte in a raw and in a
+// compressed tile fails their adler, Decode() rejects them and loading skips
+// them (they read as blank), the other tiles still load. A damaged header or
+// directory and a cut file aren't opened.
+bool CheckTrackFile()
+{
+    const std::filesystem::path path = TempFile("MouseTrackerChecks.mtrk");
+    Canvas canvas(Canvas::Format::RGBA8);
+    canvas.Resize(300, 200);
+    const TrackFile::Header header = canvas.TrackHeader();
+    const std::vector<std::vector<unsigned char>> tiles = TrackTiles(header);
+    const size_t tileCount = tiles.size();
+    const auto tile = [&](size_t i) { return tiles[i].empty() ? nullptr : tiles[i].data(); };
+
+    // the tiles in skipped read as blank
+    const auto loads = [&](const std::vector<size_t>& skipped)
+    {
+        std::vector<std::vector<unsigned char>> expected = tiles;
+        for (size_t i : skipped)
+            expected[i].clear();
+        return LoadsAs(path, {}, header, expected);
+    };
+
+    uint32_t firstId = 0;
+    for (unsigned threads : { 1u, 3u })
+    {
+        TrackFile track;
+        if (!TrackFile::Write(path, header, tileCount, tile, threads) || track.Open(path).has_value())
+            return Report("track file", false, "writing on " + std::to_string(threads) + " thread(s) failed");
+        if (threads == 1)
+            firstId = track.Id();
+        else if (track.Id() == firstId)
+            return Report("track file", false, "two tracks got the same id");
+
+        std::vector<unsigned char> decoded(header.tileBytes);
+        for (size_t i = 0; i < tileCount; ++i)
+        {
+            const TrackFile::Entry* e = track.Find((uint32_t)i);
+            if ((e == nullptr) != tiles[i].empty())
+                return Report("track file", false, "tile " + std::to_string(i) + (e == nullptr ? " is missing" : " is stored but empty"));
+            if (e == nullptr)
+                continue;
+            if ((e->bytes == header.tileBytes) != (i % 4 == 1))
+                return Report("track file", false, "tile " + std::to_string(i) + " of " + std::to_string(e->bytes) + " bytes is stored " + (i % 4 == 1 ? "compressed" : "raw"));
+            if (!track.Decode(*e, decoded.data()) || decoded != tiles[i])
+                return Report("track file", false, "tile " + std::to_string(i) + " doesn't decode");
+        }
+    }
+    if (!loads({}))
+        return Report("track file", false, "the canvas doesn't load the track");
+
+    // a raw and a compressed tile with one flipped byte
+    std::vector<size_t> damaged;
+    uint64_t directoryOffset = 0;
+    {
+        TrackFile track;
+        if (track.Open(path).has_value())
+            return Report("track file", false, "reopening failed");
+        for (size_t i : { (size_t)5, (size_t)6 })
+        {
+            const TrackFile::Entry* e = track.Find((uint32_t)i);
+            if (e == nullptr || !FlipByte(path, e->offset + e->bytes / 2))
+                return Report("track file", false, "couldn't damage tile " + std::to_string(i));
+            damaged.push_back(i);
+        }
+        directoryOffset = track.Entries().back().offset + track.Entries().back().bytes;
+    }
+    {
+        TrackFile track;
+        std::vector<unsigned char> decoded(header.tileBytes);
+        bool rejected = !track.Open(path).has_value();
+        for (const TrackFile::Entry& e : track.Entries())
+            rejected &= track.Decode(e, decoded.data()) == (std::find(damaged.begin(), damaged.end(), e.index) == damaged.end());
+        if (!rejected)
+            return Report("track file", false, "a tile with a bad adler decoded or an intact one didn't");
+    }
+    if (!loads(damaged))
+        return Report("track file", false, "the canvas doesn't skip the damaged tiles");
+
+    // damaged header and directory, then the file cut in the directory
+    for (uint64_t offset : { (uint64_t)20, directoryOffset + 4 })
+    {
+        TrackFile track;
+        if (!TrackFile::Write(path, header, tileCount, tile) || !FlipByte(path, offset) || !track.Open(path).has_value())
+            return Report("track file", false, "a damaged " + std::string(offset == 20 ? "header" : "directory") + " was opened");
+    }
+    std::error_code ec;
+    TrackFile cut;
+    const bool written = TrackFile::Write(path, header, tileCount, tile);
+    std::filesystem::resize_file(path, std::filesystem::file_size(path, ec) - 7, ec);
+    const bool ok = written && !ec && cut.Open(path).has_value();
+    std::filesystem::remove(path, ec);
+    return Report("track file", ok, "a cut file was opened");
+}
+
+
+// A version 1 track (no id, the header crc names it) made from a version 2
+// one, opened with its crc as the id and loaded with a journal written
+// against that crc, the way autosave left them before the id
+bool CheckTrackVersion1()
+{
+    const std::filesystem::path path = TempFile("MouseTrackerChecks.mtrk");
+    const std::filesystem::path journal = path.string() + ".journal";
+    Canvas canvas(Canvas::Format::RGBA8);
+    canvas.Resize(300, 200);
+    const TrackFile::Header header = canvas.TrackHeader();
+    std::vector<std::vector<unsigned char>> tiles = TrackTiles(header);
+    if (!TrackFile::Write(path, header, tiles.size(), [&](size_t i) { return tiles[i].empty() ? nullptr : tiles[i].data(); }))
+        return Report("track version 1", false, "writing the track failed");
+
+    // without the id and every offset 4 bytes earlier
+    std::vector<unsigned char> file;
+    {
+        MappedFile mapped;
+        if (!mapped.Open(path))
+            return Report("track version 1", false, "reading the track failed");
+        file.assign(mapped.Data(), mapped.Data() + mapped.Size());
+    }
+    file.erase(file.begin() + 52, file.begin() + 56);
+    const uint64_t directoryOffset = SessionLog::GetU64(&file[44]) - 4;
+    SessionLog::PutU32(&file[8], 1);
+    SessionLog::PutU64(&file[44], directoryOffset);
+    SessionLog::PutU32(&file[52], Crc32(file.data(), 52));
+    const size_t entries = SessionLog::GetU32(&file[40]);
+    unsigned char* directory = &file[directoryOffset];
+    for (size_t i = 0; i < entries; ++i)
+        SessionLog::PutU64(directory + i * TrackFile::EntryBytes + 8, SessionLog::GetU64(directory + i * TrackFile::EntryBytes + 8) - 4);
+    SessionLog::PutU32(directory + entries * TrackFile::EntryBytes, Crc32(directory, entries * TrackFile::EntryBytes));
+    std::FILE* f = std::fopen(path.string().c_str(), "wb");
+    const bool written = f != nullptr && std::fwrite(file.data(), 1, file.size(), f) == file.size();
+    if (f == nullptr || std::fclose(f) != 0 || !written)
+        return Report("track version 1", false, "writing the version 1 track failed");
+
+    uint32_t id = 0;
+    {
+        TrackFile track;
+        std::vector<unsigned char> decoded(header.tileBytes);
+        const std::optional<std::string> errorMsg = track.Open(path);
+        if (errorMsg.has_value())
+            return Report("track version 1", false, errorMsg.value());
+        for (const TrackFile::Entry& e : track.Entries())
+            if (!track.Decode(e, decoded.data()) || decoded != tiles[e.index])
+                return Report("track version 1", false, "tile " + std::to_string(e.index) + " doesn't decode");
+        id = track.Id();
+        if (id != SessionLog::GetU32(&file[52]))
+            return Report("track version 1", false, "the id isn't the header crc");
+    }
+
+    // a tile drawn to and one that is blank again
+    std::vector<unsigned char> payload, planar, stored;
+    TrackFile::Pack(header, tiles[1].data(), planar, stored);
+    TrackJournal::PutTile(payload, 0, stored.data(), stored.size());
+    TrackJournal::PutTile(payload, 2, nullptr, 0);
+    tiles[0] = tiles[1];
+    tiles[2].clear();
+    const bool ok = TrackJournal::Create(journal, id) && TrackJournal::Append(journal, 2, payload) && LoadsAs(path, journal, header, tiles);
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    std::filesystem::remove(journal, ec);
+    return Report("track version 1", ok, "the journal wasn't replayed onto the track");
+}
+
+
+// Autosave of a canvas drawn to in three strokes: a track, then two
+// checkpoints appended to the journal. The last checkpoint torn in the middle
+// (a crash while appending) is dropped on restore, the canvas comes back as
+// it was at the checkpoint before.
+bool CheckAutosave()
+{
+    const std::filesystem::path path = TempFile("MouseTrackerChecks.autosave.mtrk");
+    const std::filesystem::path journal = path.string() + ".journal";
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    std::filesystem::remove(journal, ec);
+
+    const Brush brush(BrushShape::Disc, 3);
+    const std::vector<std::vector<Sample>> strokes = {
+        { { 0, 10, 10 }, { 1, 120, 40 }, { 2, 60, 150 } },
+        { { 3, 200, 20 }, { 4, 280, 180 }, { 5, 100, 100 } },
+        { { 6, 0, 190 }, { 7, 299, 60 }, { 8, 150, 0 } } // over the tiles of both
+    };
+    StrokeCanvas canvas(Canvas::Format::RGBA8);
+    canvas.Resize(300, 200);
+    std::vector<unsigned char> beforeLast;
+    uint64_t journalBytes = 0;
+    {
+        Autosave autosave(path, std::chrono::seconds(3600));
+        for (const std::vector<Sample>& stroke : strokes)
+        {
+            if (&stroke == &strokes.back())
+            {
+                beforeLast = Expanded(canvas.GetCanvas());
+                journalBytes = std::filesystem::file_size(journal, ec);
+            }
+            canvas.DrawStroke(stroke.data(), stroke.size(), 0, 0, brush);
+            canvas.EndStroke();
+            autosave.Update(canvas, true);
+            while (autosave.Busy())
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    const uint64_t fullBytes = std::filesystem::file_size(journal, ec);
+    if (ec || journalBytes <= TrackJournal::FileHeaderBytes || fullBytes <= journalBytes)
+        return Report("autosave", false, "the strokes weren't appended to the journal");
+
+    const Autosave restorer(path, std::chrono::seconds(3600));
+    StrokeCanvas restored(Canvas::Format::RGBA8);
+    restored.Resize(300, 200);
+    if (restorer.Restore(restored).has_value() || Expanded(restored.GetCanvas()) != Expanded(canvas.GetCanvas()))
+        return Report("autosave", false, "the track and journal don't restore the canvas");
+
+    std::filesystem::resize_file(journal, journalBytes + (fullBytes - journalBytes) / 2, ec);
+    restored.Resize(300, 200);
+    const std::vector<unsigned char> pixels = !ec && !restorer.Restore(restored).has_value() ? Expanded(restored.GetCanvas()) : std::vector<unsigned char>();
+    const bool ok = beforeLast != Expanded(canvas.GetCanvas()) && pixels == beforeLast;
+    std::filesystem::remove(path, ec);
+    std::filesystem::remove(journal, ec);
+    return Report("autosave", ok, "with a torn checkpoint the canvas isn't restored as it was before");
+}
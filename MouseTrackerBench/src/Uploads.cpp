@@ -0,0 +1,51 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "StrokeCanvas.h"
+#include "TextureGrid.h"
+#include "Benchmarks.h"
+#include "Sample.h"
+#include "Brush.h"
+#include "Rect.h"
+
+void BenchUploads(const BenchOptions& opt)
+{
+    constexpr size_t SamplesPerFrame = 17; // 1 kHz capture at 60 fps
+    const int sizes[][2] = { { 1920, 1080 }, { 11520, 2160 } };
+    const Brush brush(BrushShape::Disc, 2);
+    std::printf("samples: %zu in frames of %zu (disc brush, radius 2), bytes passed to glTexSubImage2D per frame\n", opt.stamps, SamplesPerFrame);
+    std::printf("canvas      textures  whole image KB  dirty mean KB  p99 KB  max KB  less\n");
+    for (const auto& size : sizes)
+    {
+        BenchOptions sized = opt;
+        sized.width = size[0];
+        sized.height = size[1];
+        const std::vector<Sample> samples = Walk(sized);
+        StrokeCanvas strokes(opt.format);
+        strokes.Resize(sized.width, sized.height);
+        TextureGrid grid;
+        grid.Layout(sized.width, sized.height, 0, TextureGrid::CellSize(0, 16384, sized.width, sized.height)); // a common GL_MAX_TEXTURE_SIZE
+
+        // what Image::DrawStroke() and Image::Upload() do without a GL context
+        std::vector<size_t> bytes;
+        for (size_t i = 0; i < samples.size(); i += SamplesPerFrame)
+        {
+            strokes.DrawStroke(samples.data() + i, std::min(SamplesPerFrame, samples.size() - i), 0, 0, brush, [&](const Rect& area) { grid.MarkDirty(area); });
+            bytes.push_back(grid.DirtyBytes());
+            for (TextureGrid::Cell& cell : grid.Cells())
+                cell.dirty = Rect();
+        }
+
+        const size_t whole = (size_t)sized.width * (size_t)sized.height * 4;
+        double mean = 0.0;
+        for (size_t b : bytes)
+            mean += (double)b / (double)bytes.size();
+        std::vector<size_t> sorted = bytes;
+        const size_t p99 = sorted.size() * 99 / 100;
+        std::nth_element(sorted.begin(), sorted.begin() + (std::ptrdiff_t)p99, sorted.end());
+        const size_t max = *std::max_element(bytes.begin(), bytes.end());
+        std::printf("%5dx%-5d %9zu %14zu %14.1f %7zu %7zu %4.0fx\n", sized.width, sized.height, grid.Cells().size(), whole / 1024, mean / 1024, sorted[p99] / 1024, max / 1024, (double)whole / mean);
+    }
+}
@@ -0,0 +1,53 @@
+#ifdef X11
+#include <iterator>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#include <X11/Xlib.h>
+
+#include "CursorCapture.h"
+#include "CursorSource.h"
+#include "Checks.h"
+#include "Sample.h"
+
+// Moves the pointer of the X server in DISPLAY (e.g. Xvfb) with
+// XWarpPointer and expects every position to arrive through CursorCapture
+bool CheckX11CursorSource()
+{
+    Display* display = XOpenDisplay(nullptr);
+    if (display == nullptr)
+    {
+        std::printf("%-40s skipped, no X server in DISPLAY\n", "x11 cursor source");
+        return true;
+    }
+
+    CursorCapture capture(std::make_unique<X11CursorSource>());
+    const int points[][2] = { { 10, 20 }, { 100, 200 }, { 300, 40 }, { 5, 5 } };
+    std::vector<Sample> samples;
+    Sample batch[64];
+    for (const auto& p : points)
+    {
+        XWarpPointer(display, None, DefaultRootWindow(display), 0, 0, 0, 0, p[0], p[1]);
+        XSync(display, False);
+        // the source coalesces what queued up, give it time to take every warp on its own
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        while (std::chrono::steady_clock::now() < deadline && (samples.empty() || samples.back().x != p[0] || samples.back().y != p[1]))
+        {
+            samples.insert(samples.end(), batch, batch + capture.Drain(batch, std::size(batch)));
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    capture.Stop();
+    XCloseDisplay(display);
+
+    size_t found = 0;
+    for (const Sample& s : samples)
+        if (found < std::size(points) && s.x == points[found][0] && s.y == points[found][1])
+            ++found;
+    return Report("x11 cursor source", found == std::size(points), "got " + std::to_string(found) + " of " + std::to_string(std::size(points)) + " warps in " + std::to_string(samples.size()) + " samples");
+}
+#endif
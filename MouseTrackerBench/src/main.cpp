@@ -0,0 +1,205 @@
+#include <system_error>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <utility>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "StrokeCanvas.h"
+#include "BenchOptions.h"
+#include "Benchmarks.h"
+#include "Canvas.h"
+#include "Checks.h"
+#include "Sample.h"
+#include "Brush.h"
+#include "Log.h"
+
+// brushes: measures how many brush stamps per second the canvas takes, for
+// the square stamped pixel by pixel (the way big pixel mode used to) and for
+// the span lists of every brush shape, radius 1 to Brush::MaxRadius.
+// formats: draws the same strokes in every storage format and measures
+// drawing, expanding the canvas to RGBA (what a texture upload does),
+// saving it as PNG and as track and clearing it, along with its memory.
+// raster: million pixels per second of line segments at 1080p and 8K, clipped
+// per pixel (the way SetPixel used to), clipped per segment and drawn onto
+// the canvas as one stroke.
+// increment: million visits per second of a wandering cursor turning RGBA
+// pixels black (the old SetDataAtIndex), counting them with and without a
+// branch and on the tiled heatmap canvas, for zero and half saturated counts.
+// replay: writes a session log of 20 * --stamps samples and rebuilds the
+// canvas from it with 1, 2, 4... threads (at least up to 8).
+// png: MB/s (of RGBA pixels) of saving a 4K and an 8K canvas as PNG with
+// deflate level 1 and 6 on 1 to 16 threads.
+// pixels: GB/s of turning opaque RGBA into gray at 1080p, 4K and 11520x2160,
+// the old two passes against the fused kernel in every instruction set, and
+// how early the fused one stops at a transparent pixel.
+// uploads: bytes a frame uploads to the textures while strokes are drawn at
+// 1080p and on three 4K monitors, only the dirty rects against the whole image.
+// frames: p50/p99 of the CPU time of a frame (draining the samples, drawing and
+// expanding the textures), expanding the whole image against the dirty rects.
+// memory: resident memory (RSS) a blank and a drawn canvas of every format add
+// for common monitor layouts, against the RGBA buffer the image used to be.
+// checks: correctness checks (see Checks.h), the exit code is set if one fails.
+//
+// MouseTrackerBench [--suite brushes|formats|raster|increment|replay|png|pixels|uploads|frames|memory|checks] [--format rgba|bit1|heatmap|gray] [--stamps <n>] [--width <pixels>] [--height <pixels>]
+
+// Stamp centers spread over the canvas and up to radius past its edges, so clipping is part of it
+inline std::vector<std::pair<int, int>> StampCenters(const BenchOptions& opt, int radius)
+{
+    std::vector<std::pair<int, int>> centers(opt.stamps);
+    uint32_t state = 0x9E3779B9u;
+    const auto next = [&](int range)
+    {
+        state = state * 1664525u + 1013904223u;
+        return (int)((uint64_t)(state >> 8) * (uint64_t)range >> 24);
+    };
+    for (std::pair<int, int>& c : centers)
+        c = { next(opt.width + 2 * radius) - radius, next(opt.height + 2 * radius) - radius };
+    return centers;
+}
+
+
+// Million stamps per second, stamp(plot, x, y) is run over all centers twice and
+// only the second pass is timed, the first one allocates the tiles
+template <class StampFn>
+inline double Measure(const BenchOptions& opt, const std::vector<std::pair<int, int>>& centers, StampFn&& stamp)
+{
+    Canvas canvas(opt.format);
+    canvas.Resize(opt.width, opt.height);
+    double seconds = 0.0;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        canvas.Paint([&](auto&& plot)
+        {
+            for (const std::pair<int, int>& c : centers)
+                stamp(plot, c.first, c.second);
+        });
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return (double)centers.size() / seconds / 1e6;
+}
+
+
+inline void BenchBrushes(const BenchOptions& opt)
+{
+    std::printf("format: %s canvas: %dx%d stamps: %zu, million stamps/s\n", FormatNames[(int)opt.format], opt.width, opt.height, opt.stamps);
+    std::printf("radius  per pixel     square       disc       soft  speedup\n");
+    for (int radius = 1; radius <= Brush::MaxRadius; ++radius)
+    {
+        const std::vector<std::pair<int, int>> centers = StampCenters(opt, radius);
+        const double perPixel = Measure(opt, centers, [&](auto&& plot, int x, int y)
+        {
+            for (int b = std::max(y - radius, 0); b <= std::min(y + radius, opt.height - 1); ++b)
+                for (int a = std::max(x - radius, 0); a <= std::min(x + radius, opt.width - 1); ++a)
+                    plot(a, b);
+        });
+
+        double spans[3];
+        for (int shape = 0; shape < 3; ++shape)
+        {
+            const Brush brush((BrushShape)shape, radius);
+            spans[shape] = Measure(opt, centers, [&](auto&& plot, int x, int y) { brush.Stamp(plot, x, y, opt.width, opt.height); });
+        }
+        std::printf("%6d %10.3f %10.3f %10.3f %10.3f %7.1fx\n", radius, perPixel, spans[0], spans[1], spans[2], spans[0] / perPixel);
+    }
+}
+
+
+inline void BenchFormats(const BenchOptions& opt)
+{
+    const std::vector<Sample> samples = Walk(opt);
+    const Brush brush(BrushShape::Disc, 2);
+    const std::filesystem::path dir = std::filesystem::temp_directory_path();
+    const std::string png = (dir / "MouseTrackerBench.png").string();
+    const std::filesystem::path track = dir / "MouseTrackerBench.mtrk";
+
+    std::printf("canvas: %dx%d samples: %zu (disc brush, radius 2)\n", opt.width, opt.height, samples.size());
+    std::printf("format   stroke M/s  expand ms  png ms   png KB  track ms  track KB  clear ms  memory MB\n");
+    for (int f = 0; f < 4; ++f)
+    {
+        StrokeCanvas strokes((Canvas::Format)f);
+        strokes.Resize(opt.width, opt.height);
+        strokes.DrawStroke(samples.data(), samples.size(), 0, 0, brush); // allocates the tiles
+        strokes.EndStroke();
+        auto start = std::chrono::steady_clock::now();
+        strokes.DrawStroke(samples.data(), samples.size(), 0, 0, brush);
+        const double stroke = (double)samples.size() / Seconds(start) / 1e6;
+
+        const Canvas& canvas = strokes.GetCanvas();
+        std::vector<unsigned char> row((size_t)opt.width * Canvas::Channel);
+        start = std::chrono::steady_clock::now();
+        for (int y = 0; y < opt.height; ++y)
+            canvas.ExpandRow(y, 0, opt.width, row.data());
+        const double expand = Seconds(start) * 1e3;
+
+        start = std::chrono::steady_clock::now();
+        const bool pngSaved = canvas.SaveToFile(png.c_str());
+        const double pngTime = Seconds(start) * 1e3;
+        start = std::chrono::steady_clock::now();
+        const bool trackSaved = canvas.SaveTrack(track);
+        const double trackTime = Seconds(start) * 1e3;
+        if (!pngSaved || !trackSaved)
+            Err << "Failed to save the " << FormatNames[f] << " canvas to " << dir << std::endl;
+
+        std::error_code ec;
+        const uintmax_t pngBytes = std::filesystem::file_size(png, ec);
+        const uintmax_t trackBytes = std::filesystem::file_size(track, ec);
+        const double memory = (double)canvas.MemoryUsage() / (1024.0 * 1024.0);
+        start = std::chrono::steady_clock::now();
+        strokes.GetCanvas().Clear();
+        const double clear = Seconds(start) * 1e3;
+        std::printf("%-8s %10.3f %10.2f %7.1f %8ju %9.1f %9ju %9.3f %10.2f\n", FormatNames[f], stroke, expand, pngTime, pngBytes / 1024, trackTime, trackBytes / 1024, clear, memory);
+    }
+    std::filesystem::remove(png);
+    std::filesystem::remove(track);
+}
+
+
+// In the order they run if --suite doesn't pick one, checks run last
+constexpr std::pair<const char*, void (*)(const BenchOptions&)> Suites[] = {
+    { "brushes",   BenchBrushes   },
+    { "formats",   BenchFormats   },
+    { "raster",    BenchRaster    },
+    { "increment", BenchIncrement },
+    { "replay",    BenchReplay    },
+    { "png",       BenchPng       },
+    { "pixels",    BenchPixels    },
+    { "uploads",   BenchUploads   },
+    { "frames",    BenchFrames    },
+    { "memory",    BenchMemory    }
+};
+
+
+int main(int argc, char** argv)
+{
+    const BenchOptions opt = ParseBenchOptions(argc, argv);
+    const bool all = opt.suite.empty();
+    bool first = true;
+    for (const auto& [name, run] : Suites)
+    {
+        if (!all && opt.suite != name)
+            continue;
+        if (!std::exchange(first, false))
+            std::printf("\n");
+        run(opt);
+    }
+
+    if (all || opt.suite == "checks")
+    {
+        if (!first)
+            std::printf("\n");
+        return RunChecks() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (first)
+    {
+        Err << "Unknown suite: " << opt.suite << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,200 @@
+#include <filesystem>
+#include <algorithm>
+#include <optional>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <utility>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+
+#include "stb/stb_image.h"
+
+#include "TrackFile.h"
+#include "Parallel.h"
+#include "Canvas.h"
+#include "Log.h"
+
+// Headless tool that combines saved images (tracks, PNGs or JPEGs of the same
+// size) into one: the union of the visited pixels or a heatmap counting how
+// many times each pixel was visited over all of them.
+//
+// MouseTrackerMerge [--sum] [--threads <n>] [--png-level <0-9>] [--list <file>] -o <output> <input>...
+//
+// Every worker thread loads one input at a time and merges it into its own
+// canvas, which are merged into the output at the end. So memory depends on
+// the image size and the number of threads, not on the number of inputs.
+//
+// Transparent pixels of PNG inputs (off screen areas of several monitors) are
+// never visited. The output is transparent where all inputs are, as long as
+// every input has transparent pixels, tracks don't store a monitor layout.
+
+struct MergeOptions
+{
+    std::vector<std::string> inputs; // <input>... and the lines of --list <file>
+    std::string output;              // -o <output>, a track if it ends with .mtrk, PNG otherwise
+    bool sum = false;                // --sum counts visits, default is the union
+    unsigned threads = 0;            // --threads <n>, 0 = all hardware threads
+    int pngLevel = 6;                // --png-level <0-9>
+};
+
+
+inline std::optional<MergeOptions> ParseMergeOptions(int argc, char** argv)
+{
+    MergeOptions opt;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* const arg = argv[i];
+        const char* const value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (std::strcmp(arg, "-o") == 0 && value != nullptr)
+        {
+            opt.output = value;
+            ++i;
+        }
+        else if (std::strcmp(arg, "--sum") == 0)
+            opt.sum = true;
+        else if (std::strcmp(arg, "--threads") == 0 && value != nullptr)
+        {
+            opt.threads = (unsigned)std::max(0, std::atoi(value));
+            ++i;
+        }
+        else if (std::strcmp(arg, "--png-level") == 0 && value != nullptr)
+        {
+            opt.pngLevel = std::clamp(std::atoi(value), 0, 9);
+            ++i;
+        }
+        else if (std::strcmp(arg, "--list") == 0 && value != nullptr)
+        {
+            std::ifstream list(value);
+            if (!list)
+            {
+                Err << "Failed to open input list [" << value << "]" << std::endl;
+                return std::nullopt;
+            }
+            for (std::string line; std::getline(list, line);)
+            {
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                if (!line.empty())
+                    opt.inputs.push_back(line);
+            }
+            ++i;
+        }
+        else if (arg[0] != '-')
+            opt.inputs.push_back(arg);
+        else
+        {
+            Err << "Unknown or incomplete argument: " << arg << std::endl;
+            return std::nullopt;
+        }
+    }
+    if (opt.output.empty() || opt.inputs.empty())
+        return std::nullopt;
+    return opt;
+}
+
+
+// Width and height from the file header, nothing is decoded
+inline std::optional<std::pair<int, int>> ImageSize(const std::string& path)
+{
+    if (TrackFile::IsTrack(path))
+    {
+        TrackFile track;
+        if (track.Open(path).has_value())
+            return std::nullopt;
+        return std::make_pair(track.GetHeader().width, track.GetHeader().height);
+    }
+    int width, height, cmp;
+    if (stbi_info(path.c_str(), &width, &height, &cmp) == 0)
+        return std::nullopt;
+    return std::make_pair(width, height);
+}
+
+
+int main(int argc, char** argv)
+{
+    const std::optional<MergeOptions> parsed = ParseMergeOptions(argc, argv);
+    if (!parsed.has_value())
+    {
+        Err << "Usage: MouseTrackerMerge [--sum] [--threads <n>] [--png-level <0-9>] [--list <file>] -o <output> <input>..." << std::endl;
+        return EXIT_FAILURE;
+    }
+    const MergeOptions& opt = parsed.value();
+    const auto start = std::chrono::steady_clock::now();
+
+    // the first input that can be read decides the size, the others have to match
+    std::optional<std::pair<int, int>> size;
+    for (size_t i = 0; i < opt.inputs.size() && !size.has_value(); ++i)
+        size = ImageSize(opt.inputs[i]);
+    if (!size.has_value())
+    {
+        Err << "None of the " << opt.inputs.size() << " inputs is a readable image" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Canvas target(opt.sum ? Canvas::Format::Count16 : Canvas::Format::Bit1);
+    target.Resize(size->first, size->second);
+    const unsigned threads = std::clamp(opt.threads != 0 ? opt.threads : HardwareThreads(), 1u, (unsigned)opt.inputs.size());
+    std::vector<Canvas> canvases;
+    for (unsigned i = 0; i < threads; ++i)
+        canvases.push_back(target.EmptyCopy());
+
+    // inputs are decoded straight into the format of the target and merged right away,
+    // the opaque areas of the inputs (their monitor layouts) are collected per worker
+    std::atomic<size_t> next{ 0 };
+    std::atomic<size_t> merged{ 0 };
+    std::vector<std::vector<Rect>> layouts(threads);
+    std::vector<unsigned char> opaque(threads, 0); // an input of the worker had no transparent pixels
+    RunParallel(threads, [&](unsigned worker)
+    {
+        Canvas& canvas = canvases[worker];
+        Canvas input = target.EmptyCopy();
+        for (size_t k = next++; k < opt.inputs.size(); k = next++)
+        {
+            input.SetMonitors({}); // takes the layout of the next image
+            if (input.LoadFromFile(opt.inputs[k], 1).has_value())
+                continue; // the reason was logged already
+            if (input.Monitors().empty())
+                opaque[worker] = 1;
+            for (const Rect& r : input.Monitors())
+                if (std::find(layouts[worker].begin(), layouts[worker].end(), r) == layouts[worker].end())
+                    layouts[worker].push_back(r);
+            canvas.MergeTiles(input, 0, input.TileCount());
+            input.Clear();
+            ++merged;
+        }
+    });
+
+    // the output is opaque wherever any input is
+    std::vector<Rect> layout;
+    for (const std::vector<Rect>& l : layouts)
+        layout.insert(layout.end(), l.begin(), l.end());
+    if (merged != 0 && std::none_of(opaque.begin(), opaque.end(), [](unsigned char o) { return o != 0; }))
+        target.SetMonitors(std::move(layout));
+
+    // every worker reduces its share of the tiles over all canvases
+    const size_t tiles = target.TileCount();
+    RunParallel(threads, [&](unsigned worker)
+    {
+        const size_t begin = tiles * worker / threads;
+        const size_t end = tiles * (worker + 1) / threads;
+        for (Canvas& canvas : canvases)
+            target.MergeTiles(canvas, begin, end);
+    });
+    target.FinishMerge();
+    canvases.clear();
+
+    const std::filesystem::path output = opt.output;
+    const bool written = TrackFile::HasExtension(output) ? target.SaveTrack(output, threads) : target.SaveToFile(opt.output.c_str(), { opt.pngLevel, threads });
+    if (!written)
+    {
+        Err << "Failed to write the merged image [" << opt.output << "]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    Log << "Merged " << merged << " of " << opt.inputs.size() << " images w: " << size->first << " h: " << size->second << " with " << threads << " thread(s) in " << seconds << " s [" << opt.output << "]" << std::endl;
+    return merged == opt.inputs.size() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -21,7 +21,7 @@ filter { "platforms:x86" }
     defines "X86"
 
 filter "system:windows"
-    defines "WINDOWS"
+    defines { "WINDOWS", "NOMINMAX" } -- std::min/std::max instead of the macros of <Windows.h>
 
 filter { "configurations:Debug" }
     runtime "Debug"
@@ -44,6 +44,8 @@ removeunreferencedcodedata "on"
 defines "USING_IMGUI"
 
 include "MouseTracker"
+include "MouseTrackerMerge"
+include "MouseTrackerBench"
 include "Dependencies/glfw"
 include "Dependencies/imgui"
 include "Dependencies/nativefiledialog"
\ No newline at end of file